@@ -0,0 +1,63 @@
+#include "adc_filter.h"
+
+namespace adcf {
+
+void Chain::configure(const ChainConfig& c) {
+  c_ = c;
+  if (c_.oversample < 1) c_.oversample = 1;
+  if (c_.median != 1 && c_.median != 3 && c_.median != 5) c_.median = 1;
+  if (c_.iirShift > 15) c_.iirShift = 15;
+  reset();
+}
+
+void Chain::reset() {
+  acc_ = 0;
+  n_ = 0;
+  wn_ = 0;
+  wpos_ = 0;
+  y_ = 0;
+  primed_ = false;
+}
+
+int32_t Chain::median(int32_t x) {
+  win_[wpos_] = x;
+  wpos_ = (uint8_t)((wpos_ + 1) % c_.median);
+  if (wn_ < c_.median) wn_++;
+  if (wn_ < c_.median) return x;  // not enough history yet
+
+  // Sort a copy of at most 5 values
+  int32_t s[MAX_MEDIAN];
+  for (int i = 0; i < c_.median; i++) {
+    int32_t v = win_[i];
+    int j = i - 1;
+    while (j >= 0 && s[j] > v) {
+      s[j + 1] = s[j];
+      j--;
+    }
+    s[j + 1] = v;
+  }
+  return s[c_.median / 2];
+}
+
+bool Chain::push(int32_t raw) {
+  acc_ += raw;
+  if (++n_ < c_.oversample) return false;
+
+  // Decimated sample in Q8, rounded
+  int32_t x = (int32_t)((((int64_t)acc_ << Q) + c_.oversample / 2) / c_.oversample);
+  acc_ = 0;
+  n_ = 0;
+
+  if (c_.median > 1) x = median(x);
+
+  if (!primed_) {
+    y_ = x;
+    primed_ = true;
+  } else {
+    y_ += (x - y_) >> c_.iirShift;
+  }
+  outputs_++;
+  return true;
+}
+
+} // namespace adcf
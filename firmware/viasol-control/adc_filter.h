@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Per-channel ADC filter chain: oversample/decimate -> median -> IIR.
+//
+//   - Oversampling averages N raw codes into one decimated sample.
+//   - The median (1, 3 or 5 taps) over decimated samples removes single
+//     spikes (switching transients) before they reach the IIR.
+//   - The IIR is y += (x - y) >> shift in Q8, seeded with the first sample.
+//
+// Integer only, no allocation; pure C++ so recorded sample streams can be
+// replayed on the host (tools/adc-replay).
+// -----------------------------------------------------------------------------
+
+namespace adcf {
+
+static const int MAX_MEDIAN = 5;
+static const int Q = 8;  // fractional bits of the output
+
+struct ChainConfig {
+  uint8_t oversample = 16;  // raw samples per decimated sample (>= 1)
+  uint8_t median = 3;       // 1 (off), 3 or 5
+  uint8_t iirShift = 2;     // 0 = no smoothing
+};
+
+class Chain {
+ public:
+  void configure(const ChainConfig& c);
+  void reset();
+
+  // Feed one raw code; returns true when a new filtered output is ready.
+  bool push(int32_t raw);
+
+  bool primed() const { return primed_; }
+  int32_t valueQ8() const { return y_; }
+  int32_t value() const { return (y_ + (1 << (Q - 1))) >> Q; }
+  uint32_t outputs() const { return outputs_; }
+
+ private:
+  int32_t median(int32_t x);
+
+  ChainConfig c_;
+  int32_t acc_ = 0;
+  uint8_t n_ = 0;
+
+  int32_t win_[MAX_MEDIAN] = {};
+  uint8_t wn_ = 0;
+  uint8_t wpos_ = 0;
+
+  int32_t y_ = 0;
+  bool primed_ = false;
+  uint32_t outputs_ = 0;
+};
+
+} // namespace adcf
@@ -0,0 +1,75 @@
+#include "adc_sampler.h"
+#include "adc_filter.h"
+#include "io_catalog.h"
+#include "shunt_cal.h"
+#include "heater.h"
+#include "rs485.h"
+
+enum Chan : uint8_t { CH_PV_V = 0, CH_PV_A, N_CH };
+
+struct ChannelDef {
+  const char* key;
+  adcf::ChainConfig filter;
+};
+
+// One register read per sample, so no oversampling here. PV voltage gets
+// heavier smoothing; current a wider median to reject switching spikes.
+static const ChannelDef CHANNELS[N_CH] = {
+  { "pv_v", { 1, 3, 2 } },
+  { "pv_a", { 1, 5, 1 } },
+};
+
+static adcf::Chain chains[N_CH];
+static int catalogIdx[N_CH];
+static AdcStats stats;
+
+void adcBegin() {
+  for (int c = 0; c < N_CH; c++) {
+    chains[c].configure(CHANNELS[c].filter);
+    catalogIdx[c] = inputIndexByKey(CHANNELS[c].key);
+    ioSetInputMaxAge(catalogIdx[c], ADC_PUBLISH_MS * 10);
+  }
+}
+
+static float scaled(int c) {
+  int32_t v = chains[c].value();
+  switch (c) {
+    case CH_PV_V:
+      return (uint16_t)v * 0.01f;
+    case CH_PV_A:
+      return shuntToMilliamps(shuntCal(SHUNT_PV), v) * 0.001f;
+  }
+  return 0.0f;
+}
+
+void adcTick() {
+  static uint32_t lastPoll = 0;
+  uint32_t now = millis();
+  if (now - lastPoll < ADC_POLL_MS) return;
+  lastPoll = now;
+
+  if (!rs485Online(HEATER_REMOTE)) {
+    // Let the catalog go stale rather than smoothing across the gap
+    for (int c = 0; c < N_CH; c++) chains[c].reset();
+    stats.offline++;
+    return;
+  }
+
+  int16_t regs[2];
+  rs485Regs(HEATER_REMOTE, rs485::REG_PV_V, 2, regs);
+  chains[CH_PV_V].push((uint16_t)regs[0]);
+  chains[CH_PV_A].push(regs[1]);
+  stats.samples++;
+
+  static uint32_t lastPub = 0;
+  if (now - lastPub < ADC_PUBLISH_MS) return;
+  lastPub = now;
+
+  for (int c = 0; c < N_CH; c++) {
+    if (chains[c].primed()) ioPublishInput(catalogIdx[c], scaled(c));
+  }
+}
+
+const AdcStats& adcStats() {
+  return stats;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------------------------
+// PV voltage and current into the input catalog.
+//
+// The PV+ sense divider and the INA180 PV shunt amplifier are on the remote
+// comm board (docs/01); the master has no analog inputs of its own. The
+// remote's ADC readings arrive in REG_PV_V / REG_PV_A with the 10 Hz "pv"
+// poll group. adcTick() takes each new pair through a per-channel filter
+// chain (adc_filter.h) and publishes pv_v and pv_a at ADC_PUBLISH_MS.
+// REG_PV_A is a raw amplifier code, scaled here with the same shunt
+// calibration (and learned zero) that heater.cpp uses.
+//
+// Controllers that need the unfiltered per-step value (heater, divert,
+// energy) read the registers directly; the catalog carries the same
+// measurement, smoothed. main_a has no sensor on either board yet and stays
+// unpublished.
+// -----------------------------------------------------------------------------
+
+static const uint32_t ADC_POLL_MS = 100;     // "pv" group period
+static const uint32_t ADC_PUBLISH_MS = 100;
+
+struct AdcStats {
+  uint32_t samples = 0;  // register pairs filtered
+  uint32_t offline = 0;  // polls skipped because the remote was offline
+};
+
+void adcBegin();
+void adcTick();
+
+const AdcStats& adcStats();
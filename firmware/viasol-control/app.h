@@ -10,6 +10,9 @@ struct App {
   bool inApMode = false;
   String apSsid;
 
+  // millis() at the end of the first rules pass after reset
+  uint32_t firstTickMs = 0;
+
   // optional heartbeat/debug
   uint32_t blinkMs = 500;
 };
@@ -0,0 +1,97 @@
+#include "divert.h"
+#include "divert_core.h"
+#include "heater.h"
+#include "io_catalog.h"
+#include "pv_model.h"
+#include "rs485.h"
+#include "safety.h"
+#include "shunt_cal.h"
+
+static const uint32_t SUN_HOLD_MS = 60000;   // keep the last sun estimate while no current flows
+static const uint32_t REFRESH_MS = 10000;    // re-assert the relay state
+
+static divert::Controller ctl;
+static DivertStatus status;
+static bool enabled = false;
+static String relay;
+static bool applied = false;
+static uint32_t appliedMs = 0;
+static float lastSun = 0;
+static uint32_t lastSunMs = 0;
+
+static void setRelay(bool on, uint32_t now) {
+  if (on == applied && (now - appliedMs) < REFRESH_MS) return;
+  applyOutput(relay, on);
+  applied = on;
+  appliedMs = now;
+}
+
+void divertBegin(const Settings& cfg) {
+  divert::Config c;
+  c.loadW = cfg.div_w;
+  c.minOnMs = c.minOffMs = (uint32_t)cfg.div_min_s * 1000UL;
+  c.windowMs = (uint32_t)cfg.div_window_s * 1000UL;
+
+  // Switching relays: release the old one first
+  String key = relayKey(cfg.div_loc, cfg.div_idx);
+  if (relay.length() && relay != key && applied) applyOutput(relay, false);
+  relay = key;
+
+  ctl.configure(c);
+  enabled = cfg.div_en;
+  applied = true;           // force an explicit off on the next tick
+  appliedMs = millis() - REFRESH_MS;
+  Serial.printf("[divert] %s, %s, %.0f W, min %d s, window %d s\n", enabled ? "enabled" : "disabled",
+                relay.c_str(), cfg.div_w, cfg.div_min_s, cfg.div_window_s);
+}
+
+void divertTick() {
+  static uint32_t lastTick = 0;
+  uint32_t now = millis();
+  if (now - lastTick < DIVERT_TICK_MS) return;
+  lastTick = now;
+
+  bool tripped = safetyTrips() & (safety::TRIP_LEAK | safety::TRIP_STUCK_CHANNEL);
+  if (!enabled || tripped || !rs485Online(HEATER_REMOTE)) {
+    ctl.reset();
+    status.surplusW = 0;
+    status.duty = 0;
+    status.on = false;
+    setRelay(false, now);
+    return;
+  }
+
+  int16_t regs[rs485::REG_CH_A0 + 8 - rs485::REG_PV_V];
+  rs485Regs(HEATER_REMOTE, rs485::REG_PV_V, sizeof(regs) / sizeof(regs[0]), regs);
+  float pvV = (uint16_t)regs[0] * 0.01f;
+  float pvA = shuntToMilliamps(shuntCal(SHUNT_PV), regs[rs485::REG_PV_A - rs485::REG_PV_V]) * 0.001f;
+  int32_t chMa = 0;
+  for (int ch = 0; ch < 8; ch++) chMa += regs[rs485::REG_CH_A0 - rs485::REG_PV_V + ch];
+
+  const PvModel& pv = pvModel();
+  float sun = pv.valid() ? pv.sunFraction(pvV, pvA) : 0.0f;
+  if (sun > 0) {
+    lastSun = sun;
+    lastSunMs = now;
+  } else if (now - lastSunMs < SUN_HOLD_MS) {
+    sun = lastSun;
+  }
+
+  float surplus = 0;
+  if (heaterSaturated()) {
+    surplus = sun * pv.mppW() - pvV * chMa * 0.001f;
+    if (surplus < 0) surplus = 0;
+  }
+
+  bool on = ctl.tick(surplus, now);
+  setRelay(on, now);
+
+  status.surplusW = surplus;
+  status.duty = ctl.plannedDuty();
+  status.on = on;
+  status.switches = ctl.stats().switches;
+}
+
+const DivertStatus& divertStatus() {
+  return status;
+}
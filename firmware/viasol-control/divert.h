@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// AC diversion relay (div_loc / div_idx).
+//
+// Runs divert::Controller (divert_core.h) at a fixed DIVERT_TICK_MS. The
+// surplus is what the array could deliver at its MPP (PV model x the sun
+// fraction implied by the operating point) minus what the heater channels
+// draw, and only counts while the heater is saturated. The relay drops out
+// on a leak or stuck-channel trip.
+// -----------------------------------------------------------------------------
+
+static const uint32_t DIVERT_TICK_MS = 250;
+
+struct DivertStatus {
+  float surplusW = 0;
+  float duty = 0;        // planned for the current window
+  bool on = false;
+  uint32_t switches = 0;
+};
+
+void divertBegin(const Settings& cfg);  // also on settings save
+void divertTick();
+const DivertStatus& divertStatus();
@@ -0,0 +1,79 @@
+#include "divert_core.h"
+
+namespace divert {
+
+static const uint32_t MAX_DT_MS = 1000;  // ticks missed beyond this aren't integrated
+
+void Controller::configure(const Config& c) {
+  cfg_ = c;
+  if (cfg_.loadW < 1.0f) cfg_.loadW = 1.0f;
+  if (cfg_.windowMs < cfg_.minOnMs + cfg_.minOffMs) cfg_.windowMs = cfg_.minOnMs + cfg_.minOffMs;
+  reset();
+}
+
+void Controller::reset() {
+  started_ = false;
+  on_ = false;
+  planOnMs_ = 0;
+  avgW_ = 0;
+  bankJ_ = 0;
+}
+
+float Controller::plannedDuty() const {
+  return cfg_.windowMs ? (float)planOnMs_ / cfg_.windowMs : 0.0f;
+}
+
+void Controller::plan(uint32_t nowMs) {
+  windowStartMs_ = nowMs;
+
+  float wantJ = avgW_ * cfg_.windowMs * 0.001f + bankJ_;
+  float wantMs = wantJ / cfg_.loadW * 1000.0f;
+  if (wantMs < 0) wantMs = 0;
+  if (wantMs > cfg_.windowMs) wantMs = (float)cfg_.windowMs;
+
+  if (wantMs < cfg_.minOnMs) planOnMs_ = 0;                                  // bank it
+  else if (cfg_.windowMs - wantMs < cfg_.minOffMs) planOnMs_ = cfg_.windowMs;  // run through
+  else planOnMs_ = (uint32_t)wantMs;
+}
+
+bool Controller::tick(float surplusW, uint32_t nowMs) {
+  if (!started_) {
+    started_ = true;
+    lastMs_ = nowMs;
+    switchMs_ = nowMs - cfg_.minOffMs;
+    avgW_ = surplusW > 0 ? surplusW : 0;
+    plan(nowMs);
+  }
+
+  uint32_t dt = nowMs - lastMs_;
+  lastMs_ = nowMs;
+  if (dt > MAX_DT_MS) dt = 0;
+
+  // Surplus above the load can't be captured by it
+  float s = surplusW < 0 ? 0 : (surplusW > cfg_.loadW ? cfg_.loadW : surplusW);
+
+  // Smooth over a quarter window; integrate the energy error
+  float a = (float)dt / (cfg_.windowMs * 0.25f);
+  avgW_ += (s - avgW_) * (a > 1.0f ? 1.0f : a);
+  bankJ_ += (s - (on_ ? cfg_.loadW : 0.0f)) * dt * 0.001f;
+  float bankMax = cfg_.loadW * cfg_.windowMs * 0.001f;  // one full window
+  if (bankJ_ > bankMax) bankJ_ = bankMax;
+  if (bankJ_ < -bankMax) bankJ_ = -bankMax;
+
+  if (on_) stats_.onMs += dt;
+
+  if (nowMs - windowStartMs_ >= cfg_.windowMs) plan(nowMs);
+
+  bool want = (nowMs - windowStartMs_) < planOnMs_;
+  if (want != on_) {
+    uint32_t held = nowMs - switchMs_;
+    if (held >= (on_ ? cfg_.minOnMs : cfg_.minOffMs)) {
+      on_ = want;
+      switchMs_ = nowMs;
+      stats_.switches++;
+    }
+  }
+  return on_;
+}
+
+} // namespace divert
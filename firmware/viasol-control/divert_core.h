@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Time-proportioned AC diversion relay control.
+//
+// The relay switches a fixed AC load (loadW, run from the inverter) that
+// soaks up PV surplus once the heater channels are saturated. The inverter's
+// battery buffers the surplus between pulses, so the goal is to match the
+// diverted energy to the surplus energy over a few windows. Every windowMs the on-time for the next
+// window is planned from the smoothed surplus plus an energy bank: the bank
+// integrates surplus minus diverted energy, so over- and under-diversion in
+// one window are paid back in the next (closed loop on energy, not power).
+// Plans shorter than minOnMs are skipped (the energy stays banked), plans
+// that would leave less than minOffMs off run the whole window, and the
+// relay never changes state before its minimum on/off time has passed. So
+// there are at most two switches per window, and fewer when the surplus is
+// steady.
+//
+// Pure C++; tools/divert-sim runs it against a cloudy-day surplus profile.
+// -----------------------------------------------------------------------------
+
+namespace divert {
+
+struct Config {
+  float loadW = 1500.0f;
+  uint32_t windowMs = 120000;
+  uint32_t minOnMs = 30000;
+  uint32_t minOffMs = 30000;
+};
+
+struct Stats {
+  uint32_t switches = 0;
+  uint64_t onMs = 0;
+};
+
+class Controller {
+ public:
+  void configure(const Config& c);
+  void reset();
+
+  // Call at a fixed rate with the current surplus estimate. O(1).
+  // Returns the relay state to apply.
+  bool tick(float surplusW, uint32_t nowMs);
+
+  bool on() const { return on_; }
+  float plannedDuty() const;      // of the current window
+  float bankWh() const { return bankJ_ / 3600.0f; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  void plan(uint32_t nowMs);
+
+  Config cfg_;
+  Stats stats_;
+  bool started_ = false;
+  bool on_ = false;
+  uint32_t lastMs_ = 0;
+  uint32_t windowStartMs_ = 0;
+  uint32_t switchMs_ = 0;
+  uint32_t planOnMs_ = 0;
+  float avgW_ = 0;                // EWMA of the capturable surplus
+  float bankJ_ = 0;
+};
+
+} // namespace divert
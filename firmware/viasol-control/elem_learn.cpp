@@ -0,0 +1,95 @@
+#include "elem_learn.h"
+
+#include <math.h>
+
+namespace elearn {
+
+// -----------------------------------------------------------------------------
+// Rls
+// -----------------------------------------------------------------------------
+static const float NOISE_ALPHA = 1.0f / 16.0f;
+
+void Rls::reset(float g0, float p0) {
+  g_ = g0;
+  p_ = p0;
+  p0_ = p0;
+  noise_ = 0;
+  n_ = 0;
+}
+
+void Rls::update(float x, float y) {
+  float e = y - g_ * x;
+  float k = p_ * x / (LAMBDA + x * x * p_);
+  g_ += k * e;
+  p_ = (p_ - k * x * p_) / LAMBDA;
+  if (p_ > p0_) p_ = p0_;  // no wind-up between sparse samples
+
+  noise_ = (n_ == 0) ? e * e : noise_ + (e * e - noise_) * NOISE_ALPHA;
+  n_++;
+}
+
+float Rls::relStd() const {
+  if (!(g_ > 0)) return 1.0f;
+  return sqrtf(noise_ * p_) / g_;
+}
+
+// -----------------------------------------------------------------------------
+// Learner
+// -----------------------------------------------------------------------------
+// Prior covariance: the first sample outweighs the nameplate value ~10:1
+static float priorP(float vRef) {
+  return 10.0f / (vRef * vRef);
+}
+
+void Learner::configure(const Config& c) {
+  cfg_ = c;
+  restored_ = 0;
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    float g = c.priorOhms[ch] > 0 ? 1.0f / c.priorOhms[ch] : 0.0f;
+    rls_[ch].reset(g, priorP(c.vRefV));
+  }
+  sampled_ = true;
+}
+
+void Learner::restore(int ch, float ohms) {
+  if (ch < 0 || ch >= CHANNELS || !(ohms > 0) || !(cfg_.priorOhms[ch] > 0)) return;
+  // Steady-state covariance of a well-excited estimator
+  rls_[ch].reset(1.0f / ohms, (1.0f - Rls::LAMBDA) * priorP(cfg_.vRefV));
+  restored_ |= (uint8_t)(1 << ch);
+}
+
+void Learner::onSwitch(uint8_t mask, uint32_t nowMs) {
+  if (mask == mask_) return;
+  mask_ = mask;
+  switchMs_ = nowMs;
+  sampled_ = false;
+}
+
+bool Learner::feed(float pvV, const float* chA, uint32_t nowMs) {
+  if (sampled_ || (nowMs - switchMs_) < cfg_.settleMs) return false;
+  sampled_ = true;
+  if (pvV < cfg_.minV) return false;
+
+  bool any = false;
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    if (!((mask_ >> ch) & 1) || !(cfg_.priorOhms[ch] > 0)) continue;
+    if (chA[ch] < cfg_.minA) continue;  // open element or blown fuse: not a resistance
+    rls_[ch].update(pvV, chA[ch]);
+    any = true;
+  }
+  return any;
+}
+
+float Learner::ohms(int ch) const {
+  if (ch < 0 || ch >= CHANNELS || !(cfg_.priorOhms[ch] > 0)) return 0.0f;
+  float g = rls_[ch].g();
+  return g > 1e-6f ? 1.0f / g : cfg_.priorOhms[ch];
+}
+
+float Learner::confidence(int ch) const {
+  if (ch < 0 || ch >= CHANNELS || rls_[ch].samples() < MIN_SAMPLES) return 0.0f;
+  float c = (0.05f - rls_[ch].relStd()) / 0.04f;
+  return c < 0 ? 0.0f : (c > 1 ? 1.0f : c);
+}
+
+} // namespace elearn
@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Online resistance learning for the heater channels.
+//
+// Each element is a resistor across the PV bus, so its current is I = G*V.
+// Every time the channel mask changes, the first measurement taken after the
+// switch has settled (PV voltage and per-channel currents from the same RS-485
+// frame) updates a scalar recursive least-squares estimate of G for each
+// channel that is on. The forgetting factor lets the estimate follow slow
+// drift (element temperature, wiring); the residual variance gives a
+// confidence figure. O(1) per sample, no allocation.
+//
+// Pure C++ so it runs against synthetic noisy data on the host
+// (tools/elem-learn-sim).
+// -----------------------------------------------------------------------------
+
+namespace elearn {
+
+static const int CHANNELS = 8;
+
+// -----------------------------------------------------------------------------
+// Scalar RLS for y = g * x with exponential forgetting
+// -----------------------------------------------------------------------------
+class Rls {
+ public:
+  // g0: prior estimate; p0: prior covariance (in units of 1/x^2).
+  void reset(float g0, float p0);
+  void update(float x, float y);
+
+  float g() const { return g_; }
+  uint32_t samples() const { return n_; }
+  // Standard deviation of g relative to g (residual variance * P).
+  float relStd() const;
+
+  static constexpr float LAMBDA = 0.98f;   // ~50 sample memory
+
+ private:
+  float g_ = 0;
+  float p_ = 0;
+  float p0_ = 0;
+  float noise_ = 0;   // EWMA of squared residuals
+  uint32_t n_ = 0;
+};
+
+struct Config {
+  float priorOhms[CHANNELS] = {};  // nameplate V^2/W; <= 0: not fitted
+  float vRefV = 100.0f;            // typical bus voltage, scales the prior
+  uint32_t settleMs = 200;         // after a switch, >= 2 polls of the PV group
+  float minV = 20.0f;              // below this the array is too weak to learn
+  float minA = 0.05f;              // channel current floor (shunt noise)
+};
+
+class Learner {
+ public:
+  void configure(const Config& c);
+
+  // Seed a channel from a persisted estimate. It starts with a tight prior,
+  // so new samples move it gradually, but its confidence is rebuilt from
+  // live samples.
+  void restore(int ch, float ohms);
+  bool restored(int ch) const { return (restored_ >> ch) & 1; }
+
+  // The mask just sent to the remote board.
+  void onSwitch(uint8_t mask, uint32_t nowMs);
+
+  // Measurements under the current mask, every control tick. Only the first
+  // call after a switch has settled is used. Returns true when any channel
+  // was updated.
+  bool feed(float pvV, const float* chA, uint32_t nowMs);
+
+  float ohms(int ch) const;        // learned/restored, else the prior
+  uint32_t samples(int ch) const { return rls_[ch].samples(); }
+  float relStd(int ch) const { return rls_[ch].relStd(); }
+  // 0..1: 0 below MIN_SAMPLES or at >= 5% relative std, 1 at <= 1%.
+  float confidence(int ch) const;
+  bool confident(int ch) const { return confidence(ch) >= 0.5f; }
+  // Learned value good enough to replace the nameplate one.
+  bool usable(int ch) const { return confident(ch) || restored(ch); }
+
+  static const uint32_t MIN_SAMPLES = 8;
+
+ private:
+  Config cfg_;
+  Rls rls_[CHANNELS];
+  uint8_t restored_ = 0;
+  uint8_t mask_ = 0;
+  uint32_t switchMs_ = 0;
+  bool sampled_ = true;   // one sample per switch
+};
+
+} // namespace elearn
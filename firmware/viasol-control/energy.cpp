@@ -0,0 +1,271 @@
+#include "energy.h"
+#include "metrics.h"
+#include "heater.h"
+#include "rs485.h"
+#include "shunt_cal.h"
+#include <LittleFS.h>
+#include <time.h>
+
+static const uint32_t TICK_MS = 250;
+static const uint32_t MAX_DT_MS = 1000;           // stalls/offline gaps are not integrated
+static const uint64_t UJ_PER_MWH = 3600000ULL;    // 1 mWh = 3.6 J
+static const uint32_t RING_MAGIC = 0x454E5231;    // "ENR1"
+static const uint32_t HIST_MAGIC = 0x454E4831;    // "ENH1"
+static const char* RING_PATH = "/energy.ring";
+static const char* HIST_PATH = "/energy.hist";
+static const char* HIST_TMP = "/energy.hist.tmp";
+
+struct Checkpoint {
+  uint32_t magic;
+  uint32_t seq;
+  EnergyPeriod today;
+  EnergyPeriod month;
+  uint64_t lifetime[ENERGY_SLOTS];
+  uint16_t crc;
+};
+
+struct History {
+  uint32_t magic;
+  uint16_t dayHead;     // next write position
+  uint16_t dayCount;
+  uint16_t monHead;
+  uint16_t monCount;
+  EnergyPeriod days[ENERGY_DAYS];
+  EnergyPeriod months[ENERGY_MONTHS];
+  uint16_t crc;
+};
+
+static EnergyPeriod today;
+static EnergyPeriod month;
+static uint64_t lifetime[ENERGY_SLOTS];
+static uint64_t remUj[ENERGY_SLOTS];   // sub-mWh remainder
+static History hist;
+static uint32_t seq = 0;
+static uint32_t lastIntegrateMs = 0;
+static uint32_t lastCheckpointMs = 0;
+
+static uint16_t crc16(const void* data, size_t n) {
+  return rs485::crc16((const uint8_t*)data, n);
+}
+
+// -----------------------------------------------------------------------------
+// Checkpoint ring
+// -----------------------------------------------------------------------------
+static void loadRing() {
+  File f = LittleFS.open(RING_PATH, "r");
+  if (!f) return;
+
+  Checkpoint c;
+  bool found = false;
+  for (int i = 0; i < ENERGY_RING_SLOTS; i++) {
+    if (f.read((uint8_t*)&c, sizeof(c)) != sizeof(c)) break;
+    if (c.magic != RING_MAGIC || c.crc != crc16(&c, offsetof(Checkpoint, crc))) continue;
+    if (found && (int32_t)(c.seq - seq) <= 0) continue;
+    found = true;
+    seq = c.seq;
+    today = c.today;
+    month = c.month;
+    for (int s = 0; s < ENERGY_SLOTS; s++) lifetime[s] = c.lifetime[s];
+  }
+  f.close();
+  if (found) Serial.printf("[energy] resumed checkpoint %u\n", (unsigned)seq);
+}
+
+static void writeCheckpoint() {
+  Checkpoint c = Checkpoint();  // zeroed, padding included: the CRC covers it
+  c.magic = RING_MAGIC;
+  c.seq = ++seq;
+  c.today = today;
+  c.month = month;
+  for (int s = 0; s < ENERGY_SLOTS; s++) c.lifetime[s] = lifetime[s];
+  c.crc = crc16(&c, offsetof(Checkpoint, crc));
+
+  // Create the ring at full size once so every slot has a fixed offset
+  if (!LittleFS.exists(RING_PATH)) {
+    File f = LittleFS.open(RING_PATH, "w");
+    if (!f) return;
+    uint8_t blank[sizeof(Checkpoint)];
+    memset(blank, 0xFF, sizeof(blank));
+    size_t n = 0;
+    for (int i = 0; i < ENERGY_RING_SLOTS; i++) n += f.write(blank, sizeof(blank));
+    metricsFsWrite(n);
+    f.close();
+  }
+
+  File f = LittleFS.open(RING_PATH, "r+");
+  if (!f) return;
+  f.seek((c.seq % ENERGY_RING_SLOTS) * sizeof(c));
+  metricsFsWrite(f.write((const uint8_t*)&c, sizeof(c)));
+  f.close();
+}
+
+// -----------------------------------------------------------------------------
+// Closed days/months
+// -----------------------------------------------------------------------------
+// hist is ~3.5 KB: read straight into it rather than through a stack copy
+static void loadHistory() {
+  bool ok = false;
+  File f = LittleFS.open(HIST_PATH, "r");
+  if (f) {
+    ok = f.read((uint8_t*)&hist, sizeof(hist)) == sizeof(hist) && hist.magic == HIST_MAGIC &&
+         hist.crc == crc16(&hist, offsetof(History, crc)) &&
+         hist.dayHead < ENERGY_DAYS && hist.monHead < ENERGY_MONTHS &&
+         hist.dayCount <= ENERGY_DAYS && hist.monCount <= ENERGY_MONTHS;
+    f.close();
+  }
+  if (!ok) memset((void*)&hist, 0, sizeof(hist));
+}
+
+static void saveHistory() {
+  hist.magic = HIST_MAGIC;
+  hist.crc = crc16(&hist, offsetof(History, crc));
+  File f = LittleFS.open(HIST_TMP, "w");
+  if (!f) return;
+  size_t n = f.write((const uint8_t*)&hist, sizeof(hist));
+  bool ok = n == sizeof(hist);
+  f.close();
+  metricsFsWrite(n);
+  if (ok) {
+    LittleFS.remove(HIST_PATH);
+    LittleFS.rename(HIST_TMP, HIST_PATH);
+  }
+}
+
+static void pushDay(const EnergyPeriod& d) {
+  hist.days[hist.dayHead] = d;
+  hist.dayHead = (hist.dayHead + 1) % ENERGY_DAYS;
+  if (hist.dayCount < ENERGY_DAYS) hist.dayCount++;
+}
+
+static void pushMonth(const EnergyPeriod& m) {
+  hist.months[hist.monHead] = m;
+  hist.monHead = (hist.monHead + 1) % ENERGY_MONTHS;
+  if (hist.monCount < ENERGY_MONTHS) hist.monCount++;
+}
+
+// -----------------------------------------------------------------------------
+// Wall clock rollover
+// -----------------------------------------------------------------------------
+static uint32_t currentDayKey() {
+  time_t t = time(nullptr);
+  struct tm lt;
+  localtime_r(&t, &lt);
+  if (lt.tm_year + 1900 < 2024) return 0;  // SNTP not synced yet
+  return (uint32_t)(lt.tm_year + 1900) * 10000 + (lt.tm_mon + 1) * 100 + lt.tm_mday;
+}
+
+static void checkRollover() {
+  uint32_t day = currentDayKey();
+  if (day == 0 || day == today.key) return;
+
+  // First valid time: date what has accrued so far
+  if (today.key == 0) {
+    today.key = day;
+    if (month.key == 0) month.key = day / 100;
+    return;
+  }
+  if (day < today.key) return;  // clock stepped back; keep the current day
+
+  pushDay(today);
+  today = EnergyPeriod();
+  today.key = day;
+
+  if (day / 100 != month.key) {
+    pushMonth(month);
+    month = EnergyPeriod();
+    month.key = day / 100;
+  }
+  saveHistory();
+  writeCheckpoint();
+  lastCheckpointMs = millis();
+}
+
+// -----------------------------------------------------------------------------
+// Integration
+// -----------------------------------------------------------------------------
+static void accumulate(int slot, uint32_t mW, uint32_t dtMs) {
+  remUj[slot] += (uint64_t)mW * dtMs;
+  if (remUj[slot] < UJ_PER_MWH) return;
+  uint32_t mWh = (uint32_t)(remUj[slot] / UJ_PER_MWH);
+  remUj[slot] -= (uint64_t)mWh * UJ_PER_MWH;
+  today.mWh[slot] += mWh;
+  month.mWh[slot] += mWh;
+  lifetime[slot] += mWh;
+}
+
+static void integrate(uint32_t now) {
+  uint32_t dt = now - lastIntegrateMs;
+  lastIntegrateMs = now;
+  if (dt > MAX_DT_MS || !rs485Online(HEATER_REMOTE)) return;
+
+  int16_t regs[rs485::REG_CH_A0 + ENERGY_CHANNELS - rs485::REG_PV_V];
+  rs485Regs(HEATER_REMOTE, rs485::REG_PV_V, sizeof(regs) / sizeof(regs[0]), regs);
+  uint32_t v10mV = (uint16_t)regs[0];
+
+  // 10 mV x mA / 100 = mW
+  for (int ch = 0; ch < ENERGY_CHANNELS; ch++) {
+    int32_t mA = regs[rs485::REG_CH_A0 - rs485::REG_PV_V + ch];
+    if (mA > 0) accumulate(ch, (uint32_t)(v10mV * (uint32_t)mA / 100), dt);
+  }
+  int32_t pvMa = shuntToMilliamps(shuntCal(SHUNT_PV), regs[rs485::REG_PV_A - rs485::REG_PV_V]);
+  if (pvMa > 0) accumulate(ENERGY_TOTAL, (uint32_t)((uint64_t)v10mV * (uint32_t)pvMa / 100), dt);
+}
+
+// -----------------------------------------------------------------------------
+// Public
+// -----------------------------------------------------------------------------
+void energyBegin() {
+  loadRing();
+  loadHistory();
+  lastIntegrateMs = millis();
+  lastCheckpointMs = lastIntegrateMs;
+}
+
+void energyTick() {
+  uint32_t now = millis();
+  if (now - lastIntegrateMs < TICK_MS) return;
+  integrate(now);
+
+  static uint32_t lastClock = 0;
+  if (now - lastClock >= 1000) {
+    lastClock = now;
+    checkRollover();
+  }
+
+  if (now - lastCheckpointMs >= ENERGY_CHECKPOINT_MS) {
+    lastCheckpointMs = now;
+    writeCheckpoint();
+  }
+}
+
+const EnergyPeriod& energyToday() {
+  return today;
+}
+
+const EnergyPeriod& energyMonth() {
+  return month;
+}
+
+uint64_t energyLifetimeMWh(int slot) {
+  return (slot >= 0 && slot < ENERGY_SLOTS) ? lifetime[slot] : 0;
+}
+
+int energyDayCount() {
+  return hist.dayCount;
+}
+
+bool energyDay(int i, EnergyPeriod& out) {
+  if (i < 0 || i >= hist.dayCount) return false;
+  out = hist.days[(hist.dayHead + ENERGY_DAYS - 1 - i) % ENERGY_DAYS];
+  return true;
+}
+
+int energyMonthCount() {
+  return hist.monCount;
+}
+
+bool energyMonthAt(int i, EnergyPeriod& out) {
+  if (i < 0 || i >= hist.monCount) return false;
+  out = hist.months[(hist.monHead + ENERGY_MONTHS - 1 - i) % ENERGY_MONTHS];
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------------------------
+// Energy accounting (per heater channel + PV total).
+//
+// energyTick() integrates the power reported by the heater remote at the
+// 250 ms control rate in fixed point (mW x ms = uJ, carried as a remainder,
+// so nothing is lost to rounding). Today, this month and lifetime are kept
+// as running aggregates; closed days and months go into fixed rings. The UI
+// reads only those aggregates, never a raw log.
+//
+// Persistence (LittleFS):
+//   /energy.ring  ENERGY_RING_SLOTS checkpoint records written round-robin
+//                 every ENERGY_CHECKPOINT_MS; boot resumes from the newest
+//                 CRC-valid record. A power cut loses at most one checkpoint
+//                 interval. The slots do not spread wear by themselves:
+//                 LittleFS is copy-on-write, so rewriting a slot rewrites its
+//                 data block into a freshly allocated one, and it is
+//                 LittleFS's block allocator that levels wear across the
+//                 partition (one 4 KB block per checkpoint, 288 a day). The
+//                 ring's value is the older generations to fall back to if
+//                 the newest record is torn or corrupt.
+//   /energy.hist  closed days/months, rewritten once per day rollover.
+//
+// Days and months follow the local wall clock (SNTP + tz_offset_min); until
+// the clock is set, energy accrues to "today" and is dated when the time
+// arrives.
+// -----------------------------------------------------------------------------
+
+static const int ENERGY_CHANNELS = 8;
+static const int ENERGY_TOTAL = ENERGY_CHANNELS;      // slot of the PV total
+static const int ENERGY_SLOTS = ENERGY_CHANNELS + 1;
+static const int ENERGY_DAYS = 62;
+static const int ENERGY_MONTHS = 24;
+static const int ENERGY_RING_SLOTS = 32;
+static const uint32_t ENERGY_CHECKPOINT_MS = 5UL * 60000UL;
+
+struct EnergyPeriod {
+  uint32_t key = 0;                 // yyyymmdd / yyyymm, 0 = not dated yet
+  uint32_t mWh[ENERGY_SLOTS] = {};
+};
+
+void energyBegin();
+void energyTick();
+
+const EnergyPeriod& energyToday();
+const EnergyPeriod& energyMonth();
+uint64_t energyLifetimeMWh(int slot);
+
+// Closed periods, newest first (i = 0 is yesterday / last month).
+int energyDayCount();
+bool energyDay(int i, EnergyPeriod& out);
+int energyMonthCount();
+bool energyMonthAt(int i, EnergyPeriod& out);
@@ -0,0 +1,87 @@
+#include "heap_debug.h"
+#include "heap_track.h"
+#include "metrics.h"
+
+#ifdef VIASOL_HEAP_DEBUG
+
+static HeapSample ring[HEAP_SAMPLES];
+static int head = 0;     // next write
+static int count = 0;
+static uint32_t lastSampleMs = 0;
+static uint32_t reportedViolations = 0;
+
+static void takeSample() {
+  HeapSample& s = ring[head];
+  s.tS = millis() / 1000;
+  s.freeBytes = ESP.getFreeHeap();
+  s.largestBlock = ESP.getMaxAllocHeap();
+  s.trackedLive = heaptrack::totals().liveBytes;
+  head = (head + 1) % HEAP_SAMPLES;
+  if (count < HEAP_SAMPLES) count++;
+}
+
+void heapDebugBegin() {
+  takeSample();
+  lastSampleMs = millis();
+  heaptrack::Totals t = heaptrack::totals();
+  Serial.printf("[heap] tracking on: %u allocs, %u B live at boot\n", (unsigned)t.allocs,
+                (unsigned)t.liveBytes);
+}
+
+// Outside any guard: the log line itself may allocate
+static void checkGuards(uint32_t now) {
+  if (!heaptrack::guardsArmed()) {
+    if (now >= HEAP_GUARD_WARMUP_MS) {
+      heaptrack::armGuards(true);
+      Serial.println("[heap] tick guards armed");
+    }
+    return;
+  }
+  uint32_t n = heaptrack::violations();
+  if (n == reportedViolations) return;
+  heaptrack::Violation v = heaptrack::lastViolation();
+  Serial.printf("[heap] %u allocation(s) inside %s, last %u B from pc 0x%08lx\n",
+                (unsigned)(n - reportedViolations), v.section ? v.section : "?", (unsigned)v.size,
+                (unsigned long)v.pc);
+  reportedViolations = n;
+}
+
+void heapDebugTick() {
+  uint32_t now = millis();
+  checkGuards(now);
+  if (now - lastSampleMs < HEAP_SAMPLE_MS) return;
+  lastSampleMs = now;
+  takeSample();
+}
+
+int heapSampleCount() {
+  return count;
+}
+
+bool heapSampleAt(int i, HeapSample& out) {
+  if (i < 0 || i >= count) return false;
+  out = ring[(head + HEAP_SAMPLES - 1 - i) % HEAP_SAMPLES];
+  return true;
+}
+
+static void collectMetrics(MetricWriter& w) {
+  heaptrack::Totals t = heaptrack::totals();
+  w.family("viasol_heap_tracked_live_bytes", "Bytes in blocks seen by the allocator hooks", "gauge");
+  w.u("viasol_heap_tracked_live_bytes", t.liveBytes);
+  w.family("viasol_heap_tracked_peak_bytes", "Peak of viasol_heap_tracked_live_bytes", "gauge");
+  w.u("viasol_heap_tracked_peak_bytes", t.peakBytes);
+  w.family("viasol_heap_allocations_total", "Allocations seen by the hooks", "counter");
+  w.u("viasol_heap_allocations_total", t.allocs);
+  w.family("viasol_heap_tick_allocations_total", "Allocations inside armed tick guards", "counter");
+  w.u("viasol_heap_tick_allocations_total", heaptrack::violations());
+}
+static MetricCollector metricsCollector(collectMetrics);
+
+#else
+
+void heapDebugBegin() {}
+void heapDebugTick() {}
+int heapSampleCount() { return 0; }
+bool heapSampleAt(int, HeapSample&) { return false; }
+
+#endif
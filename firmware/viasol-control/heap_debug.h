@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------------------------
+// Heap / fragmentation monitor (/debug/heap).
+//
+// Build with -DVIASOL_HEAP_DEBUG (e.g. in the sketch's build_opt.h) to hook
+// the allocator (heap_track.h) and enable the page. Every HEAP_SAMPLE_MS the
+// free heap, largest free block and tracked live bytes go into a ring, so
+// fragmentation trends are visible over the last HEAP_SAMPLES samples.
+// HEAP_GUARD_WARMUP_MS after boot the loop's TickGuards are armed; any
+// allocation inside a rule tick from then on is logged as a violation
+// (or aborts, with -DVIASOL_ALLOC_ASSERT).
+// Without the flag, these functions do nothing and the route isn't registered.
+// -----------------------------------------------------------------------------
+
+static const uint32_t HEAP_SAMPLE_MS = 10000;
+static const int HEAP_SAMPLES = 90;   // 15 minutes
+static const uint32_t HEAP_GUARD_WARMUP_MS = 30000;
+
+struct HeapSample {
+  uint32_t tS = 0;                    // uptime, seconds
+  uint32_t freeBytes = 0;
+  uint32_t largestBlock = 0;
+  uint32_t trackedLive = 0;
+};
+
+void heapDebugBegin();
+void heapDebugTick();
+
+int heapSampleCount();
+bool heapSampleAt(int i, HeapSample& out);   // i = 0 is the newest
@@ -0,0 +1,307 @@
+#include "heap_track.h"
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#else
+#include <atomic>
+#endif
+
+namespace heaptrack {
+
+// -----------------------------------------------------------------------------
+// Tables (guarded by the hook lock)
+// -----------------------------------------------------------------------------
+struct Block {
+  uintptr_t addr;              // 0 = empty
+  uint32_t size;
+  uint16_t site;
+};
+
+static const uint32_t MAX_LIVE = HEAPTRACK_SLOTS - HEAPTRACK_SLOTS / 8;
+
+static Block blocks[HEAPTRACK_SLOTS];
+static Site siteTab[MAX_SITES];   // [0] is "other"
+static Totals tot;
+
+// TickGuard state: the open section is per thread, the rest is hook-locked
+static thread_local const char* openSection = nullptr;
+static volatile bool guardsOn = false;
+static uint32_t violationCount = 0;
+static Violation lastViol;
+
+static inline uint32_t slotOf(uintptr_t a) {
+  return (uint32_t)(((a >> 3) * 2654435761u) % HEAPTRACK_SLOTS);
+}
+
+static uint16_t siteFor(uintptr_t pc) {
+  uint32_t h = (uint32_t)(((pc >> 1) * 2654435761u) % (MAX_SITES - 1));
+  for (int i = 0; i < MAX_SITES - 1; i++) {
+    uint16_t s = (uint16_t)(1 + (h + i) % (MAX_SITES - 1));
+    if (siteTab[s].pc == pc) return s;
+    if (siteTab[s].pc == 0) {
+      siteTab[s].pc = pc;
+      return s;
+    }
+  }
+  return 0;
+}
+
+// Slot holding address a, or -1
+static int find(uintptr_t a) {
+  uint32_t i = slotOf(a);
+  for (int k = 0; k < HEAPTRACK_SLOTS; k++) {
+    if (blocks[i].addr == 0) return -1;
+    if (blocks[i].addr == a) return (int)i;
+    i = (i + 1) % HEAPTRACK_SLOTS;
+  }
+  return -1;
+}
+
+// Drops slot i from the accounting and the table
+static void forget(uint32_t i) {
+  Site& st = siteTab[blocks[i].site];
+  st.liveBlocks--;
+  st.liveBytes -= blocks[i].size;
+  tot.liveBlocks--;
+  tot.liveBytes -= blocks[i].size;
+
+  // Backward-shift delete keeps probe chains intact without tombstones
+  uint32_t hole = i;
+  uint32_t j = i;
+  for (;;) {
+    j = (j + 1) % HEAPTRACK_SLOTS;
+    if (blocks[j].addr == 0) break;
+    uint32_t home = slotOf(blocks[j].addr);
+    bool movable = (hole <= j) ? (home <= hole || home > j) : (home <= hole && home > j);
+    if (movable) {
+      blocks[hole] = blocks[j];
+      hole = j;
+    }
+  }
+  blocks[hole].addr = 0;
+}
+
+void onAlloc(void* p, size_t n, uintptr_t pc) {
+  if (!p) return;
+  tot.allocs++;
+
+  if (guardsOn && openSection) {
+#ifdef VIASOL_ALLOC_ASSERT
+    abort();
+#endif
+    violationCount++;
+    lastViol.section = openSection;
+    lastViol.pc = pc;
+    lastViol.size = (uint32_t)n;
+  }
+
+  // Reused address whose free went through an untracked path
+  uintptr_t a = (uintptr_t)p;
+  int old = find(a);
+  if (old >= 0) forget((uint32_t)old);
+
+  // Keep 1/8 of the table empty: probe chains stay short and always end
+  if (tot.liveBlocks >= MAX_LIVE) {
+    tot.untracked++;
+    return;
+  }
+
+  uint32_t i = slotOf(a);
+  while (blocks[i].addr != 0) i = (i + 1) % HEAPTRACK_SLOTS;
+
+  uint16_t s = siteFor(pc);
+  blocks[i].addr = a;
+  blocks[i].size = (uint32_t)n;
+  blocks[i].site = s;
+
+  Site& st = siteTab[s];
+  st.allocs++;
+  st.liveBlocks++;
+  st.liveBytes += (uint32_t)n;
+  st.totalBytes += n;
+
+  tot.liveBlocks++;
+  tot.liveBytes += (uint32_t)n;
+  if (tot.liveBytes > tot.peakBytes) tot.peakBytes = tot.liveBytes;
+}
+
+void onFree(void* p) {
+  if (!p) return;
+  int i = find((uintptr_t)p);
+  if (i < 0) return;   // never tracked
+  forget((uint32_t)i);
+  tot.frees++;
+}
+
+Totals totals() {
+  return tot;
+}
+
+void resetPeak() {
+  tot.peakBytes = tot.liveBytes;
+}
+
+uint32_t allocCount() {
+  return tot.allocs;
+}
+
+TickGuard::TickGuard(const char* section) : prev_(openSection) {
+  openSection = section;
+}
+
+TickGuard::~TickGuard() {
+  openSection = prev_;
+}
+
+void armGuards(bool on) {
+  guardsOn = on;
+}
+
+bool guardsArmed() {
+  return guardsOn;
+}
+
+uint32_t violations() {
+  return violationCount;
+}
+
+Violation lastViolation() {
+  return lastViol;
+}
+
+int sites(Site* out, int max) {
+  int n = 0;
+  for (int s = 0; s < MAX_SITES && n < max; s++) {
+    if (siteTab[s].allocs == 0) continue;
+    // insertion sort, small table
+    Site v = siteTab[s];
+    int k = n++;
+    while (k > 0 && (out[k - 1].liveBytes < v.liveBytes ||
+                     (out[k - 1].liveBytes == v.liveBytes && out[k - 1].totalBytes < v.totalBytes))) {
+      out[k] = out[k - 1];
+      k--;
+    }
+    out[k] = v;
+  }
+  return n;
+}
+
+} // namespace heaptrack
+
+// -----------------------------------------------------------------------------
+// Hooks
+// -----------------------------------------------------------------------------
+#ifdef VIASOL_HEAP_DEBUG
+
+#ifdef ARDUINO
+static portMUX_TYPE trackMux = portMUX_INITIALIZER_UNLOCKED;
+#define TRACK_LOCK() portENTER_CRITICAL(&trackMux)
+#define TRACK_UNLOCK() portEXIT_CRITICAL(&trackMux)
+#else
+static std::atomic_flag trackFlag = ATOMIC_FLAG_INIT;
+#define TRACK_LOCK() while (trackFlag.test_and_set(std::memory_order_acquire)) {}
+#define TRACK_UNLOCK() trackFlag.clear(std::memory_order_release)
+#endif
+
+#define CALLER() ((uintptr_t)__builtin_return_address(0))
+
+static void track(void* p, size_t n, uintptr_t pc) {
+  TRACK_LOCK();
+  heaptrack::onAlloc(p, n, pc);
+  TRACK_UNLOCK();
+}
+
+static void untrack(void* p) {
+  TRACK_LOCK();
+  heaptrack::onFree(p);
+  TRACK_UNLOCK();
+}
+
+#ifdef VIASOL_HEAP_WRAP_MALLOC
+extern "C" {
+void* __real_malloc(size_t n);
+void __real_free(void* p);
+void* __real_realloc(void* p, size_t n);
+void* __real_calloc(size_t c, size_t n);
+
+void* __wrap_malloc(size_t n) {
+  void* p = __real_malloc(n);
+  track(p, n, CALLER());
+  return p;
+}
+
+void __wrap_free(void* p) {
+  untrack(p);
+  __real_free(p);
+}
+
+void* __wrap_realloc(void* p, size_t n) {
+  void* q = __real_realloc(p, n);
+  if (q || n == 0) untrack(p);
+  track(q, n, CALLER());
+  return q;
+}
+
+void* __wrap_calloc(size_t c, size_t n) {
+  void* p = __real_calloc(c, n);
+  track(p, c * n, CALLER());
+  return p;
+}
+}
+#define RAW_MALLOC __real_malloc
+#define RAW_FREE __real_free
+#else
+#define RAW_MALLOC malloc
+#define RAW_FREE free
+#endif
+
+static void* newImpl(size_t n, uintptr_t pc) {
+  void* p = RAW_MALLOC(n ? n : 1);
+  if (!p) {
+#if __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+  }
+  track(p, n, pc);
+  return p;
+}
+
+static void deleteImpl(void* p) {
+  untrack(p);
+  RAW_FREE(p);
+}
+
+void* operator new(size_t n) { return newImpl(n, CALLER()); }
+void* operator new[](size_t n) { return newImpl(n, CALLER()); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+  void* p = RAW_MALLOC(n ? n : 1);
+  track(p, n, CALLER());
+  return p;
+}
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+  void* p = RAW_MALLOC(n ? n : 1);
+  track(p, n, CALLER());
+  return p;
+}
+void operator delete(void* p) noexcept { deleteImpl(p); }
+void operator delete[](void* p) noexcept { deleteImpl(p); }
+void operator delete(void* p, size_t) noexcept { deleteImpl(p); }
+void operator delete[](void* p, size_t) noexcept { deleteImpl(p); }
+
+namespace heaptrack {
+bool enabled() { return true; }
+}
+
+#else
+
+namespace heaptrack {
+bool enabled() { return false; }
+}
+
+#endif // VIASOL_HEAP_DEBUG
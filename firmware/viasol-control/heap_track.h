@@ -0,0 +1,97 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Allocation accounting (debug builds, VIASOL_HEAP_DEBUG).
+//
+// Every tracked block is recorded in a fixed open-addressing table keyed by
+// its address, together with its size and the call site (return address of
+// the allocating call). The tracker itself never allocates, so it can sit
+// under malloc. Blocks it never saw (allocated before it started, by
+// heap_caps_* directly, or while the table was full) are ignored on free.
+//
+// Hooks (heap_track.cpp, only with VIASOL_HEAP_DEBUG):
+//   - global operator new/delete: std::vector, std::function, new
+//   - with VIASOL_HEAP_WRAP_MALLOC and the link flags
+//       -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc
+//     also malloc and friends: String, ArduinoJson
+//
+// Pure C++: the same file is linked into tools/core-bench on the host.
+// -----------------------------------------------------------------------------
+
+namespace heaptrack {
+
+#ifndef HEAPTRACK_SLOTS
+#define HEAPTRACK_SLOTS 2048   // live blocks tracked (12 bytes each)
+#endif
+static const int MAX_SITES = 64;
+
+struct Site {
+  uintptr_t pc = 0;            // 0: "other" (site table full)
+  uint32_t allocs = 0;
+  uint32_t liveBlocks = 0;
+  uint32_t liveBytes = 0;
+  uint64_t totalBytes = 0;
+};
+
+struct Totals {
+  uint32_t allocs = 0;         // since start
+  uint32_t frees = 0;          // of tracked blocks
+  uint32_t liveBlocks = 0;
+  uint32_t liveBytes = 0;
+  uint32_t peakBytes = 0;
+  uint32_t untracked = 0;      // allocations dropped because the table was full
+};
+
+// Hooks call these after the real allocator. Not reentrant: the hooks
+// serialize them.
+void onAlloc(void* p, size_t n, uintptr_t pc);
+void onFree(void* p);
+
+bool enabled();                // hooks are compiled in
+Totals totals();
+void resetPeak();
+
+// Sites sorted by live bytes (then total bytes), largest first. Returns
+// the number written.
+int sites(Site* out, int max);
+
+// Allocation count since start; a cheap probe for "did this code allocate".
+uint32_t allocCount();
+
+// -----------------------------------------------------------------------------
+// Allocation-free sections
+//
+// A TickGuard brackets code that must not touch the heap in steady state
+// (the rule ticks). Once guards are armed (after warm-up), a tracked
+// allocation made by the guarded thread while a guard is open counts as a
+// violation and records where it came from; with VIASOL_ALLOC_ASSERT it
+// aborts on the spot instead, so the backtrace names the offender.
+// Allocations by other tasks meanwhile don't count. TickGuard(nullptr)
+// inside a guarded section lifts the check for its scope (a one-off rebuild
+// after an edit). Without the hooks nothing is tracked and guards never trip.
+// -----------------------------------------------------------------------------
+struct Violation {
+  const char* section = nullptr;   // TickGuard label
+  uintptr_t pc = 0;
+  uint32_t size = 0;
+};
+
+class TickGuard {
+ public:
+  explicit TickGuard(const char* section);
+  ~TickGuard();
+  TickGuard(const TickGuard&) = delete;
+  TickGuard& operator=(const TickGuard&) = delete;
+
+ private:
+  const char* prev_;
+};
+
+void armGuards(bool on);
+bool guardsArmed();
+uint32_t violations();
+Violation lastViolation();
+
+} // namespace heaptrack
@@ -0,0 +1,213 @@
+#include "heater.h"
+#include "metrics.h"
+#include "app.h"
+#include "mppt.h"
+#include "elem_learn.h"
+#include "rs485.h"
+#include "pv_model.h"
+#include "shunt_cal.h"
+#include "safety.h"
+
+static const uint32_t STEP_MS = 250;      // >= 2 polls of the 10 Hz PV group
+static const uint32_t REPROBE_MS = 30000; // longest the engine holds a mask untested
+static const uint32_t REFRESH_MS = 1000;  // resend so a rebooted remote catches up
+static const uint32_t QUIET_MS = 2000;    // all channels off this long = zero PV current
+
+// Resistance learning
+static const uint32_t RETUNE_MS = 60000;            // re-check learned values vs the engine
+static const float RETUNE_REL = 0.02f;              // rebuild the combo table past this drift
+static const uint32_t PERSIST_MS = 30UL * 60000UL;  // NVS writes at most this often
+static const float PERSIST_REL = 0.01f;
+static const char* LEARN_KEY = "el_learn";
+
+struct LearnBlob {
+  uint8_t version;
+  float ohms[mppt::CHANNELS];  // 0: nothing learned
+};
+static const uint8_t LEARN_VERSION = 1;
+
+static mppt::Engine engine;
+static mppt::Config engineCfg;
+static elearn::Learner learner;
+static float nameplate[mppt::CHANNELS];
+static float stored[mppt::CHANNELS];
+static bool learnLoaded = false;
+static bool learning = false;
+static bool enabled = false;
+static uint8_t curMask = 0;
+static uint32_t lastSentMs = 0;
+static uint32_t lastLoadMs = 0;
+static uint32_t lastPersistMs = 0;
+
+static float relDiff(float a, float b) {
+  return b > 0 ? fabsf(a - b) / b : 1.0f;
+}
+
+// Learned resistances where the estimate is usable, nameplate elsewhere
+static void effectiveOhms(float* out) {
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) {
+    out[ch] = (learning && nameplate[ch] > 0 && learner.usable(ch)) ? learner.ohms(ch) : nameplate[ch];
+  }
+}
+
+static void loadLearned() {
+  LearnBlob b;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) stored[ch] = 0;
+  if (app.prefs.getBytes(LEARN_KEY, &b, sizeof(b)) != sizeof(b) || b.version != LEARN_VERSION) return;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) {
+    // Ignore values far from a (possibly re-entered) nameplate
+    if (nameplate[ch] > 0 && b.ohms[ch] > 0 && relDiff(b.ohms[ch], nameplate[ch]) < 0.5f) {
+      learner.restore(ch, b.ohms[ch]);
+      stored[ch] = b.ohms[ch];
+    }
+  }
+}
+
+static void persistLearned(uint32_t now) {
+  if ((now - lastPersistMs) < PERSIST_MS) return;
+
+  bool dirty = false;
+  LearnBlob b;
+  b.version = LEARN_VERSION;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) {
+    b.ohms[ch] = stored[ch];
+    if (!learner.confident(ch)) continue;
+    float r = learner.ohms(ch);
+    if (relDiff(r, stored[ch]) >= PERSIST_REL) {
+      b.ohms[ch] = r;
+      dirty = true;
+    }
+  }
+  if (!dirty) return;
+
+  lastPersistMs = now;
+  metricsNvsWrite(app.prefs.putBytes(LEARN_KEY, &b, sizeof(b)));
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) stored[ch] = b.ohms[ch];
+  Serial.println("[heater] learned resistances saved");
+}
+
+void heaterBegin(const Settings& cfg) {
+  float np[mppt::CHANNELS];
+  bool changed = !learnLoaded;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) {
+    np[ch] = (cfg.el_v[ch] > 0 && cfg.el_w[ch] > 0) ? (cfg.el_v[ch] * cfg.el_v[ch]) / cfg.el_w[ch] : 0.0f;
+    if (np[ch] != nameplate[ch]) changed = true;
+    nameplate[ch] = np[ch];
+  }
+
+  mppt::Config& c = engineCfg;
+  // MPP of the fitted curve rather than the nameplate Vmp
+  const PvModel& pv = pvModel();
+  c.vmpV = pv.valid() ? pv.mppV() : cfg.pv_vmp * cfg.pv_ns;
+  c.vocV = cfg.pv_voc * cfg.pv_ns;
+  c.impA = cfg.pv_imp * cfg.pv_np;
+  float db = 0.005f * (pv.valid() ? pv.mppW() : c.vmpV * c.impA);
+  c.deadbandW = db > 2.0f ? db : 2.0f;
+  c.reprobeSteps = (uint16_t)(REPROBE_MS / STEP_MS);
+
+  // Re-seed the estimators only when the nameplate data changed, so saving
+  // unrelated settings keeps what has been learned
+  if (changed) {
+    elearn::Config lc;
+    for (int ch = 0; ch < mppt::CHANNELS; ch++) lc.priorOhms[ch] = nameplate[ch];
+    lc.vRefV = c.vmpV > 0 ? c.vmpV : 100.0f;
+    learner.configure(lc);
+    loadLearned();
+    learnLoaded = true;
+  }
+  learning = cfg.learn_elems;
+
+  effectiveOhms(c.ohms);
+  engine.configure(c);
+  enabled = cfg.heat_en;
+  if (!enabled) engine.reset();
+
+  Serial.printf("[heater] %s, channels 0x%02X, Vmp %.1f V%s\n",
+                enabled ? "enabled" : "disabled", (unsigned)engine.available(), c.vmpV,
+                learning ? ", learning" : "");
+}
+
+uint8_t heaterMask() {
+  return curMask;
+}
+
+bool heaterSaturated() {
+  uint8_t usable = engine.available() & safetyAllowedMask();
+  return enabled && usable && curMask == usable;
+}
+
+bool heaterLearned(int ch, float& ohms, float& confidence) {
+  if (ch < 0 || ch >= mppt::CHANNELS || nameplate[ch] <= 0) return false;
+  ohms = learner.ohms(ch);
+  confidence = learner.confidence(ch);
+  return learner.samples(ch) > 0 || learner.restored(ch);
+}
+
+void applyHeaterMask(uint8_t mask) {
+  mask &= safetyAllowedMask();   // the engine already avoids these; a trip may land mid-step
+  uint32_t now = millis();
+  if (mask == curMask && (now - lastSentMs) < REFRESH_MS) return;
+  if (mask != curMask) learner.onSwitch(mask, now);
+  curMask = mask;
+  lastSentMs = now;
+  if (mask) lastLoadMs = now;
+  rs485Write(HEATER_REMOTE, rs485::REG_HEATER_MASK, (int16_t)mask);
+}
+
+// Rebuild the combo table when learned values moved away from what it uses
+static void retune(uint32_t now) {
+  static uint32_t lastCheck = 0;
+  if (now - lastCheck < RETUNE_MS) return;
+  lastCheck = now;
+
+  float ohms[mppt::CHANNELS];
+  effectiveOhms(ohms);
+  bool drift = false;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) {
+    if (relDiff(ohms[ch], engineCfg.ohms[ch]) >= RETUNE_REL) drift = true;
+  }
+  if (drift) {
+    for (int ch = 0; ch < mppt::CHANNELS; ch++) engineCfg.ohms[ch] = ohms[ch];
+    engine.configure(engineCfg);
+  }
+  persistLearned(now);
+}
+
+void heaterTick() {
+  static uint32_t lastStep = 0;
+  uint32_t now = millis();
+  if (now - lastStep < STEP_MS) return;
+  lastStep = now;
+
+  if (!rs485Online(HEATER_REMOTE)) {
+    engine.reset();
+    applyHeaterMask(0);
+    return;
+  }
+
+  // PV and channel currents are polled together; read them as one block
+  int16_t regs[rs485::REG_CH_A0 + mppt::CHANNELS - rs485::REG_PV_V];
+  rs485Regs(HEATER_REMOTE, rs485::REG_PV_V, sizeof(regs) / sizeof(regs[0]), regs);
+  float pvV = (uint16_t)regs[0] * 0.01f;
+  int32_t raw = regs[rs485::REG_PV_A - rs485::REG_PV_V];
+  shuntZeroFeed(SHUNT_PV, raw, curMask == 0 && (now - lastLoadMs) >= QUIET_MS);
+
+  if (!enabled) {
+    engine.reset();
+    applyHeaterMask(0);
+    return;
+  }
+
+  if (learning) {
+    float chA[mppt::CHANNELS];
+    for (int ch = 0; ch < mppt::CHANNELS; ch++) chA[ch] = regs[rs485::REG_CH_A0 - rs485::REG_PV_V + ch] * 0.001f;
+    learner.feed(pvV, chA, now);
+    retune(now);
+  }
+
+  float pvA = shuntToMilliamps(shuntCal(SHUNT_PV), raw) * 0.001f;
+  const PvModel& pv = pvModel();
+  float sun = pv.valid() ? pv.sunFraction(pvV, pvA) : 0.0f;
+  engine.setAllowed(safetyAllowedMask());
+  applyHeaterMask(engine.step(pvV, pvA, pv.mppW() * sun, pv.mppV()));
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Heater channel control (master side).
+//
+// Runs the P&O engine (mppt.h) on the PV voltage/current reported by the
+// remote comm board and sends the resulting channel mask back over RS-485.
+// All channels are off whenever control is disabled or the remote is offline,
+// and channels blocked by the safety interlock (safety.h) are never sent.
+// -----------------------------------------------------------------------------
+
+static const uint8_t HEATER_REMOTE = 1;  // remote comm board with the heater channels
+
+// (Re)derive element resistances and the PV hints from settings. With
+// learn_elems set, channel selection uses the learned resistances
+// (elem_learn.h) once they are confident; learned values are kept in NVS.
+void heaterBegin(const Settings& cfg);
+void heaterTick();
+
+uint8_t heaterMask();
+void applyHeaterMask(uint8_t mask);
+
+// Control is running and every channel it may use is on: the array has more
+// to give than the elements can take.
+bool heaterSaturated();
+
+// Learned resistance and confidence (0..1) for a fitted channel; false if
+// nothing has been learned for it yet.
+bool heaterLearned(int ch, float& ohms, float& confidence);
@@ -0,0 +1,212 @@
+#include "history.h"
+#include "io_catalog.h"
+
+// -----------------------------------------------------------------------------
+// Sizing
+// 1 s  x 600  = 10 minutes
+// 1 min x 1440 = 24 hours
+// 15 min x 1344 = 14 days
+// 12 bytes/bucket -> ~40 KB per input, ~530 KB for the 13 stock inputs.
+// -----------------------------------------------------------------------------
+static const uint32_t TIER_PERIOD_S[HIST_TIERS] = { 1, 60, 900 };
+static const uint32_t TIER_DEPTH[HIST_TIERS]    = { 600, 1440, 1344 };
+
+struct HistAcc {
+  float mn;
+  float mx;
+  float sum;
+  uint32_t n;
+};
+
+struct HistTier {
+  HistPoint* points = nullptr;  // [input][depth]
+  uint32_t head = 0;            // next write slot
+  uint32_t count = 0;
+  uint32_t bucket = 0;          // bucket currently accumulating
+  uint32_t newestBucket = 0;    // last bucket written to the ring
+};
+
+static HistTier tiers[HIST_TIERS];
+static HistAcc* accs = nullptr;  // [input][tier]
+static int nInputs = 0;
+static size_t totalBytes = 0;
+
+static bool started = false;
+static uint32_t upSec = 0;
+static uint32_t lastMs = 0;
+
+static void accReset(HistAcc& a) {
+  a.mn = NAN;
+  a.mx = NAN;
+  a.sum = 0.0f;
+  a.n = 0;
+}
+
+static void accAdd(HistAcc& a, float v) {
+  if (a.n == 0 || v < a.mn) a.mn = v;
+  if (a.n == 0 || v > a.mx) a.mx = v;
+  a.sum += v;
+  a.n++;
+}
+
+static void ringPush(HistTier& t, uint32_t depth, int tierIdx, bool empty) {
+  for (int i = 0; i < nInputs; i++) {
+    HistPoint& p = t.points[(size_t)i * depth + t.head];
+    HistAcc& a = accs[i * HIST_TIERS + tierIdx];
+    if (empty || a.n == 0) {
+      p.min = p.max = p.avg = NAN;
+    } else {
+      p.min = a.mn;
+      p.max = a.mx;
+      p.avg = a.sum / (float)a.n;
+    }
+  }
+  t.head = (t.head + 1) % depth;
+  if (t.count < depth) t.count++;
+}
+
+// Close the accumulating bucket (and any skipped ones) once time moves past it.
+static void tierRoll(int tierIdx, uint32_t bucket) {
+  HistTier& t = tiers[tierIdx];
+  uint32_t depth = TIER_DEPTH[tierIdx];
+  if (bucket == t.bucket) return;
+
+  ringPush(t, depth, tierIdx, false);
+
+  uint32_t gap = bucket - t.bucket - 1;
+  if (gap > depth) gap = depth;
+  for (uint32_t k = 0; k < gap; k++) ringPush(t, depth, tierIdx, true);
+
+  t.newestBucket = bucket - 1;
+  t.bucket = bucket;
+  for (int i = 0; i < nInputs; i++) accReset(accs[i * HIST_TIERS + tierIdx]);
+}
+
+bool historyBegin() {
+  if (accs) return true;
+
+  nInputs = N_INPUTS;
+  size_t pointsPerInput = 0;
+  for (int t = 0; t < HIST_TIERS; t++) pointsPerInput += TIER_DEPTH[t];
+
+  size_t pointBytes = (size_t)nInputs * pointsPerInput * sizeof(HistPoint);
+  size_t accBytes = (size_t)nInputs * HIST_TIERS * sizeof(HistAcc);
+
+  if (!psramFound()) {
+    Serial.println("[hist] no PSRAM, history disabled");
+    return false;
+  }
+
+  uint8_t* mem = (uint8_t*)ps_malloc(pointBytes + accBytes);
+  if (!mem) {
+    Serial.printf("[hist] alloc %u bytes failed, history disabled\n", (unsigned)(pointBytes + accBytes));
+    return false;
+  }
+
+  uint8_t* p = mem;
+  for (int t = 0; t < HIST_TIERS; t++) {
+    tiers[t] = HistTier{};
+    tiers[t].points = (HistPoint*)p;
+    p += (size_t)nInputs * TIER_DEPTH[t] * sizeof(HistPoint);
+  }
+  accs = (HistAcc*)p;
+  for (int i = 0; i < nInputs * HIST_TIERS; i++) accReset(accs[i]);
+
+  totalBytes = pointBytes + accBytes;
+  Serial.printf("[hist] %d inputs, %u bytes\n", nInputs, (unsigned)totalBytes);
+  return true;
+}
+
+void historyTick() {
+  if (!accs) return;
+
+  uint32_t now = millis();
+  if (!started) {
+    started = true;
+    lastMs = now;
+    upSec = now / 1000;
+    for (int t = 0; t < HIST_TIERS; t++) tiers[t].bucket = upSec / TIER_PERIOD_S[t];
+  } else {
+    uint32_t elapsed = now - lastMs;
+    if (elapsed < 1000) return;
+    uint32_t k = elapsed / 1000;
+    upSec += k;
+    lastMs += k * 1000;
+  }
+
+  for (int t = 0; t < HIST_TIERS; t++) tierRoll(t, upSec / TIER_PERIOD_S[t]);
+
+  // This pass's snapshot; a stale or missing input reads 0 live, and an
+  // outage must leave a gap, not zeros
+  for (int i = 0; i < nInputs; i++) {
+    const InputSample& s = inputSample(i);
+    if (s.q != Quality::Good || isnan(s.value)) continue;
+    HistAcc* a = &accs[i * HIST_TIERS];
+    for (int t = 0; t < HIST_TIERS; t++) accAdd(a[t], s.value);
+  }
+}
+
+bool historyEnabled() {
+  return accs != nullptr;
+}
+
+uint32_t historyUptimeSec() {
+  return upSec;
+}
+
+uint32_t historyPeriodSec(HistRes res) {
+  return TIER_PERIOD_S[(int)res];
+}
+
+uint32_t historyDepth(HistRes res) {
+  return TIER_DEPTH[(int)res];
+}
+
+size_t historyBytes() {
+  return totalBytes;
+}
+
+bool strToHistRes(const String& s, HistRes& out) {
+  if (s == "1s")  { out = HistRes::S1;  return true; }
+  if (s == "1m")  { out = HistRes::M1;  return true; }
+  if (s == "15m") { out = HistRes::M15; return true; }
+  return false;
+}
+
+bool historyOpen(int input, HistRes res, uint32_t fromSec, HistCursor& cur) {
+  if (!accs || input < 0 || input >= nInputs) return false;
+
+  const HistTier& t = tiers[(int)res];
+  uint32_t period = TIER_PERIOD_S[(int)res];
+
+  cur.input = input;
+  cur.res = res;
+  cur.count = t.count;
+  cur.newestT = t.newestBucket * period;
+  cur.pos = 0;
+
+  if (t.count == 0) return true;
+
+  // Skip buckets older than fromSec without walking them.
+  uint32_t oldestBucket = t.newestBucket - (t.count - 1);
+  uint32_t fromBucket = (fromSec + period - 1) / period;
+  if (fromBucket > oldestBucket) {
+    uint32_t skip = fromBucket - oldestBucket;
+    cur.pos = (skip > t.count) ? t.count : skip;
+  }
+  return true;
+}
+
+bool historyNext(HistCursor& cur, uint32_t& tSec, HistPoint& p) {
+  if (!accs || cur.pos >= cur.count) return false;
+
+  const HistTier& t = tiers[(int)cur.res];
+  uint32_t depth = TIER_DEPTH[(int)cur.res];
+  uint32_t period = TIER_PERIOD_S[(int)cur.res];
+
+  uint32_t slot = (t.head + depth - cur.count + cur.pos) % depth;
+  p = t.points[(size_t)cur.input * depth + slot];
+  tSec = cur.newestT - (cur.count - 1 - cur.pos) * period;
+  cur.pos++;
+  return true;
+}
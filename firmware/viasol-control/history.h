@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+
+// -----------------------------------------------------------------------------
+// In-RAM time-series history for every catalog input.
+//
+// Each input keeps three ring buffers of min/max/avg buckets (1 s, 1 min,
+// 15 min). All storage is allocated once in historyBegin() (PSRAM when the
+// board has it); historyTick() is O(1) per input and never allocates.
+//
+// Timestamps are seconds since boot (bucket start).
+// -----------------------------------------------------------------------------
+
+enum class HistRes : uint8_t { S1 = 0, M1 = 1, M15 = 2 };
+
+static const int HIST_TIERS = 3;
+
+struct HistPoint {
+  float min;
+  float max;
+  float avg;  // NaN for buckets with no samples (e.g. loop stalled)
+};
+
+// Read cursor over one input/tier, oldest -> newest.
+struct HistCursor {
+  int input = -1;
+  HistRes res = HistRes::S1;
+  uint32_t pos = 0;    // index from oldest
+  uint32_t count = 0;  // entries available
+  uint32_t newestT = 0;
+};
+
+bool historyBegin();
+void historyTick();   // after ioSnapshot(): samples Good inputs only
+
+bool historyEnabled();
+uint32_t historyUptimeSec();
+uint32_t historyPeriodSec(HistRes res);
+uint32_t historyDepth(HistRes res);
+size_t historyBytes();
+
+bool strToHistRes(const String& s, HistRes& out);  // "1s" | "1m" | "15m"
+
+// Positions the cursor at the first bucket starting at or after fromSec.
+bool historyOpen(int input, HistRes res, uint32_t fromSec, HistCursor& cur);
+bool historyNext(HistCursor& cur, uint32_t& tSec, HistPoint& p);
@@ -1,12 +1,19 @@
 #include "io_catalog.h"
 #include "app.h"
+#include "mqtt.h"
+#include "safety.h"
+#include "heater.h"
+#include "rs485.h"
+#include "pins.h"
+#include "metrics.h"
+#include <atomic>
 
 #ifndef LED_BUILTIN
   #define LED_BUILTIN 2
 #endif
 static const int LED_PIN = LED_BUILTIN;
 
-const char* INPUT_KEYS[] = {
+static const char* FIXED_INPUT_KEYS[] = {
   "tank_temp_c", 
   "floor_temp_c", 
   "indoor_temp_c",
@@ -15,10 +22,29 @@ const char* INPUT_KEYS[] = {
   "soc",
   "pv_v", 
   "pv_a", 
-  "main_a",
-  "mqtt1", "mqtt2", "mqtt3", "mqtt4"
+  "main_a"
 };
-const int N_INPUTS = sizeof(INPUT_KEYS) / sizeof(INPUT_KEYS[0]);
+static const int N_FIXED_INPUTS = sizeof(FIXED_INPUT_KEYS) / sizeof(FIXED_INPUT_KEYS[0]);
+
+const char* INPUT_KEYS[IO_MAX_INPUTS];
+int N_INPUTS = 0;
+
+// mqtt1..mqttN occupy [mqttFirst, mqttFirst + mqttCount)
+static char mqttKeyBuf[MQTT_MAX_REGS][8];
+static int mqttFirst = 0;
+static int mqttCount = 0;
+
+// Values pushed by sampling subsystems (ADC, OneWire, ...)
+static float published[IO_MAX_INPUTS];
+static bool isPublished[IO_MAX_INPUTS];
+static uint32_t publishedMs[IO_MAX_INPUTS];
+static uint32_t maxAgeMs[IO_MAX_INPUTS];
+
+// Resolved once per loop pass by ioSnapshot()
+static InputSample snap[IO_MAX_INPUTS];
+static const InputSample MISSING_SAMPLE;
+
+static std::atomic<uint16_t> remoteRelays{0};
 
 const char* OUTPUT_KEYS[] = {
   "m_relay1","m_relay2",
@@ -28,27 +54,188 @@ const char* OUTPUT_KEYS[] = {
 };
 const int N_OUTPUTS = sizeof(OUTPUT_KEYS) / sizeof(OUTPUT_KEYS[0]);
 
-float inputValueByKey(const String& key) {
-  // TODO: wire these to real sensors + MQTT "virtual registers"
-  if (key == "tank_temp_c") return 42.0f;
-  if (key == "pv_v") return 80.0f;
-  if (key == "pv_a") return 10.0f;
-  if (key == "main_a") return 2.0f;
+void ioCatalogBegin(const Settings& cfg) {
+  for (int i = 0; i < 2; i++) {
+    if (PIN_M_RELAY[i] == PIN_UNSET) continue;
+    digitalWrite(PIN_M_RELAY[i], LOW);
+    pinMode(PIN_M_RELAY[i], OUTPUT);
+  }
 
-  // mqtt placeholders
-  if (key.startsWith("mqtt")) return 0.0f;
+  N_INPUTS = 0;
+  for (int i = 0; i < IO_MAX_INPUTS; i++) {
+    isPublished[i] = false;
+    maxAgeMs[i] = IO_DEFAULT_MAX_AGE_MS;
+    snap[i] = InputSample();
+  }
+  for (int i = 0; i < N_FIXED_INPUTS; i++) INPUT_KEYS[N_INPUTS++] = FIXED_INPUT_KEYS[i];
 
+  mqttFirst = N_INPUTS;
+  mqttCount = 0;
+  for (int r = 0; r < cfg.mqtt_nregs && N_INPUTS < IO_MAX_INPUTS; r++) {
+    snprintf(mqttKeyBuf[r], sizeof(mqttKeyBuf[r]), "mqtt%d", r + 1);
+    INPUT_KEYS[N_INPUTS++] = mqttKeyBuf[r];
+    mqttCount++;
+  }
+}
+
+int ioRegisterInput(const char* key) {
+  int idx = inputIndexByKey(key);
+  if (idx >= 0) return idx;
+  if (N_INPUTS >= IO_MAX_INPUTS) return -1;
+  INPUT_KEYS[N_INPUTS] = key;
+  return N_INPUTS++;
+}
+
+int inputIndexByKey(const char* key) {
+  for (int i = 0; i < N_INPUTS; i++) {
+    if (strcmp(INPUT_KEYS[i], key) == 0) return i;
+  }
+  return -1;
+}
+
+int outputIndexByKey(const char* key) {
+  for (int i = 0; i < N_OUTPUTS; i++) {
+    if (strcmp(OUTPUT_KEYS[i], key) == 0) return i;
+  }
+  return -1;
+}
+
+int inputIndexCached(int8_t& idx, const char* key) {
+  if (idx < 0 || idx >= N_INPUTS || strcmp(INPUT_KEYS[idx], key) != 0) idx = (int8_t)inputIndexByKey(key);
+  return idx;
+}
+
+int outputIndexCached(int8_t& idx, const char* key) {
+  if (idx < 0 || idx >= N_OUTPUTS || strcmp(OUTPUT_KEYS[idx], key) != 0) idx = (int8_t)outputIndexByKey(key);
+  return idx;
+}
+
+float inputValueByIndex(int idx) {
+  if (idx < 0 || idx >= N_INPUTS) return 0.0f;
+
+  // MQTT virtual registers: lock-free read of the latest value; stale reads 0
+  if (idx >= mqttFirst && idx < mqttFirst + mqttCount) {
+    float v;
+    if (mqttRegRead(idx - mqttFirst, v)) return v;
+    return 0.0f;
+  }
+
+  // Sampled inputs (ADC, OneWire); the rest read 0 until something feeds them
+  if (isPublished[idx] && (millis() - publishedMs[idx]) <= maxAgeMs[idx]) return published[idx];
   return 0.0f;
 }
 
+void ioPublishInput(int idx, float value) {
+  if (idx < 0 || idx >= N_INPUTS) return;
+  published[idx] = value;
+  publishedMs[idx] = millis();
+  isPublished[idx] = true;
+}
+
+void ioSetInputMaxAge(int idx, uint32_t ms) {
+  if (idx < 0 || idx >= N_INPUTS) return;
+  maxAgeMs[idx] = ms;
+}
+
+// -----------------------------------------------------------------------------
+// Quality snapshot
+// -----------------------------------------------------------------------------
+void ioSnapshot() {
+  uint32_t now = millis();
+
+  for (int i = 0; i < N_INPUTS; i++) {
+    InputSample& s = snap[i];
+
+    if (i >= mqttFirst && i < mqttFirst + mqttCount) {
+      // The register applies its own configured max age
+      float v;
+      uint32_t age;
+      if (!mqttRegPeek(i - mqttFirst, v, age)) {
+        s = InputSample();
+        continue;
+      }
+      float fresh;
+      s.value = v;
+      s.stampMs = now - age;
+      s.q = mqttRegRead(i - mqttFirst, fresh) ? Quality::Good : Quality::Stale;
+      continue;
+    }
+
+    if (!isPublished[i]) {
+      s = InputSample();
+      continue;
+    }
+    s.value = published[i];
+    s.stampMs = publishedMs[i];
+    s.q = (now - publishedMs[i]) <= maxAgeMs[i] ? Quality::Good : Quality::Stale;
+  }
+}
+
+const InputSample& inputSample(int idx) {
+  if (idx < 0 || idx >= N_INPUTS) return MISSING_SAMPLE;
+  return snap[idx];
+}
+
+const char* qualityName(Quality q) {
+  switch (q) {
+    case Quality::Good:    return "good";
+    case Quality::Stale:   return "stale";
+    case Quality::Missing: return "missing";
+  }
+  return "?";
+}
+
+float inputValueByKey(const String& key) {
+  return inputValueByIndex(inputIndexByKey(key.c_str()));
+}
+
+void driveRelay(bool remote, int idx, bool on) {
+  if (remote) {
+    if (idx < 1 || idx > 3) return;
+    uint16_t bit = (uint16_t)(1 << (idx - 1));
+    uint16_t v = on ? (remoteRelays.fetch_or(bit) | bit) : (remoteRelays.fetch_and((uint16_t)~bit) & (uint16_t)~bit);
+    rs485Write(HEATER_REMOTE, rs485::REG_RELAYS, (int16_t)v);
+  } else {
+    if (idx < 1 || idx > 2 || PIN_M_RELAY[idx - 1] == PIN_UNSET) return;
+    digitalWrite(PIN_M_RELAY[idx - 1], on ? HIGH : LOW);
+  }
+}
+
+String relayKey(const String& loc, int idx) {
+  return String(loc == "remote" ? "r_relay" : "m_relay") + String(idx);
+}
+
+static MetricCounter outputWrites("viasol_output_writes_total", "applyOutput() calls that reached a driver");
+static MetricCounter outputBlocked("viasol_output_blocked_total", "applyOutput() calls refused by the interlock");
+
 void applyOutput(const String& outputKey, bool on) {
-  // TODO: map to actual relays/aux lines
+  applyOutputIndex(outputIndexByKey(outputKey.c_str()), on);
+}
+
+void applyOutputIndex(int idx, bool on) {
+  if (idx < 0 || idx >= N_OUTPUTS) return;
+  const char* k = OUTPUT_KEYS[idx];
+
+  // The safety interlock owns the PV kill relay while it has it tripped
+  if (safetyHoldsOutput(k)) {
+    outputBlocked.inc();
+    return;
+  }
+  outputWrites.inc();
+
+  // m_relayN / r_relayN
+  if ((k[0] == 'm' || k[0] == 'r') && strncmp(k + 1, "_relay", 6) == 0) {
+    driveRelay(k[0] == 'r', atoi(k + 7), on);
+    return;
+  }
+
+  // TODO: map the aux lines
   // For sanity, drive the onboard LED via one output
-  if (outputKey == "m_aux1") {
+  if (strcmp(k, "m_aux1") == 0) {
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, on ? HIGH : LOW);
   }
 
   // Debug print (remove later or gate with a debug flag)
-  // Serial.printf("OUTPUT %s = %s\n", outputKey.c_str(), on ? "ON" : "OFF");
+  // Serial.printf("OUTPUT %s = %s\n", k, on ? "ON" : "OFF");
 }
@@ -1,11 +1,78 @@
 #pragma once
 #include <Arduino.h>
+#include "settings.h"
+
+// Upper bound on catalog inputs (fixed inputs + MQTT registers + anything
+// registered at startup). Storage that scales per input sizes itself from
+// N_INPUTS after ioCatalogBegin().
+static const int IO_MAX_INPUTS = 40;
 
 extern const char* INPUT_KEYS[];
-extern const int N_INPUTS;
+extern int N_INPUTS;
 
 extern const char* OUTPUT_KEYS[];
 extern const int N_OUTPUTS;
 
+// Builds the input table: fixed inputs followed by mqtt1..mqttN.
+void ioCatalogBegin(const Settings& cfg);
+
+// Appends an input; returns its index (or the existing one), -1 when full.
+// key must stay valid for the lifetime of the program.
+int ioRegisterInput(const char* key);
+
+// Index lookups (-1 when the key is unknown). Index-based reads avoid
+// building a String per sample on hot paths.
+int inputIndexByKey(const char* key);
+int outputIndexByKey(const char* key);
+float inputValueByIndex(int idx);
+
+// Cached lookups for the rule ticks: idx keeps the last result and is only
+// re-resolved when it no longer names key, so a warm call is one strcmp.
+int inputIndexCached(int8_t& idx, const char* key);
+int outputIndexCached(int8_t& idx, const char* key);
+
+// Sampling subsystems push their latest filtered value here; reads of a
+// published input are a plain load.
+void ioPublishInput(int idx, float value);
+
+// A published input goes Stale once nothing has been pushed for maxAgeMs
+// (default IO_DEFAULT_MAX_AGE_MS). Publishers set this to a few of their
+// own update periods.
+static const uint32_t IO_DEFAULT_MAX_AGE_MS = 5000;
+void ioSetInputMaxAge(int idx, uint32_t maxAgeMs);
+
+// -----------------------------------------------------------------------------
+// Quality snapshot
+//
+// Every input carries the time of its last update and a quality flag.
+// ioSnapshot() resolves value, age and quality for the whole catalog once
+// per loop pass; rule evaluation then reads the snapshot, so all rules see
+// one consistent instant and the per-condition cost is a table load.
+// -----------------------------------------------------------------------------
+enum class Quality : uint8_t {
+  Good,     // updated within its max age
+  Stale,    // had a value, but nothing recent
+  Missing   // never updated (or unknown key)
+};
+
+struct InputSample {
+  float value = 0.0f;     // last value (0 when Missing)
+  uint32_t stampMs = 0;   // millis() of the last update
+  Quality q = Quality::Missing;
+};
+
+void ioSnapshot();
+const InputSample& inputSample(int idx);  // Missing sample for idx < 0
+const char* qualityName(Quality q);
+
+// Live value; Stale and Missing inputs read 0. Rule engines use the snapshot.
 float inputValueByKey(const String& key);
 void applyOutput(const String& outputKey, bool on);
+void applyOutputIndex(int idx, bool on);   // OUTPUT_KEYS[idx]; no-op for idx < 0
+
+// Raw relay drive (master relays 1-2 on GPIO, remote relays 1-3 on the
+// heater remote's REG_RELAYS), without the safety guard in applyOutput().
+// Safe from any task: remote relay bits are kept in an atomic shadow so
+// concurrent writers don't clobber each other's bits.
+void driveRelay(bool remote, int idx, bool on);
+String relayKey(const String& loc, int idx);  // "m_relay2", "r_relay1", ...
@@ -0,0 +1,240 @@
+#include "metrics.h"
+
+// Constant-initialized, so safe to link into from other translation units'
+// static constructors regardless of init order
+static MetricCounter* counterHead = nullptr;
+static MetricCollector* collectorHead = nullptr;
+
+MetricCounter::MetricCounter(const char* name, const char* help) : name_(name), help_(help) {
+  next_ = counterHead;
+  counterHead = this;
+}
+
+MetricCollector::MetricCollector(Fn fn) : fn_(fn) {
+  next_ = collectorHead;
+  collectorHead = this;
+}
+
+// -----------------------------------------------------------------------------
+// Writer
+// -----------------------------------------------------------------------------
+void MetricWriter::put(const char* s, size_t n) {
+  while (n) {
+    if (len_ == sizeof(buf_)) flush();
+    size_t k = sizeof(buf_) - len_;
+    if (k > n) k = n;
+    memcpy(buf_ + len_, s, k);
+    len_ += k;
+    s += k;
+    n -= k;
+  }
+}
+
+void MetricWriter::flush() {
+  if (!len_) return;
+  sink_(buf_, len_);
+  len_ = 0;
+}
+
+void MetricWriter::family(const char* name, const char* help, const char* type) {
+  puts("# HELP "); puts(name); put(" ", 1); puts(help); put("\n", 1);
+  puts("# TYPE "); puts(name); put(" ", 1); puts(type); put("\n", 1);
+}
+
+void MetricWriter::start(const char* name, const char* label, const char* labelValue) {
+  puts(name);
+  if (!label) return;
+  put("{", 1); puts(label); put("=\"", 2);
+  for (const char* p = labelValue ? labelValue : ""; *p; p++) {
+    if (*p == '\\' || *p == '"') { put("\\", 1); put(p, 1); }
+    else if (*p == '\n') put("\\n", 2);
+    else put(p, 1);
+  }
+  put("\"}", 2);
+}
+
+void MetricWriter::end(const char* num) {
+  put(" ", 1);
+  puts(num);
+  put("\n", 1);
+}
+
+void MetricWriter::u(const char* name, uint64_t v, const char* label, const char* labelValue) {
+  char num[24];
+  snprintf(num, sizeof(num), "%llu", (unsigned long long)v);
+  start(name, label, labelValue);
+  end(num);
+}
+
+void MetricWriter::i(const char* name, int32_t v, const char* label, const char* labelValue) {
+  char num[16];
+  snprintf(num, sizeof(num), "%ld", (long)v);
+  start(name, label, labelValue);
+  end(num);
+}
+
+void MetricWriter::fixed(const char* name, uint64_t v, uint8_t decimals, const char* label,
+                         const char* labelValue) {
+  if (decimals > 9) decimals = 9;
+  uint64_t scale = 1;
+  for (uint8_t k = 0; k < decimals; k++) scale *= 10;
+
+  // Up to 20 integer digits, '.', 9 decimals
+  char num[32];
+  int n = snprintf(num, sizeof(num), "%llu", (unsigned long long)(v / scale));
+  if (decimals) {
+    uint64_t frac = v % scale;
+    num[n++] = '.';
+    for (int k = decimals - 1; k >= 0; k--) {
+      num[n + k] = (char)('0' + frac % 10);
+      frac /= 10;
+    }
+    n += decimals;
+  }
+  num[n] = 0;
+  start(name, label, labelValue);
+  end(num);
+}
+
+// -----------------------------------------------------------------------------
+// Loop phases (loop task only)
+// -----------------------------------------------------------------------------
+static const char* const PHASE_NAMES[(int)LoopPhase::Count] = {
+  "net", "inputs", "rules", "rules2", "io", "heater", "energy"
+};
+
+struct PhaseStat {
+  uint32_t lastUs = 0;
+  uint32_t maxUs = 0;
+  uint64_t sumUs = 0;
+  uint32_t count = 0;
+};
+
+static PhaseStat phases[(int)LoopPhase::Count];
+static PhaseStat loopStat;
+
+static void record(PhaseStat& s, uint32_t us) {
+  s.lastUs = us;
+  if (us > s.maxUs) s.maxUs = us;
+  s.sumUs += us;
+  s.count++;
+}
+
+uint32_t metricsPhase(LoopPhase p, uint32_t startUs) {
+  uint32_t now = micros();
+  record(phases[(int)p], now - startUs);
+  return now;
+}
+
+void metricsLoopDone(uint32_t loopStartUs) {
+  record(loopStat, micros() - loopStartUs);
+}
+
+// -----------------------------------------------------------------------------
+// Storage
+// -----------------------------------------------------------------------------
+static std::atomic<uint32_t> nvsOps{0};
+static std::atomic<uint32_t> nvsBytes{0};
+static std::atomic<uint32_t> fsOps{0};
+static std::atomic<uint32_t> fsBytes{0};
+
+void metricsNvsWrite(size_t bytes) {
+  nvsOps.fetch_add(1, std::memory_order_relaxed);
+  nvsBytes.fetch_add((uint32_t)bytes, std::memory_order_relaxed);
+}
+
+void metricsFsWrite(size_t bytes) {
+  fsOps.fetch_add(1, std::memory_order_relaxed);
+  fsBytes.fetch_add((uint32_t)bytes, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// HTTP routes (registered and served from the loop task)
+// -----------------------------------------------------------------------------
+struct RouteStat {
+  const char* path;
+  const char* method;
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+
+static RouteStat routes[METRICS_MAX_ROUTES];
+static int routeCount = 0;
+
+int metricsRoute(const char* path, const char* method) {
+  for (int i = 0; i < routeCount; i++) {
+    if (!strcmp(routes[i].path, path) && !strcmp(routes[i].method, method)) return i;
+  }
+  if (routeCount >= METRICS_MAX_ROUTES) return -1;
+  routes[routeCount] = RouteStat{path, method, 0, 0, 0};
+  return routeCount++;
+}
+
+void metricsRouteDone(int slot, uint32_t startUs) {
+  if (slot < 0 || slot >= routeCount) return;
+  uint32_t us = micros() - startUs;
+  RouteStat& r = routes[slot];
+  r.count++;
+  r.sumUs += us;
+  if (us > r.maxUs) r.maxUs = us;
+}
+
+// -----------------------------------------------------------------------------
+// Render
+// -----------------------------------------------------------------------------
+static void renderCore(MetricWriter& w) {
+  w.family("viasol_uptime_seconds", "Time since reset", "gauge");
+  w.u("viasol_uptime_seconds", millis() / 1000);
+
+  w.family("viasol_heap_free_bytes", "Free internal heap", "gauge");
+  w.u("viasol_heap_free_bytes", ESP.getFreeHeap());
+  w.family("viasol_heap_min_free_bytes", "Lowest free heap since reset", "gauge");
+  w.u("viasol_heap_min_free_bytes", ESP.getMinFreeHeap());
+  w.family("viasol_heap_largest_free_block_bytes", "Largest allocatable block", "gauge");
+  w.u("viasol_heap_largest_free_block_bytes", ESP.getMaxAllocHeap());
+
+  w.family("viasol_loop_phase_seconds", "Loop phase duration (summary)", "summary");
+  for (int p = 0; p < (int)LoopPhase::Count; p++) {
+    w.fixed("viasol_loop_phase_seconds_sum", phases[p].sumUs, 6, "phase", PHASE_NAMES[p]);
+    w.u("viasol_loop_phase_seconds_count", phases[p].count, "phase", PHASE_NAMES[p]);
+  }
+  w.family("viasol_loop_phase_max_seconds", "Longest loop phase since reset", "gauge");
+  for (int p = 0; p < (int)LoopPhase::Count; p++) {
+    w.fixed("viasol_loop_phase_max_seconds", phases[p].maxUs, 6, "phase", PHASE_NAMES[p]);
+  }
+  w.family("viasol_loop_seconds", "Whole loop pass (summary)", "summary");
+  w.fixed("viasol_loop_seconds_sum", loopStat.sumUs, 6);
+  w.u("viasol_loop_seconds_count", loopStat.count);
+  w.family("viasol_loop_max_seconds", "Longest loop pass since reset", "gauge");
+  w.fixed("viasol_loop_max_seconds", loopStat.maxUs, 6);
+
+  w.family("viasol_nvs_writes_total", "NVS (Preferences) saves", "counter");
+  w.u("viasol_nvs_writes_total", nvsOps.load(std::memory_order_relaxed));
+  w.family("viasol_nvs_write_bytes_total", "Bytes written to NVS", "counter");
+  w.u("viasol_nvs_write_bytes_total", nvsBytes.load(std::memory_order_relaxed));
+  w.family("viasol_fs_writes_total", "LittleFS file writes", "counter");
+  w.u("viasol_fs_writes_total", fsOps.load(std::memory_order_relaxed));
+  w.family("viasol_fs_write_bytes_total", "Bytes written to LittleFS", "counter");
+  w.u("viasol_fs_write_bytes_total", fsBytes.load(std::memory_order_relaxed));
+
+  w.family("viasol_http_requests_total", "HTTP requests per route", "counter");
+  for (int i = 0; i < routeCount; i++) w.u("viasol_http_requests_total", routes[i].count, "route", routes[i].path);
+  w.family("viasol_http_request_seconds", "HTTP handler time per route (summary)", "summary");
+  for (int i = 0; i < routeCount; i++) {
+    w.fixed("viasol_http_request_seconds_sum", routes[i].sumUs, 6, "route", routes[i].path);
+    w.u("viasol_http_request_seconds_count", routes[i].count, "route", routes[i].path);
+  }
+  w.family("viasol_http_request_max_seconds", "Slowest request per route", "gauge");
+  for (int i = 0; i < routeCount; i++) w.fixed("viasol_http_request_max_seconds", routes[i].maxUs, 6, "route", routes[i].path);
+}
+
+void metricsRender(MetricWriter& w) {
+  renderCore(w);
+  for (MetricCounter* c = counterHead; c; c = c->next_) {
+    w.family(c->name_, c->help_, "counter");
+    w.u(c->name_, c->value());
+  }
+  for (MetricCollector* c = collectorHead; c; c = c->next_) c->fn_(w);
+  w.flush();
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+
+// -----------------------------------------------------------------------------
+// Prometheus text exposition (/metrics).
+//
+// Counters are statically allocated MetricCounter objects. Each one links
+// itself into a list during static init, so there is nothing to register at
+// run time and no heap. Values are std::atomic<uint32_t> with relaxed
+// ordering, so any task can bump them (32-bit atomics are lock-free on
+// ESP32; wrap-around reads as a counter reset to Prometheus).
+//
+// Values that already live somewhere else (heap, Wi-Fi, rule tables) are
+// exported by MetricCollector callbacks at scrape time instead of being
+// copied into gauges.
+//
+// metricsRender() formats into a fixed stack buffer and streams it as chunks,
+// using integer/fixed-point formatting only (no printf floats, which can
+// allocate in newlib), so rendering itself allocates nothing. The transport
+// does: in chunked mode WebServer::sendContent() mallocs (and frees) a small
+// chunk-size header on every call, i.e. once per 768-byte flush, on top of
+// the String work in the response header.
+// -----------------------------------------------------------------------------
+
+class MetricWriter;
+
+class MetricCounter {
+ public:
+  MetricCounter(const char* name, const char* help);
+  void inc(uint32_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t value() const { return v_.load(std::memory_order_relaxed); }
+
+ private:
+  friend void metricsRender(MetricWriter& w);
+  const char* name_;
+  const char* help_;
+  std::atomic<uint32_t> v_{0};
+  MetricCounter* next_;
+};
+
+class MetricCollector {
+ public:
+  typedef void (*Fn)(MetricWriter& w);
+  explicit MetricCollector(Fn fn);
+
+ private:
+  friend void metricsRender(MetricWriter& w);
+  Fn fn_;
+  MetricCollector* next_;
+};
+
+// Streaming formatter handed to collectors
+class MetricWriter {
+ public:
+  typedef void (*Sink)(const char* data, size_t n);
+  explicit MetricWriter(Sink sink) : sink_(sink) {}
+  ~MetricWriter() { flush(); }
+
+  // # HELP / # TYPE lines; type is "counter" or "gauge"
+  void family(const char* name, const char* help, const char* type);
+
+  // One sample. label may be null; its value is escaped.
+  void u(const char* name, uint64_t v, const char* label = nullptr, const char* labelValue = nullptr);
+  void i(const char* name, int32_t v, const char* label = nullptr, const char* labelValue = nullptr);
+  // Fixed point: v / 10^decimals (e.g. microseconds as seconds: decimals = 6).
+  // decimals is capped at 9.
+  void fixed(const char* name, uint64_t v, uint8_t decimals, const char* label = nullptr,
+             const char* labelValue = nullptr);
+
+  void flush();
+
+ private:
+  void put(const char* s, size_t n);
+  void puts(const char* s) { put(s, strlen(s)); }
+  void start(const char* name, const char* label, const char* labelValue);
+  void end(const char* num);
+
+  Sink sink_;
+  char buf_[768];
+  size_t len_ = 0;
+};
+
+void metricsRender(MetricWriter& w);
+
+// -----------------------------------------------------------------------------
+// Loop phase timing
+// -----------------------------------------------------------------------------
+enum class LoopPhase : uint8_t { Net, Inputs, Rules, Rules2, Io, Heater, Energy, Count };
+
+// Records micros() - startUs against phase p and returns micros(), so phases
+// chain: t = metricsPhase(LoopPhase::Rules, t);
+uint32_t metricsPhase(LoopPhase p, uint32_t startUs);
+void metricsLoopDone(uint32_t loopStartUs);
+
+// -----------------------------------------------------------------------------
+// Storage writes
+// -----------------------------------------------------------------------------
+// One call per save (a settings save puts many keys in one go)
+void metricsNvsWrite(size_t bytes);
+void metricsFsWrite(size_t bytes);
+
+// -----------------------------------------------------------------------------
+// HTTP routes (slots assigned at route registration)
+// -----------------------------------------------------------------------------
+static const int METRICS_MAX_ROUTES = 48;
+
+int metricsRoute(const char* path, const char* method);   // -1 when full
+void metricsRouteDone(int slot, uint32_t startUs);
@@ -0,0 +1,232 @@
+#include "mppt.h"
+#include <math.h>
+#include <stdlib.h>
+
+namespace mppt {
+
+// Above GUARD_HI * Vmp the array is lightly loaded: always add load.
+// Below GUARD_LO * Vmp it is collapsing toward Isc: always shed load.
+static const float GUARD_HI = 1.15f;
+static const float GUARD_LO = 0.65f;
+
+// Estimates closer than this are left to P&O
+static const int JUMP_MIN_RUNGS = 2;
+
+static inline int popcount8(uint8_t v) {
+  int n = 0;
+  while (v) { v &= (uint8_t)(v - 1); n++; }
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+// ComboTable
+// -----------------------------------------------------------------------------
+void ComboTable::build(const float* ohms) {
+  avail_ = 0;
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    if (ohms[ch] > 0) avail_ |= (uint8_t)(1u << ch);
+  }
+
+  nEntries_ = 0;
+  for (int m = 0; m < MASKS; m++) {
+    float g = 0;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+      if ((m & (1 << ch)) && (avail_ & (1 << ch))) g += 1.0f / ohms[ch];
+    }
+    g_[m] = g;
+    rungOf_[m] = -1;
+    if (m & ~avail_) continue;
+    e_[nEntries_].g = g;
+    e_[nEntries_].mask = (uint8_t)m;
+    nEntries_++;
+  }
+
+  // Insertion sort: at most 256 entries, only on settings changes
+  for (int i = 1; i < nEntries_; i++) {
+    Entry x = e_[i];
+    int j = i - 1;
+    while (j >= 0 && e_[j].g > x.g) {
+      e_[j + 1] = e_[j];
+      j--;
+    }
+    e_[j + 1] = x;
+  }
+
+  nRungs_ = 0;
+  for (int i = 0; i < nEntries_; i++) {
+    float base = nRungs_ ? e_[rungStart_[nRungs_ - 1]].g : 0;
+    bool same = nRungs_ && (e_[i].g - base) <= base * RUNG_TOL;
+    if (!same) rungStart_[nRungs_++] = i;
+    rungOf_[e_[i].mask] = (int16_t)(nRungs_ - 1);
+  }
+  rungStart_[nRungs_] = nEntries_;
+}
+
+int ComboTable::lowerBound(float g) const {
+  int lo = 0, hi = nRungs_;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (rungConductance(mid) < g) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+uint8_t ComboTable::bestInRung(int r, uint8_t from) const {
+  uint8_t best = e_[rungStart_[r]].mask;
+  int bestFlips = CHANNELS + 1;
+  for (int i = rungStart_[r]; i < rungStart_[r + 1]; i++) {
+    int flips = popcount8((uint8_t)(e_[i].mask ^ from));
+    if (flips < bestFlips) {
+      best = e_[i].mask;
+      bestFlips = flips;
+    }
+  }
+  return best;
+}
+
+uint8_t ComboTable::pick(float targetG, uint8_t from) const {
+  if (!nRungs_) return 0;
+  int r = lowerBound(targetG);
+  if (r >= nRungs_) r = nRungs_ - 1;
+  else if (r > 0 && (targetG - rungConductance(r - 1)) < (rungConductance(r) - targetG)) r--;
+  return bestInRung(r, from);
+}
+
+uint8_t ComboTable::pickWatts(float targetW, float volts, uint8_t from) const {
+  if (volts <= 0 || targetW <= 0) return 0;
+  return pick(targetW / (volts * volts), from);
+}
+
+bool ComboTable::step(uint8_t from, int dir, uint8_t& out) const {
+  int r = rungOf_[from];
+  if (r < 0) r = lowerBound(g_[from]);
+  int next = r + (dir > 0 ? 1 : -1);
+  if (next < 0 || next >= nRungs_) return false;
+  out = bestInRung(next, from);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Engine
+// -----------------------------------------------------------------------------
+void Engine::configure(const Config& c) {
+  cfg_ = c;
+  rebuild();
+}
+
+void Engine::setAllowed(uint8_t allowed) {
+  if (allowed == allowed_) return;
+  allowed_ = allowed;
+  rebuild();
+}
+
+// Ladder over the fitted, allowed channels; tracking restarts from the
+// current mask minus anything that dropped out
+void Engine::rebuild() {
+  float ohms[CHANNELS];
+  for (int ch = 0; ch < CHANNELS; ch++) ohms[ch] = (allowed_ & (1u << ch)) ? cfg_.ohms[ch] : 0.0f;
+  table_.build(ohms);
+  mask_ &= table_.available();
+  haveLast_ = false;
+  hold_ = false;
+  seekPending_ = true;
+}
+
+void Engine::reset() {
+  mask_ = 0;
+  dir_ = 1;
+  haveLast_ = false;
+  lastP_ = 0;
+  hold_ = false;
+  seekPending_ = true;
+}
+
+void Engine::enterHold() {
+  hold_ = true;
+  haveHoldP_ = false;
+  held_ = 0;
+}
+
+bool Engine::jump(float estW, float estV) {
+  uint8_t target = table_.pickWatts(estW, estV, mask_);
+  int from = table_.rungOf(mask_);
+  int to = table_.rungOf(target);
+  if (abs(to - from) < JUMP_MIN_RUNGS) return false;
+
+  // P&O restarts from the new rung, heading the way the estimate moved us
+  dir_ = to > from ? 1 : -1;
+  mask_ = target;
+  haveLast_ = false;
+  hold_ = false;
+  stats_.jumps++;
+  return true;
+}
+
+uint8_t Engine::step(float pvV, float pvA, float estW, float estV) {
+  stats_.steps++;
+  if (!table_.available()) return mask_ = 0;
+
+  float p = pvV * pvA;
+
+  float dP = haveLast_ ? fabsf(p - lastP_) : 0;
+  bool bigChange = dP > cfg_.deadbandW && dP > cfg_.jumpFrac * (p > lastP_ ? p : lastP_);
+  if ((seekPending_ || bigChange) && estW > 0 && estV > 0) {
+    seekPending_ = false;
+    if (jump(estW, estV)) return mask_;
+  }
+
+  bool guard = false;
+  bool settle = false;  // hold after this step's move
+
+  if (cfg_.vmpV > 0 && pvV > cfg_.vmpV * GUARD_HI) {
+    dir_ = 1;
+    guard = true;
+  } else if (cfg_.vmpV > 0 && pvV < cfg_.vmpV * GUARD_LO) {
+    dir_ = -1;
+    guard = true;
+  } else if (hold_) {
+    if (!haveHoldP_) {
+      holdP_ = p;
+      haveHoldP_ = true;
+    }
+    bool drift = fabsf(p - holdP_) > cfg_.deadbandW;
+    if (!drift && ++held_ < cfg_.reprobeSteps) {
+      stats_.holdSteps++;
+      lastP_ = p;
+      return mask_;
+    }
+    // Probe toward Vmp when we know where it is, else keep the last direction
+    if (cfg_.vmpV > 0) dir_ = pvV > cfg_.vmpV ? 1 : -1;
+    stats_.probes++;
+  } else if (haveLast_ && p < lastP_ - cfg_.deadbandW) {
+    // Last move lost power: the previous rung was the better one
+    dir_ = (int8_t)-dir_;
+    stats_.reversals++;
+    settle = true;
+  } else if (haveLast_ && p <= lastP_ + cfg_.deadbandW) {
+    // Flat: nothing to gain by moving on
+    enterHold();
+    stats_.holdSteps++;
+    lastP_ = p;
+    return mask_;
+  }
+
+  lastP_ = p;
+  haveLast_ = true;
+  hold_ = false;
+
+  if (guard) stats_.guardSteps++;
+
+  uint8_t next;
+  if (table_.step(mask_, dir_, next)) {
+    mask_ = next;
+    if (settle) enterHold();
+  } else if (!guard) {
+    // End of the ladder: nowhere further to go in this direction
+    enterHold();
+  }
+  return mask_;
+}
+
+} // namespace mppt
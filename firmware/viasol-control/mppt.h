@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Perturb-and-observe stepping over the 8 heater channels.
+//
+// The PV array feeds resistive elements directly, so the operating point is
+// where the array I-V curve meets the load line I = G*V. Switching channels
+// moves G; each step() moves one notch up or down the conductance ladder of
+// all channel combinations and keeps going while power rises.
+//
+// Once a move stops paying (power flat within the deadband, a loss that
+// sends it back to the previous rung, or the end of the ladder) the engine
+// holds the mask. It probes again when power drifts from the held value by
+// more than the deadband or after reprobeSteps steps, whichever is first.
+// The voltage guard band overrides a hold.
+//
+// Walking the ladder one rung per step is slow after a reset or a sudden
+// change in sun. When the caller passes an estimate of the current MPP
+// (from the PV model), the engine jumps straight to the rung nearest it on
+// the first loaded step and whenever power moves by more than jumpFrac
+// between steps; P&O then fine-tunes from there.
+//
+// Channels the caller can't switch (the safety interlock) are left out of
+// the ladder like unfitted ones, so P&O only scores masks that are really
+// applied.
+//
+// The ladder is precomputed (ComboTable) whenever the element resistances
+// or the allowed channels change, so a step is a table lookup: fixed cost, no allocation, same answer
+// for the same inputs. Pure C++ so it runs against a simulated curve on the
+// host (tools/mppt-sim).
+// -----------------------------------------------------------------------------
+
+namespace mppt {
+
+static const int CHANNELS = 8;
+static const int MASKS = 1 << CHANNELS;
+
+// -----------------------------------------------------------------------------
+// All channel combinations sorted by conductance.
+//
+// Combinations within RUNG_TOL of each other form one rung (e.g. the 8 ways
+// to switch on one of 8 identical elements); picking within a rung prefers
+// the mask that flips the fewest channels from the current one.
+// -----------------------------------------------------------------------------
+static const float RUNG_TOL = 0.01f;  // relative
+
+class ComboTable {
+ public:
+  // ohms[ch] <= 0 marks a channel as not fitted.
+  void build(const float* ohms);
+
+  uint8_t available() const { return avail_; }
+  float conductance(uint8_t mask) const { return g_[mask]; }
+  float watts(uint8_t mask, float volts) const { return g_[mask] * volts * volts; }
+
+  int rungs() const { return nRungs_; }
+  float rungConductance(int r) const { return e_[rungStart_[r]].g; }
+  int rungOf(uint8_t mask) const { return rungOf_[mask]; }
+
+  // First rung with conductance >= g (binary search); rungs() if none.
+  int lowerBound(float g) const;
+
+  // Mask whose conductance is nearest to targetG, fewest flips from `from`.
+  uint8_t pick(float targetG, uint8_t from) const;
+  // Mask dissipating closest to targetW at the given array voltage.
+  uint8_t pickWatts(float targetW, float volts, uint8_t from) const;
+
+  // Next rung up (dir > 0) or down; returns false at the end of the ladder.
+  bool step(uint8_t from, int dir, uint8_t& out) const;
+
+ private:
+  struct Entry {
+    float g;
+    uint8_t mask;
+  };
+
+  uint8_t bestInRung(int r, uint8_t from) const;
+
+  Entry e_[MASKS];
+  int nEntries_ = 0;
+  float g_[MASKS] = {};
+  uint8_t avail_ = 0;
+
+  int rungStart_[MASKS + 1] = {};
+  int nRungs_ = 0;
+  int16_t rungOf_[MASKS] = {};  // -1 for masks using unfitted channels
+};
+
+struct Config {
+  float ohms[CHANNELS] = {};  // <= 0: channel not fitted
+  float vmpV = 0;             // array Vmp (Ns * panel Vmp)
+  float vocV = 0;             // array Voc
+  float impA = 0;             // array Imp (Np * panel Imp)
+  float deadbandW = 2.0f;     // power changes below this count as "no change"
+  uint16_t reprobeSteps = 120; // steps spent holding before probing again
+  float jumpFrac = 0.25f;     // step-to-step power change that re-seeks the estimate
+};
+
+struct Stats {
+  uint32_t steps = 0;
+  uint32_t reversals = 0;
+  uint32_t guardSteps = 0;    // steps forced by the voltage guard band
+  uint32_t holdSteps = 0;     // steps that kept the mask
+  uint32_t probes = 0;        // holds ended by drift or the reprobe timer
+  uint32_t jumps = 0;         // coarse moves to the estimated MPP
+};
+
+class Engine {
+ public:
+  // Recomputes the per-mask conductances. Channels that are no longer
+  // fitted drop out of the current mask.
+  void configure(const Config& c);
+  void reset();
+
+  // Channels that may be switched on. A change rebuilds the ladder, drops
+  // the removed channels from the current mask and re-seeks. Cheap when
+  // unchanged, so callers can pass the interlock mask every step.
+  void setAllowed(uint8_t allowed);
+
+  // One control step from the array voltage/current measured with the
+  // current mask applied. estW/estV is the estimated MPP for the present
+  // sun (0 if unknown). Returns the mask to apply next.
+  uint8_t step(float pvV, float pvA, float estW = 0, float estV = 0);
+
+  uint8_t mask() const { return mask_; }
+  bool holding() const { return hold_; }
+  uint8_t available() const { return table_.available(); }   // fitted and allowed
+  float conductance(uint8_t m) const { return table_.conductance(m); }
+  const ComboTable& table() const { return table_; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  Config cfg_;
+  ComboTable table_;
+  uint8_t allowed_ = 0xFF;
+
+  uint8_t mask_ = 0;
+  int8_t dir_ = 1;        // +1: more load (lower voltage)
+  bool haveLast_ = false;
+  float lastP_ = 0;
+  bool hold_ = false;
+  bool haveHoldP_ = false; // holdP_ is taken on the first step of a hold
+  float holdP_ = 0;
+  uint16_t held_ = 0;
+  bool seekPending_ = true;  // jump on the first step with an estimate
+  Stats stats_;
+
+  void rebuild();
+  void enterHold();
+  bool jump(float estW, float estV);
+};
+
+} // namespace mppt
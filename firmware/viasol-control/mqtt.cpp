@@ -0,0 +1,458 @@
+#include "mqtt.h"
+#include "metrics.h"
+#include "io_catalog.h"
+#include <WiFi.h>
+#include <mqtt_client.h>
+#include <atomic>
+
+// -----------------------------------------------------------------------------
+// Limits
+// -----------------------------------------------------------------------------
+static const uint32_t BACKOFF_MIN_MS = 1000;
+static const uint32_t BACKOFF_MAX_MS = 60000;
+static const int OUTBOX_MAX_BYTES = 8192;   // skip a flush while the socket is behind
+static const int MAX_PER_FLUSH = 16;        // unbatched messages per tick
+static const float REG_MAX_ABS = 1e9f;      // larger register payloads are rejected
+
+// -----------------------------------------------------------------------------
+// Topic slots (coalescing queue)
+// -----------------------------------------------------------------------------
+struct TopicSlot {
+  char sub[40];
+  char payload[24];
+  bool used;
+  bool dirty;
+};
+
+static TopicSlot slots[MQTT_MAX_TOPICS];
+static int nextFlushSlot = 0;
+
+// -----------------------------------------------------------------------------
+// Client state. Strings are copied here because esp-mqtt keeps the pointers.
+// -----------------------------------------------------------------------------
+static char host[64];
+static char user[64];
+static char pass[64];
+static char base[48];
+static char clientId[32];
+static char lwtTopic[72];
+static uint16_t port = 1883;
+static uint32_t pubMs = 5000;
+static bool batch = false;
+
+static esp_mqtt_client_handle_t client = nullptr;
+static bool started = false;
+
+// Written by the esp-mqtt task, read by mqttTick()
+static volatile bool connected = false;
+static volatile bool lostConnection = false;
+static volatile bool justConnected = false;
+
+static uint32_t backoffMs = BACKOFF_MIN_MS;
+static uint32_t nextAttemptMs = 0;
+static bool retryPending = false;
+static uint32_t lastFlushMs = 0;
+
+static MqttStats stats;
+
+// -----------------------------------------------------------------------------
+// Virtual input registers
+// -----------------------------------------------------------------------------
+struct MqttReg {
+  std::atomic<uint32_t> seq{0};    // odd while a write is in progress
+  std::atomic<uint32_t> bits{0};   // float bit pattern
+  std::atomic<uint32_t> stampMs{0};
+  std::atomic<bool> valid{false};
+  char topic[64];
+  uint16_t topicLen = 0;
+  uint32_t maxAgeMs = 60000;
+};
+
+static MqttReg regs[MQTT_MAX_REGS];
+static int nRegs = 0;
+
+static void regWrite(MqttReg& r, float v, uint32_t nowMs) {
+  uint32_t b;
+  memcpy(&b, &v, sizeof(b));
+  uint32_t s = r.seq.load(std::memory_order_relaxed);
+  r.seq.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  r.bits.store(b, std::memory_order_relaxed);
+  r.stampMs.store(nowMs, std::memory_order_relaxed);
+  r.seq.store(s + 2, std::memory_order_release);
+  r.valid.store(true, std::memory_order_release);
+}
+
+static bool regSnapshot(const MqttReg& r, float& v, uint32_t& stamp) {
+  if (!r.valid.load(std::memory_order_acquire)) return false;
+  // Single writer with a handful of stores: a retry is rare and short. Bail
+  // out rather than spin if the writer was preempted mid-update.
+  for (int tries = 0; tries < 16; tries++) {
+    uint32_t s1 = r.seq.load(std::memory_order_acquire);
+    if (s1 & 1) continue;
+    uint32_t b = r.bits.load(std::memory_order_relaxed);
+    stamp = r.stampMs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (r.seq.load(std::memory_order_relaxed) == s1) {
+      memcpy(&v, &b, sizeof(v));
+      return true;
+    }
+  }
+  return false;
+}
+
+// A number (surrounding spaces allowed) or on/off/true/false. Anything
+// else, "12abc", nan/inf or past REG_MAX_ABS, is rejected and the register
+// keeps aging toward stale.
+static bool parsePayload(const char* data, int len, float& out) {
+  char buf[32];
+  if (len <= 0 || len >= (int)sizeof(buf)) return false;
+  memcpy(buf, data, len);
+  buf[len] = 0;
+
+  if (!strcasecmp(buf, "on") || !strcasecmp(buf, "true"))  { out = 1.0f; return true; }
+  if (!strcasecmp(buf, "off") || !strcasecmp(buf, "false")) { out = 0.0f; return true; }
+
+  char* end = nullptr;
+  float v = strtof(buf, &end);
+  if (end == buf) return false;
+  while (isspace((unsigned char)*end)) end++;
+  if (*end || !isfinite(v) || fabsf(v) > REG_MAX_ABS) return false;
+  out = v;
+  return true;
+}
+
+// Runs in the client task
+static void onRegData(const esp_mqtt_event_t* ev) {
+  // Fragmented (oversized) payloads are not register values
+  if (ev->current_data_offset != 0 || ev->data_len != ev->total_data_len) return;
+
+  for (int i = 0; i < nRegs; i++) {
+    MqttReg& r = regs[i];
+    if (r.topicLen != ev->topic_len || memcmp(r.topic, ev->topic, ev->topic_len) != 0) continue;
+    float v;
+    if (parsePayload(ev->data, ev->data_len, v)) regWrite(r, v, millis());
+    return;
+  }
+}
+
+static void subscribeRegs(esp_mqtt_client_handle_t c) {
+  for (int i = 0; i < nRegs; i++) esp_mqtt_client_subscribe(c, regs[i].topic, 0);
+}
+
+static void copyStr(char* dst, size_t n, const String& src) {
+  strncpy(dst, src.c_str(), n - 1);
+  dst[n - 1] = 0;
+}
+
+static void buildTopic(char* out, size_t n, const char* sub) {
+  snprintf(out, n, "%s/%s", base, sub);
+}
+
+// -----------------------------------------------------------------------------
+// esp-mqtt callbacks (run in the client task: flags and register writes only)
+// -----------------------------------------------------------------------------
+static void onMqttEvent(void* arg, esp_event_base_t b, int32_t id, void* data) {
+  (void)arg; (void)b;
+  esp_mqtt_event_handle_t ev = (esp_mqtt_event_handle_t)data;
+  switch ((esp_mqtt_event_id_t)id) {
+    case MQTT_EVENT_CONNECTED:
+      subscribeRegs(ev->client);
+      connected = true;
+      justConnected = true;
+      break;
+    case MQTT_EVENT_DATA:
+      onRegData(ev);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      connected = false;
+      lostConnection = true;
+      break;
+    default:
+      break;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Config
+// -----------------------------------------------------------------------------
+static void fillConfig(esp_mqtt_client_config_t& mc) {
+  mc = esp_mqtt_client_config_t{};
+#if ESP_IDF_VERSION_MAJOR >= 5
+  mc.broker.address.hostname = host;
+  mc.broker.address.port = port;
+  mc.broker.address.transport = MQTT_TRANSPORT_OVER_TCP;
+  mc.credentials.client_id = clientId;
+  if (user[0]) mc.credentials.username = user;
+  if (pass[0]) mc.credentials.authentication.password = pass;
+  mc.session.last_will.topic = lwtTopic;
+  mc.session.last_will.msg = "offline";
+  mc.session.last_will.retain = 1;
+  mc.network.disable_auto_reconnect = true;
+  mc.network.timeout_ms = 5000;
+#else
+  mc.host = host;
+  mc.port = port;
+  mc.client_id = clientId;
+  if (user[0]) mc.username = user;
+  if (pass[0]) mc.password = pass;
+  mc.lwt_topic = lwtTopic;
+  mc.lwt_msg = "offline";
+  mc.lwt_retain = 1;
+  mc.disable_auto_reconnect = true;
+  mc.network_timeout_ms = 5000;
+#endif
+}
+
+void mqttBegin(const Settings& cfg) {
+  copyStr(host, sizeof(host), cfg.mqtt_host);
+  copyStr(user, sizeof(user), cfg.mqtt_user);
+  copyStr(pass, sizeof(pass), cfg.mqtt_pass);
+  copyStr(base, sizeof(base), cfg.mqtt_base);
+  port = (uint16_t)cfg.mqtt_port;
+  pubMs = cfg.mqtt_pub_ms;
+  batch = cfg.mqtt_batch;
+
+  uint32_t low = (uint32_t)(ESP.getEfuseMac() & 0xFFFFFFFF);
+  snprintf(clientId, sizeof(clientId), "viasol-%08X", (unsigned)low);
+  buildTopic(lwtTopic, sizeof(lwtTopic), "status");
+
+  backoffMs = BACKOFF_MIN_MS;
+  nextAttemptMs = millis();
+
+  if (!client) return;  // created lazily in mqttTick() once Wi-Fi is up
+  if (!host[0]) {
+    esp_mqtt_client_disconnect(client);
+    return;
+  }
+
+  esp_mqtt_client_config_t mc;
+  fillConfig(mc);
+  esp_mqtt_set_config(client, &mc);
+
+  // New settings take effect on the next (re)connect
+  if (connected) esp_mqtt_client_disconnect(client);
+  else retryPending = true;
+}
+
+// -----------------------------------------------------------------------------
+// Queue
+// -----------------------------------------------------------------------------
+bool mqttPublishStr(const char* subtopic, const char* payload) {
+  int freeSlot = -1;
+  for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
+    if (!slots[i].used) {
+      if (freeSlot < 0) freeSlot = i;
+      continue;
+    }
+    if (strcmp(slots[i].sub, subtopic) == 0) {
+      if (slots[i].dirty) stats.coalesced++;
+      strncpy(slots[i].payload, payload, sizeof(slots[i].payload) - 1);
+      slots[i].dirty = true;
+      return true;
+    }
+  }
+
+  if (freeSlot < 0) {
+    stats.dropped++;
+    return false;
+  }
+
+  TopicSlot& s = slots[freeSlot];
+  strncpy(s.sub, subtopic, sizeof(s.sub) - 1);
+  s.sub[sizeof(s.sub) - 1] = 0;
+  strncpy(s.payload, payload, sizeof(s.payload) - 1);
+  s.payload[sizeof(s.payload) - 1] = 0;
+  s.used = true;
+  s.dirty = true;
+  return true;
+}
+
+bool mqttPublish(const char* subtopic, float value) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%.3f", value);
+  return mqttPublishStr(subtopic, buf);
+}
+
+// -----------------------------------------------------------------------------
+// Flush
+// -----------------------------------------------------------------------------
+// From this pass's snapshot. A stale or missing input goes out as
+// "stale"/"missing" rather than the 0 it reads live.
+static void queueInputs() {
+  char sub[40];
+  for (int i = 0; i < N_INPUTS; i++) {
+    snprintf(sub, sizeof(sub), "in/%s", INPUT_KEYS[i]);
+    const InputSample& s = inputSample(i);
+    if (s.q == Quality::Good) mqttPublish(sub, s.value);
+    else mqttPublishStr(sub, qualityName(s.q));
+  }
+}
+
+static void flushBatch() {
+  static char json[2048];
+  size_t n = 0;
+  bool any = false;
+
+  json[n++] = '{';
+  for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
+    TopicSlot& s = slots[i];
+    if (!s.used || !s.dirty) continue;
+
+    // Numbers go out bare, anything else quoted
+    char* end = nullptr;
+    strtod(s.payload, &end);
+    bool numeric = (end && *end == 0 && s.payload[0]);
+    int w = snprintf(json + n, sizeof(json) - n, numeric ? "%s\"%s\":%s" : "%s\"%s\":\"%s\"",
+                     any ? "," : "", s.sub, s.payload);
+    if (w < 0 || (size_t)w >= sizeof(json) - n - 1) break;  // rest waits for the next flush
+    n += (size_t)w;
+    s.dirty = false;
+    any = true;
+  }
+  if (!any) return;
+  json[n++] = '}';
+
+  char topic[72];
+  buildTopic(topic, sizeof(topic), "state");
+  if (esp_mqtt_client_enqueue(client, topic, json, (int)n, 0, 0, true) >= 0) stats.published++;
+}
+
+static void flushEach() {
+  char topic[96];
+  int sent = 0;
+  for (int k = 0; k < MQTT_MAX_TOPICS && sent < MAX_PER_FLUSH; k++) {
+    int i = (nextFlushSlot + k) % MQTT_MAX_TOPICS;
+    TopicSlot& s = slots[i];
+    if (!s.used || !s.dirty) continue;
+
+    buildTopic(topic, sizeof(topic), s.sub);
+    if (esp_mqtt_client_enqueue(client, topic, s.payload, 0, 0, 0, true) < 0) break;
+    s.dirty = false;
+    stats.published++;
+    sent++;
+    nextFlushSlot = (i + 1) % MQTT_MAX_TOPICS;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Tick
+// -----------------------------------------------------------------------------
+void mqttTick() {
+  if (!host[0]) return;
+  uint32_t now = millis();
+
+  if (justConnected) {
+    justConnected = false;
+    stats.connects++;
+    backoffMs = BACKOFF_MIN_MS;
+    esp_mqtt_client_enqueue(client, lwtTopic, "online", 0, 0, 1, true);
+  }
+
+  if (lostConnection) {
+    lostConnection = false;
+    stats.disconnects++;
+    retryPending = true;
+    nextAttemptMs = now + backoffMs;
+    backoffMs = (backoffMs * 2 > BACKOFF_MAX_MS) ? BACKOFF_MAX_MS : backoffMs * 2;
+  }
+  stats.backoffMs = backoffMs;
+
+  if (!connected) {
+    if (WiFi.status() != WL_CONNECTED) return;
+    if ((int32_t)(now - nextAttemptMs) < 0) return;
+
+    if (!client) {
+      esp_mqtt_client_config_t mc;
+      fillConfig(mc);
+      client = esp_mqtt_client_init(&mc);
+      if (!client) return;
+      esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, onMqttEvent, nullptr);
+    }
+
+    if (!started) {
+      started = (esp_mqtt_client_start(client) == ESP_OK);
+      retryPending = false;
+    } else if (retryPending) {
+      esp_mqtt_client_reconnect(client);
+      retryPending = false;
+    }
+    // Attempt outcome arrives via onMqttEvent; hold off until the backoff expires
+    nextAttemptMs = now + backoffMs;
+    return;
+  }
+
+  if (now - lastFlushMs < pubMs) return;
+  lastFlushMs = now;
+
+  queueInputs();
+
+  if (esp_mqtt_client_get_outbox_size(client) > OUTBOX_MAX_BYTES) {
+    stats.deferred++;
+    return;
+  }
+
+  if (batch) flushBatch();
+  else flushEach();
+}
+
+bool mqttConnected() {
+  return connected;
+}
+
+const MqttStats& mqttStats() {
+  return stats;
+}
+
+// -----------------------------------------------------------------------------
+// Register API
+// -----------------------------------------------------------------------------
+void mqttRegsBegin(const Settings& cfg) {
+  nRegs = (cfg.mqtt_nregs > MQTT_MAX_REGS) ? MQTT_MAX_REGS : cfg.mqtt_nregs;
+  for (int i = 0; i < nRegs; i++) {
+    MqttReg& r = regs[i];
+    if (cfg.mqtt_reg_topic[i].length()) {
+      snprintf(r.topic, sizeof(r.topic), "%s", cfg.mqtt_reg_topic[i].c_str());
+    } else {
+      snprintf(r.topic, sizeof(r.topic), "%s/reg/mqtt%d", cfg.mqtt_base.c_str(), i + 1);
+    }
+    r.topicLen = (uint16_t)strlen(r.topic);
+    r.maxAgeMs = cfg.mqtt_reg_maxage_s[i] * 1000UL;
+  }
+}
+
+int mqttRegCount() {
+  return nRegs;
+}
+
+const char* mqttRegTopic(int reg) {
+  if (reg < 0 || reg >= nRegs) return "";
+  return regs[reg].topic;
+}
+
+bool mqttRegPeek(int reg, float& value, uint32_t& ageMs) {
+  ageMs = UINT32_MAX;
+  if (reg < 0 || reg >= nRegs) return false;
+  uint32_t stamp;
+  if (!regSnapshot(regs[reg], value, stamp)) return false;
+  ageMs = millis() - stamp;
+  return true;
+}
+
+bool mqttRegRead(int reg, float& value) {
+  uint32_t age;
+  if (!mqttRegPeek(reg, value, age)) return false;
+  return age <= regs[reg].maxAgeMs;
+}
+
+static void collectMetrics(MetricWriter& w) {
+  w.family("viasol_mqtt_connected", "Broker session up", "gauge");
+  w.u("viasol_mqtt_connected", mqttConnected() ? 1 : 0);
+  w.family("viasol_mqtt_published_total", "Messages handed to the client outbox", "counter");
+  w.u("viasol_mqtt_published_total", stats.published);
+  w.family("viasol_mqtt_dropped_total", "Updates rejected because the table was full", "counter");
+  w.u("viasol_mqtt_dropped_total", stats.dropped);
+  w.family("viasol_mqtt_disconnects_total", "Broker disconnects", "counter");
+  w.u("viasol_mqtt_disconnects_total", stats.disconnects);
+}
+static MetricCollector metricsCollector(collectMetrics);
@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Non-blocking MQTT publisher.
+//
+// The transport is the ESP-IDF esp-mqtt client, which runs in its own task;
+// nothing here waits on the network. Values go into a bounded table of
+// topic slots: publishing the same topic again only overwrites the pending
+// value, and mqttTick() flushes dirty slots once per cfg.mqtt_pub_ms.
+// -----------------------------------------------------------------------------
+
+static const int MQTT_MAX_TOPICS = 48;
+
+struct MqttStats {
+  uint32_t connects = 0;
+  uint32_t disconnects = 0;
+  uint32_t published = 0;   // messages handed to the client outbox
+  uint32_t coalesced = 0;   // updates that replaced an unsent value
+  uint32_t dropped = 0;     // updates rejected because the table was full
+  uint32_t deferred = 0;    // flushes skipped because the outbox was backed up
+  uint32_t backoffMs = 0;
+};
+
+// (Re)apply broker settings. Safe to call again after settings are saved.
+void mqttBegin(const Settings& cfg);
+void mqttTick();
+
+bool mqttConnected();
+const MqttStats& mqttStats();
+
+// Queue <base>/<subtopic> for the next flush. Returns false when the topic
+// table is full.
+bool mqttPublish(const char* subtopic, float value);
+bool mqttPublishStr(const char* subtopic, const char* payload);
+
+// -----------------------------------------------------------------------------
+// Virtual input registers (mqtt1..mqttN)
+// Each register is fed by one subscribed topic. The esp-mqtt task is the only
+// writer and readers take a sequence-locked snapshot, so neither side ever
+// waits on the other. Call once at boot, before mqttBegin().
+// -----------------------------------------------------------------------------
+void mqttRegsBegin(const Settings& cfg);
+int mqttRegCount();
+const char* mqttRegTopic(int reg);
+
+// Latest value, only if it arrived within the register's max age.
+bool mqttRegRead(int reg, float& value);
+
+// Latest value regardless of age. ageMs is UINT32_MAX if nothing has
+// arrived yet (and the call returns false).
+bool mqttRegPeek(int reg, float& value, uint32_t& ageMs);
@@ -0,0 +1,389 @@
+#include "ow_temps.h"
+#include "metrics.h"
+#include "app.h"
+#include "io_catalog.h"
+#include "pins.h"
+#include "heater.h"
+#include "rs485.h"
+
+#include <OneWire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const uint32_t PERIOD_MS = 2000;
+static const uint32_t CONVERT_MS = 760;     // 12-bit conversion
+static const uint32_t RESCAN_MS = 600000;   // while a sensor is missing
+static const int READ_TRIES = 3;
+static const int MISSING_CYCLES = 5;
+static const uint32_t STALE_MS = PERIOD_MS * 3;   // catalog quality goes Stale
+static const int16_t POWER_ON_RAW = 0x0550; // 85.0 C, scratchpad default
+
+// Heater board sensors, REG_CH_TEMP0.. in 0.01 C ("temps" poll group, 5 s).
+// Anything outside the DS18B20 range means the board or sensor is absent.
+static const int EL_CHANNELS = 8;
+static const uint32_t EL_STALE_MS = 15000;
+static const int16_t EL_MIN_CENTI = -5500;
+static const int16_t EL_MAX_CENTI = 12500;
+static const char* EL_TEMP_KEYS[EL_CHANNELS] = {
+  "el1_temp_c", "el2_temp_c", "el3_temp_c", "el4_temp_c",
+  "el5_temp_c", "el6_temp_c", "el7_temp_c", "el8_temp_c"
+};
+
+// Started in owBegin(), and only for buses whose pin is confirmed
+static OneWire buses[OW_BUSES];
+
+static bool busWired(int b) {
+  return b >= 0 && b < OW_BUSES && PIN_OW[b] != PIN_UNSET;
+}
+
+// Shared between the task and the loop, guarded by owMux
+static portMUX_TYPE owMux = portMUX_INITIALIZER_UNLOCKED;
+static OwSensor sensors[OW_MAX_SENSORS];
+static int nSensors = 0;
+static uint8_t tankRomBytes[8];   // resolved by owTick()
+static bool haveTankRom = false;
+static volatile bool rescanWanted = false;
+static volatile bool cacheDirty = false;
+
+// Task only
+static uint8_t failRun[OW_MAX_SENSORS];
+static bool seenValid[OW_MAX_SENSORS];
+
+// Loop only. Catalog keys must outlive rescans, so they get their own
+// append-only storage.
+static char keyStore[OW_MAX_SENSORS][16];
+static int nKeys = 0;
+static int tankIdx = -1, floorIdx = -1;
+static int elIdx[EL_CHANNELS];
+static uint8_t tankWant[8], floorWant[8];  // configured ROMs, if set
+static bool haveTankWant = false, haveFloorWant = false;
+
+String owRomHex(const uint8_t rom[8]) {
+  char s[17];
+  for (int i = 0; i < 8; i++) snprintf(s + i * 2, 3, "%02X", rom[i]);
+  return String(s);
+}
+
+static void makeKey(OwSensor& s) {
+  // Serial bytes only: family code and CRC add nothing
+  snprintf(s.key, sizeof(s.key), "ow_%02x%02x%02x%02x%02x%02x",
+           s.rom[6], s.rom[5], s.rom[4], s.rom[3], s.rom[2], s.rom[1]);
+}
+
+static int snapshot(OwSensor* snap) {
+  portENTER_CRITICAL(&owMux);
+  int n = nSensors;
+  memcpy(snap, sensors, sizeof(OwSensor) * n);
+  portEXIT_CRITICAL(&owMux);
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+// ROM cache
+// -----------------------------------------------------------------------------
+struct CachedRom {
+  uint8_t bus;
+  uint8_t rom[8];
+};
+
+static void saveCache() {
+  CachedRom c[OW_MAX_SENSORS];
+  int n;
+  portENTER_CRITICAL(&owMux);
+  n = nSensors;
+  for (int i = 0; i < n; i++) {
+    c[i].bus = sensors[i].bus;
+    memcpy(c[i].rom, sensors[i].rom, 8);
+  }
+  cacheDirty = false;
+  portEXIT_CRITICAL(&owMux);
+  metricsNvsWrite(app.prefs.putBytes("ow_roms", c, (size_t)n * sizeof(CachedRom)));
+}
+
+static int loadCache() {
+  CachedRom c[OW_MAX_SENSORS];
+  size_t len = app.prefs.getBytes("ow_roms", c, sizeof(c));
+  int n = 0;
+  for (int i = 0; i < (int)(len / sizeof(CachedRom)); i++) {
+    if (!busWired(c[i].bus)) continue;
+    OwSensor& s = sensors[n++];
+    memset(&s, 0, sizeof(s));
+    s.bus = c[i].bus;
+    memcpy(s.rom, c[i].rom, 8);
+    makeKey(s);
+  }
+  return n;
+}
+
+// Search every bus; runs in the task (or once at boot before it starts)
+static void searchAll() {
+  OwSensor found[OW_MAX_SENSORS];
+  int n = 0;
+  for (int b = 0; b < OW_BUSES; b++) {
+    if (!busWired(b)) continue;
+    int onBus = 0;
+    uint8_t rom[8];
+    buses[b].reset_search();
+    while (onBus < OW_MAX_PER_BUS && buses[b].search(rom)) {
+      if (OneWire::crc8(rom, 7) != rom[7] || rom[0] != 0x28) continue;  // DS18B20 only
+      OwSensor& s = found[n++];
+      memset(&s, 0, sizeof(s));
+      s.bus = (uint8_t)b;
+      memcpy(s.rom, rom, 8);
+      makeKey(s);
+      onBus++;
+    }
+  }
+
+  portENTER_CRITICAL(&owMux);
+  // Keep readings for sensors we already knew
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < nSensors; k++) {
+      if (memcmp(found[i].rom, sensors[k].rom, 8) == 0) {
+        uint8_t bus = found[i].bus;
+        found[i] = sensors[k];
+        found[i].bus = bus;
+        break;
+      }
+    }
+  }
+  bool changed = (n != nSensors);
+  for (int i = 0; i < n && !changed; i++) changed = memcmp(found[i].rom, sensors[i].rom, 8) != 0;
+  memcpy(sensors, found, sizeof(OwSensor) * n);
+  nSensors = n;
+  if (changed) cacheDirty = true;
+  portEXIT_CRITICAL(&owMux);
+
+  memset(failRun, 0, sizeof(failRun));
+  memset(seenValid, 0, sizeof(seenValid));
+}
+
+// -----------------------------------------------------------------------------
+// Task
+// -----------------------------------------------------------------------------
+static bool readScratch(OneWire& ow, const uint8_t rom[8], int16_t& raw, uint32_t& crcErrors) {
+  for (int t = 0; t < READ_TRIES; t++) {
+    uint8_t d[9];
+    if (!ow.reset()) return false;  // nothing answering on the bus
+    ow.select(rom);
+    ow.write(0xBE);
+    ow.read_bytes(d, 9);
+    if (OneWire::crc8(d, 8) == d[8]) {
+      raw = (int16_t)((d[1] << 8) | d[0]);
+      return true;
+    }
+    crcErrors++;
+  }
+  return false;
+}
+
+static void owTask(void*) {
+  uint32_t lastScan = millis();
+  TickType_t wake = xTaskGetTickCount();
+
+  for (;;) {
+    if (rescanWanted) {
+      rescanWanted = false;
+      lastScan = millis();
+      searchAll();
+    }
+
+    OwSensor snap[OW_MAX_SENSORS];
+    int n = snapshot(snap);
+
+    // Start a conversion on every populated bus at once (skip ROM)
+    bool busUsed[OW_BUSES] = {};
+    for (int i = 0; i < n; i++) busUsed[snap[i].bus] = true;
+    for (int b = 0; b < OW_BUSES; b++) {
+      if (!busUsed[b] || !buses[b].reset()) continue;
+      buses[b].skip();
+      buses[b].write(0x44);
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(CONVERT_MS));
+
+    bool missing = false;
+    for (int i = 0; i < n; i++) {
+      int16_t raw;
+      bool ok = readScratch(buses[snap[i].bus], snap[i].rom, raw, snap[i].crcErrors);
+      // The power-on value is only trusted once we have seen a real reading
+      if (ok && raw == POWER_ON_RAW && !seenValid[i]) ok = false;
+      if (ok) {
+        seenValid[i] = true;
+        failRun[i] = 0;
+        snap[i].tempC = raw / 16.0f;
+        snap[i].lastOkMs = millis();
+      } else if (failRun[i] < 255 && ++failRun[i] >= MISSING_CYCLES) {
+        missing = true;
+      }
+      snap[i].ok = ok;
+    }
+
+    portENTER_CRITICAL(&owMux);
+    for (int i = 0; i < n && i < nSensors; i++) {
+      if (memcmp(sensors[i].rom, snap[i].rom, 8) == 0) sensors[i] = snap[i];
+    }
+    portEXIT_CRITICAL(&owMux);
+
+    if (missing && (millis() - lastScan) >= RESCAN_MS) rescanWanted = true;
+
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(PERIOD_MS));
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Public
+// -----------------------------------------------------------------------------
+// Catalog index per snapshot slot, registering sensors seen for the first
+// time. The catalog never shrinks, so once it is full registration stops
+// (and is logged once); the key slot is only kept when it registered.
+static bool catalogFull = false;
+
+static void catalogIndices(const OwSensor* snap, int n, int* out) {
+  for (int i = 0; i < n; i++) {
+    int idx = inputIndexByKey(snap[i].key);
+    if (idx < 0 && !catalogFull && nKeys < OW_MAX_SENSORS) {
+      strlcpy(keyStore[nKeys], snap[i].key, sizeof(keyStore[nKeys]));
+      idx = ioRegisterInput(keyStore[nKeys]);
+      if (idx >= 0) {
+        nKeys++;
+        ioSetInputMaxAge(idx, STALE_MS);
+      } else {
+        catalogFull = true;
+        Serial.printf("[ow] catalog full, %s and later sensors not published\n", snap[i].key);
+      }
+    }
+    out[i] = idx;
+  }
+}
+
+// 16 hex digits, as shown by owRomHex()
+static bool parseRom(const String& hex, uint8_t rom[8]) {
+  if (hex.length() != 16) return false;
+  const char* s = hex.c_str();
+  for (int i = 0; i < 8; i++) {
+    char pair[3] = { s[i * 2], s[i * 2 + 1], 0 };
+    char* end = nullptr;
+    rom[i] = (uint8_t)strtoul(pair, &end, 16);
+    if (end != pair + 2) return false;
+  }
+  return true;
+}
+
+void owApplySettings(const Settings& cfg) {
+  haveTankWant = parseRom(cfg.ow_tank_rom, tankWant);
+  haveFloorWant = parseRom(cfg.ow_floor_rom, floorWant);
+}
+
+void owBegin(const Settings& cfg) {
+  owApplySettings(cfg);
+  tankIdx = inputIndexByKey("tank_temp_c");
+  floorIdx = inputIndexByKey("floor_temp_c");
+  ioSetInputMaxAge(tankIdx, STALE_MS);
+  ioSetInputMaxAge(floorIdx, STALE_MS);
+  for (int ch = 0; ch < EL_CHANNELS; ch++) {
+    elIdx[ch] = ioRegisterInput(EL_TEMP_KEYS[ch]);
+    ioSetInputMaxAge(elIdx[ch], EL_STALE_MS);
+  }
+
+  int wired = 0;
+  for (int b = 0; b < OW_BUSES; b++) {
+    if (!busWired(b)) continue;
+    buses[b].begin((uint8_t)PIN_OW[b]);
+    wired++;
+  }
+  if (!wired) {
+    Serial.println("[ow] pins not confirmed (pins.h), buses disabled");
+    return;
+  }
+
+  nSensors = loadCache();
+  if (nSensors == 0) {
+    searchAll();
+    if (cacheDirty) saveCache();
+  }
+  OwSensor snap[OW_MAX_SENSORS];
+  int idx[OW_MAX_SENSORS];
+  catalogIndices(snap, snapshot(snap), idx);
+  Serial.printf("[ow] %d sensor(s)\n", nSensors);
+
+  xTaskCreatePinnedToCore(owTask, "ow", 4096, nullptr, 2, nullptr, 1);
+}
+
+void owTick() {
+  static uint32_t lastPub = 0;
+  uint32_t now = millis();
+  if (now - lastPub < 500) return;
+  lastPub = now;
+
+  if (cacheDirty) saveCache();
+
+  OwSensor snap[OW_MAX_SENSORS];
+  int idx[OW_MAX_SENSORS];
+  int n = snapshot(snap);
+  catalogIndices(snap, n, idx);
+
+  // Default assignment: first sensor on bus 1 is the tank, on bus 2 the floor
+  int tank = -1, floor = -1;
+  for (int i = 0; i < n; i++) {
+    const uint8_t* rom = snap[i].rom;
+    if (haveTankWant ? memcmp(rom, tankWant, 8) == 0 : (tank < 0 && snap[i].bus == 0)) tank = i;
+    if (haveFloorWant ? memcmp(rom, floorWant, 8) == 0 : (floor < 0 && snap[i].bus == 1)) floor = i;
+  }
+
+  portENTER_CRITICAL(&owMux);
+  haveTankRom = tank >= 0;
+  if (haveTankRom) memcpy(tankRomBytes, snap[tank].rom, 8);
+  portEXIT_CRITICAL(&owMux);
+
+  for (int i = 0; i < n; i++) {
+    if (!snap[i].ok) continue;
+    if (idx[i] >= 0) ioPublishInput(idx[i], snap[i].tempC);
+    if (i == tank) ioPublishInput(tankIdx, snap[i].tempC);
+    if (i == floor) ioPublishInput(floorIdx, snap[i].tempC);
+  }
+
+  if (rs485Online(HEATER_REMOTE)) {
+    int16_t centi[EL_CHANNELS];
+    rs485Regs(HEATER_REMOTE, rs485::REG_CH_TEMP0, EL_CHANNELS, centi);
+    for (int ch = 0; ch < EL_CHANNELS; ch++) {
+      if (centi[ch] < EL_MIN_CENTI || centi[ch] > EL_MAX_CENTI) continue;
+      ioPublishInput(elIdx[ch], centi[ch] * 0.01f);
+    }
+  }
+}
+
+int owSensorCount() {
+  return nSensors;
+}
+
+bool owSensor(int i, OwSensor& out) {
+  bool ok = false;
+  portENTER_CRITICAL(&owMux);
+  if (i >= 0 && i < nSensors) {
+    out = sensors[i];
+    ok = true;
+  }
+  portEXIT_CRITICAL(&owMux);
+  return ok;
+}
+
+bool owTankTemp(float& tempC, uint32_t& ageMs) {
+  bool found = false;
+  uint32_t lastOk = 0;
+  portENTER_CRITICAL(&owMux);
+  for (int i = 0; haveTankRom && i < nSensors; i++) {
+    if (memcmp(sensors[i].rom, tankRomBytes, 8) != 0) continue;
+    found = sensors[i].lastOkMs != 0;
+    tempC = sensors[i].tempC;
+    lastOk = sensors[i].lastOkMs;
+    break;
+  }
+  portEXIT_CRITICAL(&owMux);
+  if (found) ageMs = millis() - lastOk;
+  return found;
+}
+
+void owRequestRescan() {
+  rescanWanted = true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// DS18B20 temperatures on the master's 4 OneWire headers.
+//
+// A background task starts a conversion on every bus at once, sleeps through
+// the conversion time and then reads each cached ROM (retrying on CRC
+// errors). Bus searches only happen at first boot, when a sensor goes
+// missing, or on request; the ROM list is kept in NVS.
+//
+// owTick() publishes into the catalog: every sensor as ow_<serial>, plus the
+// assigned tank and floor sensors as tank_temp_c / floor_temp_c.
+// Heater board sensors hang off the remote board and arrive over RS-485;
+// owTick() publishes them too, as el1_temp_c..el8_temp_c.
+// -----------------------------------------------------------------------------
+
+static const int OW_BUSES = 4;
+static const int OW_MAX_PER_BUS = 8;
+static const int OW_MAX_SENSORS = OW_BUSES * OW_MAX_PER_BUS;
+
+struct OwSensor {
+  uint8_t rom[8];
+  uint8_t bus;
+  char key[16];           // "ow_" + 12 hex digits of the serial
+  float tempC;
+  bool ok;                // last read succeeded
+  uint32_t lastOkMs;
+  uint32_t crcErrors;
+};
+
+void owBegin(const Settings& cfg);
+void owApplySettings(const Settings& cfg);  // tank/floor assignment
+void owTick();
+
+int owSensorCount();
+bool owSensor(int i, OwSensor& out);
+
+// Latest good reading of the assigned tank sensor, straight from the sensor
+// table (safe from any task; doesn't depend on owTick() running).
+bool owTankTemp(float& tempC, uint32_t& ageMs);
+void owRequestRescan();
+
+String owRomHex(const uint8_t rom[8]);
@@ -0,0 +1,32 @@
+#pragma once
+
+// -----------------------------------------------------------------------------
+// Master control board pin map (ESP32-S3)
+//
+// The GPIO numbers below have not been checked against the schematic yet
+// (docs/02. esp32 pins.md is still empty). Until they are, every pin reads
+// PIN_UNSET and the drivers leave it alone: the RS-485 UART is not
+// installed, OneWire buses are not searched and the master relays are
+// never driven. Build with -DVIASOL_PINS_CONFIRMED once docs/02 has been
+// filled in and the numbers match it.
+// -----------------------------------------------------------------------------
+
+static const int PIN_UNSET = -1;
+
+#ifdef VIASOL_PINS_CONFIRMED
+#define VIASOL_PIN(gpio) (gpio)
+#else
+#define VIASOL_PIN(gpio) PIN_UNSET
+#endif
+
+// RS-485 to the remote comm boards (via ISO7741). DE is driven by the UART
+// in RS-485 half-duplex mode (RTS line).
+static const int PIN_RS485_TX = VIASOL_PIN(17);
+static const int PIN_RS485_RX = VIASOL_PIN(18);
+static const int PIN_RS485_DE = VIASOL_PIN(8);
+
+// OneWire headers (DS18B20), one bus each
+static const int PIN_OW[4] = { VIASOL_PIN(38), VIASOL_PIN(39), VIASOL_PIN(40), VIASOL_PIN(41) };
+
+// Master relay drivers (m_relay1, m_relay2), active high
+static const int PIN_M_RELAY[2] = { VIASOL_PIN(9), VIASOL_PIN(10) };
@@ -0,0 +1,65 @@
+#include "pv_model.h"
+#include <math.h>
+
+static const float ISC_OVER_IMP = 1.08f;
+
+// Below this fraction of Isc a measurement says little about irradiance
+static const float MIN_INFO_FRAC = 0.05f;
+
+PvModel& pvModel() {
+  static PvModel m;
+  return m;
+}
+
+void PvModel::build(float vmp, float voc, float imp) {
+  valid_ = false;
+  if (!(vmp > 0) || !(imp > 0) || !(voc > vmp)) return;
+
+  voc_ = voc;
+  isc_ = imp * ISC_OVER_IMP;
+  double c2 = ((double)vmp / voc - 1.0) / log(1.0 - (double)imp / isc_);
+  double c1 = (1.0 - (double)imp / isc_) * exp(-(double)vmp / (c2 * voc));
+
+  double step = (double)voc / (POINTS - 1);
+  invStep_ = (float)(1.0 / step);
+  for (int k = 0; k < POINTS; k++) {
+    double v = k * step;
+    double i = isc_ * (1.0 - c1 * (exp(v / (c2 * voc)) - 1.0));
+    amps_[k] = (float)(i > 0 ? i : 0);
+  }
+  amps_[POINTS - 1] = 0;
+
+  // Golden-section search on the continuous model for the MPP
+  double a = 0, b = voc;
+  const double gr = 0.6180339887498949;
+  auto p = [&](double v) { return v * isc_ * (1.0 - c1 * (exp(v / (c2 * voc)) - 1.0)); };
+  for (int it = 0; it < 40; it++) {
+    double x1 = b - gr * (b - a);
+    double x2 = a + gr * (b - a);
+    if (p(x1) < p(x2)) a = x1; else b = x2;
+  }
+  mppV_ = (float)(0.5 * (a + b));
+  mppW_ = (float)p(mppV_);
+  valid_ = true;
+}
+
+float PvModel::currentAt(float v) const {
+  if (!valid_) return 0;
+  if (v <= 0) return amps_[0];
+  float x = v * invStep_;
+  int k = (int)x;
+  if (k >= POINTS - 1) return 0;
+  float f = x - (float)k;
+  return amps_[k] + (amps_[k + 1] - amps_[k]) * f;
+}
+
+float PvModel::powerAt(float v) const {
+  return v > 0 ? v * currentAt(v) : 0;
+}
+
+float PvModel::sunFraction(float v, float i) const {
+  float ref = currentAt(v);
+  if (ref < isc_ * MIN_INFO_FRAC || i <= 0) return 0;
+  float s = i / ref;
+  return s > 1.5f ? 1.5f : s;
+}
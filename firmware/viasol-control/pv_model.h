@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// PV array I-V model as a lookup table.
+//
+// Built from the PV model settings whenever they are validated, using the
+// explicit single-exponential fit
+//     I(V) = Isc * (1 - C1 * (exp(V / (C2 * Voc)) - 1)),  Isc ~= 1.08 * Imp
+// which passes through (0, Isc), (Vmp, Imp) and (Voc, 0). Queries are a
+// linear interpolation between table points: no transcendental math per tick.
+//
+// Current scales with irradiance while Vmp barely moves, so a measured
+// operating point gives the sun fraction and from it the power available.
+// -----------------------------------------------------------------------------
+
+class PvModel {
+ public:
+  static const int POINTS = 65;  // 0..Voc inclusive
+
+  // Array values (Ns/Np already applied).
+  void build(float vmp, float voc, float imp);
+  bool valid() const { return valid_; }
+
+  float currentAt(float v) const;  // full sun
+  float powerAt(float v) const;    // full sun
+
+  float mppV() const { return mppV_; }
+  float mppW() const { return mppW_; }
+  float voc() const { return voc_; }
+  float isc() const { return isc_; }
+
+  // Irradiance fraction implied by a measured operating point (0 if the
+  // point carries no information, e.g. open circuit).
+  float sunFraction(float v, float i) const;
+  // Expected power at voltage v for a given sun fraction.
+  float expectedPower(float v, float sun) const { return powerAt(v) * sun; }
+
+ private:
+  bool valid_ = false;
+  float voc_ = 0;
+  float isc_ = 0;
+  float invStep_ = 0;
+  float mppV_ = 0;
+  float mppW_ = 0;
+  float amps_[POINTS] = {};
+};
+
+PvModel& pvModel();
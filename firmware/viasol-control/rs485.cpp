@@ -0,0 +1,234 @@
+#include "rs485.h"
+#include "pins.h"
+#include "metrics.h"
+
+#include <driver/uart.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+static const uart_port_t RS485_UART = UART_NUM_1;
+static const int RX_BUF = 512;
+static const uint32_t ONLINE_MAX_AGE_US = 1000000;
+static const uint32_t TURNAROUND_US = 300;
+
+static const uint32_t LOAD_LOG_MS = 60000;
+
+static rs485::Scheduler* bus = nullptr;
+static portMUX_TYPE busMux = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t uartQueue = nullptr;
+static uint8_t onlineMask = 0;  // loop side, for logging transitions
+
+static inline uint32_t nowUs() { return (uint32_t)esp_timer_get_time(); }
+
+// -----------------------------------------------------------------------------
+// Bus task
+// -----------------------------------------------------------------------------
+static void rs485Task(void*) {
+  uint8_t tx[rs485::MAX_FRAME];
+  uint8_t rx[128];
+
+  for (;;) {
+    size_t len = 0;
+    portENTER_CRITICAL(&busMux);
+    bool send = bus->nextTx(nowUs(), tx, len);
+    portEXIT_CRITICAL(&busMux);
+
+    if (send) {
+      // Drop leftovers from a late response; the UART drives DE itself
+      uart_flush_input(RS485_UART);
+      xQueueReset(uartQueue);
+      uart_write_bytes(RS485_UART, tx, len);
+
+      // Encode the following request while this one is on the wire
+      portENTER_CRITICAL(&busMux);
+      bus->prefetch(nowUs());
+      portEXIT_CRITICAL(&busMux);
+    }
+
+    uart_event_t ev;
+    if (xQueueReceive(uartQueue, &ev, pdMS_TO_TICKS(1)) == pdTRUE) {
+      if (ev.type == UART_DATA) {
+        size_t n = ev.size < sizeof(rx) ? ev.size : sizeof(rx);
+        int got = uart_read_bytes(RS485_UART, rx, n, 0);
+        if (got > 0) {
+          portENTER_CRITICAL(&busMux);
+          bus->onRx(rx, (size_t)got, nowUs());
+          portEXIT_CRITICAL(&busMux);
+        }
+      } else if (ev.type == UART_FIFO_OVF || ev.type == UART_BUFFER_FULL) {
+        uart_flush_input(RS485_UART);
+        xQueueReset(uartQueue);
+      }
+    }
+
+    portENTER_CRITICAL(&busMux);
+    bus->tick(nowUs());
+    bool idle = !bus->inFlight() && bus->remotes() == 0;
+    portEXIT_CRITICAL(&busMux);
+
+    if (idle) vTaskDelay(pdMS_TO_TICKS(100));
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Public
+// -----------------------------------------------------------------------------
+void rs485Begin(const Settings& cfg) {
+  if (bus) return;  // UART and task are set up once per boot
+
+  if (PIN_RS485_TX == PIN_UNSET || PIN_RS485_RX == PIN_UNSET || PIN_RS485_DE == PIN_UNSET) {
+    Serial.println("[rs485] pins not confirmed (pins.h), bus disabled");
+    return;
+  }
+
+  bus = new rs485::Scheduler(cfg.rs485_baud);
+  bus->addDefaultGroups();
+  bus->setRemotes((uint8_t)((1u << cfg.rs485_remotes) - 1));
+  bus->setTurnaroundUs(TURNAROUND_US);
+
+  uart_config_t uc = {};
+  uc.baud_rate = (int)cfg.rs485_baud;
+  uc.data_bits = UART_DATA_8_BITS;
+  uc.parity = UART_PARITY_DISABLE;
+  uc.stop_bits = UART_STOP_BITS_1;
+  uc.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  uc.source_clk = UART_SCLK_DEFAULT;
+#else
+  uc.source_clk = UART_SCLK_APB;
+#endif
+
+  uart_driver_install(RS485_UART, RX_BUF, 0, 16, &uartQueue, 0);
+  uart_param_config(RS485_UART, &uc);
+  uart_set_pin(RS485_UART, PIN_RS485_TX, PIN_RS485_RX, PIN_RS485_DE, UART_PIN_NO_CHANGE);
+  uart_set_mode(RS485_UART, UART_MODE_RS485_HALF_DUPLEX);
+  // Wake on 3 idle symbols rather than waiting for the FIFO threshold
+  uart_set_rx_timeout(RS485_UART, 3);
+
+  xTaskCreatePinnedToCore(rs485Task, "rs485", 4096, nullptr, 5, nullptr, 1);
+
+  Serial.printf("[rs485] %u baud, %d remote(s), demand %u.%u%%\n",
+                (unsigned)cfg.rs485_baud, cfg.rs485_remotes,
+                (unsigned)(bus->demandPermille() / 10), (unsigned)(bus->demandPermille() % 10));
+}
+
+void rs485Tick() {
+  if (!bus) return;
+
+  static uint32_t lastCheck = 0;
+  uint32_t now = millis();
+  if (now - lastCheck < 500) return;
+  lastCheck = now;
+
+  for (uint8_t a = 1; a <= rs485::MAX_REMOTES; a++) {
+    uint8_t bit = (uint8_t)(1u << (a - 1));
+    if (!(bus->remotes() & bit)) continue;
+    bool on = rs485Online(a);
+    if (on == ((onlineMask & bit) != 0)) continue;
+    onlineMask = on ? (onlineMask | bit) : (onlineMask & ~bit);
+    Serial.printf("[rs485] remote %u %s\n", (unsigned)a, on ? "online" : "offline");
+  }
+
+  static uint32_t lastLoadLog = 0;
+  if (now - lastLoadLog >= LOAD_LOG_MS) {
+    lastLoadLog = now;
+    uint16_t util, demand;
+    rs485BusLoad(util, demand);
+    Serial.printf("[rs485] bus util %u.%u%% (demand %u.%u%%)\n",
+                  (unsigned)(util / 10), (unsigned)(util % 10),
+                  (unsigned)(demand / 10), (unsigned)(demand % 10));
+  }
+}
+
+bool rs485Online(uint8_t addr) {
+  if (!bus) return false;
+  portENTER_CRITICAL(&busMux);
+  bool on = bus->online(addr, nowUs(), ONLINE_MAX_AGE_US);
+  portEXIT_CRITICAL(&busMux);
+  return on;
+}
+
+int16_t rs485Reg(uint8_t addr, uint16_t reg) {
+  if (!bus) return 0;
+  portENTER_CRITICAL(&busMux);
+  int16_t v = bus->reg(addr, reg);
+  portEXIT_CRITICAL(&busMux);
+  return v;
+}
+
+void rs485Regs(uint8_t addr, uint16_t start, uint16_t count, int16_t* out) {
+  if (!bus) {
+    for (uint16_t i = 0; i < count; i++) out[i] = 0;
+    return;
+  }
+  portENTER_CRITICAL(&busMux);
+  for (uint16_t i = 0; i < count; i++) out[i] = bus->reg(addr, start + i);
+  portEXIT_CRITICAL(&busMux);
+}
+
+void rs485Write(uint8_t addr, uint16_t reg, int16_t value) {
+  if (!bus) return;
+  portENTER_CRITICAL(&busMux);
+  bus->write(addr, reg, value);
+  portEXIT_CRITICAL(&busMux);
+}
+
+bool rs485RemoteStats(uint8_t addr, rs485::RemoteStats& out) {
+  if (!bus || addr < 1 || addr > rs485::MAX_REMOTES) return false;
+  portENTER_CRITICAL(&busMux);
+  out = bus->remoteStats(addr);
+  portEXIT_CRITICAL(&busMux);
+  return true;
+}
+
+rs485::MasterStats rs485BusStats() {
+  rs485::MasterStats s;
+  if (!bus) return s;
+  portENTER_CRITICAL(&busMux);
+  s = bus->stats();
+  portEXIT_CRITICAL(&busMux);
+  return s;
+}
+
+void rs485BusLoad(uint16_t& utilPermille, uint16_t& demandPermille) {
+  utilPermille = demandPermille = 0;
+  if (!bus) return;
+  portENTER_CRITICAL(&busMux);
+  utilPermille = bus->utilPermille();
+  demandPermille = bus->demandPermille();
+  portEXIT_CRITICAL(&busMux);
+}
+
+static void collectMetrics(MetricWriter& w) {
+  rs485::MasterStats m = rs485BusStats();
+  w.family("viasol_rs485_tx_bytes_total", "RS-485 bytes sent", "counter");
+  w.u("viasol_rs485_tx_bytes_total", m.txBytes);
+  w.family("viasol_rs485_rx_bytes_total", "RS-485 bytes received", "counter");
+  w.u("viasol_rs485_rx_bytes_total", m.rxBytes);
+  w.family("viasol_rs485_crc_errors_total", "RS-485 frames with a bad CRC", "counter");
+  w.u("viasol_rs485_crc_errors_total", m.crcErrors);
+
+  uint16_t util, demand;
+  rs485BusLoad(util, demand);
+  w.family("viasol_rs485_utilization_permille", "Bus line utilization over the last second", "gauge");
+  w.u("viasol_rs485_utilization_permille", util);
+
+  char addr[4];
+  w.family("viasol_rs485_timeouts_total", "Unanswered requests per remote", "counter");
+  for (uint8_t a = 1; a <= rs485::MAX_REMOTES; a++) {
+    rs485::RemoteStats r;
+    if (!rs485RemoteStats(a, r) || !r.txns) continue;
+    snprintf(addr, sizeof(addr), "%u", (unsigned)a);
+    w.u("viasol_rs485_timeouts_total", r.timeouts, "remote", addr);
+  }
+  w.family("viasol_rs485_online", "Remote answered within the last second", "gauge");
+  for (uint8_t a = 1; a <= rs485::MAX_REMOTES; a++) {
+    rs485::RemoteStats r;
+    if (!rs485RemoteStats(a, r) || !r.txns) continue;
+    snprintf(addr, sizeof(addr), "%u", (unsigned)a);
+    w.u("viasol_rs485_online", rs485Online(a) ? 1 : 0, "remote", addr);
+  }
+}
+static MetricCollector metricsCollector(collectMetrics);
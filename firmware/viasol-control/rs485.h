@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+#include "rs485_sched.h"
+
+// -----------------------------------------------------------------------------
+// RS-485 bus master (ESP32 side).
+//
+// The protocol state machine lives in rs485_proto and the per-group polling
+// rates in rs485_sched; this file owns the UART
+// and a dedicated task that keeps the bus busy: the next request is encoded
+// while the current response is still arriving and goes out as soon as it
+// completes. The loop only reads the register mirror and queues writes.
+// -----------------------------------------------------------------------------
+
+void rs485Begin(const Settings& cfg);
+void rs485Tick();  // logs remotes going on/offline and bus load
+
+bool rs485Online(uint8_t addr);
+int16_t rs485Reg(uint8_t addr, uint16_t reg);
+// Copies count registers in one critical section, so values polled in the
+// same frame are never mixed with an older frame.
+void rs485Regs(uint8_t addr, uint16_t start, uint16_t count, int16_t* out);
+
+// Coalesced: only the latest value per register is sent.
+void rs485Write(uint8_t addr, uint16_t reg, int16_t value);
+
+bool rs485RemoteStats(uint8_t addr, rs485::RemoteStats& out);
+rs485::MasterStats rs485BusStats();
+
+// Line utilization over the last second and configured demand (1/1000).
+void rs485BusLoad(uint16_t& utilPermille, uint16_t& demandPermille);
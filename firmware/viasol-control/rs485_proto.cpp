@@ -0,0 +1,433 @@
+#include "rs485_proto.h"
+#include <string.h>
+
+namespace rs485 {
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+uint16_t crc16(const uint8_t* data, size_t n, uint16_t crc) {
+  for (size_t i = 0; i < n; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+    }
+  }
+  return crc;
+}
+
+static inline void putU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t wireTimeUs(size_t bytes, uint32_t baud) {
+  if (baud == 0) return 0;
+  return (uint32_t)(((uint64_t)bytes * 10u * 1000000u + baud - 1) / baud);
+}
+
+// -----------------------------------------------------------------------------
+// Frames
+// -----------------------------------------------------------------------------
+size_t encodeFrame(const Frame& f, uint8_t* out, size_t cap) {
+  size_t n = (size_t)f.len + FRAME_OVERHEAD;
+  if (f.len > MAX_PAYLOAD || cap < n) return 0;
+
+  out[0] = SYNC;
+  out[1] = f.addr;
+  out[2] = f.seq;
+  out[3] = f.func;
+  out[4] = f.len;
+  memcpy(out + 5, f.payload, f.len);
+  putU16(out + 5 + f.len, crc16(out + 1, 4 + f.len));
+  return n;
+}
+
+// States: 0 sync, 1 addr, 2 seq, 3 func, 4 len, 5 payload, 6 crc lo, 7 crc hi
+bool Decoder::feed(uint8_t b) {
+  switch (state_) {
+    case 0:
+      if (b == SYNC) {
+        crc_ = 0xFFFF;
+        state_ = 1;
+      }
+      return false;
+
+    case 1: f_.addr = b; break;
+    case 2: f_.seq = b; break;
+    case 3: f_.func = b; break;
+
+    case 4:
+      if (b > MAX_PAYLOAD) {
+        lenErrors++;
+        state_ = 0;
+        return false;
+      }
+      f_.len = b;
+      pos_ = 0;
+      crc_ = crc16(&b, 1, crc_);
+      state_ = (b == 0) ? 6 : 5;
+      return false;
+
+    case 5:
+      f_.payload[pos_++] = b;
+      crc_ = crc16(&b, 1, crc_);
+      if (pos_ >= f_.len) state_ = 6;
+      return false;
+
+    case 6:
+      pos_ = b;  // crc low byte
+      state_ = 7;
+      return false;
+
+    case 7: {
+      uint16_t rx = (uint16_t)(pos_ | (b << 8));
+      state_ = 0;
+      if (rx != crc_) {
+        crcErrors++;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  // header bytes 1..3
+  crc_ = crc16(&b, 1, crc_);
+  state_++;
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// Request builder
+// -----------------------------------------------------------------------------
+void XferBuilder::begin(uint8_t addr, uint8_t seq) {
+  f_.addr = addr;
+  f_.seq = seq;
+  f_.func = FN_XFER;
+  f_.len = 0;
+  wlen_ = 0;
+  nw_ = 0;
+  nr_ = 0;
+}
+
+size_t XferBuilder::freeBytes() const {
+  // 2 count bytes + write section + 3 bytes per read range
+  size_t used = 2 + wlen_ + (size_t)nr_ * 3;
+  return (used >= (size_t)MAX_PAYLOAD) ? 0 : MAX_PAYLOAD - used;
+}
+
+size_t XferBuilder::responseLen() const {
+  size_t n = 1;
+  for (int i = 0; i < nr_; i++) n += (size_t)reads_[i].count * 2;
+  return n;
+}
+
+bool XferBuilder::addWrite(uint16_t start, uint8_t count, const int16_t* values) {
+  size_t need = 3 + (size_t)count * 2;
+  if (count == 0 || nw_ >= MAX_RANGES || freeBytes() < need) return false;
+
+  uint8_t* p = wbuf_ + wlen_;
+  putU16(p, start);
+  p[2] = count;
+  for (int i = 0; i < count; i++) putU16(p + 3 + i * 2, (uint16_t)values[i]);
+  wlen_ += (uint8_t)need;
+  nw_++;
+  return true;
+}
+
+bool XferBuilder::addRead(uint16_t start, uint8_t count) {
+  if (count == 0 || nr_ >= MAX_RANGES || freeBytes() < 3) return false;
+  // The response has to fit as well
+  if (responseLen() + (size_t)count * 2 > (size_t)MAX_PAYLOAD) return false;
+  reads_[nr_].start = start;
+  reads_[nr_].count = count;
+  nr_++;
+  return true;
+}
+
+const Frame& XferBuilder::finish() {
+  uint8_t* p = f_.payload;
+  size_t n = 0;
+  p[n++] = nw_;
+  memcpy(p + n, wbuf_, wlen_);
+  n += wlen_;
+  p[n++] = nr_;
+  for (int i = 0; i < nr_; i++) {
+    putU16(p + n, reads_[i].start);
+    p[n + 2] = reads_[i].count;
+    n += 3;
+  }
+  f_.len = (uint8_t)n;
+  return f_;
+}
+
+// -----------------------------------------------------------------------------
+// Remote side
+// -----------------------------------------------------------------------------
+static void errorResponse(const Frame& req, uint8_t addr, uint8_t status, Frame& resp) {
+  resp.addr = addr;
+  resp.seq = req.seq;
+  resp.func = FN_ERROR | FN_RESP;
+  resp.len = 2;
+  resp.payload[0] = req.func;
+  resp.payload[1] = status;
+}
+
+bool Slave::handle(const Frame& req, Frame& resp) {
+  if (req.addr != addr_ || (req.func & FN_RESP)) return false;
+
+  if (req.func != FN_XFER) {
+    errorResponse(req, addr_, ST_BAD_FUNC, resp);
+    return true;
+  }
+
+  const uint8_t* p = req.payload;
+  size_t len = req.len;
+  size_t pos = 0;
+
+  // Validate the whole request before touching any register
+  if (pos >= len) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+  uint8_t nw = p[pos++];
+  size_t writesAt = pos;
+  for (int i = 0; i < nw; i++) {
+    if (pos + 3 > len) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+    uint16_t start = getU16(p + pos);
+    uint8_t count = p[pos + 2];
+    if (start + count > n_) { errorResponse(req, addr_, ST_BAD_REG, resp); return true; }
+    if (start < REG_WRITABLE_FIRST) { errorResponse(req, addr_, ST_READ_ONLY, resp); return true; }
+    pos += 3 + (size_t)count * 2;
+    if (pos > len) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+  }
+
+  if (pos >= len) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+  uint8_t nr = p[pos++];
+  size_t readsAt = pos;
+  size_t respLen = 1;
+  for (int i = 0; i < nr; i++) {
+    if (pos + 3 > len) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+    uint16_t start = getU16(p + pos);
+    uint8_t count = p[pos + 2];
+    if (start + count > n_) { errorResponse(req, addr_, ST_BAD_REG, resp); return true; }
+    respLen += (size_t)count * 2;
+    pos += 3;
+  }
+  if (respLen > (size_t)MAX_PAYLOAD) { errorResponse(req, addr_, ST_BAD_LEN, resp); return true; }
+
+  // Apply writes
+  pos = writesAt;
+  for (int i = 0; i < nw; i++) {
+    uint16_t start = getU16(p + pos);
+    uint8_t count = p[pos + 2];
+    for (int k = 0; k < count; k++) regs_[start + k] = (int16_t)getU16(p + pos + 3 + k * 2);
+    writes += count;
+    pos += 3 + (size_t)count * 2;
+  }
+
+  // Gather reads
+  resp.addr = addr_;
+  resp.seq = req.seq;
+  resp.func = FN_XFER | FN_RESP;
+  resp.payload[0] = ST_OK;
+  size_t out = 1;
+  pos = readsAt;
+  for (int i = 0; i < nr; i++) {
+    uint16_t start = getU16(p + pos);
+    uint8_t count = p[pos + 2];
+    for (int k = 0; k < count; k++) {
+      putU16(resp.payload + out, (uint16_t)regs_[start + k]);
+      out += 2;
+    }
+    pos += 3;
+  }
+  resp.len = (uint8_t)out;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Master side
+// -----------------------------------------------------------------------------
+static const int WRITABLE = REG_COUNT - REG_WRITABLE_FIRST;
+
+void Master::write(uint8_t addr, uint16_t reg, int16_t value) {
+  if (addr < 1 || addr > MAX_REMOTES) return;
+  if (reg < REG_WRITABLE_FIRST || reg >= REG_COUNT) return;
+  int a = addr - 1;
+  int w = reg - REG_WRITABLE_FIRST;
+  wval_[a][w] = value;
+  wdirty_[a][w >> 5] |= (1u << (w & 31));
+}
+
+bool Master::hasPendingWrites(uint8_t addr) const {
+  int a = idx(addr);
+  for (size_t i = 0; i < sizeof(wdirty_[0]) / sizeof(wdirty_[0][0]); i++) {
+    if (wdirty_[a][i]) return true;
+  }
+  return false;
+}
+
+int Master::addPendingWrites(XferBuilder& b, uint8_t addr) {
+  int a = idx(addr);
+  int added = 0;
+  int w = 0;
+  while (w < WRITABLE) {
+    if (!(wdirty_[a][w >> 5] & (1u << (w & 31)))) { w++; continue; }
+
+    // Coalesce a run of consecutive dirty registers into one range
+    int start = w;
+    while (w < WRITABLE && (wdirty_[a][w >> 5] & (1u << (w & 31))) && (w - start) < 32) w++;
+    int count = w - start;
+
+    if (!b.addWrite((uint16_t)(REG_WRITABLE_FIRST + start), (uint8_t)count, &wval_[a][start])) break;
+    for (int k = start; k < start + count; k++) {
+      wdirty_[a][k >> 5] &= ~(1u << (k & 31));
+      nextWsent_[k >> 5] |= (1u << (k & 31));
+    }
+    added += count;
+  }
+  return added;
+}
+
+bool Master::plan(XferBuilder& b, uint8_t& addr, uint32_t nowUs) {
+  (void)nowUs;
+  if (!remotes_) return false;
+
+  // Next remote in the mask, round robin
+  for (int k = 0; k < MAX_REMOTES; k++) {
+    rr_ = (uint8_t)((rr_ + 1) % MAX_REMOTES);
+    if (remotes_ & (1u << rr_)) break;
+  }
+  addr = (uint8_t)(rr_ + 1);
+
+  addPendingWrites(b, addr);
+  b.addRead(REG_FW_VERSION, 3);
+  b.addRead(REG_PV_V, 2);
+  b.addRead(REG_CH_A0, 8);
+  b.addRead(REG_CH_TEMP0, 8);
+  b.addRead(REG_LEAK, 1);
+  b.addRead(REG_HEATER_MASK, 3);
+  return true;
+}
+
+void Master::prefetch(uint32_t nowUs) {
+  if (nextReady_) return;
+
+  memset(nextWsent_, 0, sizeof(nextWsent_));
+  uint8_t addr = 0;
+  next_.begin(0, ++seq_);
+  if (!plan(next_, addr, nowUs)) return;
+
+  next_.setAddr(addr);
+  nextLen_ = encodeFrame(next_.finish(), nextBuf_, sizeof(nextBuf_));
+  if (!nextLen_) return;
+  nextAddr_ = addr;
+  nextReady_ = true;
+}
+
+bool Master::nextTx(uint32_t nowUs, uint8_t* out, size_t& len) {
+  if (inFlight_) return false;
+  if (!nextReady_) prefetch(nowUs);
+  if (!nextReady_) return false;
+
+  memcpy(out, nextBuf_, nextLen_);
+  len = nextLen_;
+
+  cur_ = next_;
+  curAddr_ = nextAddr_;
+  curSeq_ = cur_.seq();
+  memcpy(wsent_, nextWsent_, sizeof(wsent_));
+  nextReady_ = false;
+
+  uint32_t respBytes = (uint32_t)cur_.responseLen() + FRAME_OVERHEAD;
+  sentUs_ = nowUs;
+  deadlineUs_ = nowUs + wireTimeUs(len, baud_) + turnaroundUs_ + wireTimeUs(respBytes, baud_) + 2000;
+  inFlight_ = true;
+
+  rstats_[idx(curAddr_)].txns++;
+  stats_.txBytes += (uint32_t)len;
+  return true;
+}
+
+void Master::finishTxn(bool ok, uint32_t nowUs) {
+  RemoteStats& rs = rstats_[idx(curAddr_)];
+  if (ok) {
+    uint32_t rtt = nowUs - sentUs_;
+    rs.ok++;
+    rs.lastOkUs = nowUs;
+    if (rs.rttMinUs == 0 || rtt < rs.rttMinUs) rs.rttMinUs = rtt;
+    if (rtt > rs.rttMaxUs) rs.rttMaxUs = rtt;
+    rs.rttAvgUs = rs.rttAvgUs ? rs.rttAvgUs + (int32_t)(rtt - rs.rttAvgUs) / 8 : rtt;
+  } else {
+    // Writes that did not get acked go out again with their latest value
+    int a = idx(curAddr_);
+    for (size_t i = 0; i < sizeof(wsent_) / sizeof(wsent_[0]); i++) wdirty_[a][i] |= wsent_[i];
+  }
+  inFlight_ = false;
+  completed(cur_, ok, nowUs);
+}
+
+void Master::applyResponse(const Frame& f, uint32_t nowUs) {
+  if (f.func == (FN_ERROR | FN_RESP)) {
+    rstats_[idx(curAddr_)].errors++;
+    finishTxn(false, nowUs);
+    return;
+  }
+
+  if (f.len != cur_.responseLen() || f.payload[0] != ST_OK) {
+    rstats_[idx(curAddr_)].errors++;
+    finishTxn(false, nowUs);
+    return;
+  }
+
+  int a = idx(curAddr_);
+  size_t pos = 1;
+  for (int i = 0; i < cur_.nReads(); i++) {
+    const Range& r = cur_.read(i);
+    for (int k = 0; k < r.count; k++) {
+      uint16_t reg = (uint16_t)(r.start + k);
+      if (reg < REG_COUNT) mirror_[a][reg] = (int16_t)getU16(f.payload + pos);
+      pos += 2;
+    }
+  }
+  finishTxn(true, nowUs);
+}
+
+void Master::onRx(const uint8_t* data, size_t n, uint32_t nowUs) {
+  stats_.rxBytes += (uint32_t)n;
+  for (size_t i = 0; i < n; i++) {
+    if (!dec_.feed(data[i])) continue;
+
+    const Frame& f = dec_.frame();
+    if (!inFlight_ || !(f.func & FN_RESP) || f.addr != curAddr_ || f.seq != curSeq_) {
+      stats_.lateFrames++;
+      continue;
+    }
+    applyResponse(f, nowUs);
+  }
+  stats_.crcErrors = dec_.crcErrors;
+}
+
+void Master::tick(uint32_t nowUs) {
+  if (!inFlight_) return;
+  if ((int32_t)(nowUs - deadlineUs_) < 0) return;
+
+  rstats_[idx(curAddr_)].timeouts++;
+  dec_.reset();
+  finishTxn(false, nowUs);
+}
+
+int16_t Master::reg(uint8_t addr, uint16_t r) const {
+  if (addr < 1 || addr > MAX_REMOTES || r >= REG_COUNT) return 0;
+  return mirror_[addr - 1][r];
+}
+
+bool Master::online(uint8_t addr, uint32_t nowUs, uint32_t maxAgeUs) const {
+  if (addr < 1 || addr > MAX_REMOTES) return false;
+  const RemoteStats& rs = rstats_[addr - 1];
+  return rs.ok > 0 && (nowUs - rs.lastOkUs) <= maxAgeUs;
+}
+
+} // namespace rs485
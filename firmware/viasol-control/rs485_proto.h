@@ -0,0 +1,279 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// -----------------------------------------------------------------------------
+// Master <-> remote comm board protocol (RS-485, half duplex).
+//
+// Pure C++ with no Arduino dependencies: the ESP32 driver (rs485.cpp) and a
+// host harness over a pty pair drive the same Master/Slave state machines.
+//
+// Frame:
+//   SYNC(0xA5) ADDR SEQ FUNC LEN PAYLOAD[LEN] CRC16(lo,hi)
+//   CRC16 is Modbus (poly 0xA001, init 0xFFFF) over ADDR..PAYLOAD.
+//   Requests carry the remote address; responses carry the responding remote
+//   address with FN_RESP set and echo SEQ.
+//
+// FN_XFER payload (request):
+//   nw, nw x { start(u16 LE), count(u8), count x int16 LE }   -- writes first
+//   nr, nr x { start(u16 LE), count(u8) }                      -- then reads
+// FN_XFER payload (response):
+//   status(u8), then the values for each read range in request order
+// -----------------------------------------------------------------------------
+
+namespace rs485 {
+
+static const uint8_t SYNC = 0xA5;
+static const uint8_t ADDR_MASTER = 0x00;
+static const uint8_t MAX_REMOTES = 8;        // remote addresses 1..MAX_REMOTES
+
+static const int MAX_PAYLOAD = 120;
+static const int FRAME_OVERHEAD = 7;         // sync, addr, seq, func, len, crc x2
+static const int MAX_FRAME = MAX_PAYLOAD + FRAME_OVERHEAD;
+static const int MAX_RANGES = 8;             // per direction per frame
+
+enum Func : uint8_t {
+  FN_XFER  = 0x01,
+  FN_ERROR = 0x7F,
+  FN_RESP  = 0x80
+};
+
+enum Status : uint8_t {
+  ST_OK = 0,
+  ST_BAD_FUNC = 1,
+  ST_BAD_REG = 2,
+  ST_BAD_LEN = 3,
+  ST_READ_ONLY = 4
+};
+
+// -----------------------------------------------------------------------------
+// Remote register map (int16 registers)
+// -----------------------------------------------------------------------------
+static const uint16_t REG_COUNT = 0x80;
+
+enum Reg : uint16_t {
+  REG_FW_VERSION  = 0x00,  // ro
+  REG_STATUS      = 0x01,  // ro, bit flags
+  REG_UPTIME_S    = 0x02,  // ro, wraps
+
+  REG_PV_V        = 0x10,  // ro, 10 mV units (unsigned)
+  REG_PV_A        = 0x11,  // ro, PV shunt amplifier ADC code (scaled on the master)
+  REG_CH_A0       = 0x20,  // ro, 8 channels, mA
+  REG_CH_TEMP0    = 0x30,  // ro, 8 channels, 0.01 degC
+  REG_LEAK        = 0x40,  // ro, bit per channel
+
+  REG_HEATER_MASK = 0x50,  // rw, bit per channel
+  REG_RELAYS      = 0x51,  // rw, bit per relay
+  REG_AUX         = 0x52,  // rw, bit per aux output
+
+  REG_CFG0        = 0x60   // rw, configuration block to the end of the map
+};
+
+static const uint16_t REG_WRITABLE_FIRST = REG_HEATER_MASK;
+
+uint16_t crc16(const uint8_t* data, size_t n, uint16_t crc = 0xFFFF);
+
+// -----------------------------------------------------------------------------
+// Frames
+// -----------------------------------------------------------------------------
+struct Frame {
+  uint8_t addr = 0;
+  uint8_t seq = 0;
+  uint8_t func = 0;
+  uint8_t len = 0;
+  uint8_t payload[MAX_PAYLOAD];
+};
+
+// Returns encoded length (0 if cap is too small).
+size_t encodeFrame(const Frame& f, uint8_t* out, size_t cap);
+
+// Byte-at-a-time decoder; resynchronises on the next SYNC after any error.
+class Decoder {
+ public:
+  // Returns true when a complete, CRC-valid frame is available in frame().
+  bool feed(uint8_t b);
+  const Frame& frame() const { return f_; }
+  void reset() { state_ = 0; }
+
+  uint32_t crcErrors = 0;
+  uint32_t lenErrors = 0;
+
+ private:
+  Frame f_;
+  uint8_t state_ = 0;
+  uint8_t pos_ = 0;
+  uint16_t crc_ = 0;
+};
+
+struct Range {
+  uint16_t start;
+  uint8_t count;
+};
+
+// Builds an FN_XFER request. add*() return false when the frame is full.
+class XferBuilder {
+ public:
+  void begin(uint8_t addr, uint8_t seq);
+  void setAddr(uint8_t addr) { f_.addr = addr; }
+  uint8_t addr() const { return f_.addr; }
+  uint8_t seq() const { return f_.seq; }
+  bool addWrite(uint16_t start, uint8_t count, const int16_t* values);
+  bool addRead(uint16_t start, uint8_t count);
+  // Finalises the payload. Returns the frame to encode.
+  const Frame& finish();
+
+  uint8_t nReads() const { return nr_; }
+  const Range& read(int i) const { return reads_[i]; }
+  size_t responseLen() const;  // expected response payload length
+  size_t freeBytes() const;
+
+ private:
+  Frame f_;
+  uint8_t wbuf_[MAX_PAYLOAD];
+  uint8_t wlen_ = 0;
+  uint8_t nw_ = 0;
+  Range reads_[MAX_RANGES];
+  uint8_t nr_ = 0;
+};
+
+// Expected time on the wire for n bytes (8N1) in microseconds.
+uint32_t wireTimeUs(size_t bytes, uint32_t baud);
+
+// -----------------------------------------------------------------------------
+// Remote side: answers FN_XFER against a register array. Used by the remote
+// comm board and as the simulated remote in host tests.
+// -----------------------------------------------------------------------------
+class Slave {
+ public:
+  Slave(uint8_t addr, int16_t* regs, uint16_t nRegs) : addr_(addr), regs_(regs), n_(nRegs) {}
+
+  // Returns true if resp should be transmitted.
+  bool handle(const Frame& req, Frame& resp);
+
+  uint32_t writes = 0;  // registers written by the master
+
+ private:
+  uint8_t addr_;
+  int16_t* regs_;
+  uint16_t n_;
+};
+
+// -----------------------------------------------------------------------------
+// Master side
+//
+// One request is in flight at a time (the bus is half duplex), but the next
+// request is encoded while the current one is outstanding, so it goes out as
+// soon as the response completes or times out: the only idle gap on the bus
+// is the remote's turnaround.
+// -----------------------------------------------------------------------------
+struct RemoteStats {
+  uint32_t txns = 0;
+  uint32_t ok = 0;
+  uint32_t timeouts = 0;
+  uint32_t errors = 0;     // error responses and malformed payloads
+  uint32_t rttMinUs = 0;
+  uint32_t rttMaxUs = 0;
+  uint32_t rttAvgUs = 0;   // EWMA, 1/8
+  uint32_t lastOkUs = 0;
+};
+
+struct MasterStats {
+  uint32_t txBytes = 0;
+  uint32_t rxBytes = 0;
+  uint32_t lateFrames = 0;  // wrong seq/addr (e.g. after a timeout)
+  uint32_t crcErrors = 0;
+};
+
+class Master {
+ public:
+  explicit Master(uint32_t baud) : baud_(baud) {}
+  virtual ~Master() {}
+
+  // Remotes to poll, bit n = address n+1.
+  void setRemotes(uint8_t mask) { remotes_ = mask; }
+  uint8_t remotes() const { return remotes_; }
+
+  // Remote response turnaround allowance added to every timeout.
+  void setTurnaroundUs(uint32_t us) { turnaroundUs_ = us; }
+
+  // Queue a register write; repeated writes to the same register coalesce
+  // and ride along on the next request to that remote.
+  void write(uint8_t addr, uint16_t reg, int16_t value);
+
+  // Returns true and fills out/len when a frame should be transmitted now.
+  bool nextTx(uint32_t nowUs, uint8_t* out, size_t& len);
+
+  // Encode the following request ahead of time. Call right after the frame
+  // from nextTx() has been handed to the UART.
+  void prefetch(uint32_t nowUs);
+
+  // Feed received bytes.
+  void onRx(const uint8_t* data, size_t n, uint32_t nowUs);
+
+  // Expire an outstanding request. Call periodically.
+  void tick(uint32_t nowUs);
+
+  bool inFlight() const { return inFlight_; }
+
+  int16_t reg(uint8_t addr, uint16_t r) const;
+  bool online(uint8_t addr, uint32_t nowUs, uint32_t maxAgeUs) const;
+
+  const RemoteStats& remoteStats(uint8_t addr) const { return rstats_[idx(addr)]; }
+  const MasterStats& stats() const { return stats_; }
+
+ protected:
+  // Fill the builder with the next request; return false if nothing to send.
+  // Default: the measurement block of each remote in turn, plus any pending
+  // writes for it.
+  virtual bool plan(XferBuilder& b, uint8_t& addr, uint32_t nowUs);
+  // Called when a request completes (ok=false on timeout/error).
+  virtual void completed(const XferBuilder& req, bool ok, uint32_t nowUs) { (void)req; (void)ok; (void)nowUs; }
+
+  // Append pending writes for addr (call before adding reads); returns the
+  // number of registers added.
+  int addPendingWrites(XferBuilder& b, uint8_t addr);
+  bool hasPendingWrites(uint8_t addr) const;
+  uint32_t baud() const { return baud_; }
+
+  static int idx(uint8_t addr) { return (addr >= 1 && addr <= MAX_REMOTES) ? addr - 1 : 0; }
+
+ private:
+  void finishTxn(bool ok, uint32_t nowUs);
+  void applyResponse(const Frame& f, uint32_t nowUs);
+
+  uint32_t baud_;
+  uint8_t remotes_ = 0x01;
+  uint32_t turnaroundUs_ = 500;
+
+  int16_t mirror_[MAX_REMOTES][REG_COUNT] = {};
+  RemoteStats rstats_[MAX_REMOTES];
+  MasterStats stats_;
+
+  // Pending writes: shadow values + dirty bits for the writable window
+  int16_t wval_[MAX_REMOTES][REG_COUNT - REG_WRITABLE_FIRST] = {};
+  uint32_t wdirty_[MAX_REMOTES][(REG_COUNT - REG_WRITABLE_FIRST + 31) / 32] = {};
+  // Writes carried by the current request; re-marked dirty if it fails
+  uint32_t wsent_[(REG_COUNT - REG_WRITABLE_FIRST + 31) / 32] = {};
+
+  Decoder dec_;
+  uint8_t seq_ = 0;
+  uint8_t rr_ = 0;
+
+  // Current transaction
+  bool inFlight_ = false;
+  uint8_t curAddr_ = 0;
+  uint8_t curSeq_ = 0;
+  uint32_t sentUs_ = 0;
+  uint32_t deadlineUs_ = 0;
+  XferBuilder cur_;
+
+  // Next transaction, encoded ahead of time
+  bool nextReady_ = false;
+  uint8_t nextAddr_ = 0;
+  XferBuilder next_;
+  uint8_t nextBuf_[MAX_FRAME];
+  size_t nextLen_ = 0;
+  uint32_t nextWsent_[(REG_COUNT - REG_WRITABLE_FIRST + 31) / 32] = {};
+};
+
+} // namespace rs485
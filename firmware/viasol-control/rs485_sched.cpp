@@ -0,0 +1,167 @@
+#include "rs485_sched.h"
+
+namespace rs485 {
+
+static const uint32_t BACKOFF_MIN_US = 20000;
+static const uint32_t BACKOFF_MAX_US = 2000000;
+static const uint32_t UTIL_WINDOW_US = 1000000;
+
+static inline int32_t since(uint32_t nowUs, uint32_t t) { return (int32_t)(nowUs - t); }
+
+bool Scheduler::addGroup(const RegGroup& g) {
+  if (nGroups_ >= MAX_GROUPS || g.count == 0 || g.periodMs == 0) return false;
+
+  // Keep the table in priority order so packing walks it front to back
+  int i = nGroups_++;
+  while (i > 0 && groups_[i - 1].priority < g.priority) {
+    groups_[i] = groups_[i - 1];
+    i--;
+  }
+  groups_[i] = g;
+  return true;
+}
+
+void Scheduler::addDefaultGroups() {
+  addGroup({ "currents", REG_CH_A0,       8,  3, 100 });
+  addGroup({ "pv",       REG_PV_V,        2,  3, 100 });
+  addGroup({ "leak",     REG_LEAK,        1,  2, 500 });
+  addGroup({ "outputs",  REG_HEATER_MASK, 3,  2, 500 });
+  addGroup({ "status",   REG_FW_VERSION,  3,  1, 1000 });
+  addGroup({ "temps",    REG_CH_TEMP0,    8,  1, 5000 });
+  addGroup({ "config",   REG_CFG0,        32, 0, 60000 });
+}
+
+bool Scheduler::backingOff(uint8_t addr, uint32_t nowUs) const {
+  int a = idx(addr);
+  return fails_[a] >= 2 && since(nowUs, backoffUntil_[a]) < 0;
+}
+
+void Scheduler::markPolled(int a, int g, uint32_t nowUs) {
+  uint32_t periodUs = groups_[g].periodMs * 1000;
+  int32_t late = since(nowUs, due_[a][g]);
+  GroupStats& gs = gstats_[a][g];
+  gs.polls++;
+  if (late > 0 && (uint32_t)late > gs.maxLateUs) gs.maxLateUs = (uint32_t)late;
+  if (late > (int32_t)periodUs) gs.misses++;
+
+  // Keep phase while roughly on time; after a long stall don't try to catch up
+  if (late > (int32_t)periodUs) due_[a][g] = nowUs + periodUs;
+  else due_[a][g] += periodUs;
+}
+
+bool Scheduler::plan(XferBuilder& b, uint8_t& addr, uint32_t nowUs) {
+  uint8_t mask = remotes();
+  if (!mask || !nGroups_) return false;
+
+  if (!started_) {
+    started_ = true;
+    winStartUs_ = nowUs;
+    for (int a = 0; a < MAX_REMOTES; a++) {
+      for (int g = 0; g < nGroups_; g++) due_[a][g] = nowUs;
+    }
+  }
+
+  // Most urgent due group: effective priority, then lateness
+  int bestA = -1, bestG = -1, bestPrio = -1;
+  int32_t bestLate = 0;
+  int writeA = -1;
+  for (int a = 0; a < MAX_REMOTES; a++) {
+    if (!(mask & (1u << a))) continue;
+    if (backingOff((uint8_t)(a + 1), nowUs)) continue;
+    if (writeA < 0 && hasPendingWrites((uint8_t)(a + 1))) writeA = a;
+
+    for (int g = 0; g < nGroups_; g++) {
+      int32_t late = since(nowUs, due_[a][g]);
+      if (late < 0) continue;
+      int prio = groups_[g].priority;
+      if ((uint32_t)late >= groups_[g].periodMs * 1000) prio++;
+      if (prio > bestPrio || (prio == bestPrio && late > bestLate)) {
+        bestA = a; bestG = g; bestPrio = prio; bestLate = late;
+      }
+    }
+  }
+
+  // Nothing due: still push out pending writes right away
+  if (bestA < 0) bestA = writeA;
+  if (bestA < 0) return false;
+
+  addr = (uint8_t)(bestA + 1);
+  addPendingWrites(b, addr);
+
+  uint8_t carried = 0;
+  if (bestG >= 0 && b.addRead(groups_[bestG].start, groups_[bestG].count)) {
+    markPolled(bestA, bestG, nowUs);
+    carried |= (uint8_t)(1u << bestG);
+  }
+
+  // Fill the frame with this remote's other due or nearly due groups
+  for (int g = 0; g < nGroups_; g++) {
+    if (carried & (1u << g)) continue;
+    int32_t early = (int32_t)(groups_[g].periodMs * 1000 / 2);
+    if (since(nowUs, due_[bestA][g]) < -early) continue;
+    if (!b.addRead(groups_[g].start, groups_[g].count)) continue;
+    markPolled(bestA, g, nowUs);
+    carried |= (uint8_t)(1u << g);
+  }
+
+  tagSeq_[b.seq() & 3] = b.seq();
+  tagGroups_[b.seq() & 3] = carried;
+  return true;
+}
+
+void Scheduler::completed(const XferBuilder& req, bool ok, uint32_t nowUs) {
+  int a = idx(req.addr());
+  uint8_t t = req.seq() & 3;
+  uint8_t carried = (tagSeq_[t] == req.seq()) ? tagGroups_[t] : 0;
+  tagGroups_[t] = 0;
+
+  if (ok) {
+    fails_[a] = 0;
+  } else {
+    // Ask again as soon as the remote is out of backoff
+    for (int g = 0; g < nGroups_; g++) {
+      if (carried & (1u << g)) due_[a][g] = nowUs;
+    }
+    if (fails_[a] < 255) fails_[a]++;
+    if (fails_[a] >= 2) {
+      int shift = fails_[a] - 2;
+      uint32_t us = (shift >= 7) ? BACKOFF_MAX_US : (BACKOFF_MIN_US << shift);
+      if (us > BACKOFF_MAX_US) us = BACKOFF_MAX_US;
+      backoffUntil_[a] = nowUs + us;
+    }
+  }
+
+  updateUtil(nowUs);
+}
+
+void Scheduler::updateUtil(uint32_t nowUs) {
+  uint32_t el = nowUs - winStartUs_;
+  if (el < UTIL_WINDOW_US) return;
+
+  uint32_t bytes = stats().txBytes + stats().rxBytes;
+  uint64_t busyUs = (uint64_t)wireTimeUs(bytes - winBytes_, baud());
+  uint64_t pm = busyUs * 1000 / el;
+  utilPermille_ = (uint16_t)(pm > 1000 ? 1000 : pm);
+  winBytes_ = bytes;
+  winStartUs_ = nowUs;
+}
+
+uint16_t Scheduler::demandPermille() const {
+  // Bytes per second if every group were read on its own schedule, with the
+  // frame overhead paid at the rate of each remote's fastest group.
+  uint32_t fastestMs = 0;
+  uint32_t perRemote = 0;  // bytes/s
+  for (int g = 0; g < nGroups_; g++) {
+    perRemote += (uint32_t)(3 + 2 * groups_[g].count) * 1000 / groups_[g].periodMs;
+    if (!fastestMs || groups_[g].periodMs < fastestMs) fastestMs = groups_[g].periodMs;
+  }
+  if (fastestMs) perRemote += (uint32_t)(2 * FRAME_OVERHEAD + 3) * 1000 / fastestMs;
+
+  int n = 0;
+  for (int a = 0; a < MAX_REMOTES; a++) if (remotes() & (1u << a)) n++;
+
+  uint64_t pm = (uint64_t)wireTimeUs((size_t)perRemote * n, baud()) / 1000;
+  return (uint16_t)(pm > 65535 ? 65535 : pm);
+}
+
+} // namespace rs485
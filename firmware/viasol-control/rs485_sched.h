@@ -0,0 +1,84 @@
+#pragma once
+#include "rs485_proto.h"
+
+// -----------------------------------------------------------------------------
+// Bus scheduler: polls register groups at their own rates.
+//
+// Each group (a register range) has a period and a priority. plan() picks the
+// most urgent due group across all remotes, then packs any other groups of
+// the same remote that are due (or due within half a period) into the same
+// frame. When the bus cannot keep up, lower priorities slow down first; a
+// group overdue by a full period is bumped one level so it still gets through.
+//
+// A remote that keeps failing is backed off exponentially, so a dead board
+// costs a probe now and then rather than a timeout per slot.
+//
+// Pure C++ like rs485_proto; the host harness runs it as-is.
+// -----------------------------------------------------------------------------
+
+namespace rs485 {
+
+static const int MAX_GROUPS = 8;
+
+struct RegGroup {
+  const char* name;
+  uint16_t start;
+  uint8_t count;
+  uint8_t priority;   // higher first
+  uint32_t periodMs;
+};
+
+struct GroupStats {
+  uint32_t polls = 0;
+  uint32_t misses = 0;     // served more than one period late
+  uint32_t maxLateUs = 0;
+};
+
+class Scheduler : public Master {
+ public:
+  explicit Scheduler(uint32_t baud) : Master(baud) {}
+
+  // Groups are fixed once polling starts. Returns false when full.
+  bool addGroup(const RegGroup& g);
+  void addDefaultGroups();
+
+  int groupCount() const { return nGroups_; }
+  const RegGroup& group(int g) const { return groups_[g]; }
+  const GroupStats& groupStats(uint8_t addr, int g) const { return gstats_[idx(addr)][g]; }
+
+  // Share of line time carrying bytes over the last window (1/1000).
+  uint16_t utilPermille() const { return utilPermille_; }
+  // Share the configured rates would need for the polled remotes (1/1000);
+  // above 1000 the bus is oversubscribed and low priorities stretch.
+  uint16_t demandPermille() const;
+
+  bool backingOff(uint8_t addr, uint32_t nowUs) const;
+
+ protected:
+  bool plan(XferBuilder& b, uint8_t& addr, uint32_t nowUs) override;
+  void completed(const XferBuilder& req, bool ok, uint32_t nowUs) override;
+
+ private:
+  void markPolled(int a, int g, uint32_t nowUs);
+  void updateUtil(uint32_t nowUs);
+
+  RegGroup groups_[MAX_GROUPS];
+  int nGroups_ = 0;
+
+  bool started_ = false;
+  uint32_t due_[MAX_REMOTES][MAX_GROUPS] = {};
+  GroupStats gstats_[MAX_REMOTES][MAX_GROUPS];
+
+  uint8_t fails_[MAX_REMOTES] = {};
+  uint32_t backoffUntil_[MAX_REMOTES] = {};
+
+  // Groups carried by the (at most two) planned/in-flight requests, by seq
+  uint8_t tagSeq_[4] = {};
+  uint8_t tagGroups_[4] = {};
+
+  uint32_t winStartUs_ = 0;
+  uint32_t winBytes_ = 0;
+  uint16_t utilPermille_ = 0;
+};
+
+} // namespace rs485
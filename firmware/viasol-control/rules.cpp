@@ -1,12 +1,18 @@
 #include "rules.h"
 #include "app.h"
 #include "io_catalog.h"
+#include "metrics.h"
 #include <Preferences.h>
 
 struct RuleRuntime {
   bool lastCondition = false;
   bool active = false;
   uint32_t activeUntilMs = 0;
+  int8_t inIdx = -1;      // catalog indices, see inputIndexCached()
+  int8_t rhsIdx = -1;
+  int8_t outIdx = -1;
+  uint32_t evals = 0;     // /metrics
+  uint32_t fires = 0;     // rising edges
 };
 
 Rule rules[MAX_RULES];
@@ -109,39 +115,41 @@ void loadRules() {
 }
 
 void saveRules() {
+  size_t n = 0;
   for (int i = 0; i < MAX_RULES; i++) {
     char k[24];
 
     snprintf(k, sizeof(k), "r%d_en", i);
-    app.prefs.putBool(k, rules[i].enabled);
+    n += app.prefs.putBool(k, rules[i].enabled);
 
     snprintf(k, sizeof(k), "r%d_in", i);
-    app.prefs.putString(k, rules[i].inputKey);
+    n += app.prefs.putString(k, rules[i].inputKey);
 
     snprintf(k, sizeof(k), "r%d_op", i);
-    app.prefs.putString(k, opToStr(rules[i].op));
+    n += app.prefs.putString(k, opToStr(rules[i].op));
 
     snprintf(k, sizeof(k), "r%d_rhs", i);
-    app.prefs.putString(k, rhsToStr(rules[i].rhsSource));
+    n += app.prefs.putString(k, rhsToStr(rules[i].rhsSource));
 
     snprintf(k, sizeof(k), "r%d_th", i);
-    app.prefs.putFloat(k, rules[i].threshold);
+    n += app.prefs.putFloat(k, rules[i].threshold);
 
     snprintf(k, sizeof(k), "r%d_rin", i);
-    app.prefs.putString(k, rules[i].rhsInputKey);
+    n += app.prefs.putString(k, rules[i].rhsInputKey);
 
     snprintf(k, sizeof(k), "r%d_out", i);
-    app.prefs.putString(k, rules[i].outputKey);
+    n += app.prefs.putString(k, rules[i].outputKey);
 
     snprintf(k, sizeof(k), "r%d_on", i);
-    app.prefs.putBool(k, rules[i].outputOn);
+    n += app.prefs.putBool(k, rules[i].outputOn);
 
     snprintf(k, sizeof(k), "r%d_mode", i);
-    app.prefs.putString(k, modeToStr(rules[i].mode));
+    n += app.prefs.putString(k, modeToStr(rules[i].mode));
 
     snprintf(k, sizeof(k), "r%d_dur", i);
-    app.prefs.putUInt(k, rules[i].durationSec);
+    n += app.prefs.putUInt(k, rules[i].durationSec);
   }
+  metricsNvsWrite(n);
 }
 
 void processRules() {
@@ -150,20 +158,27 @@ void processRules() {
   for (int i = 0; i < MAX_RULES; i++) {
     if (!rules[i].enabled) continue;
 
-    float lhs = inputValueByKey(rules[i].inputKey);
+    const InputSample& lhs = inputSample(inputIndexCached(rr[i].inIdx, rules[i].inputKey.c_str()));
+    bool known = (lhs.q == Quality::Good);
     float rhs = rules[i].threshold;
     if (rules[i].rhsSource == RhsSource::INPUT_KEY) {
-      rhs = inputValueByKey(rules[i].rhsInputKey);
+      const InputSample& r = inputSample(inputIndexCached(rr[i].rhsIdx, rules[i].rhsInputKey.c_str()));
+      known = known && (r.q == Quality::Good);
+      rhs = r.value;
     }
 
-    bool cond = evalCmp(lhs, rules[i].op, rhs);
+    // Stale/missing inputs hold the last condition rather than compare 0
+    bool cond = known ? evalCmp(lhs.value, rules[i].op, rhs) : rr[i].lastCondition;
     bool rising = (cond && !rr[i].lastCondition);
     rr[i].lastCondition = cond;
+    rr[i].evals++;
+    if (rising) rr[i].fires++;
+    int out = outputIndexCached(rr[i].outIdx, rules[i].outputKey.c_str());
 
     switch (rules[i].mode) {
       case RuleMode::FOLLOW: {
         bool drive = cond ? rules[i].outputOn : !rules[i].outputOn;
-        applyOutput(rules[i].outputKey, drive);
+        applyOutputIndex(out, drive);
       } break;
 
       case RuleMode::ONCE: {
@@ -171,11 +186,11 @@ void processRules() {
           uint32_t dur = (rules[i].durationSec == 0) ? 1 : rules[i].durationSec;
           rr[i].active = true;
           rr[i].activeUntilMs = now + dur * 1000UL;
-          applyOutput(rules[i].outputKey, rules[i].outputOn);
+          applyOutputIndex(out, rules[i].outputOn);
         }
         if (rr[i].active && (int32_t)(now - rr[i].activeUntilMs) >= 0) {
           rr[i].active = false;
-          applyOutput(rules[i].outputKey, !rules[i].outputOn);
+          applyOutputIndex(out, !rules[i].outputOn);
         }
       } break;
 
@@ -184,13 +199,30 @@ void processRules() {
           uint32_t dur = (rules[i].durationSec == 0) ? 1 : rules[i].durationSec;
           rr[i].active = true;
           rr[i].activeUntilMs = now + dur * 1000UL;
-          applyOutput(rules[i].outputKey, rules[i].outputOn);
+          applyOutputIndex(out, rules[i].outputOn);
         }
         if (rr[i].active && (int32_t)(now - rr[i].activeUntilMs) >= 0) {
           rr[i].active = false;
-          applyOutput(rules[i].outputKey, !rules[i].outputOn);
+          applyOutputIndex(out, !rules[i].outputOn);
         }
       } break;
     }
   }
 }
+
+static void collectMetrics(MetricWriter& w) {
+  char idx[8];
+  w.family("viasol_rule_evaluations_total", "Rules v1 evaluations per slot", "counter");
+  for (int i = 0; i < MAX_RULES; i++) {
+    if (!rules[i].enabled) continue;
+    snprintf(idx, sizeof(idx), "%d", i);
+    w.u("viasol_rule_evaluations_total", rr[i].evals, "rule", idx);
+  }
+  w.family("viasol_rule_triggers_total", "Rules v1 rising edges per slot", "counter");
+  for (int i = 0; i < MAX_RULES; i++) {
+    if (!rules[i].enabled) continue;
+    snprintf(idx, sizeof(idx), "%d", i);
+    w.u("viasol_rule_triggers_total", rr[i].fires, "rule", idx);
+  }
+}
+static MetricCollector metricsCollector(collectMetrics);
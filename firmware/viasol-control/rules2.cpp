@@ -2,32 +2,33 @@
 #include "io_catalog.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include "metrics.h"
+#include <algorithm>
+#include <unordered_map>
 
 namespace rules2 {
 
-// -----------------------------------------------------------------------------
-// Global DB
-// -----------------------------------------------------------------------------
-Db db;
-
-
+// The engine (evaluation, holds, processRules2) is in rules2_engine.cpp.
 static const char* RULES2_PATH = "/rules2.json";
 static const uint16_t RULES2_SCHEMA = 1;
-
+static const char* BUILDER_GROUP = "MVP group";   // made by the rule page checkboxes
 
 // -----------------------------------------------------------------------------
 // Internal helpers
 // -----------------------------------------------------------------------------
-static bool cmp(CmpOp op, float a, float b) {
-  switch (op) {
-    case CmpOp::GT: return a >  b;
-    case CmpOp::GE: return a >= b;
-    case CmpOp::LT: return a <  b;
-    case CmpOp::LE: return a <= b;
-    case CmpOp::EQ: return a == b;
-    case CmpOp::NE: return a != b;
+const char* unknownPolicyToStr(UnknownPolicy p) {
+  switch (p) {
+    case UnknownPolicy::Hold: return "hold";
+    case UnknownPolicy::Off:  return "off";
+    case UnknownPolicy::On:   return "on";
   }
-  return false;
+  return "hold";
+}
+
+UnknownPolicy strToUnknownPolicy(const String& s) {
+  if (s == "off") return UnknownPolicy::Off;
+  if (s == "on") return UnknownPolicy::On;
+  return UnknownPolicy::Hold;
 }
 
 static CmpOp strToOp2(const String& s) {
@@ -40,198 +41,242 @@ static CmpOp strToOp2(const String& s) {
   return CmpOp::GT;
 }
 
-// -----------------------------------------------------------------------------
-// Db helpers
-// -----------------------------------------------------------------------------
-Condition* Db::findCond(uint32_t id) {
-  for (auto& c : conditions) if (c.id == id) return &c;
-  return nullptr;
-}
-
-ExprNode* Db::findExpr(uint32_t id) {
-  for (auto& e : expr) if (e.id == id) return &e;
-  return nullptr;
-}
-
-Rule* Db::findRule(uint32_t id) {
-  for (auto& r : rules) if (r.id == id) return &r;
-  return nullptr;
-}
-
-// -----------------------------------------------------------------------------
-// Condition evaluation
-// -----------------------------------------------------------------------------
-bool evalCondition(Condition& c, uint32_t nowMs) {
-  if (!c.enabled) return false;
-
-  bool raw = false;
-  float lhs = inputValueByKey(c.inputKey);
-
-  if (c.type == CondType::CompareInputToConst) {
-    raw = cmp(c.op, lhs, c.threshold);
-  } else { // CompareInputToInput
-    float rhs = inputValueByKey(c.rhsInputKey);
-    raw = cmp(c.op, lhs, rhs);
-  }
-
-  // Stability handling
-  if (c.stableForMs == 0) {
-    c.lastEval = raw;
-    return raw;
+static void collectMetrics(MetricWriter& w) {
+  char id[12];
+  w.family("viasol_rule2_evaluations_total", "Rules v2 expression evaluations per rule id", "counter");
+  for (const auto& r : db.rules) {
+    snprintf(id, sizeof(id), "%lu", (unsigned long)r.id);
+    w.u("viasol_rule2_evaluations_total", r.evals, "rule", id);
   }
-
-  if (raw != c.lastEval) {
-    c.lastEval = raw;
-    c.lastFlipMs = nowMs;
+  w.family("viasol_rule2_triggers_total", "Rules v2 actions fired per rule id", "counter");
+  for (const auto& r : db.rules) {
+    snprintf(id, sizeof(id), "%lu", (unsigned long)r.id);
+    w.u("viasol_rule2_triggers_total", r.fires, "rule", id);
   }
-
-  if (!raw) return false;
-  return (nowMs - c.lastFlipMs) >= c.stableForMs;
+  w.family("viasol_rule2_holds", "Timed output holds pending", "gauge");
+  w.u("viasol_rule2_holds", holdCount());
+  w.family("viasol_rule2_store_bytes", "Rules v2 store: heap block size and string pool in use", "gauge");
+  w.u("viasol_rule2_store_bytes", db.blockBytes(), "part", "block");
+  w.u("viasol_rule2_store_bytes", db.poolBytes(), "part", "strings");
 }
+static MetricCollector metricsCollector(collectMetrics);
 
 // -----------------------------------------------------------------------------
-// Expression evaluation
+// Graph passes
 // -----------------------------------------------------------------------------
-bool evalExpr(uint32_t exprId, uint32_t nowMs) {
-  ExprNode* n = db.findExpr(exprId);
-  if (!n) return false;
-
-  switch (n->type) {
-    case ExprType::LeafCond: {
-      Condition* c = db.findCond(n->condId);
-      return c ? evalCondition(*c, nowMs) : false;
-    }
-
-    case ExprType::Not:
-      return !evalExpr(n->child, nowMs);
-
-    case ExprType::And:
-      if (n->children.empty()) return true;
-      for (uint32_t cid : n->children) {
-        if (!evalExpr(cid, nowMs)) return false;
-      }
-      return true;
-
-    case ExprType::Or:
-      if (n->children.empty()) return false;
-      for (uint32_t cid : n->children) {
-        if (evalExpr(cid, nowMs)) return true;
-      }
-      return false;
+// id -> db.expr index, for passes that follow many references
+struct ExprIndex {
+  std::vector<std::pair<uint32_t, uint32_t>> byId;
+
+  ExprIndex() {
+    byId.reserve(db.expr.size());
+    for (uint32_t i = 0; i < db.expr.size(); i++) byId.push_back({ db.expr[i].id, i });
+    std::sort(byId.begin(), byId.end());
   }
-  return false;
-}
+  int operator()(uint32_t id) const {
+    auto it = std::lower_bound(byId.begin(), byId.end(), std::make_pair(id, 0u));
+    return (it != byId.end() && it->first == id) ? (int)it->second : -1;
+  }
+};
 
-// -----------------------------------------------------------------------------
-// Action application (simple hold logic for durationMs)
-// -----------------------------------------------------------------------------
-struct Hold {
-  String key;
-  uint32_t untilMs;
+struct GraphReport {
+  uint32_t dangling = 0;   // references to missing nodes, conditions, roots
+  uint32_t cycles = 0;     // edges closing a cycle
+  uint32_t deep = 0;       // nodes with more than MAX_EXPR_DEPTH levels below
+  uint32_t repaired = 0;
 };
 
-static std::vector<Hold> holds;
+// Edges of a node: a NOT has one (its child, 0 if none), AND/OR their list
+static uint32_t arity(const ExprNode& e) {
+  if (e.type == ExprType::LeafCond) return 0;
+  return e.type == ExprType::Not ? 1 : e.children.count;
+}
 
-static void serviceHolds(uint32_t nowMs) {
-  for (int i = (int)holds.size() - 1; i >= 0; --i) {
-    if (nowMs >= holds[i].untilMs) {
-      applyOutput(holds[i].key, false);
-      holds.erase(holds.begin() + i);
-    }
-  }
+static uint32_t edgeTo(const ExprNode& e, uint32_t k) {
+  return e.type == ExprType::Not ? e.child : db.children(e)[k];
 }
 
-static void applyActions(const Rule& r, uint32_t nowMs) {
-  for (const auto& a : r.actions) {
-    if (a.type != ActionType::SetOutput) continue;
+static void cutEdge(ExprNode& e, uint32_t k) {
+  if (e.type == ExprType::Not) e.child = 0;
+  else db.removeChild(e, k);
+}
 
-    applyOutput(a.outputKey, a.on);
+// Depth-first over every node with an explicit stack, so a bad graph can't
+// take the walk itself down. With repair, dangling children and the edges
+// that close cycles are cut and rules rooted too deep are disabled.
+static GraphReport walkGraph(bool repair) {
+  GraphReport rep;
+  ExprIndex indexOf;
+  uint32_t n = db.expr.size();
 
-    if (a.on && a.durationMs > 0) {
-      Hold h;
-      h.key = a.outputKey;
-      h.untilMs = nowMs + a.durationMs;
-      holds.push_back(h);
+  for (auto& e : db.expr) {
+    if (e.type == ExprType::LeafCond) {
+      if (!db.findCond(e.condId)) rep.dangling++;
+      continue;
+    }
+    for (int k = (int)arity(e) - 1; k >= 0; k--) {
+      uint32_t id = edgeTo(e, k);
+      if (id == 0 || indexOf(id) >= 0) continue;
+      rep.dangling++;
+      if (repair) {
+        cutEdge(e, k);
+        rep.repaired++;
+      }
     }
   }
-}
-
-// -----------------------------------------------------------------------------
-// Rules engine tick
-// -----------------------------------------------------------------------------
-void processRules2() {
-  uint32_t nowMs = millis();
-
-  serviceHolds(nowMs);
-
   for (auto& r : db.rules) {
-    if (!r.enabled) continue;
-
-    if (r.minEvalPeriodMs > 0 && (nowMs - r.lastEvalMs) < r.minEvalPeriodMs) {
-      continue;
+    if (r.exprRootId == 0 || indexOf(r.exprRootId) >= 0) continue;
+    rep.dangling++;
+    if (repair) {
+      r.exprRootId = 0;
+      r.enabled = false;
+      rep.repaired++;
     }
-    r.lastEvalMs = nowMs;
+  }
 
-    bool result = evalExpr(r.exprRootId, nowMs);
+  enum : uint8_t { UNSEEN, ON_PATH, DONE };
+  std::vector<uint8_t> state(n, UNSEEN);
+  std::vector<uint8_t> height(n, 0);
+  struct Frame {
+    uint32_t node;
+    uint32_t next;
+  };
+  std::vector<Frame> stack;
+
+  for (uint32_t s = 0; s < n; s++) {
+    if (state[s] != UNSEEN) continue;
+    state[s] = ON_PATH;
+    stack.push_back({ s, 0 });
+    while (!stack.empty()) {
+      Frame& f = stack.back();
+      ExprNode& e = db.expr[f.node];
+      if (f.next < arity(e)) {
+        int c = indexOf(edgeTo(e, f.next));
+        if (c >= 0 && state[c] == ON_PATH) {
+          rep.cycles++;
+          if (repair) {
+            cutEdge(e, f.next);   // the next edge moves into this slot
+            rep.repaired++;
+            continue;
+          }
+        }
+        f.next++;
+        if (c >= 0 && state[c] == UNSEEN) {
+          state[c] = ON_PATH;
+          stack.push_back({ (uint32_t)c, 0 });
+        }
+        continue;
+      }
 
-    // edge-trigger: false -> true
-    bool rising = (result && !r.lastResult);
-    r.lastResult = result;
-    if (!rising) continue;
+      uint32_t h = 0;
+      for (uint32_t k = 0; k < arity(e); k++) {
+        int c = indexOf(edgeTo(e, k));
+        if (c >= 0 && state[c] == DONE && height[c] > h) h = height[c];
+      }
+      height[f.node] = (uint8_t)(h < 254 ? h + 1 : 255);
+      if (height[f.node] > MAX_EXPR_DEPTH) rep.deep++;
+      state[f.node] = DONE;
+      stack.pop_back();
+    }
+  }
 
-    // cooldown
-    if (r.cooldownMs > 0 && (nowMs - r.lastTriggerMs) < r.cooldownMs) {
-      continue;
+  if (repair && rep.deep) {
+    for (auto& r : db.rules) {
+      int i = indexOf(r.exprRootId);
+      if (i < 0 || height[i] <= MAX_EXPR_DEPTH || !r.enabled) continue;
+      r.enabled = false;
+      rep.repaired++;
+      Serial.printf("[rules2] rule %u: expression %u levels deep (max %d), disabled\n",
+                    (unsigned)r.id, (unsigned)height[i], MAX_EXPR_DEPTH);
     }
+  }
+  return rep;
+}
 
-    r.lastTriggerMs = nowMs;
-    applyActions(r, nowMs);
+uint32_t validateRules2() {
+  GraphReport rep = walkGraph(true);
+  if (rep.repaired) db.changed();
+  uint32_t problems = rep.dangling + rep.cycles + rep.deep;
+  if (problems) {
+    Serial.printf("[rules2] graph: %u dangling refs, %u cycle edges, %u nodes too deep, %u repaired\n",
+                  (unsigned)rep.dangling, (unsigned)rep.cycles, (unsigned)rep.deep,
+                  (unsigned)rep.repaired);
   }
+  return problems;
+}
+
+// Whether the graph can take the edge just added, given the walk from
+// before it: no new cycle and no node newly past MAX_EXPR_DEPTH. A group
+// that was already too deep (an old file) doesn't block unrelated edits.
+static bool nestingOk(const GraphReport& before) {
+  GraphReport rep = walkGraph(false);
+  return rep.cycles <= before.cycles && rep.deep <= before.deep;
 }
 
 // -----------------------------------------------------------------------------
 // UI helpers (conditions)
 // -----------------------------------------------------------------------------
-uint32_t uiCreateDefaultCondition() {
-  Condition c;
-  c.id = db.allocId();
-  c.enabled = true;
-  c.name = "New condition";
-
-  c.type = CondType::CompareInputToConst;
-  c.inputKey = (N_INPUTS > 0) ? INPUT_KEYS[0] : "tank_temp_c";
-  c.op = CmpOp::GT;
+static uint32_t strBytes(const char* s) {
+  return (uint32_t)strlen(s) + 1;
+}
 
-  c.threshold = 0.0f;
-  c.rhsInputKey = (N_INPUTS > 0) ? INPUT_KEYS[0] : "tank_temp_c";
-  c.stableForMs = 0;
+// Pool room for a form post: any value may become a new string
+static uint32_t postBytes(WebServer& s) {
+  uint32_t n = 0;
+  for (int i = 0; i < s.args(); i++) n += s.arg(i).length() + 1;
+  return n;
+}
 
-  db.conditions.push_back(c);
-  return c.id;
+uint32_t uiCreateDefaultCondition() {
+  const char* name = "New condition";
+  const char* key = (N_INPUTS > 0) ? INPUT_KEYS[0] : "tank_temp_c";
+  Need more;
+  more.conditions = 1;
+  more.strBytes = strBytes(name) + strBytes(key);
+  if (!db.reserve(more)) return 0;
+
+  Condition* c = db.conditions.add();
+  c->id = db.allocId();
+  c->enabled = true;
+  c->name = db.intern(name);
+
+  c->type = CondType::CompareInputToConst;
+  c->inputKey = db.intern(key);
+  c->op = CmpOp::GT;
+
+  c->threshold = 0.0f;
+  c->rhsInputKey = c->inputKey;
+  c->stableForMs = 0;
+
+  db.changed();
+  return c->id;
 }
 
 void uiDeleteCondition(uint32_t id) {
   for (int i = (int)db.conditions.size() - 1; i >= 0; --i) {
-    if (db.conditions[i].id == id) {
-      db.conditions.erase(db.conditions.begin() + i);
-    }
+    if (db.conditions[i].id == id) db.conditions.erase(i);
   }
+  db.changed();
 }
 
 void uiSaveConditionsFromPost(WebServer& s) {
+  Need more;
+  more.strBytes = postBytes(s);
+  if (!db.reserve(more)) return;
+  db.changed();
   for (auto& c : db.conditions) {
     String base = "c" + String(c.id) + "_";
 
     c.enabled = s.hasArg(base + "en");
-    if (s.hasArg(base + "name")) c.name = s.arg(base + "name");
-    if (s.hasArg(base + "in"))   c.inputKey = s.arg(base + "in");
+    if (s.hasArg(base + "name")) c.name = db.intern(s.arg(base + "name"));
+    if (s.hasArg(base + "in"))   c.inputKey = db.intern(s.arg(base + "in"));
     if (s.hasArg(base + "op"))   c.op = strToOp2(s.arg(base + "op"));
 
     // RHS selector: CONST or INPUT
     String rhs = s.hasArg(base + "rhs") ? s.arg(base + "rhs") : "CONST";
     if (rhs == "INPUT") {
       c.type = CondType::CompareInputToInput;
-      if (s.hasArg(base + "rin")) c.rhsInputKey = s.arg(base + "rin");
+      if (s.hasArg(base + "rin")) c.rhsInputKey = db.intern(s.arg(base + "rin"));
     } else {
       c.type = CondType::CompareInputToConst;
       if (s.hasArg(base + "th")) c.threshold = s.arg(base + "th").toFloat();
@@ -244,40 +289,58 @@ void uiSaveConditionsFromPost(WebServer& s) {
 // -----------------------------------------------------------------------------
 // Rules (now select root group / expr)
 // -----------------------------------------------------------------------------
+// Leaf node for a condition. The caller has reserved an expr slot and the
+// "leaf" name.
+static uint32_t createLeafForCond(uint32_t condId) {
+  ExprNode* leaf = db.expr.add();
+  if (!leaf) return 0;
+  leaf->id = db.allocId();
+  leaf->type = ExprType::LeafCond;
+  leaf->condId = condId;
+  leaf->name = db.intern("leaf");
+  db.changed();
+  return leaf->id;
+}
+
 uint32_t uiCreateDefaultRule() {
   if (db.conditions.empty()) uiCreateDefaultCondition();
+  if (db.conditions.empty()) return 0;
+
+  const char* name = "New rule";
+  const char* out = (N_OUTPUTS > 0) ? OUTPUT_KEYS[0] : "m_relay1";
+  Need more;
+  more.expr = 1;
+  more.rules = 1;
+  more.actions = 1;
+  more.strBytes = strBytes("leaf") + strBytes(name) + strBytes(out);
+  if (!db.reserve(more)) return 0;
 
   // Default: leaf expression referencing first condition (so rule has something usable)
-  ExprNode leaf;
-  leaf.id = db.allocId();
-  leaf.type = ExprType::LeafCond;
-  leaf.condId = db.conditions[0].id;
-  leaf.name = "leaf";
-  db.expr.push_back(leaf);
-
-  Rule r;
-  r.id = db.allocId();
-  r.enabled = true;
-  r.name = "New rule";
-  r.exprRootId = leaf.id;
-  r.minEvalPeriodMs = 250;
-  r.cooldownMs = 0;
-
-  Action a;
-  a.type = ActionType::SetOutput;
-  a.outputKey = (N_OUTPUTS > 0) ? OUTPUT_KEYS[0] : "m_relay1";
-  a.on = true;
-  a.durationMs = 0;
-  r.actions.push_back(a);
-
-  db.rules.push_back(r);
-  return r.id;
+  uint32_t leafId = createLeafForCond(db.conditions[0].id);
+
+  Rule* r = db.rules.add();
+  r->id = db.allocId();
+  r->enabled = true;
+  r->name = db.intern(name);
+  r->exprRootId = leafId;
+  r->minEvalPeriodMs = 250;
+  r->cooldownMs = 0;
+
+  Action* a = db.addAction(*r);
+  a->type = ActionType::SetOutput;
+  a->outputKey = db.intern(out);
+  a->on = true;
+  a->durationMs = 0;
+
+  db.changed();
+  return r->id;
 }
 
 void uiDeleteRule(uint32_t id) {
   for (int i = (int)db.rules.size() - 1; i >= 0; --i) {
-    if (db.rules[i].id == id) db.rules.erase(db.rules.begin() + i);
+    if (db.rules[i].id == id) db.rules.erase(i);
   }
+  db.changed();
 }
 
 // Save rule from POST:
@@ -288,16 +351,34 @@ void uiSaveRuleFromPost(WebServer& s) {
   if (!s.hasArg("id")) return;
   uint32_t id = (uint32_t)s.arg("id").toInt();
 
+  // 2) If user used checkbox builder, it posts cond checkboxes.
+  // Collect selected condition IDs (checkboxes named 'cond')
+  std::vector<uint32_t> selected;
+  for (int i = 0; i < s.args(); i++) {
+    if (s.argName(i) == "cond") {
+      selected.push_back((uint32_t)s.arg(i).toInt());
+    }
+  }
+
+  Need more;
+  more.expr = selected.size() + 1;
+  more.children = selected.size();
+  more.actions = 1;
+  more.strBytes = postBytes(s) + strBytes("leaf") + strBytes(BUILDER_GROUP);
+  if (!db.reserve(more)) return;
+
   Rule* r = db.findRule(id);
   if (!r) return;
+  db.changed();
 
-  if (s.hasArg("name")) r->name = s.arg("name");
+  if (s.hasArg("name")) r->name = db.intern(s.arg("name"));
   r->enabled = s.hasArg("en");
 
 
 
   if (s.hasArg("minEval")) r->minEvalPeriodMs = (uint32_t)s.arg("minEval").toInt();
   if (s.hasArg("cooldown")) r->cooldownMs = (uint32_t)s.arg("cooldown").toInt();
+  if (s.hasArg("unk")) r->onUnknown = strToUnknownPolicy(s.arg("unk"));
   if (s.hasArg("priority")) r->priority = (int16_t)s.arg("priority").toInt();
 
 
@@ -315,37 +396,19 @@ void uiSaveRuleFromPost(WebServer& s) {
     }
   }
 
-  // 2) If user used checkbox builder, it posts cond checkboxes.
-  // Collect selected condition IDs (checkboxes named 'cond')
-  std::vector<uint32_t> selected;
-  for (int i = 0; i < s.args(); i++) {
-    if (s.argName(i) == "cond") {
-      selected.push_back((uint32_t)s.arg(i).toInt());
-    }
-  }
-
   // If user provided cond selections, rebuild a flat group and set as root
   if (!selected.empty()) {
     std::vector<uint32_t> leaves;
-    for (uint32_t cid : selected) {
-      ExprNode leaf;
-      leaf.id = db.allocId();
-      leaf.type = ExprType::LeafCond;
-      leaf.condId = cid;
-      leaf.name = "leaf";
-      db.expr.push_back(leaf);
-      leaves.push_back(leaf.id);
-    }
+    for (uint32_t cid : selected) leaves.push_back(createLeafForCond(cid));
 
-    ExprNode root;
-    root.id = db.allocId();
+    ExprNode* root = db.expr.add();
+    root->id = db.allocId();
     String mode = s.hasArg("exprMode") ? s.arg("exprMode") : "AND";
-    root.type = (mode == "OR") ? ExprType::Or : ExprType::And;
-    root.name = "MVP group";
-    root.children = leaves;
-    db.expr.push_back(root);
+    root->type = (mode == "OR") ? ExprType::Or : ExprType::And;
+    root->name = db.intern(BUILDER_GROUP);
+    db.setChildren(*root, leaves.data(), leaves.size());
 
-    r->exprRootId = root.id;
+    r->exprRootId = root->id;
   }
 
   // Safety: If rule has no valid expr root, disable it
@@ -355,10 +418,10 @@ void uiSaveRuleFromPost(WebServer& s) {
   }
 
   // Save single action (MVP)
-  if (r->actions.empty()) r->actions.push_back(Action{});
-  Action& a = r->actions[0];
+  if (r->actions.count == 0) db.addAction(*r);
+  Action& a = db.actions(*r)[0];
 
-  if (s.hasArg("out")) a.outputKey = s.arg("out");
+  if (s.hasArg("out")) a.outputKey = db.intern(s.arg("out"));
   if (s.hasArg("on"))  a.on = (s.arg("on").toInt() != 0);
   if (s.hasArg("dur")) a.durationMs = (uint32_t)s.arg("dur").toInt();
 }
@@ -367,20 +430,27 @@ void uiSaveRuleFromPost(WebServer& s) {
 // Groups (ExprNode) helpers
 // -----------------------------------------------------------------------------
 uint32_t uiCreateGroup(const String& name, bool isOr) {
-  ExprNode g;
-  g.id = db.allocId();
-  g.type = isOr ? ExprType::Or : ExprType::And;
-  g.name = name.length() ? name : String(isOr ? "New OR group" : "New AND group");
-  db.expr.push_back(g);
-  return g.id;
+  const char* nm = name.length() ? name.c_str() : (isOr ? "New OR group" : "New AND group");
+  Need more;
+  more.expr = 1;
+  more.strBytes = strBytes(nm);
+  if (!db.reserve(more)) return 0;
+
+  ExprNode* g = db.expr.add();
+  g->id = db.allocId();
+  g->type = isOr ? ExprType::Or : ExprType::And;
+  g->name = db.intern(nm);
+  db.changed();
+  return g->id;
 }
 
 void uiDeleteExprNode(uint32_t exprId) {
+  db.changed();
   // Basic delete: remove the node from db.expr, and remove references from any group children lists.
   for (auto& e : db.expr) {
     if (e.type == ExprType::And || e.type == ExprType::Or) {
-      for (int i = (int)e.children.size() - 1; i >= 0; --i) {
-        if (e.children[i] == exprId) e.children.erase(e.children.begin() + i);
+      for (int i = (int)e.children.count - 1; i >= 0; --i) {
+        if (db.children(e)[i] == exprId) db.removeChild(e, i);
       }
     }
     if (e.type == ExprType::Not && e.child == exprId) {
@@ -389,7 +459,7 @@ void uiDeleteExprNode(uint32_t exprId) {
   }
 
   for (int i = (int)db.expr.size() - 1; i >= 0; --i) {
-    if (db.expr[i].id == exprId) db.expr.erase(db.expr.begin() + i);
+    if (db.expr[i].id == exprId) db.expr.erase(i);
   }
 
   // Also detach rules that reference it
@@ -404,10 +474,14 @@ void uiDeleteExprNode(uint32_t exprId) {
 void uiSaveGroupFromPost(WebServer& s) {
   if (!s.hasArg("id")) return;
   uint32_t id = (uint32_t)s.arg("id").toInt();
+  Need more;
+  more.strBytes = postBytes(s);
+  if (!db.reserve(more)) return;
   ExprNode* g = db.findExpr(id);
   if (!g) return;
+  db.changed();
 
-  if (s.hasArg("name")) g->name = s.arg("name");
+  if (s.hasArg("name")) g->name = db.intern(s.arg("name"));
 
   if (s.hasArg("gtype")) {
     String t = s.arg("gtype");
@@ -416,16 +490,6 @@ void uiSaveGroupFromPost(WebServer& s) {
   }
 }
 
-static uint32_t createLeafForCond(uint32_t condId) {
-  ExprNode leaf;
-  leaf.id = db.allocId();
-  leaf.type = ExprType::LeafCond;
-  leaf.condId = condId;
-  leaf.name = "leaf";
-  db.expr.push_back(leaf);
-  return leaf.id;
-}
-
 void uiAddChildToGroupFromPost(WebServer& s) {
   if (!s.hasArg("gid")) return;
   uint32_t gid = (uint32_t)s.arg("gid").toInt();
@@ -433,21 +497,35 @@ void uiAddChildToGroupFromPost(WebServer& s) {
   if (!g) return;
   if (!(g->type == ExprType::And || g->type == ExprType::Or)) return;
 
+  // Up to two children; each may move the group's range to the end
+  Need more;
+  more.expr = 1;
+  more.children = 2 * (g->children.count + 2);
+  more.strBytes = strBytes("leaf");
+  if (!db.reserve(more)) return;
+  g = db.findExpr(gid);   // reserve() may have rebuilt the Db
+  db.changed();
+  GraphReport before = walkGraph(false);
+
   // Add a condition as a new leaf
   if (s.hasArg("addCond")) {
     uint32_t cid = (uint32_t)s.arg("addCond").toInt();
-    if (db.findCond(cid)) {
-      uint32_t leafId = createLeafForCond(cid);
-      g->children.push_back(leafId);
+    if (db.findCond(cid) && db.addChild(*g, createLeafForCond(cid)) && !nestingOk(before)) {
+      db.removeChild(*g, g->children.count - 1);
+      Serial.printf("[rules2] group %u: would nest deeper than %d, not added\n",
+                    (unsigned)gid, MAX_EXPR_DEPTH);
     }
   }
 
   // Add an existing group as a child (nesting)
   if (s.hasArg("addGroup")) {
     uint32_t childId = (uint32_t)s.arg("addGroup").toInt();
-    if (childId != 0 && childId != gid && db.findExpr(childId)) {
-      // Basic cycle protection: disallow self
-      g->children.push_back(childId);
+    if (childId != 0 && childId != gid && db.findExpr(childId) && db.addChild(*g, childId) &&
+        !nestingOk(before)) {
+      // A -> B -> A, or too deep: the engine would refuse the rule anyway
+      db.removeChild(*g, g->children.count - 1);
+      Serial.printf("[rules2] group %u: child %u makes a cycle or nests deeper than %d, not added\n",
+                    (unsigned)gid, (unsigned)childId, MAX_EXPR_DEPTH);
     }
   }
 }
@@ -461,8 +539,9 @@ void uiRemoveChildFromGroupFromPost(WebServer& s) {
   if (!g) return;
   if (!(g->type == ExprType::And || g->type == ExprType::Or)) return;
 
-  if (idx < 0 || idx >= (int)g->children.size()) return;
-  g->children.erase(g->children.begin() + idx);
+  if (idx < 0 || idx >= (int)g->children.count) return;
+  db.removeChild(*g, idx);
+  db.changed();
 }
 
 // -----------------------------------------------------------------------------
@@ -480,7 +559,7 @@ static void collectLeafCondIds(uint32_t exprId, std::vector<uint32_t>& out) {
     collectLeafCondIds(n->child, out);
     return;
   }
-  for (uint32_t childId : n->children) {
+  for (uint32_t childId : db.children(*n)) {
     collectLeafCondIds(childId, out);
   }
 }
@@ -500,19 +579,22 @@ const char* getRuleExprModeStr(uint32_t ruleId) {
   return (root->type == ExprType::Or) ? "OR" : "AND";
 }
 
+String labelOf(Str name, const char* kind, uint32_t id) {
+  const char* s = db.str(name);
+  return *s ? String(s) : String(kind) + " " + id;
+}
+
 String describeExpr(uint32_t exprId) {
   ExprNode* e = db.findExpr(exprId);
   if (!e) return "none";
   if (e->type == ExprType::And || e->type == ExprType::Or) {
     String t = (e->type == ExprType::Or) ? "OR" : "AND";
-    String nm = e->name.length() ? e->name : String("group ") + e->id;
-    return nm + " [" + t + "] (" + String((int)e->children.size()) + ")";
+    return labelOf(e->name, "group", e->id) + " [" + t + "] (" + String((int)e->children.count) + ")";
   }
   if (e->type == ExprType::LeafCond) {
     Condition* c = db.findCond(e->condId);
     if (!c) return String("leaf(cond ") + e->condId + ")";
-    String nm = c->name.length() ? c->name : String("cond ") + c->id;
-    return "leaf: " + nm;
+    return "leaf: " + labelOf(c->name, "cond", c->id);
   }
   if (e->type == ExprType::Not) {
     return "NOT(...)";
@@ -520,10 +602,156 @@ String describeExpr(uint32_t exprId) {
   return "expr";
 }
 
+// -----------------------------------------------------------------------------
+// Expression GC
+//
+// The checkbox builder makes new leaves and a new group on every save, and
+// deletes leave nodes behind, so db.expr only grows. Before a save and
+// after a load:
+//   - Duplicates merge: leaves on the same condition, NOTs of the same node
+//     and AND/ORs of the same type over the same children become one node,
+//     and references are rewritten to it. Passes repeat until nothing
+//     merges, so equal subtrees collapse from the leaves up. User groups
+//     (any AND/OR the builder didn't make) never merge either way: a
+//     builder group equal to one stays separate, or a rule the checkboxes
+//     made would follow later edits to the user's group.
+//   - Nodes not reachable from a rule root or a user group are dropped.
+// -----------------------------------------------------------------------------
+static bool isUserGroup(const ExprNode& e) {
+  return (e.type == ExprType::And || e.type == ExprType::Or) &&
+         strcmp(db.str(e.name), BUILDER_GROUP) != 0;
+}
+
+uint32_t gcRules2() {
+  uint32_t n = db.expr.size();
+  ExprIndex indexOf;
+
+  // rep[i]: the node standing in for node i
+  std::vector<uint32_t> rep(n);
+  for (uint32_t i = 0; i < n; i++) rep[i] = i;
+  auto canon = [&](uint32_t id) -> uint32_t {
+    int i = indexOf(id);
+    if (i < 0) return id;   // dangling: left as is
+    while (rep[i] != (uint32_t)i) i = rep[i];
+    return db.expr[i].id;
+  };
+
+  auto shapeHash = [&](const ExprNode& e) {
+    uint32_t h = 2166136261u;
+    auto mix = [&](uint32_t v) { h = (h ^ v) * 16777619u; };
+    mix((uint32_t)e.type);
+    if (e.type == ExprType::LeafCond) mix(e.condId);
+    else if (e.type == ExprType::Not) mix(canon(e.child));
+    else for (uint32_t c : db.children(e)) mix(canon(c));
+    return h;
+  };
+  auto sameShape = [&](const ExprNode& a, const ExprNode& b) {
+    if (a.type != b.type) return false;
+    if (a.type == ExprType::LeafCond) return a.condId == b.condId;
+    if (a.type == ExprType::Not) return canon(a.child) == canon(b.child);
+    if (a.children.count != b.children.count) return false;
+    Span<uint32_t> ka = db.children(a), kb = db.children(b);
+    for (uint32_t k = 0; k < ka.size(); k++) {
+      if (canon(ka[k]) != canon(kb[k])) return false;
+    }
+    return true;
+  };
+
+  uint32_t merged = 0;
+  for (bool again = true; again;) {
+    again = false;
+    std::unordered_multimap<uint32_t, uint32_t> seen;
+    for (uint32_t i = 0; i < n; i++) {
+      if (rep[i] != i) continue;
+      const ExprNode& e = db.expr[i];
+      if (isUserGroup(e)) continue;
+      uint32_t h = shapeHash(e);
+      bool dup = false;
+      auto range = seen.equal_range(h);
+      for (auto it = range.first; it != range.second && !dup; ++it) {
+        if (sameShape(db.expr[it->second], e)) {
+          rep[i] = it->second;
+          dup = true;
+        }
+      }
+      if (dup) {
+        merged++;
+        again = true;
+      } else {
+        seen.insert({ h, i });
+      }
+    }
+  }
+
+  // Point everything at the representatives; AND/OR drop repeated children
+  bool rewrote = merged > 0;
+  for (auto& r : db.rules) {
+    if (r.exprRootId) r.exprRootId = canon(r.exprRootId);
+  }
+  for (auto& e : db.expr) {
+    if (e.type == ExprType::Not) {
+      if (e.child) e.child = canon(e.child);
+    } else if (e.type == ExprType::And || e.type == ExprType::Or) {
+      Span<uint32_t> kids = db.children(e);
+      uint32_t w = 0;
+      for (uint32_t k = 0; k < kids.size(); k++) {
+        uint32_t c = canon(kids[k]);
+        bool repeat = false;
+        for (uint32_t j = 0; j < w && !repeat; j++) repeat = (kids[j] == c);
+        if (!repeat) kids[w++] = c;
+      }
+      if (w != e.children.count) rewrote = true;
+      e.children.count = w;
+    }
+  }
+
+  // Mark from the roots with an explicit stack (the graph may be deep)
+  std::vector<uint8_t> live(n, 0);
+  std::vector<uint32_t> stack;
+  auto reach = [&](uint32_t id) {
+    int i = indexOf(id);
+    if (i >= 0 && !live[i]) {
+      live[i] = 1;
+      stack.push_back(i);
+    }
+  };
+  for (const auto& r : db.rules) reach(r.exprRootId);
+  for (const auto& e : db.expr) if (isUserGroup(e)) reach(e.id);
+  while (!stack.empty()) {
+    const ExprNode& e = db.expr[stack.back()];
+    stack.pop_back();
+    if (e.type == ExprType::Not) reach(e.child);
+    else if (e.type != ExprType::LeafCond) for (uint32_t c : db.children(e)) reach(c);
+  }
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (!live[i]) continue;
+    if (kept != i) db.expr[kept] = db.expr[i];
+    kept++;
+  }
+  db.expr.truncate(kept);
+  uint32_t removed = n - kept;
+
+  if (removed) {
+    db.compact();   // also drops the removed nodes' children and strings
+  } else if (rewrote) {
+    db.changed();
+  }
+  if (removed || rewrote) {
+    Serial.printf("[rules2] gc: %u merged, %u removed, %u expr left\n",
+                  (unsigned)merged, (unsigned)removed, (unsigned)kept);
+  }
+  return removed;
+}
+
 // -----------------------------------------------------------------------------
 // Persistence stubs
 // -----------------------------------------------------------------------------
 void saveRules2() {
+  validateRules2();
+  gcRules2();   // only live, deduplicated nodes reach the file
+
   // Bump this if you add more fields or have lots of rules/expr/conds.
   // ESP32-S3 should handle 48KB fine.
   DynamicJsonDocument doc(49152);
@@ -531,6 +759,8 @@ void saveRules2() {
   doc["schema"] = RULES2_SCHEMA;
   doc["nextId"] = db.nextId;
 
+  // Strings are stored by pointer; the pool outlives the document
+
   // ---------------------------------------------------------------------------
   // Conditions
   // ---------------------------------------------------------------------------
@@ -539,14 +769,14 @@ void saveRules2() {
     JsonObject o = conds.createNestedObject();
     o["id"] = c.id;
     o["enabled"] = c.enabled;
-    o["name"] = c.name;
+    o["name"] = db.str(c.name);
 
     o["type"] = (uint8_t)c.type;
-    o["inputKey"] = c.inputKey;
+    o["inputKey"] = db.str(c.inputKey);
     o["op"] = (uint8_t)c.op;
 
     o["threshold"] = c.threshold;
-    o["rhsInputKey"] = c.rhsInputKey;
+    o["rhsInputKey"] = db.str(c.rhsInputKey);
 
     o["stableForMs"] = c.stableForMs;
   }
@@ -559,13 +789,13 @@ void saveRules2() {
     JsonObject o = expr.createNestedObject();
     o["id"] = e.id;
     o["type"] = (uint8_t)e.type;
-    o["name"] = e.name;
+    o["name"] = db.str(e.name);
 
     o["condId"] = e.condId;
     o["child"] = e.child;
 
     JsonArray kids = o.createNestedArray("children");
-    for (uint32_t cid : e.children) kids.add(cid);
+    for (uint32_t cid : db.children(e)) kids.add(cid);
   }
 
   // ---------------------------------------------------------------------------
@@ -577,17 +807,18 @@ void saveRules2() {
     o["id"] = r.id;
     o["priority"] = r.priority;   // lower = higher priority (0 is top)
     o["enabled"] = r.enabled;
-    o["name"] = r.name;
+    o["name"] = db.str(r.name);
 
     o["exprRootId"] = r.exprRootId;
     o["minEvalPeriodMs"] = r.minEvalPeriodMs;
     o["cooldownMs"] = r.cooldownMs;
+    o["onUnknown"] = unknownPolicyToStr(r.onUnknown);
 
     JsonArray acts = o.createNestedArray("actions");
-    for (const auto& a : r.actions) {
+    for (const auto& a : db.actions(r)) {
       JsonObject ao = acts.createNestedObject();
       ao["type"] = (uint8_t)a.type;
-      ao["outputKey"] = a.outputKey;
+      ao["outputKey"] = db.str(a.outputKey);
       ao["on"] = a.on;
       ao["durationMs"] = a.durationMs;
     }
@@ -604,6 +835,7 @@ void saveRules2() {
 
   size_t n = serializeJson(doc, f);
   f.close();
+  metricsFsWrite(n);
 
   Serial.printf("[rules2] saveRules2: wrote %u bytes, rules=%u, expr=%u, cond=%u\n",
                 (unsigned)n,
@@ -616,6 +848,33 @@ void saveRules2() {
   }
 }
 
+static uint32_t jsonStrBytes(JsonVariant v) {
+  return strBytes(v | "");
+}
+
+// Everything a parsed file will put into a Db
+static Need countFile(JsonDocument& doc) {
+  Need n;
+  for (JsonObject o : doc["conditions"].as<JsonArray>()) {
+    n.conditions++;
+    n.strBytes += jsonStrBytes(o["name"]) + jsonStrBytes(o["inputKey"]) + jsonStrBytes(o["rhsInputKey"]);
+  }
+  for (JsonObject o : doc["expr"].as<JsonArray>()) {
+    n.expr++;
+    n.children += o["children"].as<JsonArray>().size();
+    n.strBytes += jsonStrBytes(o["name"]);
+  }
+  for (JsonObject o : doc["rules"].as<JsonArray>()) {
+    n.rules++;
+    n.strBytes += jsonStrBytes(o["name"]);
+    for (JsonObject ao : o["actions"].as<JsonArray>()) {
+      n.actions++;
+      n.strBytes += jsonStrBytes(ao["outputKey"]);
+    }
+  }
+  return n;
+}
+
 void loadRules2() {
   if (!LittleFS.exists(RULES2_PATH)) {
     Serial.println("[rules2] loadRules2: no file, starting empty");
@@ -644,12 +903,15 @@ void loadRules2() {
     return;
   }
 
-  // Clear DB first
-  db.conditions.clear();
-  db.expr.clear();
-  db.rules.clear();
+  // Size the new Db from the file and fill it; the live one is swapped out
+  // at the end (and freed with `fresh`)
+  Db fresh;
+  if (!fresh.reserve(countFile(doc))) {
+    Serial.println("[rules2] loadRules2: out of memory");
+    return;
+  }
 
-  db.nextId = (uint32_t)(doc["nextId"] | 1);
+  fresh.nextId = (uint32_t)(doc["nextId"] | 1);
 
   // ---------------------------------------------------------------------------
   // Conditions
@@ -657,25 +919,19 @@ void loadRules2() {
   JsonArray conds = doc["conditions"].as<JsonArray>();
   if (!conds.isNull()) {
     for (JsonObject o : conds) {
-      Condition c;
-      c.id = (uint32_t)(o["id"] | 0);
-      c.enabled = (bool)(o["enabled"] | true);
-      c.name = String((const char*)(o["name"] | ""));
-
-      c.type = (CondType)(uint8_t)(o["type"] | (uint8_t)CondType::CompareInputToConst);
-      c.inputKey = String((const char*)(o["inputKey"] | ""));
-      c.op = (CmpOp)(uint8_t)(o["op"] | (uint8_t)CmpOp::GT);
+      Condition* c = fresh.conditions.add();
+      c->id = (uint32_t)(o["id"] | 0);
+      c->enabled = (bool)(o["enabled"] | true);
+      c->name = fresh.intern((const char*)(o["name"] | ""));
 
-      c.threshold = (float)(o["threshold"] | 0.0);
-      c.rhsInputKey = String((const char*)(o["rhsInputKey"] | ""));
+      c->type = (CondType)(uint8_t)(o["type"] | (uint8_t)CondType::CompareInputToConst);
+      c->inputKey = fresh.intern((const char*)(o["inputKey"] | ""));
+      c->op = (CmpOp)(uint8_t)(o["op"] | (uint8_t)CmpOp::GT);
 
-      c.stableForMs = (uint32_t)(o["stableForMs"] | 0);
+      c->threshold = (float)(o["threshold"] | 0.0);
+      c->rhsInputKey = fresh.intern((const char*)(o["rhsInputKey"] | ""));
 
-      // Reset runtime
-      c.lastEval = false;
-      c.lastFlipMs = 0;
-
-      db.conditions.push_back(c);
+      c->stableForMs = (uint32_t)(o["stableForMs"] | 0);
     }
   }
 
@@ -685,21 +941,18 @@ void loadRules2() {
   JsonArray expr = doc["expr"].as<JsonArray>();
   if (!expr.isNull()) {
     for (JsonObject o : expr) {
-      ExprNode e;
-      e.id = (uint32_t)(o["id"] | 0);
-      e.type = (ExprType)(uint8_t)(o["type"] | (uint8_t)ExprType::LeafCond);
-      e.name = String((const char*)(o["name"] | ""));
+      ExprNode* e = fresh.expr.add();
+      e->id = (uint32_t)(o["id"] | 0);
+      e->type = (ExprType)(uint8_t)(o["type"] | (uint8_t)ExprType::LeafCond);
+      e->name = fresh.intern((const char*)(o["name"] | ""));
 
-      e.condId = (uint32_t)(o["condId"] | 0);
-      e.child = (uint32_t)(o["child"] | 0);
+      e->condId = (uint32_t)(o["condId"] | 0);
+      e->child = (uint32_t)(o["child"] | 0);
 
-      e.children.clear();
       JsonArray kids = o["children"].as<JsonArray>();
       if (!kids.isNull()) {
-        for (JsonVariant v : kids) e.children.push_back((uint32_t)(v | 0));
+        for (JsonVariant v : kids) fresh.addChild(*e, (uint32_t)(v | 0));
       }
-
-      db.expr.push_back(e);
     }
   }
 
@@ -709,38 +962,32 @@ void loadRules2() {
   JsonArray rules = doc["rules"].as<JsonArray>();
   if (!rules.isNull()) {
     for (JsonObject o : rules) {
-      Rule r;
-      r.id = (uint32_t)(o["id"] | 0);
-      r.priority = (int16_t)(o["priority"] | 0);
-      r.enabled = (bool)(o["enabled"] | true);
-      r.name = String((const char*)(o["name"] | ""));
+      Rule* r = fresh.rules.add();
+      r->id = (uint32_t)(o["id"] | 0);
+      r->priority = (int16_t)(o["priority"] | 0);
+      r->enabled = (bool)(o["enabled"] | true);
+      r->name = fresh.intern((const char*)(o["name"] | ""));
 
-      r.exprRootId = (uint32_t)(o["exprRootId"] | 0);
-      r.minEvalPeriodMs = (uint32_t)(o["minEvalPeriodMs"] | 250);
-      r.cooldownMs = (uint32_t)(o["cooldownMs"] | 0);
+      r->exprRootId = (uint32_t)(o["exprRootId"] | 0);
+      r->minEvalPeriodMs = (uint32_t)(o["minEvalPeriodMs"] | 250);
+      r->cooldownMs = (uint32_t)(o["cooldownMs"] | 0);
+      r->onUnknown = strToUnknownPolicy(String((const char*)(o["onUnknown"] | "hold")));
 
-      r.actions.clear();
       JsonArray acts = o["actions"].as<JsonArray>();
       if (!acts.isNull()) {
         for (JsonObject ao : acts) {
-          Action a;
-          a.type = (ActionType)(uint8_t)(ao["type"] | (uint8_t)ActionType::SetOutput);
-          a.outputKey = String((const char*)(ao["outputKey"] | ""));
-          a.on = (bool)(ao["on"] | true);
-          a.durationMs = (uint32_t)(ao["durationMs"] | 0);
-          r.actions.push_back(a);
+          Action* a = fresh.addAction(*r);
+          a->type = (ActionType)(uint8_t)(ao["type"] | (uint8_t)ActionType::SetOutput);
+          a->outputKey = fresh.intern((const char*)(ao["outputKey"] | ""));
+          a->on = (bool)(ao["on"] | true);
+          a->durationMs = (uint32_t)(ao["durationMs"] | 0);
         }
       }
-
-      // Reset runtime
-      r.lastEvalMs = 0;
-      r.lastTriggerMs = 0;
-      r.lastResult = false;
-
-      db.rules.push_back(r);
     }
   }
 
+  db.swap(fresh);   // counts as an edit (gen moves)
+
   // ---------------------------------------------------------------------------
   // Recompute nextId safely (prevents duplicate IDs)
   // ---------------------------------------------------------------------------
@@ -750,27 +997,17 @@ void loadRules2() {
   for (const auto& r : db.rules)      if (r.id > maxId) maxId = r.id;
   if (db.nextId <= maxId) db.nextId = maxId + 1;
 
-  // ---------------------------------------------------------------------------
-  // Optional sanity warnings
-  // ---------------------------------------------------------------------------
-  for (const auto& r : db.rules) {
-    if (r.exprRootId && !db.findExpr(r.exprRootId)) {
-      Serial.printf("[rules2] WARN: rule %u root expr %u missing\n",
-                    (unsigned)r.id, (unsigned)r.exprRootId);
-    }
-  }
-  for (const auto& e : db.expr) {
-    if (e.type == ExprType::LeafCond && e.condId && !db.findCond(e.condId)) {
-      Serial.printf("[rules2] WARN: expr %u leaf cond %u missing\n",
-                    (unsigned)e.id, (unsigned)e.condId);
-    }
-  }
+  // A hand-edited or old file may be cyclic (older firmware only refused a
+  // group nesting itself); repair before the engine sees it
+  validateRules2();
+  gcRules2();   // files from before the GC carry every builder leftover
 
-  Serial.printf("[rules2] loadRules2: rules=%u, expr=%u, cond=%u, nextId=%u\n",
+  Serial.printf("[rules2] loadRules2: rules=%u, expr=%u, cond=%u, nextId=%u, %u B block\n",
                 (unsigned)db.rules.size(),
                 (unsigned)db.expr.size(),
                 (unsigned)db.conditions.size(),
-                (unsigned)db.nextId);
+                (unsigned)db.nextId,
+                (unsigned)db.blockBytes());
 
   if (doc.overflowed()) {
     Serial.println("[rules2] loadRules2: WARNING doc overflowed (increase capacity)");
@@ -783,14 +1020,25 @@ void loadRules2() {
 // Demo bootstrap
 // -----------------------------------------------------------------------------
 void initRules2Defaults() {
-  db = Db{};
+  db.clear();
+  db.changed();
   db.nextId = 1;
 
+  // Room for the whole demo up front, so the pointers below stay valid
+  Need demo;
+  demo.conditions = 2;
+  demo.expr = 3;
+  demo.rules = 1;
+  demo.actions = 1;
+  demo.children = 2;
+  demo.strBytes = 192;
+  if (!db.reserve(demo)) return;
+
   // Make two conditions
   uint32_t c1 = uiCreateDefaultCondition();
   if (auto* c = db.findCond(c1)) {
-    c->name = "PV V > 50";
-    c->inputKey = "pv_v";
+    c->name = db.intern("PV V > 50");
+    c->inputKey = db.intern("pv_v");
     c->type = CondType::CompareInputToConst;
     c->threshold = 50.0f;
     c->stableForMs = 1000;
@@ -798,8 +1046,8 @@ void initRules2Defaults() {
 
   uint32_t c2 = uiCreateDefaultCondition();
   if (auto* c = db.findCond(c2)) {
-    c->name = "Tank temp > 40";
-    c->inputKey = "tank_temp_c";
+    c->name = db.intern("Tank temp > 40");
+    c->inputKey = db.intern("tank_temp_c");
     c->type = CondType::CompareInputToConst;
     c->threshold = 40.0f;
     c->stableForMs = 0;
@@ -809,27 +1057,24 @@ void initRules2Defaults() {
   // g_or = (c1 OR c2)
   uint32_t g_or = uiCreateGroup("Demo OR", true);
   if (auto* g = db.findExpr(g_or)) {
-    g->children.push_back(createLeafForCond(c1));
-    g->children.push_back(createLeafForCond(c2));
+    db.addChild(*g, createLeafForCond(c1));
+    db.addChild(*g, createLeafForCond(c2));
   }
 
   // Create a rule using g_or root
-  Rule r;
-  r.id = db.allocId();
-  r.enabled = true;
-  r.name = "Demo: (PV OR Tank) -> aux1";
-  r.exprRootId = g_or;
-  r.minEvalPeriodMs = 500;
-  r.cooldownMs = 5000;
-
-  Action a;
-  a.type = ActionType::SetOutput;
-  a.outputKey = "m_aux1";
-  a.on = true;
-  a.durationMs = 2000;
-  r.actions.push_back(a);
-
-  db.rules.push_back(r);
+  Rule* r = db.rules.add();
+  r->id = db.allocId();
+  r->enabled = true;
+  r->name = db.intern("Demo: (PV OR Tank) -> aux1");
+  r->exprRootId = g_or;
+  r->minEvalPeriodMs = 500;
+  r->cooldownMs = 5000;
+
+  Action* a = db.addAction(*r);
+  a->type = ActionType::SetOutput;
+  a->outputKey = db.intern("m_aux1");
+  a->on = true;
+  a->durationMs = 2000;
 }
 
 } // namespace rules2
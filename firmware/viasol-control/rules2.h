@@ -14,6 +14,47 @@ namespace rules2 {
 // -----------------------------------------------------------------------------
 enum class CmpOp : uint8_t { GT, GE, LT, LE, EQ, NE };
 
+// -----------------------------------------------------------------------------
+// Three-valued results (Kleene logic). A condition on a Stale or Missing
+// input is Unknown; AND/OR only resolve past an Unknown child when another
+// child decides the result on its own (false AND x, true OR x).
+// -----------------------------------------------------------------------------
+enum class Tri : uint8_t { False, True, Unknown };
+
+// What a rule does with its outputs while its expression is Unknown.
+enum class UnknownPolicy : uint8_t {
+  Hold,   // leave outputs as they are, don't trigger
+  Off,    // drive every action output off (fail safe for heaters, pumps)
+  On      // drive every action output on (e.g. freeze protection)
+};
+
+const char* unknownPolicyToStr(UnknownPolicy p);   // "hold" | "off" | "on"
+UnknownPolicy strToUnknownPolicy(const String& s);
+
+// -----------------------------------------------------------------------------
+// Storage handles (see Db)
+// -----------------------------------------------------------------------------
+struct Str {
+  uint32_t off = 0;      // into the Db's string pool; 0 is ""
+};
+
+struct Range {
+  uint32_t first = 0;    // into a shared Db table
+  uint32_t count = 0;
+};
+
+template <typename T>
+struct Span {
+  T* p = nullptr;
+  uint32_t n = 0;
+
+  uint32_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  T& operator[](uint32_t i) const { return p[i]; }
+  T* begin() const { return p; }
+  T* end() const { return p + n; }
+};
+
 // -----------------------------------------------------------------------------
 // Condition blocks (atomic IFs)
 // -----------------------------------------------------------------------------
@@ -25,18 +66,18 @@ enum class CondType : uint8_t {
 struct Condition {
   uint32_t id = 0;
   bool enabled = true;
-  String name;
+  Str name;
 
   CondType type = CondType::CompareInputToConst;
 
-  String inputKey;
+  Str inputKey;
   CmpOp op = CmpOp::GT;
 
   // RHS = CONST
   float threshold = 0.0f;
 
   // RHS = INPUT
-  String rhsInputKey;
+  Str rhsInputKey;
 
   // Stability helpers
   uint32_t stableForMs = 0;
@@ -55,7 +96,7 @@ enum class ExprType : uint8_t { LeafCond, And, Or, Not };
 struct ExprNode {
   uint32_t id = 0;
   ExprType type = ExprType::LeafCond;
-  String name;                 // used for groups (and can be used for leaves too)
+  Str name;                    // used for groups (and can be used for leaves too)
 
   // LeafCond
   uint32_t condId = 0;
@@ -63,8 +104,8 @@ struct ExprNode {
   // Not
   uint32_t child = 0;
 
-  // And / Or
-  std::vector<uint32_t> children;
+  // And / Or: ids in the Db's child table
+  Range children;
 };
 
 // -----------------------------------------------------------------------------
@@ -74,9 +115,11 @@ enum class ActionType : uint8_t { SetOutput };
 
 struct Action {
   ActionType type = ActionType::SetOutput;
-  String outputKey;
+  Str outputKey;
   bool on = true;
   uint32_t durationMs = 0;   // 0 = no hold
+
+  int8_t outIdx = -1;        // runtime: see outputIndexCached()
 };
 
 // -----------------------------------------------------------------------------
@@ -86,47 +129,160 @@ struct Rule {
   uint32_t id = 0;
   int16_t priority = 0;   // lower number = higher priority, UI sorting
   bool enabled = true;
-  String name;
+  Str name;
 
   uint32_t exprRootId = 0;
-  std::vector<Action> actions;
+  Range actions;          // in the Db's action table
 
   // Timing controls
   uint32_t minEvalPeriodMs = 250; // frequency limit
   uint32_t cooldownMs = 0;        // lockout after trigger
+  UnknownPolicy onUnknown = UnknownPolicy::Hold;
 
   // Runtime state
   uint32_t lastEvalMs = 0;
   uint32_t lastTriggerMs = 0;
   bool lastResult = false;
+  Tri lastTri = Tri::False;
+  uint32_t evals = 0;     // /metrics
+  uint32_t fires = 0;
 };
 
 // -----------------------------------------------------------------------------
 // In-memory database
+//
+// A Db lives in one heap block: fixed-capacity tables for the conditions,
+// expression nodes, rules, rule actions and group children, plus a pool of
+// interned strings. Names and keys are Str handles into the pool; a group's
+// children and a rule's actions are contiguous ranges of the shared child
+// and action tables. loadRules2() sizes the block from the file and fills
+// it in place (one allocation), and a whole Db is freed or swapped in one
+// step.
+//
+// Edits use the headroom left when the block was built. A mutator first
+// calls reserve() for what it may add; if that doesn't fit, the Db is
+// rebuilt into a bigger block, which also drops strings and ranges orphaned
+// by earlier edits. Pointers into the tables stay valid until the next
+// reserve() or compact().
 // -----------------------------------------------------------------------------
+template <typename T>
+class Table {
+ public:
+  uint32_t size() const { return n_; }
+  bool empty() const { return n_ == 0; }
+  uint32_t capacity() const { return cap_; }
+  T& operator[](uint32_t i) { return p_[i]; }
+  const T& operator[](uint32_t i) const { return p_[i]; }
+  T* begin() { return p_; }
+  T* end() { return p_ + n_; }
+  const T* begin() const { return p_; }
+  const T* end() const { return p_ + n_; }
+
+  // Default-initialized entry at the end, nullptr when full
+  T* add() {
+    if (n_ == cap_) return nullptr;
+    p_[n_] = T();
+    return &p_[n_++];
+  }
+  void erase(uint32_t i) {
+    if (i >= n_) return;
+    memmove((void*)(p_ + i), (const void*)(p_ + i + 1), (n_ - i - 1) * sizeof(T));
+    n_--;
+  }
+  void truncate(uint32_t n) {
+    if (n < n_) n_ = n;
+  }
+
+ private:
+  friend struct Db;
+  T* p_ = nullptr;
+  uint32_t n_ = 0;
+  uint32_t cap_ = 0;
+};
+
+// Room a mutator needs on top of what is in use
+struct Need {
+  uint32_t conditions = 0;
+  uint32_t expr = 0;
+  uint32_t rules = 0;
+  uint32_t actions = 0;
+  uint32_t children = 0;
+  uint32_t strBytes = 0;   // including terminators
+};
+
 struct Db {
-  std::vector<Condition> conditions;
-  std::vector<ExprNode> expr;
-  std::vector<Rule> rules;
+  Table<Condition> conditions;
+  Table<ExprNode> expr;
+  Table<Rule> rules;
+  Table<Action> actionTab;
+  Table<uint32_t> childTab;
 
   uint32_t nextId = 1;
+  uint32_t gen = 0;       // bumped by every edit; the engine recompiles on change
+
+  Db() = default;
+  ~Db();
+  Db(const Db&) = delete;
+  Db& operator=(const Db&) = delete;
 
   uint32_t allocId() { return nextId++; }
+  void changed() { gen++; }
+
+  // Empties the tables and the pool, keeping the block.
+  void clear();
+  // Exchanges contents (blocks included); gen keeps counting across it.
+  void swap(Db& o);
+  // Headroom for `more`; rebuilds into a bigger block if needed. False only
+  // when the allocation fails (the Db is unchanged then).
+  bool reserve(const Need& more);
+  // Rebuilds into a right-sized block, dropping orphaned strings/ranges.
+  bool compact();
+
+  Str intern(const char* s);
+  Str intern(const String& s) { return intern(s.c_str()); }
+  const char* str(Str s) const { return pool_ ? pool_ + s.off : ""; }
+
+  Span<uint32_t> children(const ExprNode& e) { return { childTab.p_ + e.children.first, e.children.count }; }
+  Span<Action> actions(const Rule& r) { return { actionTab.p_ + r.actions.first, r.actions.count }; }
+  bool addChild(ExprNode& g, uint32_t id);          // may move the range to the end
+  void removeChild(ExprNode& g, uint32_t idx);
+  bool setChildren(ExprNode& g, const uint32_t* ids, uint32_t n);
+  Action* addAction(Rule& r);
+
+  uint32_t blockBytes() const { return blockBytes_; }
+  uint32_t poolBytes() const { return poolUsed_; }
 
   Condition* findCond(uint32_t id);
   ExprNode* findExpr(uint32_t id);
   Rule* findRule(uint32_t id);
+
+ private:
+  bool alloc(const Need& cap);
+  void copyFrom(Db& o);
+  Need live();
+  template <typename T> T* growRange(Table<T>& t, Range& r);
+
+  uint8_t* block_ = nullptr;
+  uint32_t blockBytes_ = 0;
+  char* pool_ = nullptr;
+  uint32_t poolUsed_ = 0;
+  uint32_t poolCap_ = 0;
+  uint32_t* hash_ = nullptr;   // open addressing over pool offsets, 0 = empty
+  uint32_t hashCap_ = 0;       // power of two
+  uint32_t hashed_ = 0;
 };
 
 // Global Rules v2 DB
 extern Db db;
 
 // -----------------------------------------------------------------------------
-// Engine
+// Engine (rules2_engine.cpp). Runs on a compiled copy of the Db, rebuilt
+// whenever db.gen moves, so anything that edits the Db must call
+// db.changed(). Conditions read the catalog snapshot taken by ioSnapshot()
+// for this loop pass. A tick does not allocate.
 // -----------------------------------------------------------------------------
 void processRules2();
-bool evalCondition(Condition& c, uint32_t nowMs);
-bool evalExpr(uint32_t exprId, uint32_t nowMs);
+int holdCount();        // timed output holds pending
 
 // -----------------------------------------------------------------------------
 // UI helpers (conditions + rules)
@@ -154,6 +310,28 @@ void uiRemoveChildFromGroupFromPost(WebServer& s);     // remove by index
 void getRuleSelectedCondIds(uint32_t ruleId, std::vector<uint32_t>& out);
 const char* getRuleExprModeStr(uint32_t ruleId); // "AND" or "OR"
 String describeExpr(uint32_t exprId);            // short text for UI
+String labelOf(Str name, const char* kind, uint32_t id);  // name, or "<kind> <id>" if unnamed
+
+// -----------------------------------------------------------------------------
+// Maintenance
+// -----------------------------------------------------------------------------
+// Longest root-to-leaf path, in nodes. Deeper nesting is refused when
+// edited and disabled on load; the engine's walk stack is this big.
+static const int MAX_EXPR_DEPTH = 16;
+
+// Checks the expression graph: references to missing nodes, conditions or
+// roots, cycles, and nesting past MAX_EXPR_DEPTH. Repairs what it can
+// (drops dangling children and cycle edges, disables rules that are too
+// deep); a leaf on a deleted condition stays and evaluates Unknown, as does
+// a NOT whose child was cut, so the rule's onUnknown policy applies. A
+// group too deep that no rule starts at is only reported. Edits refuse
+// anything that adds a cycle or makes another node too deep. Runs on load
+// and before every save. Returns the problems found.
+uint32_t validateRules2();
+
+// Merges duplicate expression nodes and drops the ones no rule or user group
+// reaches. Runs on load and before every save. Returns the nodes removed.
+uint32_t gcRules2();
 
 // -----------------------------------------------------------------------------
 // Persistence (stub now, real Preferences later)
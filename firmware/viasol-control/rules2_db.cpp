@@ -0,0 +1,313 @@
+#include "rules2.h"
+#include <utility>
+
+namespace rules2 {
+
+// -----------------------------------------------------------------------------
+// Block layout
+// -----------------------------------------------------------------------------
+static const uint32_t MIN_POOL = 128;
+
+static uint32_t align8(uint32_t n) {
+  return (n + 7) & ~7u;
+}
+
+static uint32_t pow2AtLeast(uint32_t n) {
+  uint32_t p = 16;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+// Headroom left for UI edits when a block is built
+static uint32_t roomy(uint32_t n) {
+  return n + (n / 4 > 4 ? n / 4 : 4);
+}
+
+static uint32_t hashStr(const char* s) {
+  uint32_t h = 2166136261u;   // FNV-1a
+  while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h;
+}
+
+template <typename T>
+static uint32_t place(uint32_t& at, uint32_t n) {
+  uint32_t off = at;
+  at += align8(n * sizeof(T));
+  return off;
+}
+
+Db::~Db() {
+  free(block_);
+}
+
+bool Db::alloc(const Need& cap) {
+  uint32_t poolCap = cap.strBytes + 1;
+  uint32_t hashCap = pow2AtLeast(poolCap / 8);
+
+  uint32_t at = 0;
+  uint32_t oc = place<Condition>(at, cap.conditions);
+  uint32_t oe = place<ExprNode>(at, cap.expr);
+  uint32_t orr = place<Rule>(at, cap.rules);
+  uint32_t oa = place<Action>(at, cap.actions);
+  uint32_t och = place<uint32_t>(at, cap.children);
+  uint32_t oh = place<uint32_t>(at, hashCap);
+  uint32_t op = place<char>(at, poolCap);
+
+  uint8_t* b = (uint8_t*)malloc(at);
+  if (!b) return false;
+  free(block_);
+  block_ = b;
+  blockBytes_ = at;
+
+  conditions.p_ = (Condition*)(b + oc);
+  conditions.cap_ = cap.conditions;
+  expr.p_ = (ExprNode*)(b + oe);
+  expr.cap_ = cap.expr;
+  rules.p_ = (Rule*)(b + orr);
+  rules.cap_ = cap.rules;
+  actionTab.p_ = (Action*)(b + oa);
+  actionTab.cap_ = cap.actions;
+  childTab.p_ = (uint32_t*)(b + och);
+  childTab.cap_ = cap.children;
+  hash_ = (uint32_t*)(b + oh);
+  hashCap_ = hashCap;
+  pool_ = (char*)(b + op);
+  poolCap_ = poolCap;
+  clear();
+  return true;
+}
+
+void Db::clear() {
+  conditions.n_ = 0;
+  expr.n_ = 0;
+  rules.n_ = 0;
+  actionTab.n_ = 0;
+  childTab.n_ = 0;
+  if (hash_) memset(hash_, 0, hashCap_ * sizeof(uint32_t));
+  hashed_ = 0;
+  if (pool_) pool_[0] = 0;
+  poolUsed_ = pool_ ? 1 : 0;
+}
+
+void Db::swap(Db& o) {
+  std::swap(conditions, o.conditions);
+  std::swap(expr, o.expr);
+  std::swap(rules, o.rules);
+  std::swap(actionTab, o.actionTab);
+  std::swap(childTab, o.childTab);
+  std::swap(nextId, o.nextId);
+  std::swap(block_, o.block_);
+  std::swap(blockBytes_, o.blockBytes_);
+  std::swap(pool_, o.pool_);
+  std::swap(poolUsed_, o.poolUsed_);
+  std::swap(poolCap_, o.poolCap_);
+  std::swap(hash_, o.hash_);
+  std::swap(hashCap_, o.hashCap_);
+  std::swap(hashed_, o.hashed_);
+  gen = (gen > o.gen ? gen : o.gen) + 1;
+}
+
+// -----------------------------------------------------------------------------
+// Sizing and rebuilds
+// -----------------------------------------------------------------------------
+Need Db::live() {
+  Need n;
+  n.conditions = conditions.size();
+  n.expr = expr.size();
+  n.rules = rules.size();
+  for (const auto& r : rules) n.actions += r.actions.count;
+  for (const auto& e : expr) n.children += e.children.count;
+
+  auto bytes = [&](Str s) { return s.off ? (uint32_t)strlen(str(s)) + 1 : 0; };
+  for (const auto& c : conditions) n.strBytes += bytes(c.name) + bytes(c.inputKey) + bytes(c.rhsInputKey);
+  for (const auto& e : expr) n.strBytes += bytes(e.name);
+  for (const auto& r : rules) n.strBytes += bytes(r.name);
+  for (const auto& r : rules) {
+    for (const auto& a : actions(r)) n.strBytes += bytes(a.outputKey);
+  }
+  return n;
+}
+
+// Copies o's live contents: tables in order, ranges laid out contiguously,
+// strings re-interned. The block must be big enough (see live()).
+void Db::copyFrom(Db& o) {
+  for (const auto& c : o.conditions) {
+    Condition* d = conditions.add();
+    *d = c;
+    d->name = intern(o.str(c.name));
+    d->inputKey = intern(o.str(c.inputKey));
+    d->rhsInputKey = intern(o.str(c.rhsInputKey));
+  }
+  for (auto& e : o.expr) {
+    ExprNode* d = expr.add();
+    *d = e;
+    d->name = intern(o.str(e.name));
+    d->children.first = childTab.n_;
+    for (uint32_t id : o.children(e)) childTab.p_[childTab.n_++] = id;
+  }
+  for (auto& r : o.rules) {
+    Rule* d = rules.add();
+    *d = r;
+    d->name = intern(o.str(r.name));
+    d->actions.first = actionTab.n_;
+    for (const auto& a : o.actions(r)) {
+      Action* x = &actionTab.p_[actionTab.n_++];
+      *x = a;
+      x->outputKey = intern(o.str(a.outputKey));
+    }
+  }
+  nextId = o.nextId;
+}
+
+static Need plus(const Need& a, const Need& b, bool headroom) {
+  Need n;
+  n.conditions = a.conditions + b.conditions;
+  n.expr = a.expr + b.expr;
+  n.rules = a.rules + b.rules;
+  n.actions = a.actions + b.actions;
+  n.children = a.children + b.children;
+  n.strBytes = a.strBytes + b.strBytes;
+  if (headroom) {
+    n.conditions = roomy(n.conditions);
+    n.expr = roomy(n.expr);
+    n.rules = roomy(n.rules);
+    n.actions = roomy(n.actions);
+    n.children = roomy(n.children);
+    n.strBytes = roomy(n.strBytes) + MIN_POOL;
+  }
+  return n;
+}
+
+bool Db::reserve(const Need& more) {
+  if (block_ &&
+      conditions.cap_ - conditions.n_ >= more.conditions && expr.cap_ - expr.n_ >= more.expr &&
+      rules.cap_ - rules.n_ >= more.rules && actionTab.cap_ - actionTab.n_ >= more.actions &&
+      childTab.cap_ - childTab.n_ >= more.children && poolCap_ - poolUsed_ >= more.strBytes) {
+    return true;
+  }
+
+  Db fresh;
+  if (!fresh.alloc(plus(live(), more, true))) {
+    Serial.printf("[rules2] db: out of memory growing the rule store\n");
+    return false;
+  }
+  fresh.copyFrom(*this);
+  swap(fresh);
+  return true;
+}
+
+bool Db::compact() {
+  Db fresh;
+  if (!fresh.alloc(plus(live(), Need(), true))) return false;
+  fresh.copyFrom(*this);
+  swap(fresh);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// String pool
+//
+// Equal strings share one copy. Strings are never freed individually;
+// rebuilds drop the unreferenced ones. If the hash index fills up, new
+// strings are still stored, just not deduplicated until the next rebuild.
+// -----------------------------------------------------------------------------
+Str Db::intern(const char* s) {
+  Str out;
+  if (!s || !*s || !pool_) return out;
+
+  uint32_t h = hashStr(s);
+  uint32_t mask = hashCap_ - 1;
+  uint32_t i = h & mask;
+  for (uint32_t k = 0; k < hashCap_ && hash_[i]; k++) {
+    if (strcmp(pool_ + hash_[i], s) == 0) {
+      out.off = hash_[i];
+      return out;
+    }
+    i = (i + 1) & mask;
+  }
+
+  uint32_t n = (uint32_t)strlen(s) + 1;
+  if (poolCap_ - poolUsed_ < n) {
+    Serial.printf("[rules2] db: string pool full, '%.16s' dropped\n", s);
+    return out;
+  }
+  out.off = poolUsed_;
+  memcpy(pool_ + poolUsed_, s, n);
+  poolUsed_ += n;
+
+  if ((hashed_ + 1) * 4 <= hashCap_ * 3 && !hash_[i]) {
+    hash_[i] = out.off;
+    hashed_++;
+  }
+  return out;
+}
+
+// -----------------------------------------------------------------------------
+// Ranges
+// -----------------------------------------------------------------------------
+// One more slot at the end of r. A range that doesn't end the table is
+// moved to the end first; its old slots are left for the next rebuild.
+template <typename T>
+T* Db::growRange(Table<T>& t, Range& r) {
+  bool atEnd = (r.first + r.count == t.n_);
+  uint32_t need = atEnd ? 1 : r.count + 1;
+  if (t.cap_ - t.n_ < need) return nullptr;
+  if (!atEnd) {
+    memmove((void*)(t.p_ + t.n_), (const void*)(t.p_ + r.first), r.count * sizeof(T));
+    r.first = t.n_;
+    t.n_ += r.count;
+  }
+  t.n_++;
+  return &t.p_[r.first + r.count++];
+}
+
+bool Db::addChild(ExprNode& g, uint32_t id) {
+  uint32_t* slot = growRange(childTab, g.children);
+  if (!slot) return false;
+  *slot = id;
+  return true;
+}
+
+void Db::removeChild(ExprNode& g, uint32_t idx) {
+  if (idx >= g.children.count) return;
+  uint32_t* p = childTab.p_ + g.children.first;
+  memmove(p + idx, p + idx + 1, (g.children.count - idx - 1) * sizeof(uint32_t));
+  g.children.count--;
+}
+
+bool Db::setChildren(ExprNode& g, const uint32_t* ids, uint32_t n) {
+  if (n > g.children.count) {
+    if (childTab.cap_ - childTab.n_ < n) return false;
+    g.children.first = childTab.n_;
+    childTab.n_ += n;
+  }
+  g.children.count = n;
+  if (n) memcpy(childTab.p_ + g.children.first, ids, n * sizeof(uint32_t));   // ids may be null for 0
+  return true;
+}
+
+Action* Db::addAction(Rule& r) {
+  Action* a = growRange(actionTab, r.actions);
+  if (a) *a = Action();
+  return a;
+}
+
+// -----------------------------------------------------------------------------
+// Lookups
+// -----------------------------------------------------------------------------
+Condition* Db::findCond(uint32_t id) {
+  for (auto& c : conditions) if (c.id == id) return &c;
+  return nullptr;
+}
+
+ExprNode* Db::findExpr(uint32_t id) {
+  for (auto& e : expr) if (e.id == id) return &e;
+  return nullptr;
+}
+
+Rule* Db::findRule(uint32_t id) {
+  for (auto& r : rules) if (r.id == id) return &r;
+  return nullptr;
+}
+
+} // namespace rules2
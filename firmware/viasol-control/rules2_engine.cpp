@@ -0,0 +1,507 @@
+#include "rules2.h"
+#include "io_catalog.h"
+#include "heap_track.h"
+
+namespace rules2 {
+
+// -----------------------------------------------------------------------------
+// Global DB
+// -----------------------------------------------------------------------------
+Db db;
+
+// -----------------------------------------------------------------------------
+// Internal helpers
+// -----------------------------------------------------------------------------
+static Tri toTri(bool b) { return b ? Tri::True : Tri::False; }
+
+// -----------------------------------------------------------------------------
+// Compiled form
+//
+// After every edit (db.gen) or catalog change the Db is compiled into flat
+// tables, so a tick never searches by id or touches a String:
+//   - Conditions become parallel arrays: lhs operand, rhs operand, op bits.
+//     Operands index one table that holds the catalog snapshot, then a
+//     "missing" slot, then each condition's constant, so input-vs-const and
+//     input-vs-input compile to the same instructions.
+//   - A pass compares every condition in straight-line loops over those
+//     arrays into two bitsets, T (true) and U (unknown); a bit in neither
+//     is false. The compare loop has no branches or calls, so the compiler
+//     can vectorize it.
+//   - Groups keep a mask of their direct leaf conditions and resolve it
+//     with word-wide AND/OR.
+//   - Each rule gets its nodes in post-order (children before parents), so
+//     evaluating it is one loop over that list with no recursion: stack use
+//     is constant and time is bounded by the list length.
+// Compiling allocates; it only runs after an edit, never in steady state.
+// -----------------------------------------------------------------------------
+enum : uint8_t { OP_LT = 1, OP_EQ = 2, OP_GT = 4, OP_INV = 8 };
+
+static uint8_t opBits(CmpOp op) {
+  switch (op) {
+    case CmpOp::GT: return OP_GT;
+    case CmpOp::GE: return OP_GT | OP_EQ;
+    case CmpOp::LT: return OP_LT;
+    case CmpOp::LE: return OP_LT | OP_EQ;
+    case CmpOp::EQ: return OP_EQ;
+    case CmpOp::NE: return OP_EQ | OP_INV;   // !(a == b): true for NaN, like a != b
+  }
+  return OP_GT;
+}
+
+struct StableRef {
+  int cond;
+  Condition* src;   // valid until the next compile
+};
+
+struct Node {
+  ExprType type = ExprType::LeafCond;
+  int16_t cond = -1;       // LeafCond: condition index, -1 if dangling
+  int32_t mask = -1;       // And/Or: offset of the leaf mask in masks, -1 if none
+  uint16_t subFirst = 0;   // nested children (node indices) in subs
+  uint16_t subCount = 0;
+};
+
+struct Compiled {
+  bool valid = false;
+  uint32_t gen = 0;
+  int inputs = 0;          // N_INPUTS at compile time
+  int n = 0;               // conditions
+  int words = 0;           // 32-bit words per condition bitset
+
+  // Operand table: [0, inputs) snapshot, [inputs] missing, then constants
+  std::vector<float> vals;
+  std::vector<uint8_t> good;
+
+  // Per condition
+  std::vector<uint16_t> lhs;
+  std::vector<uint16_t> rhs;
+  std::vector<uint8_t> op;
+  std::vector<float> a, b;          // gathered operands (scratch)
+  std::vector<uint8_t> known, res;  // scratch
+  std::vector<uint32_t> en, T, U;
+  std::vector<StableRef> stable;
+
+  // Expressions (index = position in db.expr) and rule roots
+  std::vector<Node> nodes;
+  std::vector<uint32_t> masks;
+  std::vector<int16_t> subs;
+  std::vector<int16_t> roots;       // per db.rules entry, -1: none
+
+  // Per rule: its nodes in evaluation order, in order[first, first + count)
+  std::vector<int16_t> order;
+  std::vector<uint32_t> orderFirst;
+  std::vector<uint16_t> orderCount;
+  std::vector<Tri> val;             // per node, this pass (scratch)
+};
+
+static Compiled cc;
+
+static int condIndex(uint32_t id) {
+  for (size_t i = 0; i < db.conditions.size(); i++) if (db.conditions[i].id == id) return (int)i;
+  return -1;
+}
+
+static int exprIndex(uint32_t id) {
+  for (size_t i = 0; i < db.expr.size(); i++) if (db.expr[i].id == id) return (int)i;
+  return -1;
+}
+
+// Appends root's nodes to k.order in post-order, each once. The walk's stack
+// is MAX_EXPR_DEPTH frames; false if the expression is cyclic or deeper
+// (validateRules2() keeps the Db from getting there).
+static bool flatten(Compiled& k, int root, uint32_t stamp, std::vector<uint32_t>& emitted,
+                    std::vector<uint8_t>& onPath) {
+  struct Frame {
+    int16_t node;
+    uint16_t next;
+  };
+  Frame st[MAX_EXPR_DEPTH];
+  int top = 0;
+  bool ok = true;
+
+  st[top++] = { (int16_t)root, 0 };
+  onPath[root] = 1;
+  while (top > 0) {
+    Frame& f = st[top - 1];
+    const Node& nd = k.nodes[f.node];
+    if (f.next < nd.subCount) {
+      int c = k.subs[nd.subFirst + f.next++];
+      if (c < 0 || emitted[c] == stamp) continue;
+      if (onPath[c] || top == MAX_EXPR_DEPTH) {
+        ok = false;
+        break;
+      }
+      onPath[c] = 1;
+      st[top++] = { (int16_t)c, 0 };
+      continue;
+    }
+    onPath[f.node] = 0;
+    emitted[f.node] = stamp;
+    k.order.push_back(f.node);
+    top--;
+  }
+  while (top > 0) onPath[st[--top].node] = 0;
+  return ok;
+}
+
+static void compile() {
+  heaptrack::TickGuard rebuild(nullptr);   // an edit isn't steady state
+
+  Compiled& k = cc;
+  int n = (int)db.conditions.size();
+  k.inputs = N_INPUTS;
+  k.n = n;
+  k.words = (n + 31) / 32;
+
+  int missing = k.inputs;
+  int consts = k.inputs + 1;
+  k.vals.assign(consts + n, 0.0f);
+  k.good.assign(consts + n, 0);
+  k.lhs.resize(n);
+  k.rhs.resize(n);
+  k.op.resize(n);
+  k.a.resize(n);
+  k.b.resize(n);
+  k.known.resize(n);
+  k.res.resize(n);
+  k.en.assign(k.words, 0);
+  k.T.assign(k.words, 0);
+  k.U.assign(k.words, 0);
+  k.stable.clear();
+
+  for (int i = 0; i < n; i++) {
+    Condition& c = db.conditions[i];
+    int l = inputIndexByKey(db.str(c.inputKey));
+    k.lhs[i] = (uint16_t)(l < 0 ? missing : l);
+    if (c.type == CondType::CompareInputToConst) {
+      k.rhs[i] = (uint16_t)(consts + i);
+      k.vals[consts + i] = c.threshold;
+      k.good[consts + i] = 1;
+    } else {
+      int r = inputIndexByKey(db.str(c.rhsInputKey));
+      k.rhs[i] = (uint16_t)(r < 0 ? missing : r);
+    }
+    k.op[i] = opBits(c.op);
+    if (!c.enabled) continue;
+    k.en[i >> 5] |= 1u << (i & 31);
+    if (c.stableForMs) k.stable.push_back({ i, &c });
+  }
+
+  k.nodes.assign(db.expr.size(), Node());
+  k.masks.clear();
+  k.subs.clear();
+  for (size_t j = 0; j < db.expr.size(); j++) {
+    const ExprNode& e = db.expr[j];
+    Node& nd = k.nodes[j];
+    nd.type = e.type;
+    nd.subFirst = (uint16_t)k.subs.size();
+
+    if (e.type == ExprType::LeafCond) {
+      nd.cond = (int16_t)condIndex(e.condId);
+    } else if (e.type == ExprType::Not) {
+      k.subs.push_back((int16_t)exprIndex(e.child));
+    } else {
+      for (uint32_t cid : db.children(e)) {
+        int x = exprIndex(cid);
+        int ci = (x >= 0 && db.expr[x].type == ExprType::LeafCond) ? condIndex(db.expr[x].condId) : -1;
+        if (ci < 0) {
+          // Nested group, NOT, or a dangling reference (evaluates Unknown)
+          k.subs.push_back((int16_t)x);
+          continue;
+        }
+        if (nd.mask < 0) {
+          nd.mask = (int32_t)k.masks.size();
+          k.masks.resize(k.masks.size() + k.words, 0);
+        }
+        k.masks[nd.mask + (ci >> 5)] |= 1u << (ci & 31);
+      }
+    }
+    nd.subCount = (uint16_t)(k.subs.size() - nd.subFirst);
+  }
+
+  k.roots.resize(db.rules.size());
+  for (size_t i = 0; i < db.rules.size(); i++) {
+    k.roots[i] = (int16_t)(db.rules[i].exprRootId ? exprIndex(db.rules[i].exprRootId) : -1);
+  }
+
+  k.val.assign(db.expr.size(), Tri::False);
+  k.order.clear();
+  k.orderFirst.assign(db.rules.size(), 0);
+  k.orderCount.assign(db.rules.size(), 0);
+  std::vector<uint32_t> emitted(db.expr.size(), 0);   // stamp: rule index + 1
+  std::vector<uint8_t> onPath(db.expr.size(), 0);
+  for (size_t i = 0; i < db.rules.size(); i++) {
+    k.orderFirst[i] = (uint32_t)k.order.size();
+    if (k.roots[i] < 0) continue;
+    if (!flatten(k, k.roots[i], (uint32_t)i + 1, emitted, onPath)) {
+      k.order.resize(k.orderFirst[i]);
+      k.roots[i] = -1;
+      Serial.printf("[rules2] rule %u: expression cyclic or deeper than %d, never fires\n",
+                    (unsigned)db.rules[i].id, MAX_EXPR_DEPTH);
+    }
+    k.orderCount[i] = (uint16_t)(k.order.size() - k.orderFirst[i]);
+  }
+
+  k.gen = db.gen;
+  k.valid = true;
+}
+
+// -----------------------------------------------------------------------------
+// Condition pass: every condition, once per tick that has a rule due
+// -----------------------------------------------------------------------------
+static void evalConditions(uint32_t nowMs) {
+  Compiled& k = cc;
+  const int n = k.n;
+
+  for (int i = 0; i < k.inputs; i++) {
+    const InputSample& s = inputSample(i);
+    k.vals[i] = s.value;
+    k.good[i] = (s.q == Quality::Good);
+  }
+
+  for (int i = 0; i < n; i++) {
+    k.a[i] = k.vals[k.lhs[i]];
+    k.b[i] = k.vals[k.rhs[i]];
+    k.known[i] = k.good[k.lhs[i]] & k.good[k.rhs[i]];
+  }
+
+  // Branch-free: select the <, ==, > outcome through the op bits
+  const float* a = k.a.data();
+  const float* b = k.b.data();
+  const uint8_t* op = k.op.data();
+  uint8_t* res = k.res.data();
+  for (int i = 0; i < n; i++) {
+    uint8_t m = op[i];
+    uint8_t hit = (uint8_t)(((a[i] < b[i]) * OP_LT) | ((a[i] == b[i]) * OP_EQ) | ((a[i] > b[i]) * OP_GT));
+    res[i] = (uint8_t)(((hit & m) != 0) ^ (m >> 3));
+  }
+
+  for (int w = 0; w < k.words; w++) {
+    int base = w * 32;
+    int lim = (n - base < 32) ? n - base : 32;
+    uint32_t t = 0, u = 0;
+    for (int j = 0; j < lim; j++) {
+      t |= (uint32_t)(res[base + j] & k.known[base + j]) << j;
+      u |= (uint32_t)(k.known[base + j] ^ 1) << j;
+    }
+    k.T[w] = t & k.en[w];
+    k.U[w] = u & k.en[w];
+  }
+
+  // Stability windows, only for the conditions that have one. Unknown
+  // restarts the window: recovered data must hold for stableForMs again.
+  for (const StableRef& s : k.stable) {
+    int w = s.cond >> 5;
+    uint32_t bit = 1u << (s.cond & 31);
+    Condition& c = *s.src;
+    if (k.U[w] & bit) {
+      c.lastEval = false;
+      c.lastFlipMs = nowMs;
+      continue;
+    }
+    bool raw = (k.T[w] & bit) != 0;
+    if (raw != c.lastEval) {
+      c.lastEval = raw;
+      c.lastFlipMs = nowMs;
+    }
+    if (raw && (nowMs - c.lastFlipMs) < c.stableForMs) k.T[w] &= ~bit;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Expression evaluation over the condition bits
+// -----------------------------------------------------------------------------
+// A reference to a deleted condition or node is Unknown, not False, so the
+// rule's onUnknown policy applies: NOT(<deleted>) must not read True.
+static Tri condTri(int i) {
+  if (i < 0) return Tri::Unknown;
+  uint32_t bit = 1u << (i & 31);
+  if (cc.U[i >> 5] & bit) return Tri::Unknown;
+  return toTri((cc.T[i >> 5] & bit) != 0);
+}
+
+// A child's result from this pass; dangling references are Unknown
+static Tri subTri(int j) {
+  return j < 0 ? Tri::Unknown : cc.val[j];
+}
+
+// One node, from its leaf bits and its children's results
+static Tri evalNode(int j) {
+  const Node& e = cc.nodes[j];
+  const int16_t* sub = cc.subs.data() + e.subFirst;
+
+  switch (e.type) {
+    case ExprType::LeafCond:
+      return condTri(e.cond);
+
+    case ExprType::Not: {
+      Tri t = subTri(e.subCount ? sub[0] : -1);
+      if (t == Tri::Unknown) return t;
+      return toTri(t == Tri::False);
+    }
+
+    // A deciding child short-circuits; Unknown only wins if none decides.
+    // Empty groups: AND is True, OR is False.
+    case ExprType::And: {
+      bool unknown = false;
+      if (e.mask >= 0) {
+        const uint32_t* m = cc.masks.data() + e.mask;
+        for (int w = 0; w < cc.words; w++) {
+          if (m[w] & ~(cc.T[w] | cc.U[w])) return Tri::False;
+          if (m[w] & cc.U[w]) unknown = true;
+        }
+      }
+      for (int i = 0; i < e.subCount; i++) {
+        Tri t = subTri(sub[i]);
+        if (t == Tri::False) return Tri::False;
+        if (t == Tri::Unknown) unknown = true;
+      }
+      return unknown ? Tri::Unknown : Tri::True;
+    }
+
+    case ExprType::Or: {
+      bool unknown = false;
+      if (e.mask >= 0) {
+        const uint32_t* m = cc.masks.data() + e.mask;
+        for (int w = 0; w < cc.words; w++) {
+          if (m[w] & cc.T[w]) return Tri::True;
+          if (m[w] & cc.U[w]) unknown = true;
+        }
+      }
+      for (int i = 0; i < e.subCount; i++) {
+        Tri t = subTri(sub[i]);
+        if (t == Tri::True) return Tri::True;
+        if (t == Tri::Unknown) unknown = true;
+      }
+      return unknown ? Tri::Unknown : Tri::False;
+    }
+  }
+  return Tri::False;
+}
+
+// A rule's nodes in order; its root comes last
+static Tri evalRule(size_t i) {
+  if (cc.roots[i] < 0) return Tri::False;
+  const int16_t* ord = cc.order.data() + cc.orderFirst[i];
+  for (uint16_t x = 0; x < cc.orderCount[i]; x++) cc.val[ord[x]] = evalNode(ord[x]);
+  return cc.val[cc.roots[i]];
+}
+
+// -----------------------------------------------------------------------------
+// Action application (simple hold logic for durationMs)
+//
+// One hold slot per catalog output: a second timed action on an output that
+// is already held keeps the earlier deadline (that is when the first hold
+// would have switched it off). Nothing here touches the heap.
+// -----------------------------------------------------------------------------
+static const int MAX_HOLDS = 16;   // >= N_OUTPUTS
+
+static uint32_t holdUntilMs[MAX_HOLDS];
+static uint16_t heldMask = 0;
+
+static void serviceHolds(uint32_t nowMs) {
+  for (int i = 0; heldMask && i < MAX_HOLDS; i++) {
+    uint16_t bit = (uint16_t)(1u << i);
+    if (!(heldMask & bit) || (int32_t)(nowMs - holdUntilMs[i]) < 0) continue;
+    heldMask &= (uint16_t)~bit;
+    applyOutputIndex(i, false);
+  }
+}
+
+static void addHold(int out, uint32_t untilMs) {
+  if (out < 0 || out >= MAX_HOLDS) return;
+  uint16_t bit = (uint16_t)(1u << out);
+  if ((heldMask & bit) && (int32_t)(untilMs - holdUntilMs[out]) >= 0) return;
+  holdUntilMs[out] = untilMs;
+  heldMask |= bit;
+}
+
+static void dropHold(int out) {
+  if (out >= 0 && out < MAX_HOLDS) heldMask &= (uint16_t)~(1u << out);
+}
+
+int holdCount() {
+  int n = 0;
+  for (uint16_t m = heldMask; m; m &= (uint16_t)(m - 1)) n++;
+  return n;
+}
+
+// Fail-safe state for a rule whose inputs went Stale/Missing
+static void applyUnknownPolicy(Rule& r) {
+  if (r.onUnknown == UnknownPolicy::Hold) return;
+  bool on = (r.onUnknown == UnknownPolicy::On);
+  for (auto& a : db.actions(r)) {
+    if (a.type != ActionType::SetOutput) continue;
+    int out = outputIndexCached(a.outIdx, db.str(a.outputKey));
+    dropHold(out);
+    applyOutputIndex(out, on);
+  }
+  // Short enough for Print::printf's stack buffer
+  Serial.printf("[rules2] '%.24s' inputs unknown, outputs %s\n", db.str(r.name), on ? "on" : "off");
+}
+
+static void applyActions(Rule& r, uint32_t nowMs) {
+  for (auto& a : db.actions(r)) {
+    if (a.type != ActionType::SetOutput) continue;
+
+    int out = outputIndexCached(a.outIdx, db.str(a.outputKey));
+    applyOutputIndex(out, a.on);
+
+    if (a.on && a.durationMs > 0) addHold(out, nowMs + a.durationMs);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Rules engine tick
+// -----------------------------------------------------------------------------
+void processRules2() {
+  uint32_t nowMs = millis();
+
+  serviceHolds(nowMs);
+
+  if (!cc.valid || cc.gen != db.gen || cc.inputs != N_INPUTS) compile();
+  bool evaluated = false;
+
+  for (size_t i = 0; i < db.rules.size(); i++) {
+    Rule& r = db.rules[i];
+    if (!r.enabled) continue;
+
+    if (r.minEvalPeriodMs > 0 && (nowMs - r.lastEvalMs) < r.minEvalPeriodMs) {
+      continue;
+    }
+    r.lastEvalMs = nowMs;
+    r.evals++;
+
+    if (!evaluated) {
+      evalConditions(nowMs);
+      evaluated = true;
+    }
+    Tri t = evalRule(i);
+    Tri prevTri = r.lastTri;
+    r.lastTri = t;
+
+    if (t == Tri::Unknown) {
+      if (prevTri != Tri::Unknown) applyUnknownPolicy(r);
+      // A forced state is re-asserted by the next true edge once data is back
+      if (r.onUnknown != UnknownPolicy::Hold) r.lastResult = false;
+      continue;
+    }
+    bool result = (t == Tri::True);
+
+    // edge-trigger: false -> true
+    bool rising = (result && !r.lastResult);
+    r.lastResult = result;
+    if (!rising) continue;
+
+    // cooldown
+    if (r.cooldownMs > 0 && (nowMs - r.lastTriggerMs) < r.cooldownMs) {
+      continue;
+    }
+
+    r.lastTriggerMs = nowMs;
+    r.fires++;
+    applyActions(r, nowMs);
+  }
+}
+
+} // namespace rules2
@@ -0,0 +1,157 @@
+#include "safety.h"
+#include "heater.h"
+#include "ow_temps.h"
+#include "rs485.h"
+#include "io_catalog.h"
+#include "metrics.h"
+#include <esp_timer.h>
+#include <atomic>
+
+static const uint32_t KILL_REFRESH_MS = 1000;  // re-assert a remote kill relay
+
+// Timer task only
+static safety::Interlock interlock;
+static bool killState = false;
+static uint32_t killSentMs = 0;
+
+// Settings handed to the timer task, guarded by safetyMux
+static portMUX_TYPE safetyMux = portMUX_INITIALIZER_UNLOCKED;
+static safety::Limits pending;
+static bool pendingDirty = false;
+static bool killRemote = false;
+static int killIdx = 2;
+
+// Published by the timer task. Fail safe until the first evaluation.
+static std::atomic<uint8_t> allowedMask{0};
+static std::atomic<uint8_t> activeTrips{0};
+static std::atomic<uint32_t> tripCount{0};
+
+// Loop only
+static String killKey;
+static esp_timer_handle_t timer = nullptr;
+
+static void onTimer(void*) {
+  safety::Inputs in;
+  in.nowMs = millis();
+
+  float t;
+  uint32_t age;
+  in.tankValid = owTankTemp(t, age);
+  in.tankC = t;
+  in.tankAgeMs = age;
+
+  in.busOnline = rs485Online(HEATER_REMOTE);
+  int16_t mA[safety::CHANNELS];
+  rs485Regs(HEATER_REMOTE, rs485::REG_CH_A0, safety::CHANNELS, mA);
+  for (int ch = 0; ch < safety::CHANNELS; ch++) in.chA[ch] = mA[ch] * 0.001f;
+  in.leakBits = (uint8_t)rs485Reg(HEATER_REMOTE, rs485::REG_LEAK);
+  in.commanded = heaterMask();
+
+  bool remote;
+  int idx;
+  portENTER_CRITICAL(&safetyMux);
+  if (pendingDirty) {
+    interlock.configure(pending);
+    pendingDirty = false;
+  }
+  remote = killRemote;
+  idx = killIdx;
+  portEXIT_CRITICAL(&safetyMux);
+
+  safety::Verdict v = interlock.evaluate(in);
+  allowedMask.store(v.allowed);
+  activeTrips.store(v.trips);
+  tripCount.store(interlock.tripCount());
+
+  // The heater masks its own output; this covers a mask sent just before
+  // the trip (or a loop that has stopped running)
+  if (in.commanded & ~v.allowed) {
+    rs485Write(HEATER_REMOTE, rs485::REG_HEATER_MASK, (int16_t)(in.commanded & v.allowed));
+  }
+
+  bool refresh = v.pvKill && remote && (in.nowMs - killSentMs) >= KILL_REFRESH_MS;
+  if (v.pvKill != killState || refresh) {
+    driveRelay(remote, idx, v.pvKill);
+    killState = v.pvKill;
+    killSentMs = in.nowMs;
+  }
+}
+
+void safetyApplySettings(const Settings& cfg) {
+  safety::Limits l;
+  l.tankMaxC = cfg.tank_sp_c + SAFETY_TANK_MARGIN_C;
+  for (int ch = 0; ch < safety::CHANNELS; ch++) {
+    l.chMaxA[ch] = (cfg.el_v[ch] > 0 && cfg.el_w[ch] > 0) ? SAFETY_OC_FACTOR * cfg.el_w[ch] / cfg.el_v[ch] : 0.0f;
+  }
+
+  bool remote = (cfg.pvkill_loc == "remote");
+  int idx = constrain(cfg.pvkill_idx, 1, remote ? 3 : 2);
+  killKey = relayKey(cfg.pvkill_loc, idx);
+
+  portENTER_CRITICAL(&safetyMux);
+  pending = l;
+  pendingDirty = true;
+  killRemote = remote;
+  killIdx = idx;
+  portEXIT_CRITICAL(&safetyMux);
+}
+
+void safetyBegin(const Settings& cfg) {
+  safetyApplySettings(cfg);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "safety";
+  if (esp_timer_create(&args, &timer) != 0 ||
+      esp_timer_start_periodic(timer, SAFETY_PERIOD_MS * 1000ULL) != 0) {
+    Serial.println("[safety] timer start FAILED, heater channels stay off");
+    return;
+  }
+  Serial.printf("[safety] every %u ms, tank limit %.1f C, PV kill %s\n",
+                (unsigned)SAFETY_PERIOD_MS, cfg.tank_sp_c + SAFETY_TANK_MARGIN_C, killKey.c_str());
+}
+
+void safetyTick() {
+  static uint8_t logged = 0;
+  uint8_t t = activeTrips.load();
+  if (t == logged) return;
+  if (t & ~logged) Serial.printf("[safety] TRIP %s\n", safetyTripNames(t & ~logged).c_str());
+  if (logged & ~t) Serial.printf("[safety] cleared %s\n", safetyTripNames(logged & ~t).c_str());
+  logged = t;
+}
+
+uint8_t safetyAllowedMask() {
+  return allowedMask.load();
+}
+
+uint8_t safetyTrips() {
+  return activeTrips.load();
+}
+
+uint32_t safetyTripCount() {
+  return tripCount.load();
+}
+
+String safetyTripNames(uint8_t trips) {
+  static const char* NAMES[] = { "tank over-temp", "tank sensor", "over-current", "stuck channel", "leak" };
+  String s;
+  for (int i = 0; i < 5; i++) {
+    if (!(trips & (1 << i))) continue;
+    if (s.length()) s += ", ";
+    s += NAMES[i];
+  }
+  return s.length() ? s : String("none");
+}
+
+bool safetyHoldsOutput(const char* outputKey) {
+  return (activeTrips.load() & (safety::TRIP_STUCK_CHANNEL | safety::TRIP_LEAK)) && killKey == outputKey;
+}
+
+static void collectMetrics(MetricWriter& w) {
+  w.family("viasol_safety_trips_total", "Interlock trips since reset", "counter");
+  w.u("viasol_safety_trips_total", tripCount.load());
+  w.family("viasol_safety_active_trips", "Latched trip bits", "gauge");
+  w.u("viasol_safety_active_trips", activeTrips.load());
+}
+static MetricCollector metricsCollector(collectMetrics);
@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+#include "safety_core.h"
+
+// -----------------------------------------------------------------------------
+// Safety interlock (ESP32 side).
+//
+// A periodic esp_timer (dispatched from the esp_timer task, which outranks
+// every application task including loop()) samples the sources directly --
+// the OneWire sensor table, the RS-485 register mirror -- runs
+// safety::Interlock and enforces the verdict:
+//   - heater channels that aren't allowed are masked out of every mask the
+//     heater controller sends, and re-written every period while violated;
+//   - the PV kill relay (pvkill_loc / pvkill_idx) is energized while a leak
+//     or a stuck channel is latched.
+// Nothing here goes through loop(), the catalog or either rule engine, so a
+// slow HTTP request can't delay it. Reaction bound: SAFETY_PERIOD_MS plus
+// one RS-485 transaction after the sample arrives.
+//
+// Limits: tank at tank_sp_c + SAFETY_TANK_MARGIN_C, channel current at
+// SAFETY_OC_FACTOR x the element's nameplate current.
+// -----------------------------------------------------------------------------
+
+static const uint32_t SAFETY_PERIOD_MS = 20;
+static const float SAFETY_TANK_MARGIN_C = 10.0f;
+static const float SAFETY_OC_FACTOR = 1.25f;
+
+void safetyBegin(const Settings& cfg);
+void safetyApplySettings(const Settings& cfg);
+void safetyTick();  // loop(): logs trip changes only
+
+uint8_t safetyAllowedMask();  // heater channels that may be on
+uint8_t safetyTrips();        // safety::Trip bits
+uint32_t safetyTripCount();
+String safetyTripNames(uint8_t trips);
+
+// True if the safety layer currently owns this output (rules must not drive it).
+bool safetyHoldsOutput(const char* outputKey);
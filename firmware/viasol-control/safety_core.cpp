@@ -0,0 +1,82 @@
+#include "safety_core.h"
+
+namespace safety {
+
+static const uint8_t HARD_TRIPS = TRIP_TANK_OVERTEMP | TRIP_TANK_SENSOR | TRIP_STUCK_CHANNEL | TRIP_LEAK;
+static const uint8_t KILL_TRIPS = TRIP_STUCK_CHANNEL | TRIP_LEAK;
+
+static int bitIndex(uint8_t t) {
+  int i = 0;
+  while (t > 1) { t >>= 1; i++; }
+  return i;
+}
+
+bool Interlock::Persist::update(bool cond, uint32_t nowMs, uint32_t holdMs) {
+  if (!cond) {
+    on = false;
+    return false;
+  }
+  if (!on) {
+    on = true;
+    sinceMs = nowMs;
+  }
+  return (nowMs - sinceMs) >= holdMs;
+}
+
+bool Interlock::latch(uint8_t t, bool on, uint32_t nowMs) {
+  int i = bitIndex(t);
+  if (on) {
+    lastFaultMs_[i] = nowMs;
+    if (!(active_ & t)) {
+      active_ |= t;
+      tripCount_++;
+    }
+  } else if ((active_ & t) && (nowMs - lastFaultMs_[i]) >= lim_.clearMs) {
+    active_ &= (uint8_t)~t;
+  }
+  return (active_ & t) != 0;
+}
+
+Verdict Interlock::evaluate(const Inputs& in) {
+  const uint32_t now = in.nowMs;
+  Verdict v;
+
+  // Tank: no recent reading is a trip of its own; over-temperature releases
+  // only below the limit minus the hysteresis
+  bool sensorBad = !in.tankValid || in.tankAgeMs > lim_.tankMaxAgeMs;
+  latch(TRIP_TANK_SENSOR, sensorBad, now);
+  float limit = (active_ & TRIP_TANK_OVERTEMP) ? lim_.tankMaxC - lim_.tankHystC : lim_.tankMaxC;
+  latch(TRIP_TANK_OVERTEMP, !sensorBad && in.tankC >= limit, now);
+
+  // Channels; an offline bus has no current data (the remote switches its
+  // outputs off by itself when the master goes quiet)
+  uint8_t fitted = 0;
+  bool anyStuck = false;
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    uint8_t bit = (uint8_t)(1 << ch);
+    if (lim_.chMaxA[ch] > 0) fitted |= bit;
+
+    float a = in.busOnline ? in.chA[ch] : 0.0f;
+    bool over = lim_.chMaxA[ch] > 0 && a > lim_.chMaxA[ch];
+    if (oc_[ch].update(over, now, lim_.overcurrentMs)) {
+      ocLatched_ |= bit;
+      ocLastMs_[ch] = now;
+    } else if ((ocLatched_ & bit) && !over && (now - ocLastMs_[ch]) >= lim_.clearMs) {
+      ocLatched_ &= (uint8_t)~bit;
+    }
+    if (over) ocLastMs_[ch] = now;
+
+    bool offButFlowing = !(in.commanded & bit) && a > lim_.offLeakA;
+    if (stuck_[ch].update(offButFlowing, now, lim_.stuckMs)) anyStuck = true;
+  }
+  latch(TRIP_OVERCURRENT, ocLatched_ != 0, now);
+  latch(TRIP_STUCK_CHANNEL, anyStuck, now);
+  latch(TRIP_LEAK, leak_.update(in.busOnline && in.leakBits != 0, now, lim_.leakMs), now);
+
+  v.trips = active_;
+  v.allowed = (active_ & HARD_TRIPS) ? 0 : (uint8_t)(fitted & ~ocLatched_);
+  v.pvKill = (active_ & KILL_TRIPS) != 0;
+  return v;
+}
+
+} // namespace safety
@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+// Safety interlock decision logic.
+//
+// A fixed set of hard limits evaluated against the latest raw samples. The
+// result says which heater channels may be on and whether the PV kill relay
+// must open. Trips latch: a condition must be absent for CLEAR_MS before it
+// releases, so a marginal reading can't chatter the relays.
+//
+// No Arduino dependencies: safety.cpp runs it from a high-priority timer on
+// the ESP32, tools/safety-sim drives it with scripted faults on the host.
+// The rule engines never see or override it.
+// -----------------------------------------------------------------------------
+
+namespace safety {
+
+static const int CHANNELS = 8;
+
+enum Trip : uint8_t {
+  TRIP_TANK_OVERTEMP = 1 << 0,  // tank above limit
+  TRIP_TANK_SENSOR   = 1 << 1,  // no recent tank reading: can't prove it's safe
+  TRIP_OVERCURRENT   = 1 << 2,  // a channel above its limit (that channel off)
+  TRIP_STUCK_CHANNEL = 1 << 3,  // current on a channel commanded off -> PV kill
+  TRIP_LEAK          = 1 << 4,  // leak sense -> everything off, PV kill
+};
+
+struct Limits {
+  float tankMaxC = 85.0f;
+  float tankHystC = 2.0f;
+  uint32_t tankMaxAgeMs = 30000;
+  float chMaxA[CHANNELS] = {};    // <= 0: channel not fitted (never allowed on)
+  float offLeakA = 0.3f;          // "off" channel current above this is stuck
+  uint32_t overcurrentMs = 200;   // condition must persist (>= 2 polls)
+  uint32_t stuckMs = 1000;        // allows for the off command and decay
+  uint32_t leakMs = 0;
+  uint32_t clearMs = 30000;       // fault-free time before a trip releases
+};
+
+struct Inputs {
+  uint32_t nowMs = 0;
+  bool tankValid = false;         // a reading exists
+  float tankC = 0;
+  uint32_t tankAgeMs = 0;
+  bool busOnline = false;         // remote samples are current
+  float chA[CHANNELS] = {};
+  uint8_t commanded = 0;          // mask last sent by the heater controller
+  uint8_t leakBits = 0;
+};
+
+struct Verdict {
+  uint8_t allowed = 0xFF;         // channels that may be on
+  bool pvKill = false;
+  uint8_t trips = 0;              // active (latched) trips
+};
+
+class Interlock {
+ public:
+  void configure(const Limits& l) { lim_ = l; }
+  const Limits& limits() const { return lim_; }
+
+  // One evaluation. O(CHANNELS), no allocation.
+  Verdict evaluate(const Inputs& in);
+
+  uint32_t tripCount() const { return tripCount_; }
+  uint8_t lastTrips() const { return active_; }
+
+ private:
+  // A condition that has to hold for a while before it counts
+  struct Persist {
+    bool on = false;
+    uint32_t sinceMs = 0;
+    bool update(bool cond, uint32_t nowMs, uint32_t holdMs);
+  };
+
+  // Latches condition `on` for trip bit t; returns whether t is active.
+  bool latch(uint8_t t, bool on, uint32_t nowMs);
+
+  Limits lim_;
+  uint8_t active_ = 0;
+  uint32_t lastFaultMs_[8] = {};  // per trip bit
+  Persist oc_[CHANNELS];
+  Persist stuck_[CHANNELS];
+  Persist leak_;
+  uint8_t ocLatched_ = 0;         // channels held off for over-current
+  uint32_t ocLastMs_[CHANNELS] = {};
+  uint32_t tripCount_ = 0;
+};
+
+} // namespace safety
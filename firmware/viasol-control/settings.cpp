@@ -1,5 +1,8 @@
 #include "settings.h"
 #include "app.h"
+#include "pv_model.h"
+#include "shunt_cal.h"
+#include "metrics.h"
 #include <Preferences.h>
 
 static void clampRelayIdx(const String& loc, int& idx) {
@@ -11,12 +14,36 @@ static void clampRelayIdx(const String& loc, int& idx) {
 void validateSettings(Settings& cfg) {
   clampRelayIdx(cfg.div_loc, cfg.div_idx);
   clampRelayIdx(cfg.pvkill_loc, cfg.pvkill_idx);
+  if (cfg.div_w < 10.0f) cfg.div_w = 10.0f;
+  if (cfg.div_min_s < 5) cfg.div_min_s = 5;
+  if (cfg.div_min_s > 600) cfg.div_min_s = 600;
+  if (cfg.div_window_s < 2 * cfg.div_min_s) cfg.div_window_s = 2 * cfg.div_min_s;
+  if (cfg.div_window_s > 3600) cfg.div_window_s = 3600;
 
   if (cfg.mqtt_port < 1) cfg.mqtt_port = 1883;
   if (cfg.mqtt_port > 65535) cfg.mqtt_port = 65535;
+  if (cfg.mqtt_pub_ms < 250) cfg.mqtt_pub_ms = 250;
+  if (cfg.mqtt_pub_ms > 3600000UL) cfg.mqtt_pub_ms = 3600000UL;
+  if (cfg.mqtt_nregs < 0) cfg.mqtt_nregs = 0;
+  if (cfg.mqtt_nregs > MQTT_MAX_REGS) cfg.mqtt_nregs = MQTT_MAX_REGS;
+  for (int i = 0; i < MQTT_MAX_REGS; i++) {
+    if (cfg.mqtt_reg_maxage_s[i] < 1) cfg.mqtt_reg_maxage_s[i] = 1;
+  }
+
+  if (cfg.rs485_remotes < 0) cfg.rs485_remotes = 0;
+  if (cfg.rs485_remotes > 8) cfg.rs485_remotes = 8;
+  if (cfg.rs485_baud < 9600) cfg.rs485_baud = 9600;
+  if (cfg.rs485_baud > 1000000UL) cfg.rs485_baud = 1000000UL;
 
   if (cfg.pv_ns < 1) cfg.pv_ns = 1;
   if (cfg.pv_np < 1) cfg.pv_np = 1;
+  if (cfg.pv_vmp < 1.0f) cfg.pv_vmp = 1.0f;
+  if (cfg.pv_imp < 0.1f) cfg.pv_imp = 0.1f;
+  if (cfg.pv_voc <= cfg.pv_vmp) cfg.pv_voc = cfg.pv_vmp * 1.2f;
+
+  // Derived tables follow the settings they come from
+  pvModel().build(cfg.pv_vmp * cfg.pv_ns, cfg.pv_voc * cfg.pv_ns, cfg.pv_imp * cfg.pv_np);
+  shuntCalBuild(cfg);
 }
 
 void loadSettings(Settings& cfg) {
@@ -38,6 +65,10 @@ void loadSettings(Settings& cfg) {
 
   cfg.div_loc = app.prefs.getString("div_loc", cfg.div_loc);
   cfg.div_idx = app.prefs.getInt("div_idx", cfg.div_idx);
+  cfg.div_en = app.prefs.getBool("div_en", cfg.div_en);
+  cfg.div_w = app.prefs.getFloat("div_w", cfg.div_w);
+  cfg.div_min_s = app.prefs.getInt("div_min_s", cfg.div_min_s);
+  cfg.div_window_s = app.prefs.getInt("div_win_s", cfg.div_window_s);
   cfg.pvkill_loc = app.prefs.getString("pvkill_loc", cfg.pvkill_loc);
   cfg.pvkill_idx = app.prefs.getInt("pvkill_idx", cfg.pvkill_idx);
 
@@ -53,6 +84,22 @@ void loadSettings(Settings& cfg) {
   cfg.mqtt_user = app.prefs.getString("mqtt_user", cfg.mqtt_user);
   cfg.mqtt_pass = app.prefs.getString("mqtt_pass", cfg.mqtt_pass);
   cfg.mqtt_base = app.prefs.getString("mqtt_base", cfg.mqtt_base);
+  cfg.mqtt_pub_ms = app.prefs.getUInt("mqtt_pub_ms", cfg.mqtt_pub_ms);
+  cfg.mqtt_batch = app.prefs.getBool("mqtt_batch", cfg.mqtt_batch);
+  cfg.mqtt_nregs = app.prefs.getInt("mq_n", cfg.mqtt_nregs);
+  for (int i = 0; i < MQTT_MAX_REGS; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "mq_t%d", i);
+    cfg.mqtt_reg_topic[i] = app.prefs.getString(key, cfg.mqtt_reg_topic[i]);
+    snprintf(key, sizeof(key), "mq_a%d", i);
+    cfg.mqtt_reg_maxage_s[i] = app.prefs.getUInt(key, cfg.mqtt_reg_maxage_s[i]);
+  }
+
+  cfg.ow_tank_rom = app.prefs.getString("ow_tank", cfg.ow_tank_rom);
+  cfg.ow_floor_rom = app.prefs.getString("ow_floor", cfg.ow_floor_rom);
+
+  cfg.rs485_remotes = app.prefs.getInt("rs485_n", cfg.rs485_remotes);
+  cfg.rs485_baud = app.prefs.getUInt("rs485_baud", cfg.rs485_baud);
 
   cfg.pv_ns = app.prefs.getInt("pv_ns", cfg.pv_ns);
   cfg.pv_np = app.prefs.getInt("pv_np", cfg.pv_np);
@@ -68,6 +115,7 @@ void loadSettings(Settings& cfg) {
     cfg.el_w[i] = app.prefs.getFloat(key, cfg.el_w[i]);
   }
   cfg.learn_elems = app.prefs.getBool("learn_elems", cfg.learn_elems);
+  cfg.heat_en = app.prefs.getBool("heat_en", cfg.heat_en);
 
   cfg.wifi_ssid = app.prefs.getString("wifi_ssid", cfg.wifi_ssid);
   cfg.wifi_pass = app.prefs.getString("wifi_pass", cfg.wifi_pass);
@@ -80,56 +128,79 @@ void loadSettings(Settings& cfg) {
 }
 
 void saveSettings(const Settings& cfg) {
-  app.prefs.putFloat("tank_sp_c", cfg.tank_sp_c);
-
-  app.prefs.putString("shunt_mode", cfg.shunt_mode);
-  app.prefs.putInt("pv_shunt_a", cfg.pv_shunt_a);
-  app.prefs.putInt("pv_shunt_mv", cfg.pv_shunt_mv);
-  app.prefs.putFloat("pv_shunt_mohm", cfg.pv_shunt_mohm);
-
-  app.prefs.putInt("main_shunt_a", cfg.main_shunt_a);
-  app.prefs.putInt("main_shunt_mv", cfg.main_shunt_mv);
-  app.prefs.putFloat("main_shunt_mohm", cfg.main_shunt_mohm);
-
-  app.prefs.putInt("tz_offset_min", cfg.tz_offset_min);
-  app.prefs.putLong64("rtc_epoch", (int64_t)cfg.rtc_epoch);
-
-  app.prefs.putString("div_loc", cfg.div_loc);
-  app.prefs.putInt("div_idx", cfg.div_idx);
-  app.prefs.putString("pvkill_loc", cfg.pvkill_loc);
-  app.prefs.putInt("pvkill_idx", cfg.pvkill_idx);
-
-  app.prefs.putString("m_aux1_name", cfg.m_aux1_name);
-  app.prefs.putString("m_aux2_name", cfg.m_aux2_name);
-  app.prefs.putString("m_aux3_name", cfg.m_aux3_name);
-  app.prefs.putString("r_aux1_name", cfg.r_aux1_name);
-  app.prefs.putString("r_aux2_name", cfg.r_aux2_name);
-  app.prefs.putString("r_aux3_name", cfg.r_aux3_name);
-
-  app.prefs.putString("mqtt_host", cfg.mqtt_host);
-  app.prefs.putInt("mqtt_port", cfg.mqtt_port);
-  app.prefs.putString("mqtt_user", cfg.mqtt_user);
-  app.prefs.putString("mqtt_pass", cfg.mqtt_pass);
-  app.prefs.putString("mqtt_base", cfg.mqtt_base);
-
-  app.prefs.putInt("pv_ns", cfg.pv_ns);
-  app.prefs.putInt("pv_np", cfg.pv_np);
-  app.prefs.putFloat("pv_vmp", cfg.pv_vmp);
-  app.prefs.putFloat("pv_voc", cfg.pv_voc);
-  app.prefs.putFloat("pv_imp", cfg.pv_imp);
+  size_t n = 0;
+  n += app.prefs.putFloat("tank_sp_c", cfg.tank_sp_c);
+
+  n += app.prefs.putString("shunt_mode", cfg.shunt_mode);
+  n += app.prefs.putInt("pv_shunt_a", cfg.pv_shunt_a);
+  n += app.prefs.putInt("pv_shunt_mv", cfg.pv_shunt_mv);
+  n += app.prefs.putFloat("pv_shunt_mohm", cfg.pv_shunt_mohm);
+
+  n += app.prefs.putInt("main_shunt_a", cfg.main_shunt_a);
+  n += app.prefs.putInt("main_shunt_mv", cfg.main_shunt_mv);
+  n += app.prefs.putFloat("main_shunt_mohm", cfg.main_shunt_mohm);
+
+  n += app.prefs.putInt("tz_offset_min", cfg.tz_offset_min);
+  n += app.prefs.putLong64("rtc_epoch", (int64_t)cfg.rtc_epoch);
+
+  n += app.prefs.putString("div_loc", cfg.div_loc);
+  n += app.prefs.putInt("div_idx", cfg.div_idx);
+  n += app.prefs.putBool("div_en", cfg.div_en);
+  n += app.prefs.putFloat("div_w", cfg.div_w);
+  n += app.prefs.putInt("div_min_s", cfg.div_min_s);
+  n += app.prefs.putInt("div_win_s", cfg.div_window_s);
+  n += app.prefs.putString("pvkill_loc", cfg.pvkill_loc);
+  n += app.prefs.putInt("pvkill_idx", cfg.pvkill_idx);
+
+  n += app.prefs.putString("m_aux1_name", cfg.m_aux1_name);
+  n += app.prefs.putString("m_aux2_name", cfg.m_aux2_name);
+  n += app.prefs.putString("m_aux3_name", cfg.m_aux3_name);
+  n += app.prefs.putString("r_aux1_name", cfg.r_aux1_name);
+  n += app.prefs.putString("r_aux2_name", cfg.r_aux2_name);
+  n += app.prefs.putString("r_aux3_name", cfg.r_aux3_name);
+
+  n += app.prefs.putString("mqtt_host", cfg.mqtt_host);
+  n += app.prefs.putInt("mqtt_port", cfg.mqtt_port);
+  n += app.prefs.putString("mqtt_user", cfg.mqtt_user);
+  n += app.prefs.putString("mqtt_pass", cfg.mqtt_pass);
+  n += app.prefs.putString("mqtt_base", cfg.mqtt_base);
+  n += app.prefs.putUInt("mqtt_pub_ms", cfg.mqtt_pub_ms);
+  n += app.prefs.putBool("mqtt_batch", cfg.mqtt_batch);
+  n += app.prefs.putInt("mq_n", cfg.mqtt_nregs);
+  for (int i = 0; i < MQTT_MAX_REGS; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "mq_t%d", i);
+    n += app.prefs.putString(key, cfg.mqtt_reg_topic[i]);
+    snprintf(key, sizeof(key), "mq_a%d", i);
+    n += app.prefs.putUInt(key, cfg.mqtt_reg_maxage_s[i]);
+  }
+
+  n += app.prefs.putString("ow_tank", cfg.ow_tank_rom);
+  n += app.prefs.putString("ow_floor", cfg.ow_floor_rom);
+
+  n += app.prefs.putInt("rs485_n", cfg.rs485_remotes);
+  n += app.prefs.putUInt("rs485_baud", cfg.rs485_baud);
+
+  n += app.prefs.putInt("pv_ns", cfg.pv_ns);
+  n += app.prefs.putInt("pv_np", cfg.pv_np);
+  n += app.prefs.putFloat("pv_vmp", cfg.pv_vmp);
+  n += app.prefs.putFloat("pv_voc", cfg.pv_voc);
+  n += app.prefs.putFloat("pv_imp", cfg.pv_imp);
 
   for (int i = 0; i < 8; i++) {
     char key[8];
     snprintf(key, sizeof(key), "elv%d", i);
-    app.prefs.putFloat(key, cfg.el_v[i]);
+    n += app.prefs.putFloat(key, cfg.el_v[i]);
     snprintf(key, sizeof(key), "elw%d", i);
-    app.prefs.putFloat(key, cfg.el_w[i]);
+    n += app.prefs.putFloat(key, cfg.el_w[i]);
   }
-  app.prefs.putBool("learn_elems", cfg.learn_elems);
+  n += app.prefs.putBool("learn_elems", cfg.learn_elems);
+  n += app.prefs.putBool("heat_en", cfg.heat_en);
 
-  app.prefs.putString("wifi_ssid", cfg.wifi_ssid);
-  app.prefs.putString("wifi_pass", cfg.wifi_pass);
-  app.prefs.putString("ap_pass", cfg.ap_pass);
+  n += app.prefs.putString("wifi_ssid", cfg.wifi_ssid);
+  n += app.prefs.putString("wifi_pass", cfg.wifi_pass);
+  n += app.prefs.putString("ap_pass", cfg.ap_pass);
 
-  app.prefs.putUInt("blinkMs", app.blinkMs);
+  n += app.prefs.putUInt("blinkMs", app.blinkMs);
+  metricsNvsWrite(n);
 }
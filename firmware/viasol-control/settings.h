@@ -1,6 +1,8 @@
 #pragma once
 #include <Arduino.h>
 
+static const int MQTT_MAX_REGS = 16;
+
 struct Settings {
   // Control
   float tank_sp_c = 55.0f;
@@ -25,6 +27,12 @@ struct Settings {
   String pvkill_loc = "master";
   int pvkill_idx = 2;
 
+  // AC diversion (time-proportioned, see divert_core.h)
+  bool div_en = false;
+  float div_w = 1500.0f;       // AC load on the diversion relay
+  int div_min_s = 30;          // minimum relay on and off time
+  int div_window_s = 120;      // time-proportioning window
+
   // Names
   String m_aux1_name = "master_aux1";
   String m_aux2_name = "master_aux2";
@@ -39,6 +47,21 @@ struct Settings {
   String mqtt_user = "";
   String mqtt_pass = "";
   String mqtt_base = "solarheater";
+  uint32_t mqtt_pub_ms = 5000;  // per-topic publish interval (coalesced)
+  bool mqtt_batch = false;      // one JSON object under <base>/state
+
+  // MQTT virtual input registers mqtt1..mqttN (applied at boot)
+  int mqtt_nregs = 4;
+  String mqtt_reg_topic[MQTT_MAX_REGS];  // "" = <base>/reg/mqttN
+  uint32_t mqtt_reg_maxage_s[MQTT_MAX_REGS] = {60,60,60,60,60,60,60,60,60,60,60,60,60,60,60,60};
+
+  // Temperature sensors (ROM as 16 hex digits; "" = first sensor on bus 1 / bus 2)
+  String ow_tank_rom = "";
+  String ow_floor_rom = "";
+
+  // RS-485 remote comm boards (addresses 1..N, applied at boot)
+  int rs485_remotes = 1;
+  uint32_t rs485_baud = 250000;
 
   // PV model
   int pv_ns = 4;
@@ -51,6 +74,7 @@ struct Settings {
   float el_v[8] = {24,24,24,24,24,24,24,24};
   float el_w[8] = {1000,1000,1000,1000,1000,1000,1000,1000};
   bool learn_elems = false;
+  bool heat_en = false;  // P&O channel switching
 
   // Wi-Fi creds
   String wifi_ssid = "";
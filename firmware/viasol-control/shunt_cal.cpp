@@ -0,0 +1,104 @@
+#include "shunt_cal.h"
+#include "metrics.h"
+#include "app.h"
+
+static const int ZERO_SAMPLES = 32;
+static const int32_t ZERO_MAX_SPREAD = 8;       // codes, noise bound while quiet
+static const int32_t ZERO_MAX_OFFSET = 200;     // codes, beyond this something is wrong
+static const uint32_t ZERO_INTERVAL_MS = 24UL * 3600UL * 1000UL;
+
+struct ZeroState {
+  int n = 0;
+  int64_t sum = 0;
+  int32_t lo = 0;
+  int32_t hi = 0;
+  bool done = false;
+  uint32_t doneMs = 0;
+  bool warned = false;
+};
+
+static ShuntCal cals[SHUNT_COUNT];
+static ZeroState zero[SHUNT_COUNT];
+static bool offsetsLoaded = false;
+
+static const char* offsetKey(ShuntId id) {
+  return id == SHUNT_PV ? "sh_off_pv" : "sh_off_main";
+}
+
+static float shuntMohm(const String& mode, int ratedA, int ratedMv, float mohm) {
+  if (mode == "mohm") return mohm;
+  if (ratedA <= 0) return 0;
+  return (float)ratedMv / (float)ratedA;   // mV / A = mOhm
+}
+
+static int32_t scaleQ16(float mohm) {
+  if (!(mohm > 0)) return 0;
+  // uV at the shunt per code, then mA = uV / mOhm
+  double uvPerCode = (double)SHUNT_ADC_FS_UV / SHUNT_ADC_COUNTS / SHUNT_AMP_GAIN;
+  double maPerCode = uvPerCode / mohm;
+  return (int32_t)(maPerCode * 65536.0 + 0.5);
+}
+
+void shuntCalBuild(const Settings& cfg) {
+  cals[SHUNT_PV].scaleQ16 = scaleQ16(shuntMohm(cfg.shunt_mode, cfg.pv_shunt_a, cfg.pv_shunt_mv, cfg.pv_shunt_mohm));
+  cals[SHUNT_MAIN].scaleQ16 = scaleQ16(shuntMohm(cfg.shunt_mode, cfg.main_shunt_a, cfg.main_shunt_mv, cfg.main_shunt_mohm));
+
+  if (!offsetsLoaded) {
+    offsetsLoaded = true;
+    for (int i = 0; i < SHUNT_COUNT; i++) {
+      cals[i].offset = app.prefs.getInt(offsetKey((ShuntId)i), 0);
+    }
+  }
+}
+
+const ShuntCal& shuntCal(ShuntId id) {
+  return cals[id < SHUNT_COUNT ? id : SHUNT_PV];
+}
+
+void shuntZeroFeed(ShuntId id, int32_t raw, bool quiet) {
+  if (id >= SHUNT_COUNT) return;
+  ZeroState& z = zero[id];
+
+  uint32_t now = millis();
+  if (z.done && (now - z.doneMs) < ZERO_INTERVAL_MS) return;
+
+  if (!quiet) {
+    z.n = 0;
+    return;
+  }
+
+  if (z.n == 0) {
+    z.sum = 0;
+    z.lo = z.hi = raw;
+  }
+  z.sum += raw;
+  if (raw < z.lo) z.lo = raw;
+  if (raw > z.hi) z.hi = raw;
+  if (++z.n < ZERO_SAMPLES) return;
+
+  int32_t mean = (int32_t)(z.sum / z.n);
+  int32_t spread = z.hi - z.lo;
+  z.n = 0;
+  if (spread > ZERO_MAX_SPREAD || mean < -ZERO_MAX_OFFSET || mean > ZERO_MAX_OFFSET) {
+    if (!z.warned) {
+      z.warned = true;
+      Serial.printf("[shunt] zero cal %u rejected (mean %ld, spread %ld)\n",
+                    (unsigned)id, (long)mean, (long)spread);
+    }
+    return;
+  }
+
+  z.done = true;
+  z.warned = false;
+  z.doneMs = now;
+  if (mean != cals[id].offset) {
+    cals[id].offset = mean;
+    metricsNvsWrite(app.prefs.putInt(offsetKey(id), mean));
+  }
+  Serial.printf("[shunt] zero cal %u offset %ld\n", (unsigned)id, (long)mean);
+}
+
+uint32_t shuntZeroAgeSec(ShuntId id) {
+  if (id >= SHUNT_COUNT || !zero[id].done) return UINT32_MAX;
+  return (millis() - zero[id].doneMs) / 1000;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Shunt calibration.
+//
+// Shunt settings (rated A/mV or an mOhm override) are folded into one Q16
+// scale per shunt whenever validateSettings() runs, so converting an ADC code
+// to milliamps is a subtract, multiply and shift per sample.
+//
+// The zero offset is learned at zero current (all heater channels off): once
+// after boot and then daily, and kept in NVS across reboots.
+// -----------------------------------------------------------------------------
+
+enum ShuntId : uint8_t { SHUNT_PV = 0, SHUNT_MAIN = 1, SHUNT_COUNT = 2 };
+
+// Analog front end: INA180A2 (50 V/V) into a 12-bit ADC
+static const int32_t SHUNT_AMP_GAIN = 50;
+static const int32_t SHUNT_ADC_FS_UV = 3100000;  // full scale at 11 dB attenuation
+static const int32_t SHUNT_ADC_COUNTS = 4096;
+
+struct ShuntCal {
+  int32_t scaleQ16 = 0;  // mA per ADC code, Q16
+  int32_t offset = 0;    // ADC code at zero current
+};
+
+static inline int32_t shuntToMilliamps(const ShuntCal& c, int32_t raw) {
+  return (int32_t)(((int64_t)(raw - c.offset) * c.scaleQ16) >> 16);
+}
+
+// Called from validateSettings()
+void shuntCalBuild(const Settings& cfg);
+
+const ShuntCal& shuntCal(ShuntId id);
+
+// Feed raw samples while current is known to be zero (quiet=true) or not.
+// A settled, plausible average becomes the new offset.
+void shuntZeroFeed(ShuntId id, int32_t raw, bool quiet);
+uint32_t shuntZeroAgeSec(ShuntId id);  // UINT32_MAX if never calibrated
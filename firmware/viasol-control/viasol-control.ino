@@ -7,6 +7,20 @@
 #include "rules.h"
 #include "web_routes.h"
 #include "rules2.h"
+#include "history.h"
+#include "mqtt.h"
+#include "io_catalog.h"
+#include "rs485.h"
+#include "heater.h"
+#include "adc_sampler.h"
+#include "ow_temps.h"
+#include "energy.h"
+#include "safety.h"
+#include "divert.h"
+#include "wifi_link.h"
+#include "metrics.h"
+#include "heap_debug.h"
+#include "heap_track.h"
 
 
 
@@ -22,43 +36,6 @@ static String chipSuffix() {
   return String(buf).substring(2);
 }
 
-static bool connectToSta(uint32_t timeoutMs) {
-  WiFi.mode(WIFI_STA);
-  WiFi.setSleep(false);
-  WiFi.disconnect(true, true);
-  delay(200);
-
-  Serial.printf("Connecting to WiFi SSID: '%s'\n", cfg.wifi_ssid.c_str());
-  WiFi.begin(cfg.wifi_ssid.c_str(), cfg.wifi_pass.c_str());
-
-  uint32_t start = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeoutMs) {
-    delay(300);
-  }
-
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.print("Connected. IP: ");
-    Serial.println(WiFi.localIP());
-    return true;
-  }
-
-  Serial.println("WiFi connect failed.");
-  return false;
-}
-
-static void startApMode() {
-  app.inApMode = true;
-  WiFi.mode(WIFI_AP);
-
-  bool ok;
-  if (cfg.ap_pass.length() >= 8) ok = WiFi.softAP(app.apSsid.c_str(), cfg.ap_pass.c_str());
-  else ok = WiFi.softAP(app.apSsid.c_str());
-
-  Serial.printf("AP start %s\n", ok ? "OK" : "FAILED");
-  Serial.print("AP SSID: "); Serial.println(app.apSsid);
-  Serial.print("AP IP: "); Serial.println(WiFi.softAPIP());
-}
-
 void setup() {
   Serial.begin(115200);
   delay(200);
@@ -74,32 +51,76 @@ void setup() {
   // Load settings (this also begins prefs)
   loadSettings(cfg);
 
-  // Load programmable rules
+  // Input catalog (fixed inputs + MQTT registers); everything sized per input follows
+  ioCatalogBegin(cfg);
+  mqttRegsBegin(cfg);
+  owBegin(cfg);  // registers ow_<serial> inputs for cached sensors
+
+  // Load programmable rules (both engines run from the first loop pass)
   loadRules();
+  rules2::loadRules2();
 
-  // Try STA first if creds exist, else AP mode
-  bool connected = false;
-  if (cfg.wifi_ssid.length() && cfg.wifi_pass.length()) {
-    connected = connectToSta(15000);
-  }
-  if (!connected) startApMode();
-  else app.inApMode = false;
+  // Input history buffers (allocated once, PSRAM)
+  historyBegin();
 
-  // Register routes and start server
-  registerWebRoutes(cfg);
-  app.server.begin();
+  // Filtered PV volts/amps from the remote's registers -> catalog
+  adcBegin();
 
-  rules2::loadRules2();          // or initRules2Defaults() for now
-  //rules2::initRules2Defaults();   // temporary until UI/persistence exists
+  // Remote comm boards (bus task starts polling immediately)
+  rs485Begin(cfg);
+  safetyBegin(cfg);  // before anything can switch a heater channel
+  heaterBegin(cfg);
+  divertBegin(cfg);
+  energyBegin();
 
+  // MQTT connects in the background once Wi-Fi is up
+  mqttBegin(cfg);
 
-  Serial.println("Web server started.");
+  // Routes now; the server itself starts from wifiTick() once an interface is up
+  registerWebRoutes(cfg);
+
+  // STA join (or setup AP) in the background; never waits here
+  wifiBegin(cfg);
+
+  heapDebugBegin();
+  Serial.printf("[boot] setup done at %u ms\n", (unsigned)millis());
 }
 
 void loop() {
-  app.server.handleClient();
-  processRules();
-  rules2::processRules2(); // new rules v2 (parallel)
+  uint32_t loopStart = micros();
+  uint32_t t = loopStart;
+
+  wifiTick();
+  if (wifiServerUp()) app.server.handleClient();
+  t = metricsPhase(LoopPhase::Net, t);
+  adcTick();
+  owTick();
+  ioSnapshot();
+  t = metricsPhase(LoopPhase::Inputs, t);
+  {
+    heaptrack::TickGuard guard("processRules");
+    processRules();
+  }
+  t = metricsPhase(LoopPhase::Rules, t);
+  {
+    heaptrack::TickGuard guard("processRules2");
+    rules2::processRules2(); // new rules v2 (parallel)
+  }
+  t = metricsPhase(LoopPhase::Rules2, t);
+  if (!app.firstTickMs) {
+    app.firstTickMs = millis();
+    Serial.printf("[boot] first control tick at %u ms\n", (unsigned)app.firstTickMs);
+  }
+  historyTick();
+  mqttTick();
+  rs485Tick();
+  t = metricsPhase(LoopPhase::Io, t);
+  heaterTick();
+  divertTick();
+  t = metricsPhase(LoopPhase::Heater, t);
+  energyTick();
+  safetyTick();
+  metricsPhase(LoopPhase::Energy, t);
 
 
 
@@ -119,5 +140,6 @@ void loop() {
     digitalWrite(LED_PIN, ledState ? HIGH : LOW);
   }
 
-  // Later: heaterTick(); mqttTick(); rs485Tick(); etc.
+  heapDebugTick();
+  metricsLoopDone(loopStart);
 }
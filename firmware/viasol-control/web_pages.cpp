@@ -2,6 +2,16 @@
 #include "rules.h"
 #include "io_catalog.h"
 #include "app.h"
+#include "heater.h"
+#include "pv_model.h"
+#include "shunt_cal.h"
+#include "ow_temps.h"
+#include "energy.h"
+#include "safety.h"
+#include "divert.h"
+#include "wifi_link.h"
+#include "heap_debug.h"
+#include "heap_track.h"
 
 
 // minimal escaping
@@ -29,11 +39,15 @@ String buildMainHtml(const Settings& cfg, const String& ipStr, bool inApMode) {
   p += "<div class='card'>";
   p += "<p>Mode: <b>" + String(inApMode ? "AP setup" : "Normal") + "</b></p>";
   p += "<p>IP: <b>" + htmlEscape(ipStr) + "</b></p>";
+  p += "<p class='muted'>Boot: control running at " + String(app.firstTickMs) + " ms, network up at " +
+       String(wifiUpMs()) + " ms after reset.</p>";
   p += "<p>Tank setpoint: <b>" + String(cfg.tank_sp_c, 1) + " degC</b></p>";
   p += "<p class='muted'>Use config to edit settings and rules.</p>";
   p += "<a class='btn' href='/config'>Open Config</a>";
   p += "<div style='height:10px;'></div>";
   p += "<a class='btn' href='/rules'>Open Rules</a>";
+  p += "<div style='height:10px;'></div>";
+  p += "<a class='btn' href='/energy'>Energy</a>";
   p += "</div></body></html>";
   return p;
 }
@@ -108,6 +122,8 @@ String buildConfigControlHtml(const Settings& cfg) {
   p += "<div class='card'>";
   p += "<label>Tank setpoint (degC)</label>";
   p += "<input name='tank_sp_c' type='number' step='0.1' value='" + String(cfg.tank_sp_c, 1) + "'>";
+  p += "<div class='muted'>Safety cut-off at " + String(cfg.tank_sp_c + SAFETY_TANK_MARGIN_C, 1) +
+       " degC. Interlock: <b>" + safetyTripNames(safetyTrips()) + "</b> (" + String(safetyTripCount()) + " trips since boot)</div>";
 
   p += "<div class='row'>";
   p += "<div><label>Timezone offset (minutes)</label>";
@@ -122,6 +138,31 @@ String buildConfigControlHtml(const Settings& cfg) {
   p += "<div class='muted' style='margin-top:8px;'>RTC epoch is optional; later you can add NTP and ignore this.</div>";
   p += "</div>";
 
+  // Temperature sensor assignment
+  auto romSelect = [&](const char* name, const String& cur) {
+    String s;
+    s += "<select name='"; s += name; s += "'>";
+    s += "<option value='' " + String(cur.length() ? "" : "selected") + ">auto</option>";
+    for (int i = 0; i < owSensorCount(); i++) {
+      OwSensor o;
+      if (!owSensor(i, o)) continue;
+      String hex = owRomHex(o.rom);
+      s += "<option value='" + hex + "' " + String(hex == cur ? "selected" : "") + ">";
+      s += String(o.key) + " (bus " + String(o.bus + 1) + (o.ok ? ", " + String(o.tempC, 1) + " C" : ", no reading") + ")</option>";
+    }
+    s += "</select>";
+    return s;
+  };
+
+  p += "<div class='card'>";
+  p += "<h3 style='margin:0 0 8px;'>Temperature sensors</h3>";
+  p += "<div class='row'>";
+  p += "<div><label>Tank</label>" + romSelect("ow_tank", cfg.ow_tank_rom) + "</div>";
+  p += "<div><label>Floor</label>" + romSelect("ow_floor", cfg.ow_floor_rom) + "</div>";
+  p += "</div>";
+  p += "<div class='muted' style='margin-top:8px;'>Auto: first sensor on header 1 is the tank, on header 2 the floor. Every sensor is also an input named ow_&lt;serial&gt;.</div>";
+  p += "</div>";
+
   p += saveButtons("/config/control");
   p += "</form>";
 
@@ -147,6 +188,26 @@ String buildConfigMqttHtml(const Settings& cfg) {
   p += "</div>";
 
   p += "<label>Base topic</label><input name='mqtt_base' value='" + htmlEscape(cfg.mqtt_base) + "'>";
+
+  p += "<label>Publish interval (ms)</label>";
+  p += "<input name='mqtt_pub_ms' type='number' min='250' value='" + String(cfg.mqtt_pub_ms) + "'>";
+  p += "<input type='hidden' name='mqtt_form' value='1'>";
+  p += "<label><input type='checkbox' name='mqtt_batch' " + String(cfg.mqtt_batch ? "checked" : "") + "> Batch values into one JSON message (&lt;base&gt;/state)</label>";
+  p += "<div class='muted' style='margin-top:8px;'>Each topic is published at most once per interval with its latest value.</div>";
+  p += "</div>";
+
+  p += "<div class='card'><h3 style='margin:0 0 8px;'>Input registers</h3>";
+  p += "<label>Number of registers (mqtt1..mqttN, max " + String(MQTT_MAX_REGS) + ")</label>";
+  p += "<input name='mqtt_nregs' type='number' min='0' max='" + String(MQTT_MAX_REGS) + "' value='" + String(cfg.mqtt_nregs) + "'>";
+  for (int i = 0; i < cfg.mqtt_nregs; i++) {
+    p += "<div class='row'>";
+    p += "<div><label>mqtt" + String(i+1) + " topic</label>";
+    p += "<input name='mq_t" + String(i) + "' placeholder='" + htmlEscape(cfg.mqtt_base) + "/reg/mqtt" + String(i+1) + "' value='" + htmlEscape(cfg.mqtt_reg_topic[i]) + "'></div>";
+    p += "<div><label>Max age (s)</label>";
+    p += "<input name='mq_a" + String(i) + "' type='number' min='1' value='" + String(cfg.mqtt_reg_maxage_s[i]) + "'></div>";
+    p += "</div>";
+  }
+  p += "<div class='muted' style='margin-top:8px;'>A register older than its max age reads as stale. Register count and topics apply after reboot.</div>";
   p += "</div>";
 
   p += saveButtons("/config/mqtt");
@@ -174,18 +235,33 @@ String buildConfigWifiHtml(const Settings& cfg, bool inApMode) {
   p += "<input name='ap_pass' value='" + htmlEscape(cfg.ap_pass) + "'>";
 
   if (inApMode) {
-    p += "<div class='muted' style='margin-top:8px;'>Saving in AP mode will reboot and attempt to join the Wi-Fi network.</div>";
+    p += "<div class='muted' style='margin-top:8px;'>Saving joins the network right away; this AP stays up until the connection has been stable for a minute.</div>";
   } else {
-    p += "<div class='muted' style='margin-top:8px;'>If you change creds while already connected, you may need to reboot to apply.</div>";
+    p += "<div class='muted' style='margin-top:8px;'>New credentials apply on save. If the join fails, the device AP comes up alongside.</div>";
   }
   p += "</div>";
 
+  const WifiStats& ws = wifiStats();
+  p += "<div class='card'>";
+  p += "<div><b>Status:</b> " + String(wifiStateName(ws.state));
+  if (ws.rescueAp) p += " (rescue AP up)";
+  p += "</div>";
+  if (ws.state == WifiState::Online) {
+    p += "<div class='muted'>RSSI " + String(ws.rssi) + " dBm, worst " + String(ws.rssiMin) + " dBm since connect</div>";
+  } else if (ws.outageMs) {
+    p += "<div class='muted'>Down for " + String(ws.outageMs / 1000) + " s, last reason " + String(ws.lastReason) + "</div>";
+  }
+  p += "<div class='muted'>Connects " + String(ws.connects) + ", drops " + String(ws.disconnects) +
+       ", attempts " + String(ws.attempts) + ". Last outage " + String(ws.lastOutageMs / 1000) +
+       " s, longest " + String(ws.longestOutageMs / 1000) + " s, total " + String(ws.totalOutageS) + " s.</div>";
+  p += "</div>";
+
   p += saveButtons("/config/wifi");
   p += "</form>";
 
   p += "<div class='card'>";
   p += "<form method='POST' action='/forgetWiFi'>";
-  p += "<button type='submit'>Forget Wi-Fi and reboot into AP mode</button>";
+  p += "<button type='submit'>Forget Wi-Fi and switch to AP setup</button>";
   p += "</form>";
   p += "</div>";
 
@@ -225,6 +301,11 @@ String buildConfigShuntsHtml(const Settings& cfg) {
   p += "<label>mOhm override</label><input name='main_shunt_mohm' type='number' step='0.0001' value='" + String(cfg.main_shunt_mohm, 4) + "'>";
   p += "</div>";
 
+  uint32_t age = shuntZeroAgeSec(SHUNT_PV);
+  p += "<div class='muted'>PV zero offset " + String(shuntCal(SHUNT_PV).offset) + " codes";
+  p += (age == UINT32_MAX) ? String(", not calibrated since boot") : (", calibrated " + String(age / 60) + " min ago");
+  p += ". Calibrates automatically while all heater channels are off.</div>";
+
   p += saveButtons("/config/shunts");
   p += "</form>";
 
@@ -254,6 +335,16 @@ String buildConfigRelaysHtml(const Settings& cfg) {
   p += "<div><label>Location</label>" + locSelect("div_loc", cfg.div_loc) + "</div>";
   p += "<div><label>Relay index</label><input name='div_idx' type='number' min='1' max='3' value='" + String(cfg.div_idx) + "'></div>";
   p += "</div>";
+  p += "<div class='row'>";
+  p += "<div><label>AC load (W)</label><input name='div_w' type='number' min='10' step='10' value='" + String(cfg.div_w, 0) + "'></div>";
+  p += "<div><label>Min on/off time (s)</label><input name='div_min_s' type='number' min='5' max='600' value='" + String(cfg.div_min_s) + "'></div>";
+  p += "</div>";
+  p += "<label>Window (s)</label><input name='div_window_s' type='number' min='10' max='3600' value='" + String(cfg.div_window_s) + "'>";
+  p += "<label><input type='checkbox' name='div_en' " + String(cfg.div_en ? "checked" : "") + "> Divert PV surplus once the heater channels are saturated</label>";
+  p += "<input type='hidden' name='relay_form' value='1'>";
+  const DivertStatus& ds = divertStatus();
+  p += "<div class='muted'>Surplus " + String(ds.surplusW, 0) + " W, duty " + String((int)(ds.duty * 100)) +
+       "%, relay " + String(ds.on ? "on" : "off") + ", " + String(ds.switches) + " switches since boot.</div>";
   p += "<div class='muted' style='margin-top:8px;'>Master supports relay 1-2; Remote supports relay 1-3. Firmware clamps if needed.</div>";
   p += "</div>";
 
@@ -265,6 +356,15 @@ String buildConfigRelaysHtml(const Settings& cfg) {
   p += "</div>";
   p += "</div>";
 
+  p += "<div class='card'>";
+  p += "<h3 style='margin:0 0 8px;'>Remote comm bus (RS-485)</h3>";
+  p += "<div class='row'>";
+  p += "<div><label>Remote boards</label><input name='rs485_n' type='number' min='0' max='8' value='" + String(cfg.rs485_remotes) + "'></div>";
+  p += "<div><label>Baud</label><input name='rs485_baud' type='number' min='9600' max='1000000' step='1' value='" + String(cfg.rs485_baud) + "'></div>";
+  p += "</div>";
+  p += "<div class='muted' style='margin-top:8px;'>Remotes answer at addresses 1..N. Applies after reboot.</div>";
+  p += "</div>";
+
   p += saveButtons("/config/relays");
   p += "</form>";
 
@@ -294,6 +394,15 @@ String buildConfigPvHtml(const Settings& cfg) {
   p += "<div class='muted' style='margin-top:8px;'>Used for estimates and sanity checks. Doesn’t need to be perfect.</div>";
   p += "</div>";
 
+  const PvModel& m = pvModel();
+  if (m.valid()) {
+    p += "<div class='card'>";
+    p += "<h3 style='margin:0 0 8px;'>Array model (full sun)</h3>";
+    p += "<div>MPP " + String(m.mppV(), 1) + " V / " + String(m.mppW(), 0) + " W";
+    p += ", Voc " + String(m.voc(), 1) + " V, Isc " + String(m.isc(), 2) + " A</div>";
+    p += "</div>";
+  }
+
   p += saveButtons("/config/pv");
   p += "</form>";
 
@@ -318,9 +427,16 @@ String buildConfigElementsHtml(const Settings& cfg) {
     p += "<div><label>Element " + String(i+1) + " wattage</label>";
     p += "<input name='elw" + String(i) + "' type='number' step='1' value='" + String(cfg.el_w[i], 0) + "'></div>";
     p += "</div>";
+    float ohms, conf;
+    if (heaterLearned(i, ohms, conf)) {
+      p += "<div class='muted'>Learned " + String(ohms, 2) + " &Omega; (" + String((int)(conf * 100)) + "% confidence)</div>";
+    }
   }
 
   p += "<label><input type='checkbox' name='learn_elems' " + String(cfg.learn_elems ? "checked" : "") + "> Learn heating elements (experimental)</label>";
+  p += "<label><input type='checkbox' name='heat_en' " + String(cfg.heat_en ? "checked" : "") + "> Enable heater control (perturb and observe)</label>";
+  p += "<input type='hidden' name='el_form' value='1'>";
+  p += "<div class='muted' style='margin-top:8px;'>Elements are switched by remote board " + String(HEATER_REMOTE) + ". Set voltage or wattage to 0 for unused channels.</div>";
   p += "</div>";
 
   p += saveButtons("/config/elements");
@@ -331,6 +447,123 @@ String buildConfigElementsHtml(const Settings& cfg) {
 }
 
 
+// kWh with 3 decimals from mWh
+static String kwh(uint64_t mWh) {
+  char b[24];
+  snprintf(b, sizeof(b), "%llu.%03u", (unsigned long long)(mWh / 1000000ULL), (unsigned)((mWh / 1000ULL) % 1000ULL));
+  return String(b);
+}
+
+static String periodLabel(uint32_t key) {
+  if (key == 0) return "(clock not set)";
+  char b[12];
+  if (key > 999999) snprintf(b, sizeof(b), "%04u-%02u-%02u", (unsigned)(key / 10000), (unsigned)(key / 100 % 100), (unsigned)(key % 100));
+  else snprintf(b, sizeof(b), "%04u-%02u", (unsigned)(key / 100), (unsigned)(key % 100));
+  return String(b);
+}
+
+static void energyRow(String& p, const String& label, const EnergyPeriod& e) {
+  p += "<tr><td>" + label + "</td><td><b>" + kwh(e.mWh[ENERGY_TOTAL]) + "</b></td>";
+  for (int ch = 0; ch < ENERGY_CHANNELS; ch++) p += "<td>" + kwh(e.mWh[ch]) + "</td>";
+  p += "</tr>";
+}
+
+static void energyHeader(String& p) {
+  p += "<table style='width:100%;font-size:13px;'><tr><th></th><th>PV</th>";
+  for (int ch = 0; ch < ENERGY_CHANNELS; ch++) p += "<th>E" + String(ch + 1) + "</th>";
+  p += "</tr>";
+}
+
+String buildEnergyHtml() {
+  String p; p.reserve(16000);
+  pageStart(p, "Energy");
+
+  p += "<h2>Energy (kWh)</h2>";
+
+  p += "<div class='card'>";
+  energyHeader(p);
+  energyRow(p, "Today " + periodLabel(energyToday().key), energyToday());
+  energyRow(p, "Month " + periodLabel(energyMonth().key), energyMonth());
+  p += "<tr><td>Lifetime</td><td><b>" + kwh(energyLifetimeMWh(ENERGY_TOTAL)) + "</b></td>";
+  for (int ch = 0; ch < ENERGY_CHANNELS; ch++) p += "<td>" + kwh(energyLifetimeMWh(ch)) + "</td>";
+  p += "</tr></table>";
+  p += "<div class='muted'>PV is the array output; E1..E8 are the heater channels.</div>";
+  p += "</div>";
+
+  EnergyPeriod e;
+  p += "<div class='card'><h3>Months</h3>";
+  energyHeader(p);
+  for (int i = 0; energyMonthAt(i, e); i++) energyRow(p, periodLabel(e.key), e);
+  p += "</table></div>";
+
+  p += "<div class='card'><h3>Days</h3>";
+  energyHeader(p);
+  for (int i = 0; energyDay(i, e); i++) energyRow(p, periodLabel(e.key), e);
+  p += "</table></div>";
+
+  p += "<a class='btn' href='/'>Home</a>";
+  pageEnd(p);
+  return p;
+}
+
+String buildHeapDebugHtml() {
+  // Snapshot first so this page's own String growth doesn't skew the numbers
+  heaptrack::Totals t = heaptrack::totals();
+  static heaptrack::Site sites[heaptrack::MAX_SITES];
+  int nSites = heaptrack::sites(sites, heaptrack::MAX_SITES);
+  char pcBuf[12];
+
+  String p; p.reserve(12000);
+  pageStart(p, "Heap");
+  p += "<h2>Heap</h2>";
+
+  p += "<div class='card'>";
+  p += "<div>Free <b>" + String(ESP.getFreeHeap()) + "</b> B, largest block <b>" + String(ESP.getMaxAllocHeap()) +
+       "</b> B, minimum free " + String(ESP.getMinFreeHeap()) + " B</div>";
+  p += "<div>Tracked live <b>" + String(t.liveBytes) + "</b> B in " + String(t.liveBlocks) + " blocks, peak " +
+       String(t.peakBytes) + " B</div>";
+  p += "<div class='muted'>" + String(t.allocs) + " allocations, " + String(t.frees) + " frees";
+  if (t.untracked) p += ", " + String(t.untracked) + " not tracked (table full)";
+  p += ".</div>";
+  if (!heaptrack::guardsArmed()) {
+    p += "<div class='muted'>Tick guards arm " + String(HEAP_GUARD_WARMUP_MS / 1000) + " s after boot.</div>";
+  } else if (heaptrack::violations() == 0) {
+    p += "<div>Rule ticks: <b>no allocations</b> since warm-up</div>";
+  } else {
+    heaptrack::Violation v = heaptrack::lastViolation();
+    snprintf(pcBuf, sizeof(pcBuf), "0x%08lx", (unsigned long)v.pc);
+    p += "<div style='color:#b00;'>Rule ticks: <b>" + String(heaptrack::violations()) + "</b> allocations since warm-up, last " +
+         String(v.size) + " B in " + String(v.section ? v.section : "?") + " from <code>" + String(pcBuf) + "</code></div>";
+  }
+  p += "</div>";
+
+  p += "<div class='card'><h3>Call sites</h3>";
+  p += "<table style='width:100%;font-size:13px;'><tr><th>PC</th><th>Live B</th><th>Live blocks</th><th>Allocs</th><th>Total B</th></tr>";
+  for (int i = 0; i < nSites && i < 32; i++) {
+    if (sites[i].pc) snprintf(pcBuf, sizeof(pcBuf), "0x%08lx", (unsigned long)sites[i].pc);
+    else strcpy(pcBuf, "other");
+    p += "<tr><td><code>" + String(pcBuf) + "</code></td><td>" + String(sites[i].liveBytes) + "</td><td>" +
+         String(sites[i].liveBlocks) + "</td><td>" + String(sites[i].allocs) + "</td><td>" +
+         String((uint32_t)sites[i].totalBytes) + "</td></tr>";
+  }
+  p += "</table>";
+  p += "<div class='muted'>Resolve with <code>xtensa-esp32s3-elf-addr2line -pfiaC -e viasol-control.ino.elf &lt;pc&gt;</code>.</div>";
+  p += "</div>";
+
+  p += "<div class='card'><h3>History</h3>";
+  p += "<table style='width:100%;font-size:13px;'><tr><th>Uptime s</th><th>Free B</th><th>Largest B</th><th>Tracked B</th></tr>";
+  HeapSample s;
+  for (int i = 0; heapSampleAt(i, s); i++) {
+    p += "<tr><td>" + String(s.tS) + "</td><td>" + String(s.freeBytes) + "</td><td>" + String(s.largestBlock) +
+         "</td><td>" + String(s.trackedLive) + "</td></tr>";
+  }
+  p += "</table></div>";
+
+  p += "<a class='btn' href='/'>Home</a>";
+  pageEnd(p);
+  return p;
+}
+
 // FULL rules page (RHS const/input) — you asked to keep this unified
 String buildRulesHtml() {
   String p;
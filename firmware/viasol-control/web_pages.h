@@ -13,5 +13,7 @@ String buildConfigShuntsHtml(const Settings& cfg);
 String buildConfigRelaysHtml(const Settings& cfg);
 String buildConfigPvHtml(const Settings& cfg);
 String buildConfigElementsHtml(const Settings& cfg);
+String buildEnergyHtml();
+String buildHeapDebugHtml();
 
 String buildRulesHtml();
@@ -6,13 +6,13 @@
 #include <algorithm>
 
 // Simple helper: <select> from a key list
-static String htmlSelectKeys(const char* name, const char* keys[], int n, const String& cur) {
+static String htmlSelectKeys(const char* name, const char* keys[], int n, const char* cur) {
   String h;
   h += "<select name='" + String(name) + "'>";
   for (int i = 0; i < n; i++) {
     String k = keys[i];
     h += "<option value='" + k + "'";
-    if (k == cur) h += " selected";
+    if (strcmp(keys[i], cur) == 0) h += " selected";
     h += ">" + k + "</option>";
   }
   h += "</select>";
@@ -98,7 +98,7 @@ String buildRules2HomeHtml(Settings& cfg) {
 
       h += "<tr>";
       h += "<td>" + String(r.id) + "</td>";
-      h += "<td><a href='/config/rules2/edit?id=" + String(r.id) + "'>" + r.name + "</a></td>";
+      h += "<td><a href='/config/rules2/edit?id=" + String(r.id) + "'>" + rules2::db.str(r.name) + "</a></td>";
       h += "<td>" + String(r.enabled ? "yes" : "no") + "</td>";
       h += "<td>" + String(r.priority) + "</td>";
       h += "<td>" + rules2::describeExpr(r.exprRootId) + "</td>";
@@ -150,9 +150,9 @@ String buildRules2ConditionsHtml(Settings& cfg) {
     if (c.enabled) h += " checked";
     h += "></td>";
 
-    h += "<td><input name='" + base + "name' value='" + c.name + "'></td>";
+    h += "<td><input name='" + base + "name' value='" + rules2::db.str(c.name) + "'></td>";
 
-    h += "<td>" + htmlSelectKeys((base + "in").c_str(), INPUT_KEYS, N_INPUTS, c.inputKey) + "</td>";
+    h += "<td>" + htmlSelectKeys((base + "in").c_str(), INPUT_KEYS, N_INPUTS, rules2::db.str(c.inputKey)) + "</td>";
 
     h += "<td><select name='" + base + "op'>";
     const char* ops[] = {"GT","GE","LT","LE","EQ","NE"};
@@ -169,7 +169,7 @@ String buildRules2ConditionsHtml(Settings& cfg) {
     h += "</select></td>";
 
     h += "<td><input name='" + base + "th' value='" + String(c.threshold) + "'></td>";
-    h += "<td>" + htmlSelectKeys((base + "rin").c_str(), INPUT_KEYS, N_INPUTS, c.rhsInputKey) + "</td>";
+    h += "<td>" + htmlSelectKeys((base + "rin").c_str(), INPUT_KEYS, N_INPUTS, rules2::db.str(c.rhsInputKey)) + "</td>";
     h += "<td><input name='" + base + "st' value='" + String(c.stableForMs) + "'></td>";
 
     h += "<td>"
@@ -205,7 +205,7 @@ String buildRules2EditRuleHtml(Settings& cfg, uint32_t ruleId) {
   h += "<form method='POST' action='/config/rules2/save'>";
   h += "<input type='hidden' name='id' value='" + String(r->id) + "'>";
 
-  h += "<p>Name: <input name='name' value='" + r->name + "'></p>";
+  h += "<p>Name: <input name='name' value='" + String(rules2::db.str(r->name)) + "'></p>";
 
   h += "<p><label><input type='checkbox' name='en'";
   if (r->enabled) h += " checked";
@@ -218,6 +218,19 @@ String buildRules2EditRuleHtml(Settings& cfg, uint32_t ruleId) {
   h += "<p>minEvalPeriodMs: <input name='minEval' value='" + String(r->minEvalPeriodMs) + "'></p>";
   h += "<p>cooldownMs: <input name='cooldown' value='" + String(r->cooldownMs) + "'></p>";
 
+  // Fail-safe when an input is stale or missing
+  static const rules2::UnknownPolicy POLICIES[] = {
+    rules2::UnknownPolicy::Hold, rules2::UnknownPolicy::Off, rules2::UnknownPolicy::On
+  };
+  h += "<p>When inputs are stale/missing: <select name='unk'>";
+  for (auto p : POLICIES) {
+    const char* v = rules2::unknownPolicyToStr(p);
+    h += "<option value='" + String(v) + "'";
+    if (p == r->onUnknown) h += " selected";
+    h += ">" + String(v) + "</option>";
+  }
+  h += "</select></p>";
+
   // Root group selection (preferred)
   h += "<h3>Expression (Groups)</h3>";
   h += "<p>Root expression:</p>";
@@ -255,21 +268,21 @@ String buildRules2EditRuleHtml(Settings& cfg, uint32_t ruleId) {
   } else {
     // Not pre-checking these anymore because this is now a “builder” not the saved root
     for (auto const& c : rules2::db.conditions) {
-      String nm = c.name.length() ? c.name : String("cond ") + c.id;
+      String nm = rules2::labelOf(c.name, "cond", c.id);
       h += "<label><input type='checkbox' name='cond' value='" + String(c.id) + "'> "
-           + nm + " (" + c.inputKey + ")</label><br>";
+           + nm + " (" + rules2::db.str(c.inputKey) + ")</label><br>";
     }
   }
   h += "</details>";
 
   h += "<h3>Action</h3>";
-  if (r->actions.empty()) {
+  if (r->actions.count == 0) {
     h += "<p>Output: " + htmlSelectKeys("out", OUTPUT_KEYS, N_OUTPUTS, "m_relay1") + "</p>";
     h += "<p>On: <select name='on'><option value='1'>1</option><option value='0'>0</option></select></p>";
     h += "<p>Duration ms (0=none): <input name='dur' value='0'></p>";
   } else {
-    auto const& a = r->actions[0];
-    h += "<p>Output: " + htmlSelectKeys("out", OUTPUT_KEYS, N_OUTPUTS, a.outputKey) + "</p>";
+    auto const& a = rules2::db.actions(*r)[0];
+    h += "<p>Output: " + htmlSelectKeys("out", OUTPUT_KEYS, N_OUTPUTS, rules2::db.str(a.outputKey)) + "</p>";
     h += "<p>On: <select name='on'>";
     h += String("<option value='1'") + (a.on ? " selected" : "") + ">1</option>";
     h += String("<option value='0'") + (!a.on ? " selected" : "") + ">0</option>";
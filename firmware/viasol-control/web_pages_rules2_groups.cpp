@@ -7,7 +7,7 @@ static String htmlSelectCondIds(const char* name, uint32_t curId) {
   h += "<select name='" + String(name) + "'>";
   h += "<option value='0'>-- select condition --</option>";
   for (auto const& c : rules2::db.conditions) {
-    String nm = c.name.length() ? c.name : String("cond ") + c.id;
+    String nm = rules2::labelOf(c.name, "cond", c.id);
     h += "<option value='" + String(c.id) + "'";
     if (c.id == curId) h += " selected";
     h += ">" + nm + "</option>";
@@ -55,9 +55,9 @@ String buildRules2GroupsHtml(Settings& cfg) {
     String t = (e.type == rules2::ExprType::Or) ? "OR" : "AND";
     h += "<tr>";
     h += "<td>" + String(e.id) + "</td>";
-    h += "<td>" + (e.name.length() ? e.name : String("group ") + e.id) + "</td>";
+    h += "<td>" + rules2::labelOf(e.name, "group", e.id) + "</td>";
     h += "<td>" + t + "</td>";
-    h += "<td>" + String((int)e.children.size()) + "</td>";
+    h += "<td>" + String((int)e.children.count) + "</td>";
     h += "<td><a href='/config/rules2/group?id=" + String(e.id) + "'>edit</a></td>";
     h += "<td><form method='POST' action='/config/rules2/groups/delete'>"
          "<input type='hidden' name='id' value='" + String(e.id) + "'>"
@@ -83,7 +83,7 @@ String buildRules2EditGroupHtml(Settings& cfg, uint32_t groupId) {
   // Save group meta
   h += "<form method='POST' action='/config/rules2/group/save'>";
   h += "<input type='hidden' name='id' value='" + String(g->id) + "'>";
-  h += "<p>Name: <input name='name' value='" + g->name + "'></p>";
+  h += "<p>Name: <input name='name' value='" + String(rules2::db.str(g->name)) + "'></p>";
   h += "<p>Type: <select name='gtype'>";
   h += String("<option value='AND'") + (g->type == rules2::ExprType::And ? " selected" : "") + ">AND</option>";
   h += String("<option value='OR'")  + (g->type == rules2::ExprType::Or  ? " selected" : "") + ">OR</option>";
@@ -93,13 +93,13 @@ String buildRules2EditGroupHtml(Settings& cfg, uint32_t groupId) {
 
   // Children list
   h += "<h3>Children</h3>";
-  if (g->children.empty()) {
+  if (g->children.count == 0) {
     h += "<p><i>No children yet.</i></p>";
   } else {
     h += "<table border='1' cellpadding='6' cellspacing='0'>";
     h += "<tr><th>#</th><th>Expr</th><th>Remove</th></tr>";
-    for (int i = 0; i < (int)g->children.size(); i++) {
-      uint32_t cid = g->children[i];
+    for (int i = 0; i < (int)g->children.count; i++) {
+      uint32_t cid = rules2::db.children(*g)[i];
       h += "<tr>";
       h += "<td>" + String(i) + "</td>";
       h += "<td>" + rules2::describeExpr(cid) + "</td>";
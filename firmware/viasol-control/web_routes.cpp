@@ -6,6 +6,15 @@
 #include "rules2.h"
 #include "web_pages_rules2.h"
 #include "web_pages_rules2_groups.h"
+#include "history.h"
+#include "mqtt.h"
+#include "io_catalog.h"
+#include "heater.h"
+#include "ow_temps.h"
+#include "safety.h"
+#include "divert.h"
+#include "wifi_link.h"
+#include "metrics.h"
 
 
 #include <WiFi.h>
@@ -206,6 +215,69 @@ static void handleRules2RemoveChildFromGroup() {
 
 
 
+// ---- History API ----
+// GET /api/history?key=pv_v&from=<uptime s>&res=1s|1m|15m[&fmt=csv|bin]
+// bin = packed little-endian records { uint32 t; float min, max, avg; }
+static void handleApiHistory() {
+  int idx = inputIndexByKey(app.server.arg("key").c_str());
+  if (idx < 0) {
+    app.server.send(404, "text/plain", "Unknown key");
+    return;
+  }
+
+  HistRes res = HistRes::S1;
+  if (app.server.hasArg("res") && !strToHistRes(app.server.arg("res"), res)) {
+    app.server.send(400, "text/plain", "res must be 1s, 1m or 15m");
+    return;
+  }
+
+  uint32_t from = (uint32_t)strtoul(app.server.arg("from").c_str(), nullptr, 10);
+  bool bin = (app.server.arg("fmt") == "bin");
+
+  HistCursor cur;
+  if (!historyOpen(idx, res, from, cur)) {
+    app.server.send(503, "text/plain", "History disabled");
+    return;
+  }
+
+  app.server.sendHeader("X-Uptime-S", String(historyUptimeSec()));
+  app.server.sendHeader("X-Period-S", String(historyPeriodSec(res)));
+  app.server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  app.server.send(200, bin ? "application/octet-stream" : "text/csv", "");
+
+  // Stream in fixed chunks; no per-row String building.
+  char buf[1024];
+  size_t n = 0;
+  if (!bin) n = (size_t)snprintf(buf, sizeof(buf), "t,min,max,avg\n");
+
+  uint32_t t;
+  HistPoint p;
+  while (historyNext(cur, t, p)) {
+    // A row is formatted on its own first: %.3f of a float near 3.4e38
+    // is 44 chars, so CSV row lengths vary widely.
+    char row[160];
+    size_t len;
+    if (bin) {
+      memcpy(row, &t, 4);
+      memcpy(row + 4, &p, sizeof(p));
+      len = 4 + sizeof(p);
+    } else {
+      int r = snprintf(row, sizeof(row), "%lu,%.3f,%.3f,%.3f\n",
+                       (unsigned long)t, p.min, p.max, p.avg);
+      if (r < 0) continue;
+      len = ((size_t)r < sizeof(row)) ? (size_t)r : sizeof(row) - 1;
+    }
+    if (sizeof(buf) - n < len) {
+      app.server.sendContent(buf, n);
+      n = 0;
+    }
+    memcpy(buf + n, row, len);
+    n += len;
+  }
+  if (n) app.server.sendContent(buf, n);
+  app.server.sendContent("");
+}
+
 static void handleSaveSettings(Settings& cfg) {
   // --- Control ---
   cfg.tank_sp_c = argFloat("tank_sp_c", cfg.tank_sp_c);
@@ -229,6 +301,23 @@ static void handleSaveSettings(Settings& cfg) {
   cfg.mqtt_user = argStr("mqtt_user", cfg.mqtt_user);
   cfg.mqtt_pass = argStr("mqtt_pass", cfg.mqtt_pass);
   cfg.mqtt_base = argStr("mqtt_base", cfg.mqtt_base);
+  cfg.mqtt_pub_ms = (uint32_t)argInt("mqtt_pub_ms", (int)cfg.mqtt_pub_ms);
+  if (app.server.hasArg("mqtt_form")) cfg.mqtt_batch = argBool("mqtt_batch");
+  cfg.mqtt_nregs = argInt("mqtt_nregs", cfg.mqtt_nregs);
+  for (int i = 0; i < MQTT_MAX_REGS; i++) {
+    String kt = "mq_t" + String(i);
+    String ka = "mq_a" + String(i);
+    if (app.server.hasArg(kt)) cfg.mqtt_reg_topic[i] = app.server.arg(kt);
+    if (app.server.hasArg(ka)) cfg.mqtt_reg_maxage_s[i] = (uint32_t)app.server.arg(ka).toInt();
+  }
+
+  // --- Temperature sensors ---
+  cfg.ow_tank_rom = argStr("ow_tank", cfg.ow_tank_rom);
+  cfg.ow_floor_rom = argStr("ow_floor", cfg.ow_floor_rom);
+
+  // --- RS-485 ---
+  cfg.rs485_remotes = argInt("rs485_n", cfg.rs485_remotes);
+  cfg.rs485_baud = (uint32_t)argInt("rs485_baud", (int)cfg.rs485_baud);
 
   // --- Wi-Fi ---
   if (app.server.hasArg("wifi_ssid")) cfg.wifi_ssid = app.server.arg("wifi_ssid");
@@ -249,6 +338,10 @@ static void handleSaveSettings(Settings& cfg) {
   // --- Relays ---
   cfg.div_loc = argStr("div_loc", cfg.div_loc);
   cfg.div_idx = argInt("div_idx", cfg.div_idx);
+  if (app.server.hasArg("relay_form")) cfg.div_en = argBool("div_en");
+  cfg.div_w = argFloat("div_w", cfg.div_w);
+  cfg.div_min_s = argInt("div_min_s", cfg.div_min_s);
+  cfg.div_window_s = argInt("div_window_s", cfg.div_window_s);
   cfg.pvkill_loc = argStr("pvkill_loc", cfg.pvkill_loc);
   cfg.pvkill_idx = argInt("pvkill_idx", cfg.pvkill_idx);
 
@@ -267,9 +360,16 @@ static void handleSaveSettings(Settings& cfg) {
     if (app.server.hasArg(kw)) cfg.el_w[i] = app.server.arg(kw).toFloat();
   }
   cfg.learn_elems = app.server.hasArg("learn_elems");
+  if (app.server.hasArg("el_form")) cfg.heat_en = argBool("heat_en");
 
   validateSettings(cfg);
   saveSettings(cfg);
+  mqttBegin(cfg);
+  heaterBegin(cfg);
+  owApplySettings(cfg);
+  safetyApplySettings(cfg);
+  divertBegin(cfg);
+  wifiApplySettings(cfg);
 
 
 
@@ -279,25 +379,18 @@ static void handleSaveSettings(Settings& cfg) {
   // redirect target
   String ret = app.server.hasArg("return") ? app.server.arg("return") : String("/config");
 
-  // In AP mode, saving Wi-Fi should reboot to attempt STA join
-  if (app.inApMode && (app.server.hasArg("wifi_ssid") || app.server.hasArg("wifi_pass"))) {
-    app.server.send(200, "text/plain", "Saved. Rebooting to connect to Wi-Fi...");
-    delay(250);
-    ESP.restart();
-    return;
-  }
-
   app.server.sendHeader("Location", ret);
   app.server.send(303);
 }
 
 
-static void handleForgetWiFi() {
+static void handleForgetWiFi(Settings& cfg) {
   app.prefs.remove("wifi_ssid");
   app.prefs.remove("wifi_pass");
-  app.server.send(200, "text/plain", "Cleared Wi-Fi. Rebooting into AP setup...");
-  delay(250);
-  ESP.restart();
+  cfg.wifi_ssid = "";
+  cfg.wifi_pass = "";
+  app.server.send(200, "text/plain", "Cleared Wi-Fi. Switching to AP setup: join " + app.apSsid + ".");
+  wifiApplySettings(cfg);
 }
 
 static void handleReboot() {
@@ -306,69 +399,109 @@ static void handleReboot() {
   ESP.restart();
 }
 
+// Registers a handler and times it into its /metrics slot
+static void route(const char* path, HTTPMethod method, WebServer::THandlerFunction fn) {
+  int slot = metricsRoute(path, method == HTTP_POST ? "POST" : "GET");
+  app.server.on(path, method, [slot, fn]() {
+    uint32_t t0 = micros();
+    fn();
+    metricsRouteDone(slot, t0);
+  });
+}
+
+// Each call is one HTTP chunk (and one small malloc inside WebServer)
+static void metricsSink(const char* data, size_t n) {
+  app.server.sendContent(data, n);
+}
+
+static void handleMetrics() {
+  app.server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  app.server.send(200, "text/plain; version=0.0.4", "");
+  {
+    MetricWriter w(metricsSink);
+    metricsRender(w);
+  }
+  app.server.sendContent("", 0);  // last chunk
+}
+
 void registerWebRoutes(Settings& cfg) {
   // Wrap handlers that need cfg
-  app.server.on("/", HTTP_GET, [&cfg](){ handleMain(cfg); });
-  app.server.on("/saveSettings", HTTP_POST, [&cfg](){ handleSaveSettings(cfg); });
+  route("/", HTTP_GET, [&cfg](){ handleMain(cfg); });
+  route("/saveSettings", HTTP_POST, [&cfg](){ handleSaveSettings(cfg); });
 
-  app.server.on("/rules", HTTP_GET, handleRules);
-  app.server.on("/saveRules", HTTP_POST, handleSaveRules);
+  route("/rules", HTTP_GET, handleRules);
+  route("/saveRules", HTTP_POST, handleSaveRules);
 
-  app.server.on("/logo.png", HTTP_GET, handleLogo);
-  app.server.on("/forgetWiFi", HTTP_POST, handleForgetWiFi);
-  app.server.on("/reboot", HTTP_POST, handleReboot);
+  route("/logo.png", HTTP_GET, handleLogo);
+  route("/forgetWiFi", HTTP_POST, [&cfg](){ handleForgetWiFi(cfg); });
+  route("/reboot", HTTP_POST, handleReboot);
 
-  app.server.on("/config", HTTP_GET, [&cfg](){
+  route("/config", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigHomeHtml(cfg, app.inApMode));
   });
 
-  app.server.on("/config/control", HTTP_GET, [&cfg](){
+  route("/config/control", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigControlHtml(cfg));
   });
-  app.server.on("/config/mqtt", HTTP_GET, [&cfg](){
+  route("/config/mqtt", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigMqttHtml(cfg));
   });
-  app.server.on("/config/wifi", HTTP_GET, [&cfg](){
+  route("/config/wifi", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigWifiHtml(cfg, app.inApMode));
   });
-  app.server.on("/config/shunts", HTTP_GET, [&cfg](){
+  route("/config/shunts", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigShuntsHtml(cfg));
   });
-  app.server.on("/config/relays", HTTP_GET, [&cfg](){
+  route("/config/relays", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigRelaysHtml(cfg));
   });
-  app.server.on("/config/pv", HTTP_GET, [&cfg](){
+  route("/config/pv", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigPvHtml(cfg));
   });
-  app.server.on("/config/elements", HTTP_GET, [&cfg](){
+  route("/config/elements", HTTP_GET, [&cfg](){
     app.server.send(200, "text/html", buildConfigElementsHtml(cfg));
   });
 
+  route("/energy", HTTP_GET, [](){
+    app.server.send(200, "text/html", buildEnergyHtml());
+  });
+
   // --- Rules v2 (parallel) ---
-  app.server.on("/config/rules2", HTTP_GET, [&cfg](){ handleRules2(cfg); });
-  app.server.on("/config/rules2/new", HTTP_POST, handleRules2NewRule);
-  app.server.on("/config/rules2/edit", HTTP_GET, [&cfg](){ handleRules2EditRule(cfg); });
-  app.server.on("/config/rules2/save", HTTP_POST, handleRules2SaveRule);
-  app.server.on("/config/rules2/delete", HTTP_POST, handleRules2DeleteRule);
+  route("/config/rules2", HTTP_GET, [&cfg](){ handleRules2(cfg); });
+  route("/config/rules2/new", HTTP_POST, handleRules2NewRule);
+  route("/config/rules2/edit", HTTP_GET, [&cfg](){ handleRules2EditRule(cfg); });
+  route("/config/rules2/save", HTTP_POST, handleRules2SaveRule);
+  route("/config/rules2/delete", HTTP_POST, handleRules2DeleteRule);
 
-  app.server.on("/config/rules2/conditions", HTTP_GET, [&cfg](){ handleRules2Conditions(cfg); });
-  app.server.on("/config/rules2/conditions/new", HTTP_POST, handleRules2NewCondition);
-  app.server.on("/config/rules2/conditions/save", HTTP_POST, handleRules2SaveConditions);
-  app.server.on("/config/rules2/conditions/delete", HTTP_POST, handleRules2DeleteCondition);
+  route("/config/rules2/conditions", HTTP_GET, [&cfg](){ handleRules2Conditions(cfg); });
+  route("/config/rules2/conditions/new", HTTP_POST, handleRules2NewCondition);
+  route("/config/rules2/conditions/save", HTTP_POST, handleRules2SaveConditions);
+  route("/config/rules2/conditions/delete", HTTP_POST, handleRules2DeleteCondition);
 
     // --- Rules v2 groups ---
-  app.server.on("/config/rules2/groups", HTTP_GET, [&cfg](){ handleRules2Groups(cfg); });
-  app.server.on("/config/rules2/groups/new", HTTP_POST, handleRules2NewGroup);
-  app.server.on("/config/rules2/groups/delete", HTTP_POST, handleRules2DeleteGroup);
-
-  app.server.on("/config/rules2/group", HTTP_GET, [&cfg](){ handleRules2EditGroup(cfg); });
-  app.server.on("/config/rules2/group/save", HTTP_POST, handleRules2SaveGroup);
-  app.server.on("/config/rules2/group/addChild", HTTP_POST, handleRules2AddChildToGroup);
-  app.server.on("/config/rules2/group/removeChild", HTTP_POST, handleRules2RemoveChildFromGroup);
-
-  app.server.on("/config/rules2/demo", HTTP_POST, handleRules2Demo);
+  route("/config/rules2/groups", HTTP_GET, [&cfg](){ handleRules2Groups(cfg); });
+  route("/config/rules2/groups/new", HTTP_POST, handleRules2NewGroup);
+  route("/config/rules2/groups/delete", HTTP_POST, handleRules2DeleteGroup);
+
+  route("/config/rules2/group", HTTP_GET, [&cfg](){ handleRules2EditGroup(cfg); });
+  route("/config/rules2/group/save", HTTP_POST, handleRules2SaveGroup);
+  route("/config/rules2/group/addChild", HTTP_POST, handleRules2AddChildToGroup);
+  route("/config/rules2/group/removeChild", HTTP_POST, handleRules2RemoveChildFromGroup);
+
+  route("/config/rules2/demo", HTTP_POST, handleRules2Demo);
+
+  route("/api/history", HTTP_GET, handleApiHistory);
+  route("/metrics", HTTP_GET, handleMetrics);
+#ifdef VIASOL_HEAP_DEBUG
+  route("/debug/heap", HTTP_GET, [](){
+    app.server.send(200, "text/html", buildHeapDebugHtml());
+  });
+#endif
 
+  static int notFoundSlot = metricsRoute("(not found)", "GET");
   app.server.onNotFound([]() {
+    uint32_t t0 = micros();
     app.server.send(404, "text/plain", "Not Found");
+    metricsRouteDone(notFoundSlot, t0);
   });
 }
@@ -0,0 +1,317 @@
+#include "wifi_link.h"
+#include "app.h"
+#include "metrics.h"
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <atomic>
+
+static const uint32_t RETRY_FIRST_MS = 1000;
+static const uint32_t RSSI_PERIOD_MS = 2000;
+static const uint32_t STALE_EVENT_MS = 500;   // disconnect events this soon after begin() are our own
+
+// Set from the Wi-Fi event task / timer task, consumed by wifiTick()
+static std::atomic<bool> staGotIp{false};
+static std::atomic<bool> staLost{false};
+static std::atomic<bool> apStarted{false};
+static std::atomic<bool> rescueRequested{false};
+static std::atomic<uint8_t> lastReason{0};
+
+// Loop only
+static WifiStats st;
+static String ssid, pass, apPass;
+static bool apUp = false;
+static bool serverUp = false;
+static bool clockStarted = false;
+static uint32_t upMs = 0;
+static int32_t tzOffsetS = 0;
+static uint32_t stateMs = 0;        // entered the current state
+static uint32_t retryDelayMs = RETRY_FIRST_MS;   // next backoff
+static uint32_t waitMs = 0;                       // current backoff
+static uint32_t outageStartMs = 0;
+static bool inOutage = false;
+static uint32_t lastRssiMs = 0;
+static esp_timer_handle_t rescueTimer = nullptr;
+
+static void onWifiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      staGotIp = true;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      lastReason = info.wifi_sta_disconnected.reason;
+      staLost = true;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+      staLost = true;
+      break;
+    case ARDUINO_EVENT_WIFI_AP_START:
+      apStarted = true;
+      break;
+    default:
+      break;
+  }
+}
+
+static void onRescueTimer(void*) {
+  rescueRequested = true;
+}
+
+static void armRescue(uint32_t ms) {
+  if (!rescueTimer) return;
+  esp_timer_stop(rescueTimer);
+  esp_timer_start_once(rescueTimer, (uint64_t)ms * 1000ULL);
+}
+
+static void setState(WifiState s, uint32_t now) {
+  st.state = s;
+  stateMs = now;
+}
+
+// -----------------------------------------------------------------------------
+// Interfaces
+// -----------------------------------------------------------------------------
+static void startSoftAp() {
+  bool ok;
+  if (apPass.length() >= 8) ok = WiFi.softAP(app.apSsid.c_str(), apPass.c_str());
+  else ok = WiFi.softAP(app.apSsid.c_str());
+  Serial.printf("[wifi] AP start %s, SSID %s\n", ok ? "OK" : "FAILED", app.apSsid.c_str());
+}
+
+static void enterSetup(uint32_t now) {
+  if (rescueTimer) esp_timer_stop(rescueTimer);
+  WiFi.disconnect(false);
+  WiFi.mode(WIFI_AP);
+  startSoftAp();
+  st.rescueAp = false;
+  app.inApMode = true;
+  setState(WifiState::Setup, now);
+}
+
+static void startRescue() {
+  if (st.rescueAp || st.state == WifiState::Setup) return;
+  Serial.printf("[wifi] STA down %u ms (reason %u), rescue AP up\n",
+                (unsigned)(millis() - outageStartMs), (unsigned)lastReason.load());
+  WiFi.mode(WIFI_AP_STA);
+  startSoftAp();
+  st.rescueAp = true;
+  app.inApMode = true;
+}
+
+static void stopRescue() {
+  if (!st.rescueAp) return;
+  Serial.println("[wifi] STA stable, rescue AP down");
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  st.rescueAp = false;
+  app.inApMode = false;
+}
+
+static void startJoin(uint32_t now) {
+  if (WiFi.getMode() == WIFI_OFF || WiFi.getMode() == WIFI_AP) {
+    WiFi.mode(st.rescueAp ? WIFI_AP_STA : WIFI_STA);
+  }
+  WiFi.setSleep(false);
+  WiFi.begin(ssid.c_str(), pass.c_str());
+  st.attempts++;
+  setState(WifiState::Joining, now);
+}
+
+static void beginOutage(uint32_t now) {
+  if (inOutage) return;
+  inOutage = true;
+  outageStartMs = now;
+}
+
+static void endOutage(uint32_t now) {
+  if (!inOutage) return;
+  inOutage = false;
+  uint32_t d = now - outageStartMs;
+  st.lastOutageMs = d;
+  if (d > st.longestOutageMs) st.longestOutageMs = d;
+  st.totalOutageS += d / 1000;
+  st.outageMs = 0;
+}
+
+static void backoff(uint32_t now) {
+  setState(WifiState::Backoff, now);
+  waitMs = retryDelayMs;
+  retryDelayMs = retryDelayMs * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : retryDelayMs * 2;
+}
+
+// -----------------------------------------------------------------------------
+// Public
+// -----------------------------------------------------------------------------
+void wifiBegin(const Settings& cfg) {
+  tzOffsetS = cfg.tz_offset_min * 60L;
+  ssid = cfg.wifi_ssid;
+  pass = cfg.wifi_pass;
+  apPass = cfg.ap_pass;
+
+  WiFi.persistent(false);       // credentials live in our own prefs
+  WiFi.setAutoReconnect(false); // the supervisor owns retries
+  WiFi.onEvent(onWifiEvent);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onRescueTimer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "wifi_rescue";
+  esp_timer_create(&args, &rescueTimer);
+
+  uint32_t now = millis();
+  if (!ssid.length() || !pass.length()) {
+    enterSetup(now);
+    return;
+  }
+
+  app.inApMode = false;
+  Serial.printf("[wifi] joining '%s'\n", ssid.c_str());
+  beginOutage(now);
+  retryDelayMs = RETRY_FIRST_MS;
+  startJoin(now);
+  armRescue(WIFI_JOIN_TIMEOUT_MS);
+}
+
+void wifiApplySettings(const Settings& cfg) {
+  tzOffsetS = cfg.tz_offset_min * 60L;
+  uint32_t now = millis();
+
+  if (cfg.ap_pass != apPass) {
+    apPass = cfg.ap_pass;
+    if (app.inApMode) startSoftAp();
+  }
+  if (cfg.wifi_ssid == ssid && cfg.wifi_pass == pass) return;
+  ssid = cfg.wifi_ssid;
+  pass = cfg.wifi_pass;
+
+  if (!ssid.length() || !pass.length()) {
+    Serial.println("[wifi] credentials cleared, setup AP");
+    endOutage(now);
+    enterSetup(now);
+    return;
+  }
+
+  // Keep whatever AP the user is on while the new network is tried
+  Serial.printf("[wifi] new credentials, joining '%s'\n", ssid.c_str());
+  if (st.state == WifiState::Setup) st.rescueAp = true;
+  WiFi.disconnect(false);
+  staLost = false;
+  beginOutage(now);
+  retryDelayMs = RETRY_FIRST_MS;
+  startJoin(now);
+  armRescue(WIFI_JOIN_TIMEOUT_MS);
+}
+
+void wifiTick() {
+  uint32_t now = millis();
+  if (apStarted.exchange(false)) apUp = true;
+
+  bool gotIp = staGotIp.exchange(false);
+  bool lost = staLost.exchange(false);
+  st.lastReason = lastReason.load();
+
+  switch (st.state) {
+    case WifiState::Setup:
+      break;
+
+    case WifiState::Joining:
+      if (gotIp) {
+        if (rescueTimer) esp_timer_stop(rescueTimer);
+        endOutage(now);
+        st.connects++;
+        st.rssiMin = 0;
+        retryDelayMs = RETRY_FIRST_MS;
+        lastRssiMs = now - RSSI_PERIOD_MS;
+        setState(WifiState::Online, now);
+        Serial.printf("[wifi] connected, IP %s, RSSI %d at %u ms\n", WiFi.localIP().toString().c_str(),
+                      (int)WiFi.RSSI(), (unsigned)now);
+        if (!clockStarted) {
+          // Wall clock for energy day/month rollups
+          configTime(tzOffsetS, 0, "pool.ntp.org", "time.google.com");
+          clockStarted = true;
+        }
+      } else if ((lost && now - stateMs >= STALE_EVENT_MS) || now - stateMs >= WIFI_ATTEMPT_MS) {
+        WiFi.disconnect(false);
+        backoff(now);
+      }
+      break;
+
+    case WifiState::Online:
+      if (lost) {
+        st.disconnects++;
+        st.rssi = 0;
+        Serial.printf("[wifi] disconnected (reason %u)\n", (unsigned)st.lastReason);
+        beginOutage(now);
+        armRescue(WIFI_RESCUE_MS);
+        retryDelayMs = RETRY_FIRST_MS;
+        backoff(now);
+        break;
+      }
+      if (st.rescueAp && now - stateMs >= WIFI_RESCUE_CLEAR_MS) stopRescue();
+      if (now - lastRssiMs >= RSSI_PERIOD_MS) {
+        lastRssiMs = now;
+        st.rssi = (int8_t)WiFi.RSSI();
+        if (st.rssiMin == 0 || st.rssi < st.rssiMin) st.rssiMin = st.rssi;
+      }
+      break;
+
+    case WifiState::Backoff:
+      if (now - stateMs >= waitMs) startJoin(now);
+      break;
+  }
+
+  if (inOutage) st.outageMs = now - outageStartMs;
+  if (rescueRequested.exchange(false) && st.state != WifiState::Online) startRescue();
+
+  if (!serverUp && (st.state == WifiState::Online || apUp)) {
+    app.server.begin();
+    serverUp = true;
+    upMs = now;
+    Serial.printf("[wifi] web server started at %u ms\n", (unsigned)upMs);
+  }
+}
+
+bool wifiServerUp() {
+  return serverUp;
+}
+
+uint32_t wifiUpMs() {
+  return upMs;
+}
+
+const WifiStats& wifiStats() {
+  return st;
+}
+
+const char* wifiStateName(WifiState s) {
+  switch (s) {
+    case WifiState::Setup: return "setup";
+    case WifiState::Joining: return "joining";
+    case WifiState::Online: return "online";
+    case WifiState::Backoff: return "backoff";
+  }
+  return "?";
+}
+
+static void collectMetrics(MetricWriter& w) {
+  w.family("viasol_wifi_state", "Supervisor state (labelled)", "gauge");
+  for (uint8_t s = 0; s <= (uint8_t)WifiState::Backoff; s++) {
+    w.u("viasol_wifi_state", st.state == (WifiState)s ? 1 : 0, "state", wifiStateName((WifiState)s));
+  }
+  w.family("viasol_wifi_rescue_ap", "Rescue AP up next to STA", "gauge");
+  w.u("viasol_wifi_rescue_ap", st.rescueAp ? 1 : 0);
+  w.family("viasol_wifi_rssi_dbm", "STA signal strength (0 when down)", "gauge");
+  w.i("viasol_wifi_rssi_dbm", st.rssi);
+  w.family("viasol_wifi_connects_total", "STA got an IP", "counter");
+  w.u("viasol_wifi_connects_total", st.connects);
+  w.family("viasol_wifi_disconnects_total", "STA lost its connection", "counter");
+  w.u("viasol_wifi_disconnects_total", st.disconnects);
+  w.family("viasol_wifi_join_attempts_total", "WiFi.begin() calls", "counter");
+  w.u("viasol_wifi_join_attempts_total", st.attempts);
+  w.family("viasol_wifi_outage_seconds", "Current STA outage (0 while online)", "gauge");
+  w.fixed("viasol_wifi_outage_seconds", st.outageMs, 3);
+  w.family("viasol_wifi_outage_longest_seconds", "Longest completed outage", "gauge");
+  w.fixed("viasol_wifi_outage_longest_seconds", st.longestOutageMs, 3);
+  w.family("viasol_wifi_outage_seconds_total", "Completed outages", "counter");
+  w.u("viasol_wifi_outage_seconds_total", st.totalOutageS);
+}
+static MetricCollector metricsCollector(collectMetrics);
@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+#include "settings.h"
+
+// -----------------------------------------------------------------------------
+// Wi-Fi supervisor.
+//
+// Nothing here blocks. Wi-Fi events are recorded from the event task and
+// acted on in wifiTick(), which drives a small state machine:
+//
+//   Setup    no credentials: AP only
+//   Joining  WiFi.begin() issued, waiting for an IP (WIFI_ATTEMPT_MS)
+//   Online   STA has an IP
+//   Backoff  waiting to retry; 1 s after a drop, then doubling to WIFI_BACKOFF_MAX_MS
+//
+// While STA is down, a one-shot timer (WIFI_JOIN_TIMEOUT_MS at boot or on new
+// credentials, WIFI_RESCUE_MS after a drop) brings up the rescue AP next to the
+// STA interface (AP+STA), so the device stays reachable while the join keeps
+// retrying. The AP goes away once STA has been stable for WIFI_RESCUE_CLEAR_MS.
+//
+// New credentials are applied live by wifiApplySettings(). The web server is
+// started once any interface is up.
+// -----------------------------------------------------------------------------
+
+static const uint32_t WIFI_JOIN_TIMEOUT_MS = 15000;
+static const uint32_t WIFI_RESCUE_MS = 120000;
+static const uint32_t WIFI_RESCUE_CLEAR_MS = 60000;
+static const uint32_t WIFI_ATTEMPT_MS = 12000;
+static const uint32_t WIFI_BACKOFF_MAX_MS = 60000;
+
+enum class WifiState : uint8_t { Setup, Joining, Online, Backoff };
+
+struct WifiStats {
+  WifiState state = WifiState::Setup;
+  bool rescueAp = false;
+  int8_t rssi = 0;              // latest, dBm (0 = not connected)
+  int8_t rssiMin = 0;           // worst since the last connect
+  uint32_t connects = 0;        // STA got an IP
+  uint32_t disconnects = 0;     // STA lost it
+  uint32_t attempts = 0;        // WiFi.begin() calls
+  uint32_t outageMs = 0;        // current outage (0 while online)
+  uint32_t lastOutageMs = 0;
+  uint32_t longestOutageMs = 0;
+  uint32_t totalOutageS = 0;    // completed outages
+  uint8_t lastReason = 0;       // last disconnect reason code
+};
+
+void wifiBegin(const Settings& cfg);
+void wifiTick();
+// Credentials / AP password changed: rejoin without a restart.
+void wifiApplySettings(const Settings& cfg);
+
+bool wifiServerUp();        // app.server has been started
+uint32_t wifiUpMs();        // millis() when the first interface came up, 0 = not yet
+const WifiStats& wifiStats();
+const char* wifiStateName(WifiState s);
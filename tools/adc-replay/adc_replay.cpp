@@ -0,0 +1,57 @@
+// Replays recorded raw ADC streams through the firmware's filter chain.
+//
+//   g++ -std=gnu++17 -O2 -I../../firmware/viasol-control adc_replay.cpp
+//       ../../firmware/viasol-control/adc_filter.cpp -o adc_replay
+//   ./adc_replay [oversample=16] [median=3] [iir_shift=2] < samples.csv
+//
+// Input: one sample set per line, comma-separated raw codes (one column per
+// channel, up to 8). Output: one line per decimated sample with the filtered
+// value of every column (raw code units, 2 decimals). "gen" as the first
+// argument writes a synthetic stream (noisy ramp with spikes) instead.
+
+#include "adc_filter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int MAX_COLS = 8;
+
+static int generate(int n) {
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    double base = 1000.0 + 2000.0 * i / n;
+    int noisy = (int)(base + (rand() % 41) - 20);
+    if (i % 97 == 0) noisy += 1500;  // switching spike
+    printf("%d,%d\n", noisy, 2048 + (rand() % 9) - 4);
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "gen") == 0) return generate(argc > 2 ? atoi(argv[2]) : 4096);
+
+  adcf::ChainConfig cfg;
+  if (argc > 1) cfg.oversample = (uint8_t)atoi(argv[1]);
+  if (argc > 2) cfg.median = (uint8_t)atoi(argv[2]);
+  if (argc > 3) cfg.iirShift = (uint8_t)atoi(argv[3]);
+
+  adcf::Chain chains[MAX_COLS];
+  for (int c = 0; c < MAX_COLS; c++) chains[c].configure(cfg);
+
+  char line[256];
+  while (fgets(line, sizeof(line), stdin)) {
+    int cols = 0;
+    bool ready = false;
+    for (char* tok = strtok(line, ",\r\n"); tok && cols < MAX_COLS; tok = strtok(nullptr, ",\r\n")) {
+      ready = chains[cols++].push(atoi(tok)) || ready;
+    }
+    if (!ready) continue;
+    for (int c = 0; c < cols; c++) {
+      printf("%s%.2f", c ? "," : "", chains[c].valueQ8() / (double)(1 << adcf::Q));
+    }
+    printf("\n");
+  }
+  return 0;
+}
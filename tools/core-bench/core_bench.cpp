@@ -0,0 +1,157 @@
+// Host benchmark for the firmware's pure control cores: times each core's
+// per-tick entry point and counts heap allocations with the same allocator
+// hooks the firmware uses in VIASOL_HEAP_DEBUG builds (heap_track.cpp).
+// A core that starts allocating in steady state shows up as allocs/tick > 0.
+//
+//   F=../../firmware/viasol-control
+//   g++ -std=gnu++17 -O2 -I$F -DVIASOL_HEAP_DEBUG -DVIASOL_HEAP_WRAP_MALLOC
+//       -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc
+//       core_bench.cpp $F/heap_track.cpp $F/mppt.cpp $F/divert_core.cpp
+//       $F/safety_core.cpp $F/elem_learn.cpp $F/adc_filter.cpp -o core_bench
+//   ./core_bench [ticks=200000]
+//
+// Prints one row per core, then the allocation-site table. Exits 1 if any
+// steady-state tick allocated.
+
+#include "adc_filter.h"
+#include "divert_core.h"
+#include "elem_learn.h"
+#include "heap_track.h"
+#include "mppt.h"
+#include "safety_core.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int WARMUP = 1000;
+static int failures = 0;
+
+struct Row {
+  const char* name;
+  double nsPerTick;
+  uint32_t allocs;
+  uint32_t bytes;
+};
+
+// Runs body(i) WARMUP times untimed, then n times timed with the allocation
+// counters sampled around the timed part.
+template <typename F>
+static Row bench(const char* name, long n, F body) {
+  for (long i = 0; i < WARMUP; i++) body(i);
+
+  heaptrack::Totals a = heaptrack::totals();
+  uint32_t bytes0 = a.liveBytes;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) body(WARMUP + i);
+  auto t1 = std::chrono::steady_clock::now();
+  heaptrack::Totals b = heaptrack::totals();
+
+  Row r;
+  r.name = name;
+  r.nsPerTick = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  r.allocs = b.allocs - a.allocs;
+  r.bytes = b.liveBytes - bytes0;
+  if (r.allocs) failures++;
+  return r;
+}
+
+static volatile uint32_t sink;
+
+int main(int argc, char** argv) {
+  long n = argc > 1 ? atol(argv[1]) : 200000;
+  if (!heaptrack::enabled()) {
+    fprintf(stderr, "built without -DVIASOL_HEAP_DEBUG: allocation counts will read 0\n");
+  }
+
+  Row rows[8];
+  int nr = 0;
+
+  // P&O over a simple array model: I = Isc * (1 - (V/Voc)^8), load I = G*V
+  {
+    static mppt::Engine e;
+    mppt::Config c;
+    for (int ch = 0; ch < mppt::CHANNELS; ch++) c.ohms[ch] = 14.4f + ch;
+    c.vmpV = 136.0f; c.vocV = 168.0f; c.impA = 17.0f;
+    e.configure(c);
+    rows[nr++] = bench("mppt::Engine::step", n, [&](long i) {
+      float g = e.conductance(e.mask());
+      float v = 150.0f;
+      for (int k = 0; k < 8; k++) {
+        float ia = 18.0f * (1.0f - powf(v / 168.0f, 8.0f));
+        v = g > 0 ? 0.5f * v + 0.5f * (ia / g) : 168.0f;
+      }
+      sink = e.step(v, g * v * (1.0f + 0.001f * (i % 7)));
+    });
+  }
+
+  {
+    static divert::Controller d;
+    d.configure(divert::Config());
+    rows[nr++] = bench("divert::Controller::tick", n, [&](long i) {
+      float surplus = 800.0f + 700.0f * sinf(i * 0.001f);
+      sink = d.tick(surplus, (uint32_t)(i * 250));
+    });
+  }
+
+  {
+    static safety::Interlock il;
+    safety::Limits l;
+    for (int ch = 0; ch < safety::CHANNELS; ch++) l.chMaxA[ch] = 10.0f;
+    il.configure(l);
+    safety::Inputs in;
+    in.tankValid = true;
+    in.tankC = 55.0f;
+    in.busOnline = true;
+    in.commanded = 0x0F;
+    for (int ch = 0; ch < 4; ch++) in.chA[ch] = 7.0f;
+    rows[nr++] = bench("safety::Interlock::evaluate", n, [&](long i) {
+      in.nowMs = (uint32_t)(i * 20);
+      sink = il.evaluate(in).allowed;
+    });
+  }
+
+  {
+    static elearn::Learner le;
+    elearn::Config c;
+    for (int ch = 0; ch < elearn::CHANNELS; ch++) c.priorOhms[ch] = 14.4f;
+    le.configure(c);
+    float chA[elearn::CHANNELS];
+    rows[nr++] = bench("elearn::Learner::feed", n, [&](long i) {
+      uint32_t now = (uint32_t)(i * 250);
+      if (i % 4 == 0) le.onSwitch((uint8_t)(i / 4), now);
+      for (int ch = 0; ch < elearn::CHANNELS; ch++) chA[ch] = 130.0f / 14.4f;
+      sink = le.feed(130.0f, chA, now);
+    });
+  }
+
+  {
+    static adcf::Chain ch;
+    ch.configure(adcf::ChainConfig());
+    rows[nr++] = bench("adcf::Chain::push", n, [&](long i) {
+      sink = ch.push(2000 + (int32_t)(i % 13));
+    });
+  }
+
+  printf("%-30s %12s %10s %10s\n", "core", "ns/tick", "allocs", "bytes");
+  for (int i = 0; i < nr; i++) {
+    printf("%-30s %12.1f %10u %10u\n", rows[i].name, rows[i].nsPerTick, (unsigned)rows[i].allocs,
+           (unsigned)rows[i].bytes);
+  }
+
+  heaptrack::Totals t = heaptrack::totals();
+  printf("\nheap: %u allocs, %u frees, %u B live in %u blocks, peak %u B, %u untracked\n",
+         (unsigned)t.allocs, (unsigned)t.frees, (unsigned)t.liveBytes, (unsigned)t.liveBlocks,
+         (unsigned)t.peakBytes, (unsigned)t.untracked);
+  static heaptrack::Site sites[heaptrack::MAX_SITES];
+  int ns = heaptrack::sites(sites, heaptrack::MAX_SITES);
+  if (ns) printf("%-18s %10s %8s %8s %12s\n", "site", "live B", "blocks", "allocs", "total B");
+  for (int i = 0; i < ns; i++) {
+    printf("0x%016lx %10u %8u %8u %12llu\n", (unsigned long)sites[i].pc, (unsigned)sites[i].liveBytes,
+           (unsigned)sites[i].liveBlocks, (unsigned)sites[i].allocs, (unsigned long long)sites[i].totalBytes);
+  }
+
+  if (failures) printf("\n%d core(s) allocated in steady state\n", failures);
+  return failures ? 1 : 0;
+}
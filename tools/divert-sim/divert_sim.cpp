@@ -0,0 +1,101 @@
+// Host harness for the AC diversion controller: a cloudy day of PV surplus
+// (array output above what the saturated heater channels take) drives
+// divert::Controller at the firmware's 250 ms rate. Prints captured surplus
+// against relay switch count for a range of minimum on/off times, plus a
+// naive threshold relay for comparison.
+//
+//   g++ -std=gnu++17 -O2 -I../../firmware/viasol-control divert_sim.cpp
+//       ../../firmware/viasol-control/divert_core.cpp -o divert_sim
+//   ./divert_sim [load_w=1500] [hours=12] [buffer_wh=200]
+//
+// The AC load runs off the inverter, whose battery buffers the surplus
+// between relay pulses; the buffer starts half full.
+//   captured = surplus that ended up in the AC load (directly or buffered)
+//   spilled  = surplus lost because the buffer was full
+//   imported = energy the load drew with the buffer empty (grid)
+
+#include "divert_core.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const double ARRAY_W = 4600.0;   // Settings defaults: 4s2p, 136 V x 17 A
+static const double HEATER_W = 3000.0;  // what the channels absorb when saturated
+static const uint32_t TICK_MS = 250;
+
+// Same sun profile as tools/mppt-sim: half-sine with passing clouds
+static double sunAt(double t, double hours) {
+  double x = t / (hours * 3600.0);
+  double s = sin(M_PI * x);
+  double cloud = 0.5 + 0.5 * sin(t / 97.0) * sin(t / 413.0);
+  if (cloud < 0.35) s *= 0.3 + cloud;
+  return s > 0.02 ? s : 0.02;
+}
+
+struct Result {
+  double surplusWh = 0, capturedWh = 0, spilledWh = 0, importedWh = 0;
+  uint32_t switches = 0;
+};
+
+static double bufferWh = 200.0;
+
+template <typename Relay>
+static Result run(double loadW, double hours, Relay relay) {
+  Result r;
+  bool last = false;
+  double buf = bufferWh * 0.5;
+  uint32_t steps = (uint32_t)(hours * 3600.0 * 1000.0 / TICK_MS);
+  for (uint32_t k = 0; k < steps; k++) {
+    uint32_t now = k * TICK_MS;
+    double surplus = ARRAY_W * sunAt(now * 0.001, hours) - HEATER_W;
+    if (surplus < 0) surplus = 0;
+    bool on = relay((float)surplus, now);
+    if (on != last) r.switches++;
+    last = on;
+
+    double h = TICK_MS / 3600000.0;
+    r.surplusWh += surplus * h;
+    buf += (surplus - (on ? loadW : 0.0)) * h;
+    if (buf > bufferWh) {
+      r.spilledWh += buf - bufferWh;
+      buf = bufferWh;
+    } else if (buf < 0) {
+      r.importedWh += -buf;
+      buf = 0;
+    }
+  }
+  r.capturedWh = r.surplusWh - r.spilledWh - (buf - bufferWh * 0.5);
+  return r;
+}
+
+static void print(const char* name, const Result& r) {
+  printf("%-24s %9.0f %9.0f %6.1f%% %9.0f %9.0f %8u\n", name, r.surplusWh, r.capturedWh,
+         r.surplusWh > 0 ? 100.0 * r.capturedWh / r.surplusWh : 0.0, r.spilledWh, r.importedWh,
+         (unsigned)r.switches);
+}
+
+int main(int argc, char** argv) {
+  double loadW = argc > 1 ? atof(argv[1]) : 1500.0;
+  double hours = argc > 2 ? atof(argv[2]) : 12.0;
+  if (argc > 3) bufferWh = atof(argv[3]);
+
+  printf("%-24s %9s %9s %7s %9s %9s %8s\n", "controller", "surplusWh", "captWh", "capt", "spillWh", "importWh", "switches");
+
+  // Naive: on whenever the surplus covers half the load, no minimum times
+  print("threshold (no min)", run(loadW, hours, [&](float s, uint32_t) { return s >= loadW * 0.5f; }));
+
+  static const uint32_t MIN_S[] = { 10, 30, 60, 120 };
+  for (uint32_t m : MIN_S) {
+    divert::Config c;
+    c.loadW = (float)loadW;
+    c.minOnMs = c.minOffMs = m * 1000;
+    c.windowMs = 4 * m * 1000;
+    divert::Controller ctl;
+    ctl.configure(c);
+    char name[40];
+    snprintf(name, sizeof(name), "tp min %us window %us", (unsigned)m, (unsigned)(4 * m));
+    print(name, run(loadW, hours, [&](float s, uint32_t now) { return ctl.tick(s, now); }));
+  }
+  return 0;
+}
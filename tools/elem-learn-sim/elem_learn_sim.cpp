@@ -0,0 +1,84 @@
+// Host harness for the heater resistance learner: switches random channel
+// masks on a simulated PV bus, feeds noisy voltage/current readings through
+// elearn::Learner and compares the estimates with the true resistances.
+//
+//   g++ -std=gnu++17 -O2 -I../../firmware/viasol-control elem_learn_sim.cpp
+//       ../../firmware/viasol-control/elem_learn.cpp -o elem_learn_sim
+//   ./elem_learn_sim [switches=2000] [noise_mA=20] [seed=1]
+//
+// True resistances are off from the nameplate by up to +-15% and drift
+// slowly (element temperature). Exits 1 if any channel ends up more than 2%
+// off or not confident.
+
+#include "elem_learn.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const double EL_V = 120.0;
+static const double EL_W[8] = { 150, 200, 300, 400, 500, 600, 800, 1000 };
+static const double OFFSET[8] = { 0.12, -0.08, 0.15, -0.15, 0.03, -0.05, 0.10, 0.0 };
+
+static double gauss() {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+int main(int argc, char** argv) {
+  int switches = argc > 1 ? atoi(argv[1]) : 2000;
+  double noiseA = (argc > 2 ? atof(argv[2]) : 20.0) * 0.001;
+  srand(argc > 3 ? atoi(argv[3]) : 1);
+
+  elearn::Config cfg;
+  double nameplate[8];
+  for (int ch = 0; ch < 8; ch++) {
+    nameplate[ch] = EL_V * EL_V / EL_W[ch];
+    cfg.priorOhms[ch] = (float)nameplate[ch];
+  }
+  cfg.vRefV = 136.0f;
+
+  elearn::Learner learner;
+  learner.configure(cfg);
+
+  uint32_t now = 0;
+  double trueR[8];
+  for (int s = 0; s < switches; s++) {
+    // Slow +-3% drift over the run on top of the fixed offset
+    double drift = 0.03 * sin(2.0 * M_PI * s / switches);
+    for (int ch = 0; ch < 8; ch++) trueR[ch] = nameplate[ch] * (1.0 + OFFSET[ch]) * (1.0 + drift);
+
+    uint8_t mask = (uint8_t)(rand() & 0xFF);
+    learner.onSwitch(mask, now);
+
+    // Bus voltage sags with load; the remote reports 10 mV / 1 mA steps
+    double g = 0;
+    for (int ch = 0; ch < 8; ch++) if ((mask >> ch) & 1) g += 1.0 / trueR[ch];
+    double v = 150.0 / (1.0 + 2.0 * g) + 0.3 * gauss();
+    float pvV = (float)(round(v * 100.0) / 100.0);
+    float chA[8];
+    for (int ch = 0; ch < 8; ch++) {
+      double a = ((mask >> ch) & 1) ? v / trueR[ch] + noiseA * gauss() : noiseA * 0.5 * gauss();
+      chA[ch] = (float)(round(a * 1000.0) / 1000.0);
+    }
+
+    // Control ticks every 250 ms: only the first settled one is a sample
+    for (int t = 0; t < 2; t++) {
+      now += 250;
+      learner.feed(pvV, chA, now);
+    }
+  }
+
+  int bad = 0;
+  printf("ch  nameplate   true      learned   err%%    relStd%%  conf  n\n");
+  for (int ch = 0; ch < 8; ch++) {
+    double err = (learner.ohms(ch) - trueR[ch]) / trueR[ch] * 100.0;
+    bool ok = fabs(err) <= 2.0 && learner.confident(ch);
+    if (!ok) bad++;
+    printf("%d   %8.2f  %8.2f  %8.2f  %+6.2f  %7.2f  %4.2f  %u%s\n", ch, nameplate[ch], trueR[ch],
+           learner.ohms(ch), err, learner.relStd(ch) * 100.0, learner.confidence(ch),
+           (unsigned)learner.samples(ch), ok ? "" : "  FAIL");
+  }
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+// Host harness for the heater P&O engine: steps it against a simulated PV
+// array feeding resistive elements and compares the harvest with the best
+// possible mask and with the true maximum power point. The engine gets the
+// same PV-model MPP estimate as heater.cpp.
+//
+// Then checks the step response: from a reset and after sudden sun changes,
+// the estimate should get the engine to the best mask in a few steps where
+// plain P&O walks the ladder. Last, trips interlock channels mid-run: the
+// engine must never hand back a tripped channel and should settle on the
+// best mask of what is left.
+//
+//   g++ -std=gnu++17 -O2 -I../../firmware/viasol-control mppt_sim.cpp
+//       ../../firmware/viasol-control/mppt.cpp
+//       ../../firmware/viasol-control/pv_model.cpp -o mppt_sim
+//   ./mppt_sim [hours=12] [step_ms=250]
+//
+// Exits 1 if a step-response or interlock case fails.
+
+#include "mppt.h"
+#include "pv_model.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Array matches the Settings defaults (4s2p of 34 Vmp / 41 Voc / 8.5 Imp
+// panels); elements are a mixed 120 V set sized for a ~136 V array.
+static const int NS = 4, NP = 2;
+static const double VMP = 34.0 * NS, VOC = 41.0 * NS, IMP = 8.5 * NP;
+static const double ISC = IMP * 1.08;
+static const double EL_V = 120.0;
+static const double EL_W[8] = { 150, 200, 300, 400, 500, 600, 800, 1000 };
+
+// Explicit I-V approximation:  I = Isc * (1 - C1 * (exp(V / (C2 * Voc)) - 1))
+static double C1, C2;
+
+static double pvCurrent(double v, double sun) {
+  if (v <= 0) return ISC * sun;
+  double i = ISC * sun * (1.0 - C1 * (exp(v / (C2 * VOC)) - 1.0));
+  return i > 0 ? i : 0;
+}
+
+// Operating point of the array on a load of conductance g (bisection).
+static double operatingV(double g, double sun) {
+  if (g <= 0) return VOC;
+  double lo = 0, hi = VOC;
+  for (int k = 0; k < 50; k++) {
+    double mid = 0.5 * (lo + hi);
+    if (pvCurrent(mid, sun) > g * mid) lo = mid; else hi = mid;
+  }
+  return 0.5 * (lo + hi);
+}
+
+// Sun fraction over the day: half-sine with passing clouds.
+static double sunAt(double t, double hours) {
+  double x = t / (hours * 3600.0);
+  double s = sin(M_PI * x);
+  double cloud = 0.5 + 0.5 * sin(t / 97.0) * sin(t / 413.0);
+  if (cloud < 0.35) s *= 0.3 + cloud;
+  return s > 0.02 ? s : 0.02;
+}
+
+static PvModel model;
+
+static uint8_t stepEngine(mppt::Engine& eng, bool useModel, double v, double i) {
+  if (!useModel) return eng.step((float)v, (float)i);
+  float sun = model.sunFraction((float)v, (float)i);
+  return eng.step((float)v, (float)i, model.mppW() * sun, model.mppV());
+}
+
+static double bestMaskPower(const mppt::Engine& eng, double sun) {
+  double best = 0;
+  for (int m = 0; m < mppt::MASKS; m++) {
+    double vm = operatingV(eng.conductance((uint8_t)m), sun);
+    double pm = vm * pvCurrent(vm, sun);
+    if (pm > best) best = pm;
+  }
+  return best;
+}
+
+// Steps until the applied mask is within 2% of the best one at sunTo, after
+// settling at sunFrom (sunFrom < 0: straight from a reset).
+static int settleSteps(mppt::Engine& eng, bool useModel, double sunFrom, double sunTo) {
+  eng.reset();
+  uint8_t mask = eng.mask();
+  for (int k = 0; sunFrom >= 0 && k < 600; k++) {
+    double v = operatingV(eng.conductance(mask), sunFrom);
+    mask = stepEngine(eng, useModel, v, pvCurrent(v, sunFrom));
+  }
+  double target = 0.98 * bestMaskPower(eng, sunTo);
+  for (int k = 0; k < 600; k++) {
+    double v = operatingV(eng.conductance(mask), sunTo);
+    double i = pvCurrent(v, sunTo);
+    if (v * i >= target) return k;
+    mask = stepEngine(eng, useModel, v, i);
+  }
+  return 600;
+}
+
+// Settles at `sun`, then restricts the engine to `allowed` as heater.cpp does
+// on a trip. Returns steps to within 2% of the best allowed mask, or -1 if
+// a disallowed channel is ever switched on.
+static int tripSteps(mppt::Engine& eng, double sun, uint8_t allowed) {
+  eng.reset();
+  eng.setAllowed(0xFF);
+  uint8_t mask = eng.mask();
+  for (int k = 0; k < 600; k++) {
+    double v = operatingV(eng.conductance(mask), sun);
+    mask = stepEngine(eng, true, v, pvCurrent(v, sun));
+  }
+  eng.setAllowed(allowed);
+  mask = eng.mask();
+  double target = 0.98 * bestMaskPower(eng, sun);   // conductance() skips disallowed channels
+  int settled = 600;
+  for (int k = 0; k < 600; k++) {
+    if (mask & ~allowed) return -1;
+    double v = operatingV(eng.conductance(mask), sun);
+    double i = pvCurrent(v, sun);
+    if (settled == 600 && v * i >= target) settled = k;
+    mask = stepEngine(eng, true, v, i);
+  }
+  return settled;
+}
+
+int main(int argc, char** argv) {
+  double hours = argc > 1 ? atof(argv[1]) : 12.0;
+  double stepMs = argc > 2 ? atof(argv[2]) : 250.0;
+
+  C2 = (VMP / VOC - 1.0) / log(1.0 - IMP / ISC);
+  C1 = (1.0 - IMP / ISC) * exp(-VMP / (C2 * VOC));
+
+  mppt::Config cfg;
+  for (int ch = 0; ch < mppt::CHANNELS; ch++) cfg.ohms[ch] = (float)(EL_V * EL_V / EL_W[ch]);
+  cfg.vmpV = (float)VMP;
+  cfg.vocV = (float)VOC;
+  cfg.impA = (float)IMP;
+  cfg.deadbandW = (float)(0.005 * VMP * IMP);
+  cfg.reprobeSteps = (uint16_t)(30000.0 / stepMs);
+
+  mppt::Engine eng;
+  eng.configure(cfg);
+  model.build((float)VMP, (float)VOC, (float)IMP);
+
+  double dt = stepMs / 1000.0;
+  double eEngine = 0, eBestMask = 0, eMpp = 0;
+  uint32_t switches = 0, flips = 0;
+  uint8_t mask = eng.mask();
+
+  double refT = -1;
+  for (double t = 0; t < hours * 3600.0; t += dt) {
+    double sun = sunAt(t, hours);
+
+    double v = operatingV(eng.conductance(mask), sun);
+    double i = pvCurrent(v, sun);
+    eEngine += v * i * dt;
+
+    // References are expensive; sample them once per simulated second
+    if (t - refT < 1.0) {
+      uint8_t next = stepEngine(eng, true, v, i);
+      if (next != mask) switches++;
+      flips += (uint32_t)__builtin_popcount(next ^ mask);
+      mask = next;
+      continue;
+    }
+    double refDt = (refT < 0) ? dt : t - refT;
+    refT = t;
+
+    eBestMask += bestMaskPower(eng, sun) * refDt;
+
+    double pMpp = 0;
+    for (double vv = 0.5 * VMP; vv < VOC; vv += 0.1) {
+      double pp = vv * pvCurrent(vv, sun);
+      if (pp > pMpp) pMpp = pp;
+    }
+    eMpp += pMpp * refDt;
+
+    uint8_t next = stepEngine(eng, true, v, i);
+    if (next != mask) switches++;
+    flips += (uint32_t)__builtin_popcount(next ^ mask);
+    mask = next;
+  }
+
+  const mppt::Stats& st = eng.stats();
+  printf("%.1f h at %.0f ms/step: %u steps, %u reversals, %u guard steps, %u mask changes (%u channel flips), %d rungs\n",
+         hours, stepMs, (unsigned)st.steps, (unsigned)st.reversals, (unsigned)st.guardSteps,
+         (unsigned)switches, (unsigned)flips, eng.table().rungs());
+  printf("hold: %u steps (%.1f%%), %u probes, %u jumps\n", (unsigned)st.holdSteps,
+         100.0 * st.holdSteps / st.steps, (unsigned)st.probes, (unsigned)st.jumps);
+  printf("harvest: engine %.2f kWh, best mask %.2f kWh (%.1f%%), true MPP %.2f kWh (%.1f%%)\n",
+         eEngine / 3.6e6, eBestMask / 3.6e6, 100.0 * eEngine / eBestMask,
+         eMpp / 3.6e6, 100.0 * eEngine / eMpp);
+
+  struct Case {
+    const char* name;
+    double from, to;
+  };
+  static const Case CASES[] = {
+    { "reset, 80% sun", -1, 0.8 },
+    { "reset, 20% sun", -1, 0.2 },
+    { "cloud 100% -> 30%", 1.0, 0.3 },
+    { "clearing 30% -> 100%", 0.3, 1.0 },
+  };
+  // A jump lands on the estimate; P&O may need a rung or two from there
+  static const int MAX_STEPS = 4;
+
+  printf("step response (steps to within 2%% of the best mask):\n");
+  int failures = 0;
+  for (const Case& c : CASES) {
+    mppt::Engine walk, seek;
+    walk.configure(cfg);
+    seek.configure(cfg);
+    int nWalk = settleSteps(walk, false, c.from, c.to);
+    int nSeek = settleSteps(seek, true, c.from, c.to);
+    bool ok = nSeek <= MAX_STEPS && nSeek <= nWalk;
+    printf("  %-22s P&O only %3d, with estimate %3d  %s\n", c.name, nWalk, nSeek, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+  }
+
+  struct Trip {
+    const char* name;
+    double sun;
+    uint8_t allowed;
+  };
+  static const Trip TRIPS[] = {
+    { "trip 800+1000 W, 100%", 1.0, 0x3F },
+    { "trip 150+500 W, 60%", 0.6, 0xEE },
+    { "trip all but 150 W, 30%", 0.3, 0x01 },
+  };
+  printf("interlock (steps to within 2%% of the best allowed mask):\n");
+  for (const Trip& c : TRIPS) {
+    mppt::Engine eng2;
+    eng2.configure(cfg);
+    int n = tripSteps(eng2, c.sun, c.allowed);
+    bool ok = n >= 0 && n <= MAX_STEPS;
+    if (n < 0) printf("  %-24s tripped channel switched on  FAIL\n", c.name);
+    else printf("  %-24s %3d  %s\n", c.name, n, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+  }
+  return failures ? 1 : 0;
+}
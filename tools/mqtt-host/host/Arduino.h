@@ -0,0 +1,50 @@
+#pragma once
+// Minimal host stand-in for the Arduino core, just enough to compile mqtt.cpp
+// and metrics.cpp. The clock is real: the harness talks to a live broker.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  const char* c_str() const { return s_.c_str(); }
+  unsigned length() const { return (unsigned)s_.size(); }
+  bool operator==(const char* s) const { return s_ == s; }
+
+ private:
+  std::string s_;
+};
+
+struct HostSerial {
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  void println(const char* s) { puts(s); }
+};
+extern HostSerial Serial;
+
+struct HostEsp {
+  uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ull; }
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+};
+extern HostEsp ESP;
@@ -0,0 +1,10 @@
+#pragma once
+// Host stand-in: the build host's network is always up.
+#include <Arduino.h>
+
+enum { WL_CONNECTED = 3 };
+
+struct HostWiFi {
+  int status() { return WL_CONNECTED; }
+};
+extern HostWiFi WiFi;
@@ -0,0 +1,428 @@
+// Host esp-mqtt shim: MQTT 3.1.1 over a blocking TCP socket, one thread per
+// client. Only what mqtt.cpp and the harness need: CONNECT with a will,
+// QoS 0/1 PUBLISH both ways, SUBSCRIBE, keepalive and DISCONNECT.
+
+#include "mqtt_client.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+struct esp_mqtt_client {
+  std::mutex mu;
+  std::string host, user, pass, clientId, lwtTopic, lwtMsg;
+  uint32_t port = 1883;
+  int lwtQos = 0;
+  bool lwtRetain = false;
+  int timeoutMs = 10000;
+  int keepaliveS = 120;
+
+  esp_event_handler_t handler = nullptr;
+  void* handlerArg = nullptr;
+
+  std::deque<Bytes> outbox;
+  size_t outboxBytes = 0;
+  uint16_t nextMsgId = 1;
+
+  bool started = false;
+  std::atomic<bool> wantConnect{false};
+  std::atomic<bool> wantDisconnect{false};
+  std::atomic<bool> dropNow{false};
+  std::atomic<bool> refuse{false};
+  std::atomic<int> attempts{0};
+  std::atomic<int> fd{-1};
+};
+
+static std::mutex registryMu;
+static std::vector<esp_mqtt_client*> registry;
+
+// -----------------------------------------------------------------------------
+// Packet encoding
+// -----------------------------------------------------------------------------
+static void putU16(Bytes& b, uint16_t v) {
+  b.push_back((uint8_t)(v >> 8));
+  b.push_back((uint8_t)v);
+}
+
+static void putStr(Bytes& b, const std::string& s) {
+  putU16(b, (uint16_t)s.size());
+  b.insert(b.end(), s.begin(), s.end());
+}
+
+static Bytes frame(uint8_t type, const Bytes& body) {
+  Bytes p;
+  p.push_back(type);
+  size_t n = body.size();
+  do {
+    uint8_t d = n % 128;
+    n /= 128;
+    if (n) d |= 0x80;
+    p.push_back(d);
+  } while (n);
+  p.insert(p.end(), body.begin(), body.end());
+  return p;
+}
+
+static Bytes connectPacket(esp_mqtt_client& c) {
+  Bytes b;
+  putStr(b, "MQTT");
+  b.push_back(4);  // protocol level 3.1.1
+  uint8_t flags = 0x02;  // clean session
+  if (!c.lwtTopic.empty()) flags |= 0x04 | (uint8_t)(c.lwtQos << 3) | (c.lwtRetain ? 0x20 : 0);
+  if (!c.user.empty()) flags |= 0x80;
+  if (!c.pass.empty()) flags |= 0x40;
+  b.push_back(flags);
+  putU16(b, (uint16_t)c.keepaliveS);
+  putStr(b, c.clientId);
+  if (!c.lwtTopic.empty()) {
+    putStr(b, c.lwtTopic);
+    putStr(b, c.lwtMsg);
+  }
+  if (!c.user.empty()) putStr(b, c.user);
+  if (!c.pass.empty()) putStr(b, c.pass);
+  return frame(0x10, b);
+}
+
+// -----------------------------------------------------------------------------
+// Socket helpers
+// -----------------------------------------------------------------------------
+static bool sendAll(int fd, const Bytes& p) {
+  size_t off = 0;
+  while (off < p.size()) {
+    ssize_t w = send(fd, p.data() + off, p.size() - off, MSG_NOSIGNAL);
+    if (w <= 0) return false;
+    off += (size_t)w;
+  }
+  return true;
+}
+
+static int openSocket(const std::string& host, uint32_t port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  char portStr[8];
+  snprintf(portStr, sizeof(portStr), "%u", (unsigned)port);
+  if (getaddrinfo(host.c_str(), portStr, &hints, &res) != 0) return -1;
+  int fd = -1;
+  for (addrinfo* a = res; a; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+// Reads one whole packet, waiting up to timeoutMs for it to start. Returns
+// 0 on timeout, -1 on a dead socket.
+static int readPacket(int fd, int timeoutMs, uint8_t& type, Bytes& body) {
+  pollfd p{fd, POLLIN, 0};
+  int r = poll(&p, 1, timeoutMs);
+  if (r == 0) return 0;
+  if (r < 0) return -1;
+
+  auto readN = [fd](uint8_t* dst, size_t n) {
+    while (n) {
+      ssize_t got = recv(fd, dst, n, 0);
+      if (got <= 0) return false;
+      dst += got;
+      n -= (size_t)got;
+    }
+    return true;
+  };
+
+  if (!readN(&type, 1)) return -1;
+  size_t len = 0;
+  for (int shift = 0; shift < 28; shift += 7) {
+    uint8_t d;
+    if (!readN(&d, 1)) return -1;
+    len |= (size_t)(d & 0x7F) << shift;
+    if (!(d & 0x80)) break;
+  }
+  body.resize(len);
+  if (len && !readN(body.data(), len)) return -1;
+  return 1;
+}
+
+// -----------------------------------------------------------------------------
+// Client thread
+// -----------------------------------------------------------------------------
+static void post(esp_mqtt_client& c, esp_mqtt_event_t& ev) {
+  ev.client = &c;
+  if (c.handler) c.handler(c.handlerArg, "MQTT_EVENTS", ev.event_id, &ev);
+}
+
+static void postSimple(esp_mqtt_client& c, esp_mqtt_event_id_t id) {
+  esp_mqtt_event_t ev{};
+  ev.event_id = id;
+  post(c, ev);
+}
+
+static void onPublish(esp_mqtt_client& c, uint8_t type, Bytes& body) {
+  if (body.size() < 2) return;
+  size_t tlen = ((size_t)body[0] << 8) | body[1];
+  size_t off = 2 + tlen;
+  if (off > body.size()) return;
+  int qos = (type >> 1) & 3;
+  uint16_t id = 0;
+  if (qos) {
+    if (off + 2 > body.size()) return;
+    id = (uint16_t)((body[off] << 8) | body[off + 1]);
+    off += 2;
+  }
+  std::string topic((const char*)body.data() + 2, tlen);
+  std::string data((const char*)body.data() + off, body.size() - off);
+
+  esp_mqtt_event_t ev{};
+  ev.event_id = MQTT_EVENT_DATA;
+  ev.topic = &topic[0];
+  ev.topic_len = (int)topic.size();
+  ev.data = &data[0];
+  ev.data_len = ev.total_data_len = (int)data.size();
+  ev.msg_id = id;
+  post(c, ev);
+
+  if (qos == 1) {
+    Bytes ack;
+    putU16(ack, id);
+    sendAll(c.fd, frame(0x40, ack));
+  }
+}
+
+static bool tryConnect(esp_mqtt_client& c) {
+  c.attempts++;
+  if (c.refuse) return false;
+
+  Bytes pkt;
+  std::string host;
+  uint32_t port;
+  int timeoutMs;
+  {
+    std::lock_guard<std::mutex> lk(c.mu);
+    pkt = connectPacket(c);
+    host = c.host;
+    port = c.port;
+    timeoutMs = c.timeoutMs;
+  }
+
+  int fd = openSocket(host, port);
+  if (fd < 0) return false;
+  uint8_t type = 0;
+  Bytes body;
+  if (!sendAll(fd, pkt) || readPacket(fd, timeoutMs, type, body) != 1 || (type & 0xF0) != 0x20 ||
+      body.size() < 2 || body[1] != 0) {
+    close(fd);
+    return false;
+  }
+  c.fd = fd;
+  return true;
+}
+
+static void closeSession(esp_mqtt_client& c, bool graceful) {
+  if (graceful) sendAll(c.fd, frame(0xE0, Bytes()));
+  close(c.fd);
+  c.fd = -1;
+}
+
+static void runClient(esp_mqtt_client* cp) {
+  esp_mqtt_client& c = *cp;
+  for (;;) {
+    if (!c.wantConnect.exchange(false)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    c.wantDisconnect = false;
+    c.dropNow = false;
+    if (!tryConnect(c)) {
+      // esp-mqtt reports a failed attempt as a disconnect
+      postSimple(c, MQTT_EVENT_DISCONNECTED);
+      continue;
+    }
+    postSimple(c, MQTT_EVENT_CONNECTED);
+
+    auto lastSend = std::chrono::steady_clock::now();
+    for (;;) {
+      if (c.dropNow) {
+        closeSession(c, false);
+        break;
+      }
+      if (c.wantDisconnect) {
+        closeSession(c, true);
+        break;
+      }
+
+      bool ok = true;
+      for (;;) {
+        Bytes p;
+        {
+          std::lock_guard<std::mutex> lk(c.mu);
+          if (c.outbox.empty()) break;
+          p.swap(c.outbox.front());
+          c.outbox.pop_front();
+          c.outboxBytes -= p.size();
+        }
+        if (!(ok = sendAll(c.fd, p))) break;
+        lastSend = std::chrono::steady_clock::now();
+      }
+      if (!ok) {
+        closeSession(c, false);
+        break;
+      }
+
+      if (std::chrono::steady_clock::now() - lastSend > std::chrono::seconds(c.keepaliveS / 2)) {
+        sendAll(c.fd, frame(0xC0, Bytes()));
+        lastSend = std::chrono::steady_clock::now();
+      }
+
+      uint8_t type;
+      Bytes body;
+      int r = readPacket(c.fd, 10, type, body);
+      if (r < 0) {
+        closeSession(c, false);
+        break;
+      }
+      if (r > 0 && (type & 0xF0) == 0x30) onPublish(c, type, body);
+    }
+    postSimple(c, MQTT_EVENT_DISCONNECTED);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// esp-mqtt API
+// -----------------------------------------------------------------------------
+static void applyConfig(esp_mqtt_client& c, const esp_mqtt_client_config_t* cfg) {
+  auto s = [](const char* p) { return std::string(p ? p : ""); };
+  std::lock_guard<std::mutex> lk(c.mu);
+  c.host = s(cfg->host);
+  c.port = cfg->port ? cfg->port : 1883;
+  c.user = s(cfg->username);
+  c.pass = s(cfg->password);
+  c.clientId = s(cfg->client_id);
+  c.lwtTopic = s(cfg->lwt_topic);
+  c.lwtMsg = cfg->lwt_msg_len ? std::string(cfg->lwt_msg, cfg->lwt_msg_len) : s(cfg->lwt_msg);
+  c.lwtQos = cfg->lwt_qos;
+  c.lwtRetain = cfg->lwt_retain != 0;
+  if (cfg->network_timeout_ms) c.timeoutMs = cfg->network_timeout_ms;
+  if (cfg->keepalive) c.keepaliveS = cfg->keepalive;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config) {
+  esp_mqtt_client* c = new esp_mqtt_client();
+  applyConfig(*c, config);
+  std::lock_guard<std::mutex> lk(registryMu);
+  registry.push_back(c);
+  return c;
+}
+
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t* config) {
+  applyConfig(*client, config);
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+  if (client->started) return ESP_FAIL;
+  client->started = true;
+  client->wantConnect = true;
+  std::thread(runClient, client).detach();
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client) {
+  if (client->fd >= 0) return ESP_FAIL;
+  client->wantConnect = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client) {
+  client->wantDisconnect = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void* arg) {
+  (void)event;  // the shim only supports MQTT_EVENT_ANY
+  client->handler = handler;
+  client->handlerArg = arg;
+  return ESP_OK;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain, bool store) {
+  (void)store;
+  if (len == 0 && data) len = (int)strlen(data);
+  Bytes b;
+  putStr(b, topic);
+  std::lock_guard<std::mutex> lk(client->mu);
+  int id = 0;
+  if (qos > 0) {
+    id = client->nextMsgId++;
+    if (!client->nextMsgId) client->nextMsgId = 1;
+    putU16(b, (uint16_t)id);
+  }
+  b.insert(b.end(), data, data + len);
+  Bytes p = frame((uint8_t)(0x30 | (qos << 1) | (retain ? 1 : 0)), b);
+  client->outboxBytes += p.size();
+  client->outbox.push_back(std::move(p));
+  return id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain) {
+  return esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, true);
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos) {
+  Bytes b;
+  std::lock_guard<std::mutex> lk(client->mu);
+  int id = client->nextMsgId++;
+  if (!client->nextMsgId) client->nextMsgId = 1;
+  putU16(b, (uint16_t)id);
+  putStr(b, topic);
+  b.push_back((uint8_t)qos);
+  Bytes p = frame(0x82, b);
+  client->outboxBytes += p.size();
+  client->outbox.push_front(std::move(p));  // ahead of queued publishes
+  return id;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+  std::lock_guard<std::mutex> lk(client->mu);
+  return (int)client->outboxBytes;
+}
+
+esp_mqtt_client_handle_t hostMqttFind(const char* clientId) {
+  std::lock_guard<std::mutex> lk(registryMu);
+  for (esp_mqtt_client* c : registry) {
+    std::lock_guard<std::mutex> lk2(c->mu);
+    if (c->clientId == clientId) return c;
+  }
+  return nullptr;
+}
+
+void hostMqttDrop(esp_mqtt_client_handle_t client) {
+  client->dropNow = true;
+}
+
+void hostMqttRefuse(esp_mqtt_client_handle_t client, bool refuse) {
+  client->refuse = refuse;
+}
+
+int hostMqttAttempts(esp_mqtt_client_handle_t client) {
+  return client->attempts;
+}
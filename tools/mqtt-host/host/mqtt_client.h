@@ -0,0 +1,85 @@
+#pragma once
+// Host implementation of the subset of the ESP-IDF 4.x esp-mqtt API that
+// mqtt.cpp uses, over a plain TCP socket (MQTT 3.1.1). Like esp-mqtt, each
+// client runs its own thread that owns the socket and posts events from
+// there, so mqtt.cpp sees the same threading as on the device.
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef const char* esp_event_base_t;
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef enum {
+  MQTT_EVENT_ANY = -1,
+  MQTT_EVENT_ERROR = 0,
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBSCRIBED,
+  MQTT_EVENT_UNSUBSCRIBED,
+  MQTT_EVENT_PUBLISHED,
+  MQTT_EVENT_DATA,
+  MQTT_EVENT_BEFORE_CONNECT
+} esp_mqtt_event_id_t;
+
+typedef struct {
+  esp_mqtt_event_id_t event_id;
+  esp_mqtt_client_handle_t client;
+  char* data;
+  int data_len;
+  int total_data_len;
+  int current_data_offset;
+  char* topic;
+  int topic_len;
+  int msg_id;
+  int session_present;
+} esp_mqtt_event_t;
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef struct {
+  const char* host;
+  uint32_t port;
+  const char* username;
+  const char* password;
+  const char* client_id;
+  const char* lwt_topic;
+  const char* lwt_msg;
+  int lwt_qos;
+  int lwt_retain;
+  int lwt_msg_len;
+  bool disable_auto_reconnect;
+  int network_timeout_ms;
+  int keepalive;
+} esp_mqtt_client_config_t;
+
+typedef void (*esp_event_handler_t)(void*, esp_event_base_t, int32_t, void*);
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void* arg);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain, bool store);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos);
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+// -----------------------------------------------------------------------------
+// Fault injection (host only)
+// -----------------------------------------------------------------------------
+// Client created with the given client_id, or null.
+esp_mqtt_client_handle_t hostMqttFind(const char* clientId);
+// Kills the socket without a DISCONNECT packet, as a lost link would: the
+// broker publishes the client's will.
+void hostMqttDrop(esp_mqtt_client_handle_t client);
+// While set, connection attempts fail as if the broker were unreachable.
+void hostMqttRefuse(esp_mqtt_client_handle_t client, bool refuse);
+// Connection attempts made so far (successful or not).
+int hostMqttAttempts(esp_mqtt_client_handle_t client);
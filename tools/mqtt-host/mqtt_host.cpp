@@ -0,0 +1,238 @@
+// Host harness for the MQTT publisher (mqtt.cpp) against a real broker.
+// host/ supplies an Arduino stand-in and an esp-mqtt shim over TCP, so the
+// firmware source runs unmodified with the same client-thread callbacks.
+//
+//   g++ -std=gnu++17 -O2 -pthread -Ihost -I../../firmware/viasol-control
+//       mqtt_host.cpp host/mqtt_client.cpp ../../firmware/viasol-control/mqtt.cpp
+//       ../../firmware/viasol-control/metrics.cpp -o mqtt_host
+//   ./mqtt_host [host] [port]          (default 127.0.0.1 1883)
+//
+// run.sh starts a throwaway mosquitto and runs this against it. Checks
+// coalescing, register subscriptions, batch mode, the will on an unclean
+// drop, reconnect, and backoff while the broker refuses connections.
+// Exits 1 if any scenario fails.
+
+#include "mqtt.h"
+#include "io_catalog.h"
+#include <WiFi.h>
+#include <mqtt_client.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+HostSerial Serial;
+HostEsp ESP;
+HostWiFi WiFi;
+
+static const auto t0 = std::chrono::steady_clock::now();
+uint32_t millis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - t0).count();
+}
+uint32_t micros() { return millis() * 1000u; }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// One catalog input, so every flush also carries in/probe
+static InputSample probe;
+static const InputSample MISSING_SAMPLE;
+const char* INPUT_KEYS[] = {"probe"};
+int N_INPUTS = 1;
+const InputSample& inputSample(int idx) { return idx == 0 ? probe : MISSING_SAMPLE; }
+const char* qualityName(Quality q) {
+  return q == Quality::Good ? "good" : q == Quality::Stale ? "stale" : "missing";
+}
+
+// -----------------------------------------------------------------------------
+// Observer: a second client subscribed to <base>/# that records everything
+// -----------------------------------------------------------------------------
+struct Msg {
+  std::string topic, payload;
+};
+
+static std::mutex seenMu;
+static std::vector<Msg> seen;
+static std::string base;
+static volatile bool observerUp = false;
+
+static void onObserver(void*, esp_event_base_t, int32_t id, void* data) {
+  esp_mqtt_event_handle_t ev = (esp_mqtt_event_handle_t)data;
+  if (id == MQTT_EVENT_CONNECTED) {
+    esp_mqtt_client_subscribe(ev->client, (base + "/#").c_str(), 1);
+    observerUp = true;
+  } else if (id == MQTT_EVENT_DATA) {
+    std::lock_guard<std::mutex> lk(seenMu);
+    seen.push_back(Msg{std::string(ev->topic, ev->topic_len), std::string(ev->data, ev->data_len)});
+  }
+}
+
+static std::vector<Msg> take(const std::string& sub) {
+  std::string topic = base + "/" + sub;
+  std::lock_guard<std::mutex> lk(seenMu);
+  std::vector<Msg> out;
+  for (const Msg& m : seen) {
+    if (m.topic == topic) out.push_back(m);
+  }
+  return out;
+}
+
+static void forget() {
+  std::lock_guard<std::mutex> lk(seenMu);
+  seen.clear();
+}
+
+static bool lastIs(const std::string& sub, const char* payload) {
+  std::vector<Msg> m = take(sub);
+  return !m.empty() && m.back().payload == payload;
+}
+
+// -----------------------------------------------------------------------------
+// Driver
+// -----------------------------------------------------------------------------
+// Runs the firmware loop (mqttTick every 5 ms) until done() or the timeout.
+static bool pump(uint32_t timeoutMs, const std::function<bool()>& done) {
+  uint32_t start = millis();
+  while (millis() - start < timeoutMs) {
+    mqttTick();
+    if (done()) return true;
+    delay(5);
+  }
+  return false;
+}
+
+static void settle(uint32_t ms) {
+  pump(ms, [] { return false; });
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+int main(int argc, char** argv) {
+  const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+  int port = argc > 2 ? atoi(argv[2]) : 1883;
+
+  // Unique base so retained messages from earlier runs don't leak in
+  char b[48];
+  snprintf(b, sizeof(b), "viasol-test-%d", (int)getpid());
+  base = b;
+
+  Settings cfg;
+  cfg.mqtt_host = host;
+  cfg.mqtt_port = port;
+  cfg.mqtt_base = b;
+  cfg.mqtt_pub_ms = 200;
+  cfg.mqtt_nregs = 2;
+  cfg.mqtt_reg_maxage_s[0] = 5;
+
+  esp_mqtt_client_config_t oc{};
+  oc.host = host;
+  oc.port = (uint32_t)port;
+  oc.client_id = "viasol-test-observer";
+  esp_mqtt_client_handle_t observer = esp_mqtt_client_init(&oc);
+  esp_mqtt_client_register_event(observer, MQTT_EVENT_ANY, onObserver, nullptr);
+  esp_mqtt_client_start(observer);
+  if (!pump(3000, [] { return observerUp; })) {
+    printf("cannot reach a broker at %s:%d\n", host, port);
+    return 1;
+  }
+  delay(200);  // let the SUBACK land before the device says anything
+
+  printf("connect\n");
+  mqttRegsBegin(cfg);
+  mqttBegin(cfg);
+  check(pump(3000, [] { return mqttConnected() && lastIs("status", "online"); }),
+        "connects and publishes retained \"online\"");
+  esp_mqtt_client_handle_t dev = hostMqttFind("viasol-C3D4E5F6");
+  check(dev != nullptr, "client id derived from the efuse MAC");
+  if (!dev) return 1;
+
+  printf("coalescing\n");
+  settle(300);
+  forget();
+  uint32_t coalesced0 = mqttStats().coalesced;
+  for (int i = 0; i < 100; i++) mqttPublish("test/burst", (float)i);
+  settle(600);
+  std::vector<Msg> burst = take("test/burst");
+  check(burst.size() == 1, "100 updates between flushes go out once");
+  check(!burst.empty() && burst.back().payload == "99.000", "the last value wins");
+  check(mqttStats().coalesced - coalesced0 >= 99, "stats.coalesced counts the replaced updates");
+  probe.value = 12.5f;
+  probe.q = Quality::Good;
+  check(pump(1000, [] { return lastIs("in/probe", "12.500"); }), "catalog inputs published under in/");
+  probe.q = Quality::Stale;
+  check(pump(1000, [] { return lastIs("in/probe", "stale"); }), "a stale input goes out as \"stale\", not a number");
+
+  printf("registers\n");
+  esp_mqtt_client_publish(observer, (base + "/reg/mqtt1").c_str(), "42.5", 0, 1, 0);
+  esp_mqtt_client_publish(observer, (base + "/reg/mqtt2").c_str(), "ON", 0, 1, 0);
+  float v1 = 0, v2 = 0;
+  check(pump(2000, [&] { return mqttRegRead(0, v1) && v1 == 42.5f; }), "mqtt1 reads a numeric payload");
+  check(pump(2000, [&] { return mqttRegRead(1, v2) && v2 == 1.0f; }), "mqtt2 reads \"ON\" as 1");
+  for (const char* bad : { "12abc", "nan", "inf", "-inf", "1e38", "" }) {
+    esp_mqtt_client_publish(observer, (base + "/reg/mqtt1").c_str(), bad, 0, 1, 0);
+  }
+  // Same publisher and session, so mqtt2's update lands after them
+  esp_mqtt_client_publish(observer, (base + "/reg/mqtt2").c_str(), "7", 0, 1, 0);
+  pump(2000, [&] { return mqttRegRead(1, v2) && v2 == 7.0f; });
+  check(mqttRegRead(0, v1) && v1 == 42.5f, "junk, nan/inf and 1e38 leave mqtt1 alone");
+  esp_mqtt_client_publish(observer, (base + "/reg/mqtt1").c_str(), " 43 ", 0, 1, 0);
+  check(pump(2000, [&] { return mqttRegRead(0, v1) && v1 == 43.0f; }), "a space-padded number is accepted");
+
+  printf("batch mode\n");
+  cfg.mqtt_batch = true;
+  mqttBegin(cfg);  // settings change forces a reconnect
+  check(pump(5000, [] { return !mqttConnected(); }) && pump(5000, [] { return mqttConnected(); }),
+        "reconnects after a settings change");
+  settle(300);
+  forget();
+  mqttPublish("test/a", 1);
+  mqttPublish("test/b", 2);
+  settle(600);
+  bool one = false;
+  for (const Msg& m : take("state")) {
+    one |= m.payload.find("\"test/a\":1.000") != std::string::npos &&
+           m.payload.find("\"test/b\":2.000") != std::string::npos;
+  }
+  check(one, "dirty slots go out as one <base>/state object");
+  check(take("test/a").empty() && take("test/b").empty(), "no per-topic messages in batch mode");
+
+  printf("unclean drop\n");
+  MqttStats before = mqttStats();
+  forget();
+  hostMqttDrop(dev);
+  check(pump(5000, [] { return lastIs("status", "offline"); }), "broker publishes the will");
+  check(pump(5000, [] { return lastIs("status", "online"); }), "reconnects and restores \"online\"");
+  check(mqttStats().disconnects == before.disconnects + 1, "stats.disconnects counts the drop");
+  check(mqttStats().connects == before.connects + 1, "stats.connects counts the reconnect");
+
+  printf("backoff\n");
+  int attempts0 = hostMqttAttempts(dev);
+  hostMqttRefuse(dev, true);
+  hostMqttDrop(dev);
+  settle(8000);
+  int tries = hostMqttAttempts(dev) - attempts0;
+  printf("    %d attempts in 8 s, backoff now %u ms\n", tries, (unsigned)mqttStats().backoffMs);
+  check(tries >= 2 && tries <= 4, "retries are spaced out, not hammered");
+  check(mqttStats().backoffMs >= 8000, "backoff doubles on each failure");
+  hostMqttRefuse(dev, false);
+  check(pump(20000, [] { return mqttConnected(); }), "connects once the broker accepts again");
+  mqttTick();
+  check(mqttStats().backoffMs == 1000, "backoff resets after a good connect");
+
+  esp_mqtt_client_disconnect(observer);
+  delay(100);
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
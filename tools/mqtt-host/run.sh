@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds mqtt_host and runs it against a throwaway mosquitto on a spare port.
+#   ./run.sh [port]        (default 18883; needs mosquitto on PATH)
+set -e
+cd "$(dirname "$0")"
+PORT=${1:-18883}
+F=../../firmware/viasol-control
+
+g++ -std=gnu++17 -O2 -pthread -Ihost -I$F mqtt_host.cpp host/mqtt_client.cpp \
+    $F/mqtt.cpp $F/metrics.cpp -o mqtt_host
+
+mosquitto -p "$PORT" >mosquitto.log 2>&1 &
+BROKER=$!
+trap 'kill $BROKER 2>/dev/null' EXIT
+sleep 0.5
+
+./mqtt_host 127.0.0.1 "$PORT"
@@ -0,0 +1,146 @@
+// Host harness for the RS-485 protocol core: runs the firmware's Scheduler
+// against simulated remotes over a pty pair and reports throughput/latency.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I../../firmware/viasol-control rs485_sim.cpp
+//       ../../firmware/viasol-control/rs485_proto.cpp ../../firmware/viasol-control/rs485_sched.cpp -o rs485_sim -lutil
+//   ./rs485_sim [remotes=2] [seconds=5] [baud=250000] [present=remotes]
+//
+// Remotes above "present" never answer, to exercise timeouts and backoff.
+//
+// The pty has no real line rate, so each side sleeps for the frame's wire
+// time at the given baud before handing it over.
+
+#include "rs485_sched.h"
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+
+using namespace rs485;
+
+static uint32_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+static void sleepUs(uint32_t us) {
+  timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+  nanosleep(&ts, nullptr);
+}
+
+static void makeRaw(int fd) {
+  termios t;
+  tcgetattr(fd, &t);
+  cfmakeraw(&t);
+  tcsetattr(fd, TCSANOW, &t);
+}
+
+static std::atomic<bool> running(true);
+
+// Remotes 1..n share the "bus" end of the pty.
+static void remoteLoop(int fd, int n, uint32_t baud) {
+  static int16_t regs[MAX_REMOTES][REG_COUNT];
+  Slave* slaves[MAX_REMOTES];
+  for (int i = 0; i < n; i++) {
+    for (int r = 0; r < REG_COUNT; r++) regs[i][r] = (int16_t)(i * 1000 + r);
+    slaves[i] = new Slave((uint8_t)(i + 1), regs[i], REG_COUNT);
+  }
+
+  Decoder dec;
+  Frame resp;
+  uint8_t buf[256], out[MAX_FRAME];
+  while (running) {
+    pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, 50) <= 0) continue;
+    ssize_t got = read(fd, buf, sizeof(buf));
+    for (ssize_t i = 0; i < got; i++) {
+      if (!dec.feed(buf[i])) continue;
+      for (int s = 0; s < n; s++) {
+        if (!slaves[s]->handle(dec.frame(), resp)) continue;
+        size_t len = encodeFrame(resp, out, sizeof(out));
+        sleepUs(wireTimeUs(len, baud));
+        if (write(fd, out, len) != (ssize_t)len) perror("remote write");
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int nRemotes = argc > 1 ? atoi(argv[1]) : 2;
+  int seconds = argc > 2 ? atoi(argv[2]) : 5;
+  uint32_t baud = argc > 3 ? (uint32_t)atoi(argv[3]) : 250000;
+  if (nRemotes < 1) nRemotes = 1;
+  if (nRemotes > MAX_REMOTES) nRemotes = MAX_REMOTES;
+  int present = argc > 4 ? atoi(argv[4]) : nRemotes;
+  if (present < 0 || present > nRemotes) present = nRemotes;
+
+  int mfd, sfd;
+  if (openpty(&mfd, &sfd, nullptr, nullptr, nullptr) < 0) {
+    perror("openpty");
+    return 1;
+  }
+  makeRaw(mfd);
+  makeRaw(sfd);
+
+  std::thread remote(remoteLoop, sfd, present, baud);
+
+  Scheduler m(baud);
+  m.addDefaultGroups();
+  m.setRemotes((uint8_t)((1u << nRemotes) - 1));
+  m.setTurnaroundUs(2000);  // pty + scheduler jitter
+
+  uint8_t tx[MAX_FRAME], rx[256];
+  uint32_t start = nowUs();
+  int16_t mask = 0;
+  uint32_t lastWrite = start;
+  while ((nowUs() - start) < (uint32_t)seconds * 1000000u) {
+    size_t len;
+    if (m.nextTx(nowUs(), tx, len)) {
+      sleepUs(wireTimeUs(len, baud));
+      if (write(mfd, tx, len) != (ssize_t)len) perror("master write");
+      m.prefetch(nowUs());
+    }
+    if (nowUs() - lastWrite >= 100000) {  // control loop output at 10 Hz
+      lastWrite = nowUs();
+      m.write(1, REG_HEATER_MASK, ++mask & 0xFF);
+    }
+    pollfd p = { mfd, POLLIN, 0 };
+    if (poll(&p, 1, 1) > 0) {
+      ssize_t got = read(mfd, rx, sizeof(rx));
+      if (got > 0) m.onRx(rx, (size_t)got, nowUs());
+    }
+    m.tick(nowUs());
+  }
+  running = false;
+  remote.join();
+
+  double secs = (nowUs() - start) / 1e6;
+  const MasterStats& ms = m.stats();
+  printf("baud %u, %d remote(s), %.1f s\n", (unsigned)baud, nRemotes, secs);
+  printf("bus: tx %u B, rx %u B, %.0f%% of line rate, late %u, crc %u\n",
+         (unsigned)ms.txBytes, (unsigned)ms.rxBytes,
+         100.0 * (ms.txBytes + ms.rxBytes) * 10 / (baud * secs),
+         (unsigned)ms.lateFrames, (unsigned)ms.crcErrors);
+  printf("scheduler: util %.1f%%, demand %.1f%%\n", m.utilPermille() / 10.0, m.demandPermille() / 10.0);
+  for (int a = 1; a <= nRemotes; a++) {
+    const RemoteStats& rs = m.remoteStats((uint8_t)a);
+    printf("remote %d: %u txns (%.0f/s), ok %u, timeouts %u, errors %u, rtt min/avg/max %u/%u/%u us\n",
+           a, (unsigned)rs.txns, rs.txns / secs, (unsigned)rs.ok, (unsigned)rs.timeouts,
+           (unsigned)rs.errors, (unsigned)rs.rttMinUs, (unsigned)rs.rttAvgUs, (unsigned)rs.rttMaxUs);
+    for (int g = 0; g < m.groupCount(); g++) {
+      const GroupStats& gs = m.groupStats((uint8_t)a, g);
+      printf("  %-8s %6.2f/s (want %6.2f), misses %u, max late %u us\n",
+             m.group(g).name, gs.polls / secs, 1000.0 / m.group(g).periodMs,
+             (unsigned)gs.misses, (unsigned)gs.maxLateUs);
+    }
+  }
+  return 0;
+}
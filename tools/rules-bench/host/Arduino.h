@@ -0,0 +1,91 @@
+#pragma once
+// Minimal host stand-in for the Arduino core, just enough to compile the
+// rule engines (rules.cpp, rules2_engine.cpp) and metrics.cpp. String keeps
+// its text in a malloc'd buffer like the real one, so a hidden copy or
+// temporary shows up in the allocation counters.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Driven by the bench
+extern uint32_t hostMillis;
+inline uint32_t millis() { return hostMillis; }
+inline uint32_t micros() { return hostMillis * 1000u; }
+
+class String {
+ public:
+  String() {}
+  String(const char* s) { assign(s, s ? strlen(s) : 0); }
+  String(const String& o) { assign(o.buf_, o.len_); }
+  String(String&& o) noexcept : buf_(o.buf_), len_(o.len_) { o.buf_ = nullptr; o.len_ = 0; }
+  explicit String(long v) { char b[24]; snprintf(b, sizeof(b), "%ld", v); assign(b, strlen(b)); }
+  explicit String(int v) : String((long)v) {}
+  explicit String(unsigned v) : String((long)v) {}
+  ~String() { free(buf_); }
+
+  String& operator=(const String& o) { if (this != &o) assign(o.buf_, o.len_); return *this; }
+  String& operator=(String&& o) noexcept {
+    if (this != &o) { free(buf_); buf_ = o.buf_; len_ = o.len_; o.buf_ = nullptr; o.len_ = 0; }
+    return *this;
+  }
+  String& operator=(const char* s) { assign(s, s ? strlen(s) : 0); return *this; }
+  String& operator+=(const String& o) { append(o.c_str(), o.len_); return *this; }
+  String& operator+=(const char* s) { append(s, strlen(s)); return *this; }
+
+  bool operator==(const String& o) const { return strcmp(c_str(), o.c_str()) == 0; }
+  bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+  bool operator!=(const String& o) const { return !(*this == o); }
+  bool operator!=(const char* s) const { return !(*this == s); }
+
+  const char* c_str() const { return buf_ ? buf_ : ""; }
+  unsigned length() const { return (unsigned)len_; }
+  void reserve(size_t) {}
+
+ private:
+  void assign(const char* s, size_t n) {
+    free(buf_);
+    buf_ = nullptr;
+    len_ = 0;
+    append(s, n);
+  }
+  void append(const char* s, size_t n) {
+    if (!n) return;
+    char* b = (char*)realloc(buf_, len_ + n + 1);
+    memcpy(b + len_, s, n);
+    b[len_ + n] = 0;
+    buf_ = b;
+    len_ += n;
+  }
+
+  char* buf_ = nullptr;
+  size_t len_ = 0;
+};
+
+inline String operator+(const String& a, const String& b) { String s(a); s += b; return s; }
+inline String operator+(const String& a, const char* b) { String s(a); s += b; return s; }
+
+struct HostSerial {
+  bool quiet = false;
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (quiet) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  void println(const char* s) { if (!quiet) puts(s); }
+};
+extern HostSerial Serial;
+
+struct HostEsp {
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+};
+extern HostEsp ESP;
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in: an empty namespace, reads return the defaults.
+#include <Arduino.h>
+
+class Preferences {
+ public:
+  bool getBool(const char*, bool d) { return d; }
+  float getFloat(const char*, float d) { return d; }
+  uint32_t getUInt(const char*, uint32_t d) { return d; }
+  String getString(const char*, const char* d) { return String(d); }
+  size_t putBool(const char*, bool) { return 1; }
+  size_t putFloat(const char*, float) { return 4; }
+  size_t putUInt(const char*, uint32_t) { return 4; }
+  size_t putString(const char*, const String& s) { return s.length(); }
+  size_t putString(const char*, const char* s) { return strlen(s); }
+};
@@ -0,0 +1,8 @@
+#pragma once
+// Host stand-in: the engines only pass WebServer& around in UI helpers.
+#include <Arduino.h>
+
+class WebServer {
+ public:
+  explicit WebServer(int) {}
+};
@@ -0,0 +1,599 @@
+// Host check that the rule ticks (processRules, processRules2) don't touch
+// the heap once warmed up. Both engines run against a small fake catalog
+// whose inputs sweep through their thresholds, go Stale and come back, so
+// edges, timed holds and the unknown-input policies all fire. After warm-up
+// the TickGuards are armed exactly as on the device and every allocation
+// inside a tick is a failure.
+//
+//   F=../../firmware/viasol-control
+//   g++ -std=gnu++17 -O2 -Ihost -I$F -DVIASOL_HEAP_DEBUG -DVIASOL_HEAP_WRAP_MALLOC
+//       -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc
+//       rules_bench.cpp $F/rules.cpp $F/rules2_engine.cpp $F/rules2_db.cpp
+//       $F/metrics.cpp $F/heap_track.cpp -o rules_bench
+//   ./rules_bench [ticks=200000]
+//   ./rules_bench compare [ticks=100000]
+//
+// Exits 1 if a guarded tick allocated, or if the guard failed to catch a
+// deliberate allocation.
+//
+// `compare` instead runs processRules2() next to a copy of the engine it
+// replaced (recursive, short-circuit) on 320 conditions in 32 groups, once
+// without and once with stability windows, and prints both tick times and
+// where their results differ. Exits 1 if they differ without windows.
+
+#include "app.h"
+#include "heap_track.h"
+#include "io_catalog.h"
+#include "rules.h"
+#include "rules2.h"
+
+#include <chrono>
+#include <vector>
+
+uint32_t hostMillis = 0;
+HostSerial Serial;
+HostEsp ESP;
+App app;
+
+// -----------------------------------------------------------------------------
+// Fake catalog (the subset of io_catalog.cpp the engines use)
+// -----------------------------------------------------------------------------
+const char* INPUT_KEYS[IO_MAX_INPUTS] = { "tank_temp_c", "floor_temp_c", "pv_v", "soc", "mqtt1" };
+int N_INPUTS = 5;
+
+const char* OUTPUT_KEYS[] = { "m_relay1", "m_relay2", "r_relay1", "r_relay2", "r_relay3", "m_aux1" };
+const int N_OUTPUTS = sizeof(OUTPUT_KEYS) / sizeof(OUTPUT_KEYS[0]);
+
+static InputSample samples[IO_MAX_INPUTS];
+static const InputSample MISSING_SAMPLE;
+static bool outputs[16];
+static uint32_t outputWrites = 0;
+
+int inputIndexByKey(const char* key) {
+  for (int i = 0; i < N_INPUTS; i++) if (strcmp(INPUT_KEYS[i], key) == 0) return i;
+  return -1;
+}
+
+int outputIndexByKey(const char* key) {
+  for (int i = 0; i < N_OUTPUTS; i++) if (strcmp(OUTPUT_KEYS[i], key) == 0) return i;
+  return -1;
+}
+
+int inputIndexCached(int8_t& idx, const char* key) {
+  if (idx < 0 || idx >= N_INPUTS || strcmp(INPUT_KEYS[idx], key) != 0) idx = (int8_t)inputIndexByKey(key);
+  return idx;
+}
+
+int outputIndexCached(int8_t& idx, const char* key) {
+  if (idx < 0 || idx >= N_OUTPUTS || strcmp(OUTPUT_KEYS[idx], key) != 0) idx = (int8_t)outputIndexByKey(key);
+  return idx;
+}
+
+const InputSample& inputSample(int idx) {
+  if (idx < 0 || idx >= N_INPUTS) return MISSING_SAMPLE;
+  return samples[idx];
+}
+
+void applyOutputIndex(int idx, bool on) {
+  if (idx < 0 || idx >= N_OUTPUTS) return;
+  outputs[idx] = on;
+  outputWrites++;
+}
+
+void applyOutput(const String& key, bool on) {
+  applyOutputIndex(outputIndexByKey(key.c_str()), on);
+}
+
+float inputValueByKey(const String& key) {
+  return inputSample(inputIndexByKey(key.c_str())).value;
+}
+
+// Inputs sweep with different periods; soc drops out for 2 s every 30 s
+static void drive(uint32_t now) {
+  float t = now / 1000.0f;
+  samples[0] = { 50.0f + 10.0f * sinf(t / 7.0f), now, Quality::Good };
+  samples[1] = { 22.0f + 3.0f * sinf(t / 3.0f), now, Quality::Good };
+  samples[2] = { 60.0f + 40.0f * sinf(t / 11.0f), now, Quality::Good };
+  bool socGone = (now % 30000) < 2000;
+  samples[3] = { 50.0f + 30.0f * sinf(t / 5.0f), now, socGone ? Quality::Stale : Quality::Good };
+  samples[4] = { 48.0f + 10.0f * sinf(t / 13.0f), now, Quality::Good };
+}
+
+// -----------------------------------------------------------------------------
+// Rule sets
+// -----------------------------------------------------------------------------
+static void setupRules() {
+  loadRules();   // defaults from the (empty) host Preferences
+
+  rules[0].enabled = true;      // follow: tank above 52
+  rules[0].inputKey = "tank_temp_c";
+  rules[0].threshold = 52.0f;
+  rules[0].outputKey = "m_relay1";
+
+  rules[1].enabled = true;      // timed: pv_v above mqtt1
+  rules[1].inputKey = "pv_v";
+  rules[1].rhsSource = RhsSource::INPUT_KEY;
+  rules[1].rhsInputKey = "mqtt1";
+  rules[1].outputKey = "r_relay1";
+  rules[1].mode = RuleMode::TIMED;
+  rules[1].durationSec = 3;
+
+  rules[2].enabled = true;      // once: soc below 30 (goes Stale)
+  rules[2].inputKey = "soc";
+  rules[2].op = CmpOp::LT;
+  rules[2].threshold = 30.0f;
+  rules[2].outputKey = "m_relay2";
+  rules[2].mode = RuleMode::ONCE;
+}
+
+static uint32_t addCond(const char* in, rules2::CmpOp op, float th, const char* rhs = nullptr,
+                        uint32_t stableMs = 0) {
+  rules2::Condition* c = rules2::db.conditions.add();
+  c->id = rules2::db.allocId();
+  c->name = rules2::db.intern(in);
+  c->inputKey = c->name;
+  c->op = op;
+  c->threshold = th;
+  if (rhs) {
+    c->type = rules2::CondType::CompareInputToInput;
+    c->rhsInputKey = rules2::db.intern(rhs);
+  }
+  c->stableForMs = stableMs;
+  return c->id;
+}
+
+static uint32_t addNode(rules2::ExprType type, uint32_t condId, std::vector<uint32_t> children = {}) {
+  rules2::ExprNode* n = rules2::db.expr.add();
+  n->id = rules2::db.allocId();
+  n->type = type;
+  n->condId = condId;
+  if (type == rules2::ExprType::Not) n->child = children.at(0);
+  else rules2::db.setChildren(*n, children.data(), children.size());
+  return n->id;
+}
+
+struct BenchAction {
+  const char* out;
+  bool on;
+  uint32_t durationMs;
+};
+
+static void addRule(const char* name, uint32_t root, rules2::UnknownPolicy onUnknown,
+                    std::vector<BenchAction> actions) {
+  rules2::Rule* r = rules2::db.rules.add();
+  r->id = rules2::db.allocId();
+  r->name = rules2::db.intern(name);
+  r->exprRootId = root;
+  r->onUnknown = onUnknown;
+  r->minEvalPeriodMs = 100;
+  for (const auto& b : actions) {
+    rules2::Action* a = rules2::db.addAction(*r);
+    a->outputKey = rules2::db.intern(b.out);
+    a->on = b.on;
+    a->durationMs = b.durationMs;
+  }
+}
+
+static BenchAction act(const char* out, bool on, uint32_t durationMs = 0) {
+  return { out, on, durationMs };
+}
+
+static void setupRules2() {
+  using namespace rules2;
+  Need room;   // everything below, one block
+  room.conditions = 4;
+  room.expr = 8;
+  room.rules = 4;
+  room.actions = 5;
+  room.children = 6;
+  room.strBytes = 256;
+  db.reserve(room);
+
+  uint32_t hot = addNode(ExprType::LeafCond, addCond("tank_temp_c", rules2::CmpOp::GT, 55.0f, nullptr, 500));
+  uint32_t warm = addNode(ExprType::LeafCond, addCond("floor_temp_c", rules2::CmpOp::GE, 23.0f));
+  uint32_t sunny = addNode(ExprType::LeafCond, addCond("pv_v", rules2::CmpOp::GT, 0, "mqtt1"));
+  uint32_t low = addNode(ExprType::LeafCond, addCond("soc", rules2::CmpOp::LT, 40.0f));
+
+  uint32_t divert = addNode(ExprType::And, 0, { sunny, addNode(ExprType::Not, 0, { hot }) });
+  addRule("divert to tank", divert, UnknownPolicy::Hold, { act("r_relay2", true, 2000) });
+  addRule("floor or hot tank", addNode(ExprType::Or, 0, { warm, hot }), UnknownPolicy::Hold,
+          { act("m_aux1", true, 1500), act("m_relay2", false) });
+  addRule("low battery shed", addNode(ExprType::And, 0, { low, sunny }), UnknownPolicy::Off,
+          { act("r_relay3", true, 5000) });
+  addRule("battery unknown, a rule name longer than the printf buffer", low, UnknownPolicy::On,
+          { act("r_relay2", true, 1000) });
+  db.changed();
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+static const uint32_t TICK_MS = 10;
+static const int WARMUP = 5000;   // covers a full soc dropout cycle
+
+static void tick() {
+  hostMillis += TICK_MS;
+  drive(hostMillis);
+  {
+    heaptrack::TickGuard guard("processRules");
+    processRules();
+  }
+  {
+    heaptrack::TickGuard guard("processRules2");
+    rules2::processRules2();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Old-vs-new comparison (./rules_bench compare)
+//
+// Ref is the engine as it was before the compiled tables: a recursive walk
+// that looks nodes up by id and short-circuits, so a condition is only
+// evaluated (and its stability window only updated) when the walk reaches
+// it. It keeps its own condition, rule, hold and output state, and reads
+// the same Db as processRules2().
+// -----------------------------------------------------------------------------
+namespace ref {
+
+using namespace rules2;
+using rules2::CmpOp;   // rules.h has its own CmpOp and Rule
+using rules2::Rule;
+
+struct CondState {
+  bool lastEval = false;
+  uint32_t lastFlipMs = 0;
+  int8_t lhsIdx = -1, rhsIdx = -1;
+};
+
+struct RuleState {
+  uint32_t lastEvalMs = 0, lastTriggerMs = 0;
+  bool lastResult = false;
+  Tri lastTri = Tri::False;
+  uint32_t fires = 0;
+};
+
+static std::vector<CondState> conds;
+static std::vector<RuleState> rules;
+static bool outputs[16];
+static uint32_t holdUntilMs[16];
+static uint16_t heldMask = 0;
+
+static void reset() {
+  conds.assign(db.conditions.size(), CondState());
+  rules.assign(db.rules.size(), RuleState());
+  memset(outputs, 0, sizeof(outputs));
+  heldMask = 0;
+}
+
+static bool cmp(CmpOp op, float a, float b) {
+  switch (op) {
+    case CmpOp::GT: return a >  b;
+    case CmpOp::GE: return a >= b;
+    case CmpOp::LT: return a <  b;
+    case CmpOp::LE: return a <= b;
+    case CmpOp::EQ: return a == b;
+    case CmpOp::NE: return a != b;
+  }
+  return false;
+}
+
+static Tri toTri(bool b) { return b ? Tri::True : Tri::False; }
+
+static Tri evalCondition(Condition& c, uint32_t nowMs) {
+  if (!c.enabled) return Tri::False;
+  CondState& s = conds[&c - db.conditions.begin()];
+
+  const InputSample& lhs = inputSample(inputIndexCached(s.lhsIdx, db.str(c.inputKey)));
+  bool known = (lhs.q == Quality::Good);
+  bool raw = false;
+  if (c.type == CondType::CompareInputToConst) {
+    raw = cmp(c.op, lhs.value, c.threshold);
+  } else {
+    const InputSample& rhs = inputSample(inputIndexCached(s.rhsIdx, db.str(c.rhsInputKey)));
+    known = known && (rhs.q == Quality::Good);
+    raw = cmp(c.op, lhs.value, rhs.value);
+  }
+
+  if (!known) {
+    s.lastEval = false;
+    s.lastFlipMs = nowMs;
+    return Tri::Unknown;
+  }
+  if (c.stableForMs == 0) {
+    s.lastEval = raw;
+    return toTri(raw);
+  }
+  if (raw != s.lastEval) {
+    s.lastEval = raw;
+    s.lastFlipMs = nowMs;
+  }
+  if (!raw) return Tri::False;
+  return toTri((nowMs - s.lastFlipMs) >= c.stableForMs);
+}
+
+static Tri evalExpr(uint32_t exprId, uint32_t nowMs) {
+  ExprNode* n = db.findExpr(exprId);
+  if (!n) return Tri::False;
+
+  switch (n->type) {
+    case ExprType::LeafCond: {
+      Condition* c = db.findCond(n->condId);
+      return c ? evalCondition(*c, nowMs) : Tri::False;
+    }
+    case ExprType::Not: {
+      Tri t = evalExpr(n->child, nowMs);
+      if (t == Tri::Unknown) return t;
+      return toTri(t == Tri::False);
+    }
+    case ExprType::And: {
+      Tri acc = Tri::True;
+      for (uint32_t cid : db.children(*n)) {
+        Tri t = evalExpr(cid, nowMs);
+        if (t == Tri::False) return Tri::False;
+        if (t == Tri::Unknown) acc = Tri::Unknown;
+      }
+      return acc;
+    }
+    case ExprType::Or: {
+      Tri acc = Tri::False;
+      for (uint32_t cid : db.children(*n)) {
+        Tri t = evalExpr(cid, nowMs);
+        if (t == Tri::True) return Tri::True;
+        if (t == Tri::Unknown) acc = Tri::Unknown;
+      }
+      return acc;
+    }
+  }
+  return Tri::False;
+}
+
+static void apply(int out, bool on) {
+  if (out >= 0 && out < N_OUTPUTS) outputs[out] = on;
+}
+
+static void process(uint32_t nowMs) {
+  for (int i = 0; heldMask && i < 16; i++) {
+    uint16_t bit = (uint16_t)(1u << i);
+    if (!(heldMask & bit) || (int32_t)(nowMs - holdUntilMs[i]) < 0) continue;
+    heldMask &= (uint16_t)~bit;
+    apply(i, false);
+  }
+
+  for (uint32_t i = 0; i < db.rules.size(); i++) {
+    Rule& r = db.rules[i];
+    RuleState& s = rules[i];
+    if (!r.enabled) continue;
+    if (r.minEvalPeriodMs > 0 && (nowMs - s.lastEvalMs) < r.minEvalPeriodMs) continue;
+    s.lastEvalMs = nowMs;
+
+    Tri t = evalExpr(r.exprRootId, nowMs);
+    Tri prevTri = s.lastTri;
+    s.lastTri = t;
+
+    if (t == Tri::Unknown) {
+      if (prevTri != Tri::Unknown && r.onUnknown != UnknownPolicy::Hold) {
+        for (auto& a : db.actions(r)) {
+          int out = outputIndexCached(a.outIdx, db.str(a.outputKey));
+          if (out >= 0 && out < 16) heldMask &= (uint16_t)~(1u << out);
+          apply(out, r.onUnknown == UnknownPolicy::On);
+        }
+      }
+      if (r.onUnknown != UnknownPolicy::Hold) s.lastResult = false;
+      continue;
+    }
+    bool result = (t == Tri::True);
+    bool rising = (result && !s.lastResult);
+    s.lastResult = result;
+    if (!rising) continue;
+    if (r.cooldownMs > 0 && (nowMs - s.lastTriggerMs) < r.cooldownMs) continue;
+
+    s.lastTriggerMs = nowMs;
+    s.fires++;
+    for (auto& a : db.actions(r)) {
+      int out = outputIndexCached(a.outIdx, db.str(a.outputKey));
+      apply(out, a.on);
+      if (!a.on || a.durationMs == 0 || out < 0 || out >= 16) continue;
+      uint16_t bit = (uint16_t)(1u << out);
+      uint32_t until = nowMs + a.durationMs;
+      if ((heldMask & bit) && (int32_t)(until - holdUntilMs[out]) >= 0) continue;
+      holdUntilMs[out] = until;
+      heldMask |= bit;
+    }
+  }
+}
+
+} // namespace ref
+
+// 320 conditions in 32 groups of 10 leaves. Odd groups are OR, even groups
+// AND over mostly-true conditions, so both kinds change state. Every fourth
+// group also nests the previous one, every eighth a NOT of its first leaf.
+// With `stable`, every third condition gets a 200..1100 ms window.
+static const int CMP_CONDS = 320;
+static const int CMP_GROUPS = 32;
+
+static void setupCompare(bool stable) {
+  using namespace rules2;
+  using rules2::CmpOp;
+  struct Sweep {
+    const char* key;
+    float mid, amp;
+  };
+  static const Sweep SWEEPS[] = {
+    { "tank_temp_c", 50, 10 }, { "floor_temp_c", 22, 3 }, { "pv_v", 60, 40 }, { "soc", 50, 30 }, { "mqtt1", 48, 10 },
+  };
+  static const CmpOp OPS[] = { CmpOp::GT, CmpOp::GE, CmpOp::LT, CmpOp::LE };
+
+  db.clear();
+  db.changed();
+  Need room;
+  room.conditions = CMP_CONDS;
+  room.expr = CMP_CONDS + 2 * CMP_GROUPS;
+  room.rules = CMP_GROUPS;
+  room.actions = 2 * CMP_GROUPS;
+  room.children = CMP_CONDS + 2 * CMP_GROUPS;
+  room.strBytes = 1024;
+  db.reserve(room);
+
+  uint32_t seed = 12345;
+  auto rnd = [&seed]() {   // 0..1
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.0f;
+  };
+
+  std::vector<uint32_t> groups;
+  for (int g = 0; g < CMP_GROUPS; g++) {
+    bool isAnd = (g % 2) == 0;
+    std::vector<uint32_t> kids;
+    for (int j = 0; j < 10; j++) {
+      int i = g * 10 + j;
+      const Sweep& s = SWEEPS[(g + j) % 5];
+      CmpOp op = OPS[(int)(rnd() * 4) & 3];
+      bool greater = (op == CmpOp::GT || op == CmpOp::GE);
+      // AND leaves are true for ~90% of the sweep, OR leaves for ~20%
+      float u = isAnd ? 0.95f : 0.6f + 0.4f * rnd();
+      bool below = (greater == isAnd);   // threshold under the midpoint
+      float th = s.mid + (below ? -u : u) * s.amp;
+      const char* rhs = nullptr;
+      if (i % 16 == 15) {   // some input-vs-input
+        rhs = (s.key == SWEEPS[4].key) ? "tank_temp_c" : "mqtt1";
+        op = (i % 32 == 15) ? CmpOp::GT : CmpOp::LT;
+      }
+      uint32_t stableMs = (stable && i % 3 == 0) ? 200 + 100 * (uint32_t)(i % 10) : 0;
+      kids.push_back(addNode(ExprType::LeafCond, addCond(s.key, op, th, rhs, stableMs)));
+    }
+    if (g % 4 == 3) kids.push_back(groups.back());
+    if (g % 8 == 7) kids.push_back(addNode(ExprType::Not, 0, { kids[0] }));
+    groups.push_back(addNode(isAnd ? ExprType::And : ExprType::Or, 0, kids));
+  }
+
+  static const UnknownPolicy POLICIES[] = { UnknownPolicy::Hold, UnknownPolicy::Off, UnknownPolicy::On };
+  for (int g = 0; g < CMP_GROUPS; g++) {
+    char name[12];
+    snprintf(name, sizeof(name), "rule %d", g);
+    const char* out = OUTPUT_KEYS[g % N_OUTPUTS];
+    addRule(name, groups[g], POLICIES[g % 3],
+            { act(out, true, (g % 3 == 0) ? 500 + 100 * g : 0), act(OUTPUT_KEYS[(g + 1) % N_OUTPUTS], false) });
+    rules2::db.rules[g].minEvalPeriodMs = (g % 2) ? 100 : 250;
+    rules2::db.rules[g].cooldownMs = (g % 5 == 0) ? 2000 : 0;
+  }
+  db.changed();
+}
+
+struct CompareResult {
+  double oldNs = 0, newNs = 0;
+  uint32_t evals = 0;          // rule evaluations (same schedule in both)
+  uint32_t triDiffs = 0;       // evaluations whose result differs
+  uint32_t outDiffTicks = 0;   // ticks where any output differs
+  uint32_t oldFires = 0, newFires = 0;
+};
+
+static CompareResult runCompare(bool stable, int n) {
+  using clock = std::chrono::steady_clock;
+  setupCompare(stable);
+  ref::reset();
+  memset(outputs, 0, sizeof(outputs));
+  uint32_t fires0 = 0;
+  for (const rules2::Rule& r : rules2::db.rules) fires0 += r.fires;
+
+  CompareResult res;
+  std::vector<uint32_t> evals(rules2::db.rules.size());
+  for (uint32_t i = 0; i < rules2::db.rules.size(); i++) evals[i] = rules2::db.rules[i].evals;
+
+  clock::duration oldT{}, newT{};
+  for (int t = 0; t < n; t++) {
+    hostMillis += TICK_MS;
+    drive(hostMillis);
+    auto t0 = clock::now();
+    ref::process(hostMillis);
+    auto t1 = clock::now();
+    rules2::processRules2();
+    auto t2 = clock::now();
+    if (t > 0) {   // the first tick compiles
+      oldT += t1 - t0;
+      newT += t2 - t1;
+    }
+
+    for (uint32_t i = 0; i < rules2::db.rules.size(); i++) {
+      rules2::Rule& r = rules2::db.rules[i];
+      if (r.evals == evals[i]) continue;
+      evals[i] = r.evals;
+      res.evals++;
+      if (r.lastTri != ref::rules[i].lastTri) res.triDiffs++;
+    }
+    if (memcmp(outputs, ref::outputs, sizeof(outputs)) != 0) res.outDiffTicks++;
+  }
+
+  res.oldNs = std::chrono::duration<double, std::nano>(oldT).count() / (n - 1);
+  res.newNs = std::chrono::duration<double, std::nano>(newT).count() / (n - 1);
+  for (const rules2::Rule& r : rules2::db.rules) res.newFires += r.fires;
+  res.newFires -= fires0;
+  for (const ref::RuleState& s : ref::rules) res.oldFires += s.fires;
+  return res;
+}
+
+static int compare(int n) {
+  int failures = 0;
+  printf("%d conditions, %d groups, %d ticks (%.0f s simulated)\n", CMP_CONDS, CMP_GROUPS, n,
+         n * TICK_MS / 1000.0);
+  for (bool stable : { false, true }) {
+    CompareResult r = runCompare(stable, n);
+    printf("stability %s:\n", stable ? "on (every 3rd condition)" : "off");
+    printf("  old %.0f ns/tick, new %.0f ns/tick (%.1fx)\n", r.oldNs, r.newNs, r.oldNs / r.newNs);
+    printf("  rule results differ in %u of %u evaluations; outputs differ in %u ticks\n",
+           (unsigned)r.triDiffs, (unsigned)r.evals, (unsigned)r.outDiffTicks);
+    printf("  fires: old %u, new %u\n", (unsigned)r.oldFires, (unsigned)r.newFires);
+    // Without windows the engines must agree exactly. With them the old
+    // one's short-circuit skipped window updates, so differences are the
+    // expected change and only reported.
+    if (!stable && (r.triDiffs || r.outDiffTicks)) failures++;
+  }
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "compare") == 0) {
+    Serial.quiet = true;
+    return compare(argc > 2 ? atoi(argv[2]) : 100000) ? 1 : 0;
+  }
+
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+  int failures = 0;
+
+  setupRules();
+  setupRules2();
+  Serial.quiet = true;
+
+  for (int i = 0; i < WARMUP; i++) tick();
+
+  heaptrack::armGuards(true);
+  uint32_t a0 = heaptrack::allocCount();
+  uint32_t w0 = outputWrites;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) tick();
+  auto t1 = std::chrono::steady_clock::now();
+  uint32_t allocs = heaptrack::allocCount() - a0;
+  uint32_t v = heaptrack::violations();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  printf("%d ticks (%.0f s simulated), %.0f ns/tick, %u output writes, %d holds pending\n", n,
+         n * TICK_MS / 1000.0, ns, (unsigned)(outputWrites - w0), rules2::holdCount());
+  printf("allocations in guarded ticks: %u (%u total)\n", (unsigned)v, (unsigned)allocs);
+  if (v) {
+    heaptrack::Violation last = heaptrack::lastViolation();
+    printf("  last: %u B in %s from pc 0x%lx\n", (unsigned)last.size, last.section,
+           (unsigned long)last.pc);
+    failures++;
+  }
+
+  // The guard itself: a String built inside a section must be caught
+  static String escaped;
+  {
+    heaptrack::TickGuard guard("self-check");
+    escaped = String("allocates");
+  }
+  bool caught = heaptrack::violations() > v;
+  printf("guard self-check: %s\n", caught ? "caught" : "MISSED");
+  if (!caught) failures++;
+
+  return failures ? 1 : 0;
+}
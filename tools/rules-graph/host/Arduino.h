@@ -0,0 +1,71 @@
+#pragma once
+// Minimal host stand-in for the Arduino core, just enough to compile
+// rules2.cpp, rules2_db.cpp and metrics.cpp for the graph tests.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+inline uint32_t millis() { return 0; }
+inline uint32_t micros() { return 0; }
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  explicit String(long v) : s_(std::to_string(v)) {}
+  explicit String(int v) : s_(std::to_string(v)) {}
+  explicit String(unsigned v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long v) : s_(std::to_string(v)) {}
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* s) { s_ += s; return *this; }
+  String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(int v) { s_ += std::to_string(v); return *this; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* s) const { return s_ == s; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* s) const { return s_ != s; }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned length() const { return (unsigned)s_.size(); }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return (float)atof(s_.c_str()); }
+  void reserve(size_t n) { s_.reserve(n); }
+
+ private:
+  std::string s_;
+};
+
+template <typename T>
+inline String operator+(const String& a, const T& b) { String s(a); s += b; return s; }
+inline String operator+(const char* a, const String& b) { String s(a); s += b; return s; }
+
+struct HostSerial {
+  bool quiet = false;
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (quiet) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+  void println(const char* s) { if (!quiet) puts(s); }
+  void println(const String& s) { println(s.c_str()); }
+};
+extern HostSerial Serial;
+
+struct HostEsp {
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+};
+extern HostEsp ESP;
@@ -0,0 +1,67 @@
+#pragma once
+// Host stand-in: enough of the ArduinoJson 6 API to compile the persistence
+// code in rules2.cpp. Documents stay empty; the graph tests never save or
+// load.
+#include <Arduino.h>
+
+class JsonObject;
+class JsonArray;
+
+class JsonVariant {
+ public:
+  JsonVariant operator[](const char*) const { return JsonVariant(); }
+  template <typename T> T operator|(T d) const { return d; }
+  const char* operator|(const char* d) const { return d; }
+  template <typename T> JsonVariant& operator=(const T&) { return *this; }
+  template <typename T> T as() const { return T(); }
+  template <typename T> bool is() const { return false; }
+  bool isNull() const { return true; }
+  size_t size() const { return 0; }
+  JsonArray createNestedArray(const char* = nullptr) const;
+  JsonObject createNestedObject(const char* = nullptr) const;
+};
+
+class JsonArray : public JsonVariant {
+ public:
+  struct It {
+    bool operator!=(const It&) const { return false; }
+    void operator++() {}
+    JsonVariant operator*() const { return JsonVariant(); }
+  };
+  It begin() const { return It(); }
+  It end() const { return It(); }
+  template <typename T> bool add(const T&) { return true; }
+  JsonObject createNestedObject() const;
+  JsonArray createNestedArray() const;
+};
+
+class JsonObject : public JsonVariant {
+ public:
+  JsonObject() {}
+  JsonObject(const JsonVariant&) {}
+};
+
+inline JsonArray JsonVariant::createNestedArray(const char*) const { return JsonArray(); }
+inline JsonObject JsonVariant::createNestedObject(const char*) const { return JsonObject(); }
+inline JsonObject JsonArray::createNestedObject() const { return JsonObject(); }
+inline JsonArray JsonArray::createNestedArray() const { return JsonArray(); }
+
+class DeserializationError {
+ public:
+  explicit operator bool() const { return true; }
+  const char* c_str() const { return "host stand-in"; }
+};
+
+class JsonDocument : public JsonVariant {
+ public:
+  bool overflowed() const { return false; }
+  JsonVariant operator[](const char*) { return JsonVariant(); }
+};
+
+class DynamicJsonDocument : public JsonDocument {
+ public:
+  explicit DynamicJsonDocument(size_t) {}
+};
+
+template <typename S> DeserializationError deserializeJson(JsonDocument&, S&) { return DeserializationError(); }
+template <typename S> size_t serializeJson(const JsonDocument&, S&) { return 0; }
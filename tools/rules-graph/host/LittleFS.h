@@ -0,0 +1,21 @@
+#pragma once
+// Host stand-in: an empty file system. The graph tests don't save or load.
+#include <Arduino.h>
+
+class File {
+ public:
+  explicit operator bool() const { return false; }
+  size_t write(const uint8_t*, size_t) { return 0; }
+  size_t write(uint8_t) { return 0; }
+  int read() { return -1; }
+  size_t size() const { return 0; }
+  void close() {}
+};
+
+struct HostFs {
+  File open(const char*, const char* = "r") { return File(); }
+  bool exists(const char*) { return false; }
+  bool remove(const char*) { return false; }
+  bool rename(const char*, const char*) { return false; }
+};
+extern HostFs LittleFS;
@@ -0,0 +1,28 @@
+#pragma once
+// Host stand-in: the UI helpers only read form arguments, which a test sets
+// with post().
+#include <Arduino.h>
+#include <utility>
+#include <vector>
+
+class WebServer {
+ public:
+  explicit WebServer(int) {}
+
+  void post(std::vector<std::pair<String, String>> form) { form_ = std::move(form); }
+
+  int args() { return (int)form_.size(); }
+  String arg(int i) { return form_[i].second; }
+  String argName(int i) { return form_[i].first; }
+  String arg(const String& name) {
+    for (const auto& a : form_) if (a.first == name) return a.second;
+    return String();
+  }
+  bool hasArg(const String& name) {
+    for (const auto& a : form_) if (a.first == name) return true;
+    return false;
+  }
+
+ private:
+  std::vector<std::pair<String, String>> form_;
+};
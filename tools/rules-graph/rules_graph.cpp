@@ -0,0 +1,359 @@
+// Host checks for the rules v2 graph maintenance in rules2.cpp: the
+// expression GC (gcRules2), the load/save repair (validateRules2), the
+// cycle and depth checks on group edits, and how the engine treats what
+// the repair leaves dangling. Edits go through the same UI helpers the web
+// pages call. Broken graphs are written straight into the Db, as
+// a file from an older build could hold them. host/ supplies an Arduino
+// stand-in and a WebServer whose form arguments a test sets; persistence
+// is compiled but not exercised.
+//
+//   F=../../firmware/viasol-control
+//   g++ -std=gnu++17 -O2 -Ihost -I$F rules_graph.cpp $F/rules2.cpp
+//       $F/rules2_db.cpp $F/rules2_engine.cpp $F/heap_track.cpp
+//       $F/metrics.cpp -o rules_graph
+//   ./rules_graph
+//
+// Exits 1 if a check fails.
+
+#include "io_catalog.h"
+#include "rules2.h"
+#include <LittleFS.h>
+
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+HostSerial Serial;
+HostEsp ESP;
+HostFs LittleFS;
+
+using namespace rules2;
+
+// -----------------------------------------------------------------------------
+// Fake catalog (the subset of io_catalog.cpp rules2 uses)
+// -----------------------------------------------------------------------------
+const char* INPUT_KEYS[IO_MAX_INPUTS] = { "tank_temp_c", "pv_v" };
+int N_INPUTS = 2;
+
+const char* OUTPUT_KEYS[] = { "m_relay1" };
+const int N_OUTPUTS = 1;
+
+static const InputSample MISSING_SAMPLE;
+
+int inputIndexByKey(const char* key) {
+  for (int i = 0; i < N_INPUTS; i++) if (strcmp(INPUT_KEYS[i], key) == 0) return i;
+  return -1;
+}
+
+// Every input Missing; output writes are counted
+static int writesOn = 0, writesOff = 0;
+
+int outputIndexCached(int8_t& idx, const char*) { return idx = 0; }
+const InputSample& inputSample(int) { return MISSING_SAMPLE; }
+void applyOutputIndex(int, bool on) { (on ? writesOn : writesOff)++; }
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+static WebServer web(80);
+
+static void post(void (*handler)(WebServer&), std::initializer_list<std::pair<const char*, uint32_t>> form) {
+  std::vector<std::pair<String, String>> args;
+  for (const auto& a : form) args.push_back({ String(a.first), String((unsigned long)a.second) });
+  web.post(args);
+  handler(web);
+}
+
+// The rule page's checkbox builder: a fresh group over fresh leaves
+static void builderSave(uint32_t ruleId, std::initializer_list<uint32_t> conds) {
+  std::vector<std::pair<String, String>> args = { { "id", String((unsigned long)ruleId) } };
+  for (uint32_t c : conds) args.push_back({ "cond", String((unsigned long)c) });
+  args.push_back({ "exprMode", "AND" });
+  web.post(args);
+  uiSaveRuleFromPost(web);
+}
+
+static uint32_t leavesOn(uint32_t condId) {
+  uint32_t n = 0;
+  for (const auto& e : db.expr) n += (e.type == ExprType::LeafCond && e.condId == condId);
+  return n;
+}
+
+static uint32_t rootOf(uint32_t ruleId) {
+  Rule* r = db.findRule(ruleId);
+  return r ? r->exprRootId : 0;
+}
+
+static uint32_t childCount(uint32_t exprId) {
+  ExprNode* e = db.findExpr(exprId);
+  return e ? e->children.count : 0;
+}
+
+// Nodes and rules added without the UI's checks
+static uint32_t rawLeaf(uint32_t condId) {
+  Need m;
+  m.expr = 1;
+  db.reserve(m);
+  ExprNode* e = db.expr.add();
+  e->id = db.allocId();
+  e->condId = condId;
+  db.changed();
+  return e->id;
+}
+
+static uint32_t rawNode(ExprType type, std::vector<uint32_t> kids, const char* name = "raw") {
+  Need m;
+  m.expr = 1;
+  m.children = kids.size();
+  m.strBytes = strlen(name) + 1;
+  db.reserve(m);
+  ExprNode* e = db.expr.add();
+  e->id = db.allocId();
+  e->type = type;
+  e->name = db.intern(name);
+  if (type == ExprType::Not) e->child = kids.at(0);
+  else db.setChildren(*e, kids.data(), kids.size());
+  db.changed();
+  return e->id;
+}
+
+static void rawEdge(uint32_t from, uint32_t to) {
+  Need m;
+  m.children = childCount(from) + 1;
+  db.reserve(m);
+  db.addChild(*db.findExpr(from), to);
+  db.changed();
+}
+
+// Switches m_relay1 on when it fires; evaluated on every processRules2()
+static uint32_t rawRule(uint32_t root, UnknownPolicy onUnknown = UnknownPolicy::Hold) {
+  Need m;
+  m.rules = 1;
+  m.actions = 1;
+  m.strBytes = strlen(OUTPUT_KEYS[0]) + 1;
+  db.reserve(m);
+  Rule* r = db.rules.add();
+  r->id = db.allocId();
+  r->exprRootId = root;
+  r->onUnknown = onUnknown;
+  r->minEvalPeriodMs = 0;
+  Action* a = db.addAction(*r);
+  a->outputKey = db.intern(OUTPUT_KEYS[0]);
+  a->on = true;
+  db.changed();
+  return r->id;
+}
+
+// A leaf under `groups` nested ANDs; the top is groups + 1 levels deep
+static uint32_t chain(uint32_t condId, int groups) {
+  uint32_t top = rawLeaf(condId);
+  for (int i = 0; i < groups; i++) top = rawNode(ExprType::And, { top });
+  return top;
+}
+
+static bool ruleEnabled(uint32_t ruleId) {
+  Rule* r = db.findRule(ruleId);
+  return r && r->enabled;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-56s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+// -----------------------------------------------------------------------------
+// GC
+// -----------------------------------------------------------------------------
+static void testResaves() {
+  printf("builder re-saves\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t c2 = uiCreateDefaultCondition();
+  uint32_t r = uiCreateDefaultRule();
+
+  const int SAVES = 8;
+  for (int i = 0; i < SAVES; i++) builderSave(r, { c1, c2 });
+  check(db.expr.size() == 1 + 3 * SAVES, "each save leaves a group and two leaves behind");
+
+  gcRules2();
+  check(db.expr.size() == 3, "collapsed to one group over one leaf per condition");
+  ExprNode* root = db.findExpr(rootOf(r));
+  check(root && root->type == ExprType::And && root->children.count == 2, "rule keeps its AND of both");
+  check(leavesOn(c1) == 1 && leavesOn(c2) == 1, "one leaf per condition");
+  check(gcRules2() == 0 && db.expr.size() == 3, "a second pass changes nothing");
+}
+
+static void testDeletedCondition() {
+  printf("deleted condition\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t c2 = uiCreateDefaultCondition();
+  uint32_t r = uiCreateDefaultRule();
+  builderSave(r, { c1, c2 });
+  builderSave(r, { c1, c2 });
+
+  uiDeleteCondition(c2);
+  builderSave(r, { c1 });
+  gcRules2();
+  check(leavesOn(c2) == 0, "leaves on the deleted condition are removed");
+  check(db.expr.size() == 2, "only the rule's group and its leaf remain");
+  ExprNode* root = db.findExpr(rootOf(r));
+  check(root && root->children.count == 1, "rule's group holds the one leaf");
+}
+
+static void testUserGroups() {
+  printf("user groups\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t c2 = uiCreateDefaultCondition();
+  uint32_t r = uiCreateDefaultRule();
+
+  // The user's own AND over the same two conditions, used by no rule
+  uint32_t mine = uiCreateGroup("mine", false);
+  post(uiAddChildToGroupFromPost, { { "gid", mine }, { "addCond", c1 } });
+  post(uiAddChildToGroupFromPost, { { "gid", mine }, { "addCond", c2 } });
+  uint32_t twin = uiCreateGroup("twin", false);
+  post(uiAddChildToGroupFromPost, { { "gid", twin }, { "addCond", c1 } });
+  post(uiAddChildToGroupFromPost, { { "gid", twin }, { "addCond", c2 } });
+
+  builderSave(r, { c1, c2 });
+  builderSave(r, { c1, c2 });
+  gcRules2();
+
+  uint32_t root = rootOf(r);
+  check(root != 0 && root != mine && root != twin, "builder group not merged into an equal user group");
+  check(db.findExpr(mine) && db.findExpr(twin), "equal user groups both kept");
+  check(db.findExpr(mine)->children.count == 2, "user group keeps its children");
+  check(db.expr.size() == 5, "leaves shared, one builder group left");
+
+  // Editing the user's groups must not change the rule
+  post(uiRemoveChildFromGroupFromPost, { { "gid", mine }, { "idx", 1 } });
+  post(uiRemoveChildFromGroupFromPost, { { "gid", twin }, { "idx", 1 } });
+  ExprNode* g = db.findExpr(rootOf(r));
+  check(g && g->children.count == 2, "rule unaffected by edits to the user groups");
+}
+
+// -----------------------------------------------------------------------------
+// Validation and edit checks
+// -----------------------------------------------------------------------------
+static void testCycles() {
+  printf("cycles\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t a = rawNode(ExprType::And, { rawLeaf(c1) });
+  uint32_t b = rawNode(ExprType::Or, { a });
+  rawEdge(a, b);
+  uint32_t r = rawRule(a);
+
+  check(validateRules2() > 0, "A -> B -> A reported");
+  check(childCount(a) + childCount(b) == 2, "exactly one edge of the cycle cut");
+  check(validateRules2() == 0, "nothing left to report");
+  check(ruleEnabled(r), "rule on the repaired group stays enabled");
+
+  uint32_t x = uiCreateGroup("x", false);
+  uint32_t y = uiCreateGroup("y", true);
+  post(uiAddChildToGroupFromPost, { { "gid", x }, { "addGroup", y } });
+  check(childCount(x) == 1, "x -> y added");
+  post(uiAddChildToGroupFromPost, { { "gid", y }, { "addGroup", x } });
+  check(childCount(y) == 0, "y -> x refused");
+  post(uiAddChildToGroupFromPost, { { "gid", x }, { "addGroup", x } });
+  check(childCount(x) == 1, "x -> x refused");
+}
+
+static void testDepth() {
+  printf("depth\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t tooDeep = chain(c1, MAX_EXPR_DEPTH);
+  uint32_t r = rawRule(tooDeep);
+  uint32_t unused = chain(c1, MAX_EXPR_DEPTH + 3);   // no rule starts here
+
+  check(validateRules2() > 0, "nesting past MAX_EXPR_DEPTH reported");
+  check(!ruleEnabled(r), "rule rooted too deep disabled");
+  check(childCount(unused) == 1, "unused deep group left as it is");
+
+  // The deep groups must not block edits elsewhere
+  uint32_t g = uiCreateGroup("g", false);
+  post(uiAddChildToGroupFromPost, { { "gid", g }, { "addCond", c1 } });
+  check(childCount(g) == 1, "condition added to an unrelated group");
+  post(uiAddChildToGroupFromPost, { { "gid", g }, { "addGroup", unused } });
+  check(childCount(g) == 1, "deep group refused as a child");
+
+  // At the limit: the top of `fits` is MAX_EXPR_DEPTH - 1 levels deep
+  uint32_t fits = chain(c1, MAX_EXPR_DEPTH - 2);
+  uint32_t p = uiCreateGroup("p", false);
+  post(uiAddChildToGroupFromPost, { { "gid", p }, { "addGroup", fits } });
+  check(childCount(p) == 1, "nesting up to MAX_EXPR_DEPTH allowed");
+  uint32_t q = uiCreateGroup("q", false);
+  post(uiAddChildToGroupFromPost, { { "gid", q }, { "addGroup", p } });
+  check(childCount(q) == 0, "one level past it refused");
+}
+
+static void testDangling() {
+  printf("dangling references\n");
+  db.clear();
+  uint32_t c1 = uiCreateDefaultCondition();
+  uint32_t c2 = uiCreateDefaultCondition();
+  uint32_t orphanLeaf = rawLeaf(c2);
+  uint32_t g = rawNode(ExprType::And, { rawLeaf(c1), 9999, orphanLeaf });
+  uint32_t n = rawNode(ExprType::Not, { 8888 });
+  uint32_t good = rawRule(g);
+  uint32_t lost = rawRule(7777);
+  uiDeleteCondition(c2);
+
+  check(validateRules2() == 4, "missing child, NOT target, root and condition reported");
+  check(childCount(g) == 2, "missing child dropped from the group");
+  check(db.findExpr(n) && db.findExpr(n)->child == 0, "NOT's missing target cleared");
+  check(!ruleEnabled(lost) && rootOf(lost) == 0, "rule with a missing root disabled");
+  check(ruleEnabled(good), "rule on the repaired group stays enabled");
+  check(db.findExpr(orphanLeaf) != nullptr, "leaf on a deleted condition kept");
+  check(validateRules2() == 1, "only the deleted condition still reported");
+}
+
+// A deleted condition under a NOT, or a NOT whose child the repair cut, is
+// Unknown: the rule must not fire, and its onUnknown policy applies
+static void testDanglingEval() {
+  printf("dangling references in the engine\n");
+  db.clear();
+  uint32_t gone = uiCreateDefaultCondition();
+  uint32_t notDeleted = rawNode(ExprType::Not, { rawLeaf(gone) });
+  uint32_t a = rawNode(ExprType::And, {});
+  uint32_t notCycle = rawNode(ExprType::Not, { a });
+  rawEdge(a, notCycle);
+  uint32_t r1 = rawRule(notDeleted);
+  uint32_t r2 = rawRule(notCycle, UnknownPolicy::Off);
+  uiDeleteCondition(gone);
+  validateRules2();
+  check(db.findExpr(notCycle)->child == 0, "cycle repair cut the NOT's child");
+
+  writesOn = writesOff = 0;
+  for (int i = 0; i < 3; i++) processRules2();
+  check(writesOn == 0, "neither rule fires");
+  check(db.findRule(r1)->lastTri == Tri::Unknown, "NOT(deleted condition) is Unknown");
+  check(db.findRule(r2)->lastTri == Tri::Unknown, "NOT(cut child) is Unknown");
+  check(writesOff == 1, "onUnknown=Off switches the output off once");
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+int main() {
+  Serial.quiet = true;
+
+  testResaves();
+  testDeletedCondition();
+  testUserGroups();
+  testCycles();
+  testDepth();
+  testDangling();
+  testDanglingEval();
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+// Host harness for the safety interlock: runs safety::Interlock at the
+// firmware's 20 ms period through scripted faults and checks how fast each
+// one forces outputs off, and that trips release only after the hold time.
+//
+//   g++ -std=gnu++17 -O2 -I../../firmware/viasol-control safety_sim.cpp
+//       ../../firmware/viasol-control/safety_core.cpp -o safety_sim
+//   ./safety_sim
+//
+// Exits 1 if any scenario fails.
+
+#include "safety_core.h"
+
+#include <stdio.h>
+
+static const uint32_t PERIOD_MS = 20;
+static int failures = 0;
+
+struct Rig {
+  safety::Interlock il;
+  safety::Inputs in;
+  safety::Verdict v;
+
+  Rig() {
+    safety::Limits l;
+    l.tankMaxC = 65.0f;
+    for (int ch = 0; ch < safety::CHANNELS; ch++) l.chMaxA[ch] = 1.25f * 1000.0f / 120.0f;
+    il.configure(l);
+    in.tankValid = true;
+    in.tankC = 50.0f;
+    in.busOnline = true;
+    in.commanded = 0x0F;
+    for (int ch = 0; ch < 4; ch++) in.chA[ch] = 7.0f;
+  }
+
+  // Run until pred holds (or limit); returns elapsed ms, or -1.
+  template <typename F>
+  long runUntil(F pred, uint32_t limitMs) {
+    for (uint32_t t = 0; t <= limitMs; t += PERIOD_MS) {
+      v = il.evaluate(in);
+      if (pred(v)) return (long)t;
+      in.nowMs += PERIOD_MS;
+      in.tankAgeMs += PERIOD_MS;
+      if (in.tankAgeMs > 2000) in.tankAgeMs = 0;  // a fresh reading every 2 s
+    }
+    return -1;
+  }
+};
+
+// Times are -1 when the event never happened within the run.
+static void check(const char* name, long got, long lo, long hi) {
+  bool ok = got >= lo && got <= hi;
+  if (!ok) failures++;
+  printf("%-36s %6ld ms  (expect %ld..%ld)%s\n", name, got, lo, hi, ok ? "" : "  FAIL");
+}
+
+static void checkTrue(const char* name, bool ok) {
+  if (!ok) failures++;
+  printf("%-36s %s\n", name, ok ? "yes" : "no  FAIL");
+}
+
+int main() {
+  {
+    Rig r;
+    long t = r.runUntil([](const safety::Verdict& v) { return v.trips != 0; }, 5000);
+    check("normal operation: no trip", t, -1, -1);
+  }
+  {
+    Rig r;
+    r.runUntil([](const safety::Verdict&) { return false; }, 200);
+    r.in.tankC = 66.0f;
+    check("tank over-temp -> all off", r.runUntil([](const safety::Verdict& v) { return v.allowed == 0; }, 1000), 0, 0);
+    r.in.tankC = 64.0f;  // inside the hysteresis band: stays tripped
+    check("  held inside hysteresis", r.runUntil([](const safety::Verdict& v) { return v.allowed != 0; }, 40000), -1, -1);
+    r.in.tankC = 60.0f;
+    check("  released after clear time", r.runUntil([](const safety::Verdict& v) { return v.allowed != 0; }, 40000), 29980, 30000);
+  }
+  {
+    Rig r;
+    r.in.chA[2] = 12.0f;
+    long t = r.runUntil([](const safety::Verdict& v) { return !(v.allowed & 0x04); }, 2000);
+    check("over-current ch3 -> ch3 off", t, 200, 220);
+    checkTrue("  other channels stay allowed", (r.v.allowed & 0xFB) == 0xFB);
+    r.in.chA[2] = 0.0f;
+    r.in.commanded = 0x0B;
+    check("  ch3 released after clear time", r.runUntil([](const safety::Verdict& v) { return (v.allowed & 0x04) != 0; }, 40000), 29980, 30000);
+  }
+  {
+    Rig r;
+    r.in.commanded = 0x07;  // ch4 commanded off but still carrying current
+    long t = r.runUntil([](const safety::Verdict& v) { return v.pvKill; }, 5000);
+    check("stuck channel -> PV kill", t, 1000, 1020);
+    checkTrue("  everything off", r.v.allowed == 0);
+  }
+  {
+    Rig r;
+    r.in.leakBits = 0x01;
+    check("leak -> all off + PV kill", r.runUntil([](const safety::Verdict& v) { return v.pvKill && v.allowed == 0; }, 1000), 0, 0);
+  }
+  {
+    Rig r;
+    r.in.tankValid = false;
+    check("no tank reading -> all off", r.runUntil([](const safety::Verdict& v) { return v.allowed == 0; }, 1000), 0, 0);
+  }
+  {
+    Rig r;
+    r.in.busOnline = false;
+    r.in.chA[1] = 50.0f;  // stale mirror contents must not trip anything
+    check("bus offline: stale currents ignored", r.runUntil([](const safety::Verdict& v) { return v.trips != 0; }, 2000), -1, -1);
+  }
+
+  printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+// Minimal host stand-in for the Arduino core, just enough to compile
+// shunt_cal.cpp.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+inline uint32_t millis() { return 0; }
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  const char* c_str() const { return s_.c_str(); }
+  bool operator==(const char* s) const { return s_ == s; }
+
+ private:
+  std::string s_;
+};
+
+struct HostSerial {
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+};
+extern HostSerial Serial;
@@ -0,0 +1,9 @@
+#pragma once
+// Host stand-in: an empty namespace, reads return the defaults.
+#include <Arduino.h>
+
+class Preferences {
+ public:
+  int32_t getInt(const char*, int32_t d) { return d; }
+  size_t putInt(const char*, int32_t) { return 4; }
+};
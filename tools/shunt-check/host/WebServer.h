@@ -0,0 +1,8 @@
+#pragma once
+// Host stand-in: App only holds one.
+#include <Arduino.h>
+
+class WebServer {
+ public:
+  explicit WebServer(int) {}
+};
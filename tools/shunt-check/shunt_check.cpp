@@ -0,0 +1,85 @@
+// Host check for the shunt calibration (shunt_cal.cpp): rated A/mV and the
+// equivalent mOhm override must fold into the same Q16 scale, and a known
+// current must convert back to itself.
+//
+//   g++ -std=gnu++17 -O2 -Ihost -I../../firmware/viasol-control
+//       shunt_check.cpp ../../firmware/viasol-control/shunt_cal.cpp
+//       -o shunt_check
+//   ./shunt_check
+//
+// Exits 1 if a check fails.
+
+#include "app.h"
+#include "shunt_cal.h"
+
+#include <math.h>
+
+HostSerial Serial;
+App app;
+
+void metricsNvsWrite(size_t) {}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-52s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+// ADC code the front end reads for `amps` through a `mohm` shunt
+static int32_t codeFor(double amps, double mohm) {
+  double uv = amps * mohm * 1000.0;
+  return (int32_t)lround(uv * SHUNT_AMP_GAIN * SHUNT_ADC_COUNTS / SHUNT_ADC_FS_UV);
+}
+
+// |measured - amps| as a fraction, with the code rounding allowed for
+static bool near(int32_t ma, double amps, double tol) {
+  return fabs(ma / 1000.0 - amps) <= amps * tol;
+}
+
+int main() {
+  Settings rated;
+  rated.shunt_mode = "rated";
+  rated.pv_shunt_a = 50;
+  rated.pv_shunt_mv = 75;     // 1.5 mOhm
+  rated.main_shunt_a = 500;
+  rated.main_shunt_mv = 50;   // 0.1 mOhm
+
+  Settings mohm = rated;
+  mohm.shunt_mode = "mohm";
+  mohm.pv_shunt_mohm = 1.5f;
+  mohm.main_shunt_mohm = 0.1f;
+
+  printf("rated vs mOhm\n");
+  shuntCalBuild(rated);
+  ShuntCal pvRated = shuntCal(SHUNT_PV), mainRated = shuntCal(SHUNT_MAIN);
+  shuntCalBuild(mohm);
+  ShuntCal pvMohm = shuntCal(SHUNT_PV), mainMohm = shuntCal(SHUNT_MAIN);
+  printf("    pv scaleQ16 %ld / %ld, main %ld / %ld\n", (long)pvRated.scaleQ16, (long)pvMohm.scaleQ16,
+         (long)mainRated.scaleQ16, (long)mainMohm.scaleQ16);
+  check(pvRated.scaleQ16 > 0 && pvRated.scaleQ16 == pvMohm.scaleQ16, "75 mV / 50 A equals 1.5 mOhm");
+  check(mainRated.scaleQ16 > 0 && mainRated.scaleQ16 == mainMohm.scaleQ16, "50 mV / 500 A equals 0.1 mOhm");
+
+  Settings defaults;
+  shuntCalBuild(defaults);
+  int32_t pvDefault = shuntCal(SHUNT_PV).scaleQ16;
+  defaults.shunt_mode = "mohm";
+  shuntCalBuild(defaults);
+  check(pvDefault == shuntCal(SHUNT_PV).scaleQ16, "default rated PV shunt equals its mOhm default");
+
+  printf("conversion\n");
+  shuntCalBuild(rated);
+  int32_t ma = shuntToMilliamps(shuntCal(SHUNT_PV), codeFor(20.0, 1.5));
+  printf("    20 A through 1.5 mOhm reads %ld mA\n", (long)ma);
+  check(near(ma, 20.0, 0.01), "PV: 20 A reads as 20 A");
+  ma = shuntToMilliamps(shuntCal(SHUNT_MAIN), codeFor(250.0, 0.1));
+  printf("    250 A through 0.1 mOhm reads %ld mA\n", (long)ma);
+  check(near(ma, 250.0, 0.01), "main: 250 A reads as 250 A");
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}